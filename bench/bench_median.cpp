@@ -0,0 +1,117 @@
+// Native benchmark: median of n ADC samples.
+//
+// Compares the insertion sort used by readA0VoltageMedian() in the
+// sketch_FINAL_STATIC_IP* sketches with medianSelect() (quickselect) and
+// RunningMedian<N> (one add() + median() per new reading) for 5..101 samples.
+//
+// Build and run from the project root:
+//   g++ -std=c++11 -O2 -I include bench/bench_median.cpp -o bench_median
+//   ./bench_median
+//
+// Counts are TSC cycles on x86 hosts and nanoseconds elsewhere. Host numbers
+// are only meaningful relative to each other, not as RA4M1 cycle counts.
+
+#include <stdint.h>
+#include <stdio.h>
+#include <chrono>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+static inline uint64_t benchTicks() { return __rdtsc(); }
+static const char* TICK_UNIT = "cycles";
+#else
+static inline uint64_t benchTicks() {
+  return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+      std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+static const char* TICK_UNIT = "ns";
+#endif
+
+#include "MedianFilter.h"
+
+static const int READINGS = 2000;
+static volatile int sink;
+
+// Noisy readings around mid-scale, deterministic across runs
+static uint32_t lcgState = 12345;
+static int nextSample() {
+  lcgState = lcgState * 1664525u + 1013904223u;
+  return 480 + (int)((lcgState >> 16) % 64);
+}
+
+// Insertion sort median, as in readA0VoltageMedian()
+static int insertionSortMedian(int* vals, int samples) {
+  for (int i = 1; i < samples; i++) {
+    int key = vals[i];
+    int j = i - 1;
+    while (j >= 0 && vals[j] > key) {
+      vals[j + 1] = vals[j];
+      j--;
+    }
+    vals[j + 1] = key;
+  }
+  return vals[samples / 2];
+}
+
+static double benchInsertion(int n) {
+  int vals[101];
+  uint64_t total = 0;
+  for (int r = 0; r < READINGS; r++) {
+    for (int i = 0; i < n; i++) vals[i] = nextSample();
+    uint64_t t0 = benchTicks();
+    sink = insertionSortMedian(vals, n);
+    total += benchTicks() - t0;
+  }
+  return (double)total / READINGS;
+}
+
+static double benchSelect(int n) {
+  int vals[101];
+  uint64_t total = 0;
+  for (int r = 0; r < READINGS; r++) {
+    for (int i = 0; i < n; i++) vals[i] = nextSample();
+    uint64_t t0 = benchTicks();
+    sink = medianSelect(vals, n);
+    total += benchTicks() - t0;
+  }
+  return (double)total / READINGS;
+}
+
+template <uint8_t N>
+static double benchRunning() {
+  RunningMedian<N> filter;
+  for (int i = 0; i < N; i++) filter.add(nextSample());
+
+  uint64_t total = 0;
+  for (int r = 0; r < READINGS; r++) {
+    int v = nextSample();
+    uint64_t t0 = benchTicks();
+    filter.add(v);
+    sink = filter.median();
+    total += benchTicks() - t0;
+  }
+  return (double)total / READINGS;
+}
+
+template <uint8_t N>
+static void row() {
+  double ins = benchInsertion(N);
+  double sel = benchSelect(N);
+  double run = benchRunning<N>();
+  printf("%5d %14.0f %14.0f %14.0f %9.1fx %9.1fx\n",
+         N, ins, sel, run, ins / sel, ins / run);
+}
+
+int main() {
+  printf("Median per reading (%s, mean of %d readings)\n", TICK_UNIT, READINGS);
+  printf("%5s %14s %14s %14s %10s %10s\n",
+         "n", "insertion", "select", "running", "sel gain", "run gain");
+  row<5>();
+  row<11>();
+  row<21>();
+  row<31>();
+  row<51>();
+  row<75>();
+  row<101>();
+  return 0;
+}
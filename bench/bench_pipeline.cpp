@@ -0,0 +1,391 @@
+// Native benchmark: per-reading cost of the sensor pipeline.
+//
+// Drives the shared headers through the test mocks (test/mocks): clampf(),
+// voltageToKpa(), the float pipeline vs the readingForCode() table, one
+// BlockAdc block through the mock ADC backend to a reading, the median
+// filters, packLoRaPayload()'s LoRaFrameEncoder and the HttpUploader
+// request formatting that replaced the String URL building in
+// uploadToServer(). The original String version is kept below as a
+// baseline, like the insertion sort in bench_median.cpp.
+//
+// Build and run from the project root:
+//   pio run -e bench -t exec
+// or directly:
+//   g++ -std=c++17 -O2 -DUNIT_TEST -I include -I test/mocks
+//       bench/bench_pipeline.cpp test/mocks/mocks.cpp
+//       test/mocks/adc_backend_mock.cpp -o bench_pipeline
+//   ./bench_pipeline
+//
+// For each benchmark prints ns/op (steady_clock), ticks/op (TSC cycles on
+// x86 hosts, otherwise ns), heap allocations per op (the mocks count every
+// operator new) and bytes emitted per op (request bytes written to the
+// client, or frame length). The same numbers go to bench_output.txt, one
+// tab-separated row per benchmark, for diffing between builds. Host numbers
+// are only meaningful relative to each other, not as RA4M1 cycle counts.
+
+#include <stdint.h>
+#include <stdio.h>
+#include <chrono>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+static inline uint64_t benchTicks() { return __rdtsc(); }
+static const char* TICK_UNIT = "cycles";
+#else
+static inline uint64_t benchTicks() {
+  return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+      std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+static const char* TICK_UNIT = "ns";
+#endif
+
+#include "Arduino.h"
+#include "WiFiS3.h"
+#include "BlockAdc.h"
+#include "TankArray.h"
+#include "LevelFilter.h"
+#include "HttpUploader.h"
+#include "LoRaFrame.h"
+#include "MedianFilter.h"
+#include "ReadingBuffer.h"
+#include "SensorConversion.h"
+
+extern "C" {
+void mock_set_millis(unsigned long value);
+void mock_set_micros(unsigned long value);
+void mock_set_wifi_status(int status);
+void mock_set_analog_value(int value);
+void mock_set_client_connected(bool connected);
+void mock_set_client_response(const char* response);
+unsigned long mock_client_bytes_written();
+unsigned long mock_allocation_count();
+void mock_reset();
+}
+
+static const char* OUTPUT_FILE = "bench_output.txt";
+static const char* SERVER_HOST = "192.168.55.192";
+static const int MEDIAN_SAMPLES = 51;  // readA0VoltageMedian() window
+
+static volatile uint32_t sink;
+
+// Noisy ADC codes around mid-scale, deterministic across runs
+static uint32_t lcgState = 12345;
+static uint16_t nextCode() {
+  lcgState = lcgState * 1664525u + 1013904223u;
+  return (uint16_t)(480 + (lcgState >> 16) % 64);
+}
+
+static const uint32_t INPUTS = 1024;  // Power of two
+static float voltages[INPUTS];
+static uint16_t codes[INPUTS];
+
+struct Result {
+  const char* name;
+  double ns;
+  double ticks;
+  double allocs;
+  double bytes;
+};
+
+static Result results[32];
+static int resultCount = 0;
+
+// Runs op() `ops` times after a short warm-up. op(i) returns the bytes it
+// emitted.
+template <typename Op>
+static void measure(const char* name, uint32_t ops, Op op) {
+  for (uint32_t i = 0; i < ops / 10 + 1; i++) op(i);
+
+  unsigned long allocs0 = mock_allocation_count();
+  uint64_t bytes = 0;
+  auto t0 = std::chrono::steady_clock::now();
+  uint64_t c0 = benchTicks();
+  for (uint32_t i = 0; i < ops; i++) bytes += op(i);
+  uint64_t c1 = benchTicks();
+  auto t1 = std::chrono::steady_clock::now();
+  unsigned long allocs = mock_allocation_count() - allocs0;
+
+  Result& r = results[resultCount++];
+  r.name = name;
+  r.ns = (double)std::chrono::duration_cast<std::chrono::nanoseconds>(t1 - t0).count() / ops;
+  r.ticks = (double)(c1 - c0) / ops;
+  r.allocs = (double)allocs / ops;
+  r.bytes = (double)bytes / ops;
+}
+
+// ---------------------------------------------------------------------------
+// Baselines from the original sketch
+// ---------------------------------------------------------------------------
+
+// Insertion sort median, as in readA0VoltageMedian()
+static int insertionSortMedian(int* vals, int samples) {
+  for (int i = 1; i < samples; i++) {
+    int key = vals[i];
+    int j = i - 1;
+    while (j >= 0 && vals[j] > key) {
+      vals[j + 1] = vals[j];
+      j--;
+    }
+    vals[j + 1] = key;
+  }
+  return vals[samples / 2];
+}
+
+// Request building from uploadToServer(), written to the client the same way
+static size_t legacyUploadRequest(WiFiClient& client, float depth_m, float pressure_kpa,
+                                  float volume_liters) {
+  unsigned long before = mock_client_bytes_written();
+  String url = "/update?";
+  url += "depth=" + String(depth_m, 3);
+  url += "&pressure=" + String(pressure_kpa, 2);
+  url += "&volume=" + String(volume_liters, 2);
+
+  client.print("GET " + url + " HTTP/1.1\r\n");
+  client.print("Host: " + String(SERVER_HOST) + "\r\n");
+  client.print("Connection: close\r\n\r\n");
+  return mock_client_bytes_written() - before;
+}
+
+// ---------------------------------------------------------------------------
+// Benchmarks
+// ---------------------------------------------------------------------------
+
+static void benchConversion() {
+  measure("clampf", 1000000, [](uint32_t i) {
+    sink += (uint32_t)clampf(voltages[i & (INPUTS - 1)], 0.5f, 4.5f);
+    return 0;
+  });
+  measure("voltageToKpa", 1000000, [](uint32_t i) {
+    sink += (uint32_t)voltageToKpa(voltages[i & (INPUTS - 1)]);
+    return 0;
+  });
+  measure("packReading (float pipeline)", 1000000, [](uint32_t i) {
+    sink += packReading(adcToVoltage((float)codes[i & (INPUTS - 1)])).volume;
+    return 0;
+  });
+  measure("readingForCode (table)", 1000000, [](uint32_t i) {
+    sink += readingForCode(codes[i & (INPUTS - 1)]).volume;
+    return 0;
+  });
+  measure("readingForVolts (table, filter volts)", 1000000, [](uint32_t i) {
+    sink += readingForVolts(voltages[i & (INPUTS - 1)]).volume;
+    return 0;
+  });
+}
+
+static void benchBlockAdc() {
+  // One 5 s reading as the firmware takes it: 50 timer samples of 4
+  // conversions at 14 bits, then the block sum through TankArray
+  static BlockAdc<50> adc;
+  static const TankGeometry geometry = TankGeometry::verticalCylinder(TANK_DIAMETER_MM);
+  static const TankChannel channels[] = {TankChannel::sensorConfig(A0, &geometry)};
+  static TankArray<1> tanks(channels);
+  static unsigned long nowUs = 0;
+  static const uint8_t pins[] = {A0};
+  AdcSettings settings = {pins, 1, 14, 4, 100000};
+  mock_set_micros(nowUs);
+  adc.begin(settings);
+  measure("BlockAdc<50> block (14-bit x4)", 20000, [](uint32_t i) {
+    mock_set_analog_value(codes[i & (INPUTS - 1)]);
+    for (int k = 0; k < 50; k++) {
+      nowUs += 100000;
+      mock_set_micros(nowUs);
+    }
+    uint32_t sum = adc.blockSum();
+    PackedReading r;
+    tanks.convert(&sum, adc.blockFullScale(), &r);
+    sink += r.depth;
+    adc.release();
+    return 0;
+  });
+  adc.end();
+}
+
+static void benchLevelFilter() {
+  // One ADC sample into the firmware's per-tank filter
+  static LevelFilter kalman(LevelFilterSettings{FILTER_KALMAN, 0.05f, 1e-6f, 4e-4f, 0.2f, 3});
+  static LevelFilter ema(LevelFilterSettings{FILTER_EMA, 0.05f, 0.0f, 4e-4f, 0.2f, 3});
+  measure("LevelFilter Kalman update", 500000, [](uint32_t i) {
+    kalman.update(voltages[i & (INPUTS - 1)] * 0.01f + 2.0f);
+    return 0;
+  });
+  measure("LevelFilter EMA update", 500000, [](uint32_t i) {
+    ema.update(voltages[i & (INPUTS - 1)] * 0.01f + 2.0f);
+    return 0;
+  });
+  sink += (uint32_t)(kalman.value() + ema.value());
+}
+
+static StrappingPoint strappingPoints[TankGeometry::MAX_STRAPPING_POINTS];
+
+static void benchGeometry() {
+  // Horizontal cylinder volume computed per reading vs the precomputed table
+  static const TankGeometry horizontal = TankGeometry::horizontalCylinder(300.0f, 800.0f);
+  measure("horizontal cylinder acos/sqrt", 200000, [](uint32_t i) {
+    float h = codes[i & (INPUTS - 1)] * (0.3f / ADC_MAX);
+    float r = 0.15f, c = r - h;
+    sink += (uint32_t)((r * r * acosf(c / r) - c * sqrtf(2.0f * r * h - h * h)) * 800.0f);
+    return 0;
+  });
+  measure("horizontal cylinder table", 200000, [](uint32_t i) {
+    sink += (uint32_t)horizontal.liters(codes[i & (INPUTS - 1)] * (0.3f / ADC_MAX));
+    return 0;
+  });
+
+  for (uint8_t p = 0; p < TankGeometry::MAX_STRAPPING_POINTS; p++) {
+    strappingPoints[p].depthMm = p * 10.0f;
+    strappingPoints[p].liters = p * p * 0.5f;
+  }
+  static const TankGeometry strapping =
+      TankGeometry::strapping(strappingPoints, TankGeometry::MAX_STRAPPING_POINTS);
+  measure("strapping table (32 points)", 200000, [](uint32_t i) {
+    sink += (uint32_t)strapping.liters(codes[i & (INPUTS - 1)] * (0.31f / ADC_MAX));
+    return 0;
+  });
+}
+
+static void benchTankArray() {
+  // Converting four tanks' block sums in one structure-of-arrays batch,
+  // one of each shape
+  static const StrappingPoint points[] = {{0, 0}, {100, 20}, {250, 70}, {300, 95}};
+  static const TankGeometry geometries[] = {
+    TankGeometry::verticalCylinder(100.0f),
+    TankGeometry::horizontalCylinder(300.0f, 800.0f),
+    TankGeometry::coneBottom(400.0f, 100.0f, 600.0f),
+    TankGeometry::strapping(points, 4),
+  };
+  static const TankChannel channels[] = {
+    {A0, 0.5f, 4.5f, 10.0f, &geometries[0]},
+    {A1, 0.5f, 4.5f, 20.0f, &geometries[1]},
+    {A2, 0.4f, 4.6f, 10.0f, &geometries[2]},
+    {A3, 0.5f, 4.5f, 35.0f, &geometries[3]},
+  };
+  static TankArray<4> tanks(channels);
+  measure("TankArray<4> convert", 200000, [](uint32_t i) {
+    uint32_t sums[4];
+    for (uint8_t c = 0; c < 4; c++) sums[c] = (uint32_t)codes[(i + c) & (INPUTS - 1)] * 200;
+    PackedReading r[4];
+    tanks.convert(sums, 200 * ADC_MAX, r);
+    sink += r[0].depth + r[1].depth + r[2].depth + r[3].depth;
+    return 0;
+  });
+}
+
+static void benchMedian() {
+  static int vals[MEDIAN_SAMPLES];
+  auto fill = [](uint32_t i) {
+    for (int k = 0; k < MEDIAN_SAMPLES; k++) {
+      vals[k] = codes[(i * MEDIAN_SAMPLES + k) & (INPUTS - 1)];
+    }
+  };
+  // The refill is part of each op, so compare these two with each other
+  measure("insertion sort median (51, legacy)", 100000, [&](uint32_t i) {
+    fill(i);
+    sink += insertionSortMedian(vals, MEDIAN_SAMPLES);
+    return 0;
+  });
+  measure("medianSelect (51)", 100000, [&](uint32_t i) {
+    fill(i);
+    sink += medianSelect(vals, MEDIAN_SAMPLES);
+    return 0;
+  });
+
+  static BlockMedian<MEDIAN_SAMPLES> block;
+  measure("BlockMedian<51> add+median", 100000, [](uint32_t i) {
+    block.add(codes[i & (INPUTS - 1)]);
+    sink += block.median();
+    return 0;
+  });
+  static RunningMedian<MEDIAN_SAMPLES> running;
+  measure("RunningMedian<51> add+median", 1000000, [](uint32_t i) {
+    running.add(codes[i & (INPUTS - 1)]);
+    sink += running.median();
+    return 0;
+  });
+}
+
+static void benchLoRa() {
+  // packLoRaPayload(): a minute of 5 s readings, newest first, at DR2
+  static ReadingBuffer<12> history;
+  for (uint32_t i = 0; i < 12; i++) history.push(i * 5000, readingForCode(codes[i]));
+  static uint8_t payload[LORA_FRAME_MAX_PAYLOAD];
+  measure("LoRaFrameEncoder (12 readings)", 1000000, [](uint32_t) {
+    LoRaFrameEncoder frame(payload, au915MaxPayload(2, false), 5);
+    for (uint16_t k = history.size(); k > 0; k--) {
+      if (!frame.add(history.at(k - 1).reading)) break;
+    }
+    sink += payload[frame.length() - 1];
+    return frame.length();
+  });
+}
+
+static void benchUpload() {
+  mock_reset();
+  mock_set_wifi_status(WL_CONNECTED);
+  mock_set_client_connected(true);
+  mock_set_client_response("HTTP/1.1 200 OK\r\nContent-Length: 0\r\n\r\n");
+
+  static WiFiClient client;
+  static HttpUploader uploader(client, SERVER_HOST, 8080);
+  measure("HttpUploader upload()+poll()", 100000, [](uint32_t i) {
+    unsigned long before = mock_client_bytes_written();
+    uploader.upload(readingForCode(codes[i & (INPUTS - 1)]));
+    uploader.poll();
+    return mock_client_bytes_written() - before;
+  });
+
+  static ReadingBuffer<HttpUploader::MAX_BATCH_ROWS> ring;
+  static uint32_t t = 0;
+  measure("HttpUploader uploadBatch(24)+poll()", 20000, [](uint32_t i) {
+    for (uint8_t k = 0; k < HttpUploader::MAX_BATCH_ROWS; k++) {
+      ring.push(t += 5000, readingForCode(codes[(i + k) & (INPUTS - 1)]));
+    }
+    mock_set_millis(t);
+    unsigned long before = mock_client_bytes_written();
+    uploader.uploadBatch(ring);
+    uploader.poll();
+    return mock_client_bytes_written() - before;
+  });
+
+  measure("uploadToServer String URL (legacy)", 100000, [](uint32_t i) {
+    const PackedReading& r = readingForCode(codes[i & (INPUTS - 1)]);
+    return legacyUploadRequest(client, r.depth / 1000.0f, r.pressure / 100.0f, r.volume / 100.0f);
+  });
+}
+
+int main() {
+  for (uint32_t i = 0; i < INPUTS; i++) {
+    codes[i] = nextCode();
+    voltages[i] = adcToVoltage((float)codes[i]) + ((int)(i % 7) - 3) * 0.5f;
+  }
+
+  benchConversion();
+  benchBlockAdc();
+  benchLevelFilter();
+  benchGeometry();
+  benchTankArray();
+  benchMedian();
+  benchLoRa();
+  benchUpload();
+
+  printf("Sensor pipeline per operation (%s)\n", TICK_UNIT);
+  printf("%-38s %10s %10s %10s %10s\n", "benchmark", "ns/op", "ticks/op", "allocs/op", "bytes/op");
+  for (int i = 0; i < resultCount; i++) {
+    const Result& r = results[i];
+    printf("%-38s %10.1f %10.1f %10.2f %10.1f\n", r.name, r.ns, r.ticks, r.allocs, r.bytes);
+  }
+
+  FILE* out = fopen(OUTPUT_FILE, "w");
+  if (!out) {
+    perror(OUTPUT_FILE);
+    return 1;
+  }
+  fprintf(out, "benchmark\tns_per_op\t%s_per_op\tallocs_per_op\tbytes_per_op\n", TICK_UNIT);
+  for (int i = 0; i < resultCount; i++) {
+    const Result& r = results[i];
+    fprintf(out, "%s\t%.2f\t%.2f\t%.3f\t%.1f\n", r.name, r.ns, r.ticks, r.allocs, r.bytes);
+  }
+  fclose(out);
+  printf("\nWrote %s\n", OUTPUT_FILE);
+  return 0;
+}
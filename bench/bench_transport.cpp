@@ -0,0 +1,152 @@
+// Native benchmark: bytes on the wire and round trips per reading for each
+// WiFi transport.
+//
+// Uploads an hour of 5 s readings through HttpUploader and MqttUploader
+// against the test mocks: the scripted HTTP server (answering with the C++
+// sensor server's real responses) and the MQTT broker stand-in. Counts
+// application bytes each way, TCP connects and the round trips the device
+// waits through (a TCP handshake per connect, plus one per HTTP response or
+// MQTT PUBACK; an MQTT CONNECT goes out with the first PUBLISH and QoS 0
+// waits for nothing). TCP/IP headers (40 bytes a segment) come on top.
+//
+// Build and run from the project root:
+//   g++ -std=c++17 -O2 -DUNIT_TEST -I include -I test/mocks
+//       bench/bench_transport.cpp test/mocks/mocks.cpp -o bench_transport
+//   ./bench_transport
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include "Arduino.h"
+#include "WiFiS3.h"
+#include "HttpUploader.h"
+#include "MqttUploader.h"
+#include "ReadingBuffer.h"
+
+extern "C" {
+void mock_set_millis(unsigned long value);
+void mock_set_wifi_status(int status);
+void mock_set_client_connected(bool connected);
+void mock_set_client_response(const char* response);
+void mock_set_server_closes(bool closes);
+unsigned long mock_client_bytes_written();
+unsigned long mock_client_bytes_read();
+void mock_set_mqtt_broker(bool enabled);
+void mock_reset();
+}
+
+WiFiClient client;
+
+namespace {
+
+const int READINGS = 720;  // One hour at 5 s
+const unsigned long INTERVAL_MS = 5000;
+
+// What server/cpp/sensor_server answers (Date and timestamp vary)
+const char* const GET_RESPONSE =
+    "HTTP/1.1 200 OK\r\nServer: sensor_server_cpp/1.0\r\nDate: Fri, 16 Oct 2026 11:52:02 GMT\r\n"
+    "Content-type: application/json\r\nContent-Length: 193\r\n\r\n"
+    "{\"status\": \"success\", \"message\": \"Sensor data received\", \"data\": {\"voltage\": 0.0, "
+    "\"pressure_kpa\": 5.25, \"water_depth_m\": 1.5, \"volume_liters\": 47.12, "
+    "\"timestamp\": \"2026-10-16T11:52:02.968599\"}}";
+const char* const BATCH_RESPONSE =
+    "HTTP/1.1 200 OK\r\nServer: sensor_server_cpp/1.0\r\nDate: Fri, 16 Oct 2026 11:52:03 GMT\r\n"
+    "Content-type: application/json\r\nContent-Length: 72\r\n\r\n"
+    "{\"status\": \"success\", \"message\": \"Sensor batch received\", \"accepted\": 1}";
+
+struct Result {
+  unsigned long up;
+  unsigned long down;
+  unsigned long connects;
+  unsigned long roundTrips;
+  unsigned long uploads;
+};
+
+PackedReading reading(int i) {
+  return PackedReading{(uint16_t)(2480 + i % 7), (uint16_t)(1210 + i % 50),
+                       (uint16_t)(1234 + i % 50), (uint16_t)(9520 + i % 400)};
+}
+
+void setUpLink(bool mqtt, const char* response, bool closes) {
+  mock_reset();
+  mock_set_wifi_status(WL_CONNECTED);
+  mock_set_client_connected(true);
+  mock_set_mqtt_broker(mqtt);
+  mock_set_client_response(response);
+  mock_set_server_closes(closes);
+}
+
+template <typename Uploader>
+void drain(Uploader& uploader) {
+  for (int i = 0; i < 1000 && uploader.busy(); i++) uploader.poll();
+}
+
+// One GET /update per reading (the original uploadToServer())
+Result runGet(bool closes) {
+  setUpLink(false, GET_RESPONSE, closes);
+  HttpUploader uploader(client, "192.168.55.192", 8080);
+  for (int i = 0; i < READINGS; i++) {
+    mock_set_millis(i * INTERVAL_MS);
+    uploader.upload(reading(i));
+    drain(uploader);
+  }
+  return Result{mock_client_bytes_written(), mock_client_bytes_read(), uploader.connects(),
+                uploader.connects() + uploader.completed(), uploader.completed()};
+}
+
+// Batches of `rows` readings, from a ring like wifiBacklog
+template <typename Uploader>
+Result runBatches(Uploader& uploader, int rows, bool acked) {
+  ReadingBuffer<360> ring;
+  unsigned long uploads = 0;
+  for (int i = 0; i < READINGS; i++) {
+    mock_set_millis(i * INTERVAL_MS);
+    ring.push(millis(), reading(i));
+    if (ring.size() < rows) continue;
+    while (!ring.empty()) {
+      if (!uploader.uploadBatch(ring)) break;
+      drain(uploader);
+      uploads++;
+    }
+  }
+  unsigned long waits = acked ? uploader.completed() : 0;
+  return Result{mock_client_bytes_written(), mock_client_bytes_read(), uploader.connects(),
+                uploader.connects() + waits, uploads};
+}
+
+Result runHttpBatch(int rows) {
+  setUpLink(false, BATCH_RESPONSE, false);
+  HttpUploader uploader(client, "192.168.55.192", 8080);
+  return runBatches(uploader, rows, true);
+}
+
+Result runMqtt(uint8_t qos, uint8_t payload, int rows) {
+  setUpLink(true, nullptr, false);
+  MqttSettings settings = {"192.168.55.192", 1883, "tank-1", 0, 0, qos, payload};
+  MqttUploader uploader(client, settings);
+  return runBatches(uploader, rows, qos > 0);
+}
+
+void print(const char* name, const Result& r) {
+  double n = READINGS;
+  printf("%-44s %8.1f %8.1f %8.1f %9.3f %8lu %8lu\n", name, r.up / n, r.down / n,
+         (r.up + r.down) / n, r.roundTrips / n, r.connects, r.uploads);
+}
+
+}  // namespace
+
+int main() {
+  printf("%d readings, one every %lu s, per reading:\n", READINGS, INTERVAL_MS / 1000);
+  printf("%-44s %8s %8s %8s %9s %8s %8s\n", "transport", "up B", "down B", "total B",
+         "RTTs", "connects", "uploads");
+  print("HTTP GET /update, new connection each", runGet(true));
+  print("HTTP GET /update, keep-alive", runGet(false));
+  print("HTTP POST /update/batch, 1 row", runHttpBatch(1));
+  print("HTTP POST /update/batch, 12 rows", runHttpBatch(12));
+  print("MQTT QoS 0, text, 1 row", runMqtt(0, MQTT_PAYLOAD_TEXT, 1));
+  print("MQTT QoS 0, binary, 1 row", runMqtt(0, MQTT_PAYLOAD_BINARY, 1));
+  print("MQTT QoS 1, text, 1 row", runMqtt(1, MQTT_PAYLOAD_TEXT, 1));
+  print("MQTT QoS 1, binary, 1 row", runMqtt(1, MQTT_PAYLOAD_BINARY, 1));
+  print("MQTT QoS 1, binary, 12 rows", runMqtt(1, MQTT_PAYLOAD_BINARY, 12));
+  return 0;
+}
@@ -0,0 +1,137 @@
+#ifndef ADC_BACKEND_H
+#define ADC_BACKEND_H
+
+#include <Arduino.h>
+#include <stdint.h>
+
+// Background ADC acquisition: up to ADC_MAX_CHANNELS pins, all sampled in
+// one pass on a hardware timer.
+//
+// Each timer tick converts every channel `oversampling` times at the
+// configured resolution, channels interleaved so they see the same moment,
+// and hands one summed sample per channel to a handler from the timer
+// interrupt; the handler (BlockAdc::onSample) files them into a block.
+// Summing, rather than averaging, keeps the extra resolution: 4 conversions
+// at 14 bits give a 16-bit sample. resolutionBits + log2(oversampling) must
+// fit 16 bits.
+//
+// On the UNO R4 (RA4M1) the timer is a GPT/AGT channel from FspTimer and
+// each conversion is an analogRead() at analogReadResolution(bits). Host
+// builds get the timer from test/mocks/adc_backend_mock.cpp, which fires as
+// the mock clock advances.
+const uint8_t ADC_MAX_CHANNELS = 8;
+
+struct AdcSettings {
+  const uint8_t* pins;        // Sampled in this order; must outlive sampling
+  uint8_t channels;           // 1..ADC_MAX_CHANNELS
+  uint8_t resolutionBits;     // 10, 12 or 14
+  uint8_t oversampling;       // Conversions summed per sample: 1, 2, 4, 8 or 16
+  uint32_t sampleIntervalUs;  // Timer period
+};
+
+// Called from the timer interrupt with one sample (sum of conversions) per
+// channel
+typedef void (*AdcSampleHandler)(void* context, const uint16_t* samples);
+
+inline uint8_t adcLog2(uint8_t n) {
+  uint8_t b = 0;
+  while (n > 1) {
+    n >>= 1;
+    b++;
+  }
+  return b;
+}
+
+inline bool adcSettingsValid(const AdcSettings& s) {
+  bool bitsOk = s.resolutionBits == 10 || s.resolutionBits == 12 || s.resolutionBits == 14;
+  bool osrOk = s.oversampling >= 1 && s.oversampling <= 16 &&
+               (s.oversampling & (s.oversampling - 1)) == 0;
+  bool channelsOk = s.pins && s.channels >= 1 && s.channels <= ADC_MAX_CHANNELS;
+  return bitsOk && osrOk && channelsOk && s.resolutionBits + adcLog2(s.oversampling) <= 16 &&
+         s.sampleIntervalUs > 0;
+}
+
+// Largest sample value: every conversion at full scale
+inline uint32_t adcSampleFullScale(const AdcSettings& s) {
+  return (uint32_t)s.oversampling * ((1UL << s.resolutionBits) - 1);
+}
+
+// One sample per channel, each the sum of `oversampling` conversions
+// (timer interrupt context)
+inline void adcConvert(const AdcSettings& s, uint16_t* out) {
+  for (uint8_t c = 0; c < s.channels; c++) out[c] = 0;
+  for (uint8_t i = 0; i < s.oversampling; i++) {
+    for (uint8_t c = 0; c < s.channels; c++) {
+      out[c] = (uint16_t)(out[c] + (uint16_t)analogRead(s.pins[c]));
+    }
+  }
+}
+
+#if defined(ARDUINO_ARCH_RENESAS)
+#include <FspTimer.h>
+
+namespace adc_backend_detail {
+
+struct State {
+  FspTimer timer;
+  AdcSettings settings;
+  AdcSampleHandler handler;
+  void* context;
+  bool running;
+};
+
+inline State& state() {
+  static State s;
+  return s;
+}
+
+inline void onTimer(timer_callback_args_t*) {
+  State& s = state();
+  uint16_t samples[ADC_MAX_CHANNELS];
+  adcConvert(s.settings, samples);
+  s.handler(s.context, samples);
+}
+
+}  // namespace adc_backend_detail
+
+inline void adcBackendStop() {
+  adc_backend_detail::State& s = adc_backend_detail::state();
+  if (!s.running) return;
+  s.timer.stop();
+  s.timer.end();
+  s.running = false;
+}
+
+// Start sampling into `handler`. Returns false for invalid settings or when
+// no timer channel is free.
+inline bool adcBackendBegin(const AdcSettings& settings, AdcSampleHandler handler,
+                            void* context) {
+  if (!adcSettingsValid(settings) || !handler) return false;
+  adcBackendStop();
+  adc_backend_detail::State& s = adc_backend_detail::state();
+  s.settings = settings;
+  s.handler = handler;
+  s.context = context;
+  analogReadResolution(settings.resolutionBits);
+
+  uint8_t type = GPT_TIMER;
+  int8_t channel = FspTimer::get_available_timer(type);
+  if (channel < 0) return false;
+  float hz = 1000000.0f / (float)settings.sampleIntervalUs;
+  if (!s.timer.begin(TIMER_MODE_PERIODIC, type, channel, hz, 0.0f,
+                     adc_backend_detail::onTimer) ||
+      !s.timer.setup_overflow_irq() || !s.timer.open() || !s.timer.start()) {
+    s.timer.end();
+    return false;
+  }
+  s.running = true;
+  return true;
+}
+
+#else
+// Host builds: test/mocks/adc_backend_mock.cpp
+bool adcBackendBegin(const AdcSettings& settings, AdcSampleHandler handler, void* context);
+void adcBackendStop();
+#endif
+
+#endif
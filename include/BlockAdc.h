@@ -0,0 +1,103 @@
+#ifndef BLOCK_ADC_H
+#define BLOCK_ADC_H
+
+#include <stdint.h>
+#include "AdcBackend.h"
+
+// Double-buffered block acquisition on top of AdcBackend.h.
+//
+// The timer interrupt files each pass (one sample for each of C channels)
+// into the fill buffer, and when a block of N passes is complete the
+// buffers swap and the block is handed to the main loop
+// (ready()/block()/release()) while the next one fills. Sampling keeps
+// hardware timing no matter how long a loop() pass takes.
+//
+// If the main loop still holds the previous block when the next completes,
+// the new block is discarded and refilled (overruns() counts them) so the
+// block being read is never written.
+template <uint16_t N, uint8_t C = 1>
+class BlockAdc {
+public:
+  BlockAdc() : _settings(), _fill(0), _ready(NONE), _count(0), _sequence(0), _overruns(0) {}
+
+  // Start the backend. Returns false if it rejected the settings or they
+  // name a different number of channels than C.
+  bool begin(const AdcSettings& settings) {
+    if (settings.channels != C) return false;
+    _settings = settings;
+    _fill = 0;
+    _ready = NONE;
+    _count = 0;
+    return adcBackendBegin(settings, onSample, this);
+  }
+
+  void end() { adcBackendStop(); }
+
+  // A completed block is waiting
+  bool ready() const { return _ready != NONE; }
+
+  // The completed block, valid until release(): N passes oldest first,
+  // C channel samples each
+  const volatile uint16_t* block() const { return _blocks[_ready]; }
+
+  // Sum of one channel over the completed block
+  uint32_t blockSum(uint8_t channel = 0) const {
+    const volatile uint16_t* b = _blocks[_ready];
+    uint32_t sum = 0;
+    for (uint16_t i = 0; i < N; i++) sum += b[i * C + channel];
+    return sum;
+  }
+
+  // Every channel's sum in one pass over the block
+  void blockSums(uint32_t* sums) const {
+    const volatile uint16_t* b = _blocks[_ready];
+    for (uint8_t c = 0; c < C; c++) sums[c] = 0;
+    for (uint16_t i = 0; i < N; i++) {
+      for (uint8_t c = 0; c < C; c++) sums[c] += b[i * C + c];
+    }
+  }
+
+  // Hand the block's buffer back for filling
+  void release() { _ready = NONE; }
+
+  // Largest possible blockSum() of a channel
+  uint32_t blockFullScale() const { return N * adcSampleFullScale(_settings); }
+
+  uint32_t sequence() const { return _sequence; }
+  uint32_t overruns() const { return _overruns; }
+  const AdcSettings& settings() const { return _settings; }
+  static uint16_t blockSize() { return N; }
+  static uint8_t channels() { return C; }
+
+  // Timer interrupt side (AdcSampleHandler)
+  static void onSample(void* context, const uint16_t* samples) {
+    static_cast<BlockAdc*>(context)->push(samples);
+  }
+
+private:
+  static const uint8_t NONE = 0xFF;
+
+  void push(const uint16_t* samples) {
+    volatile uint16_t* pass = _blocks[_fill] + _count * C;
+    for (uint8_t c = 0; c < C; c++) pass[c] = samples[c];
+    if (++_count < N) return;
+    _count = 0;
+    if (_ready != NONE) {
+      _overruns++;
+      return;
+    }
+    _ready = _fill;
+    _fill ^= 1;
+    _sequence++;
+  }
+
+  AdcSettings _settings;
+  volatile uint16_t _blocks[2][N * C];
+  volatile uint8_t _fill;   // Buffer the interrupt writes
+  volatile uint8_t _ready;  // Buffer handed to loop(), NONE if none
+  volatile uint16_t _count;  // Passes in the fill buffer
+  volatile uint32_t _sequence;
+  volatile uint32_t _overruns;
+};
+
+#endif
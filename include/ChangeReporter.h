@@ -0,0 +1,139 @@
+#ifndef CHANGE_REPORTER_H
+#define CHANGE_REPORTER_H
+
+#include <stdint.h>
+#include "PackedReading.h"
+
+// When to report: any enabled trigger is enough. 0 disables a threshold.
+struct ReportThresholds {
+  uint16_t depthMm;       // Depth moved this far from the last reported reading
+  uint16_t volume;        // Volume moved this far (0.01 L units)
+  uint16_t rateMmPerMin;  // Depth changing at least this fast between readings
+  uint32_t heartbeatMs;   // Report at least this often regardless
+};
+
+// Change-driven reporting with a heartbeat.
+//
+// A tank level sits still for most of the day, so sending every reading
+// mostly repeats the last one. offer() is called with each new reading
+// and latches a report as due when depth or volume has left the deadband
+// around the last reported reading, when depth moved faster than the rate
+// threshold since the previous reading (catches a pump starting before
+// the deadband is crossed), or when the heartbeat interval has passed
+// since the last report. The transport sends when it can and then calls
+// reported(), which re-centres the deadband.
+//
+// A heartbeat of 0 (or one reading interval) with no thresholds reports
+// every reading, the old fixed-interval behaviour.
+class ChangeReporter {
+public:
+  enum Reason { NONE, FIRST, DEPTH, VOLUME, RATE, HEARTBEAT, REASON_COUNT };
+
+  // No thresholds: every reading is reported
+  ChangeReporter() : ChangeReporter(ReportThresholds{0, 0, 0, 0}) {}
+
+  explicit ChangeReporter(const ReportThresholds& thresholds)
+    : _thresholds(thresholds), _due(NONE), _hasReported(false), _hasPrevious(false),
+      _lastReportAt(0), _previousAt(0), _lastReported(), _previous() {
+    for (uint8_t i = 0; i < REASON_COUNT; i++) _counts[i] = 0;
+  }
+
+  // Feed the newest reading (taken at millis() `now`). Returns true if a
+  // report is due, now or still pending from an earlier reading.
+  bool offer(uint32_t now, const PackedReading& r) {
+    if (_due == NONE) _due = trigger(now, r);
+    _previous = r;
+    _previousAt = now;
+    _hasPrevious = true;
+    return _due != NONE;
+  }
+
+  bool due() const { return _due != NONE; }
+
+  // Why the pending report is due (NONE if it is not)
+  Reason reason() const { return _due; }
+
+  // The transport sent `r` at `now`
+  void reported(uint32_t now, const PackedReading& r) {
+    _counts[_due]++;
+    _due = NONE;
+    _lastReported = r;
+    _lastReportAt = now;
+    _hasReported = true;
+  }
+
+  // Reports sent per reason (NONE counts reports made without one due)
+  uint32_t count(Reason reason) const { return _counts[reason]; }
+
+  const ReportThresholds& thresholds() const { return _thresholds; }
+
+private:
+  Reason trigger(uint32_t now, const PackedReading& r) const {
+    if (!_hasReported) return FIRST;
+    if (_thresholds.depthMm && distance(r.depth, _lastReported.depth) >= _thresholds.depthMm) {
+      return DEPTH;
+    }
+    if (_thresholds.volume && distance(r.volume, _lastReported.volume) >= _thresholds.volume) {
+      return VOLUME;
+    }
+    if (_thresholds.rateMmPerMin && _hasPrevious && now != _previousAt &&
+        (uint64_t)distance(r.depth, _previous.depth) * 60000 >=
+            (uint64_t)_thresholds.rateMmPerMin * (now - _previousAt)) {
+      return RATE;
+    }
+    if (now - _lastReportAt >= _thresholds.heartbeatMs) return HEARTBEAT;
+    return NONE;
+  }
+
+  static uint32_t distance(uint32_t a, uint32_t b) {
+    return a > b ? a - b : b - a;
+  }
+
+  ReportThresholds _thresholds;
+  Reason _due;
+  bool _hasReported;
+  bool _hasPrevious;
+  uint32_t _lastReportAt;
+  uint32_t _previousAt;
+  PackedReading _lastReported;
+  PackedReading _previous;
+  uint32_t _counts[REASON_COUNT];
+};
+
+// One ChangeReporter per tank, reporting them together: a report is due
+// as soon as any tank's is, and reported() re-centres every tank, since
+// the transport sends all tanks in one payload.
+template <uint8_t C>
+class ChangeReporterArray {
+public:
+  explicit ChangeReporterArray(const ReportThresholds& thresholds) {
+    for (uint8_t c = 0; c < C; c++) _tanks[c] = ChangeReporter(thresholds);
+  }
+
+  // readings[0..C) taken at `now`
+  bool offer(uint32_t now, const PackedReading* readings) {
+    bool due = false;
+    for (uint8_t c = 0; c < C; c++) {
+      if (_tanks[c].offer(now, readings[c])) due = true;
+    }
+    return due;
+  }
+
+  bool due() const {
+    for (uint8_t c = 0; c < C; c++) {
+      if (_tanks[c].due()) return true;
+    }
+    return false;
+  }
+
+  void reported(uint32_t now, const PackedReading* readings) {
+    for (uint8_t c = 0; c < C; c++) _tanks[c].reported(now, readings[c]);
+  }
+
+  const ChangeReporter& tank(uint8_t c) const { return _tanks[c]; }
+
+private:
+  ChangeReporter _tanks[C];
+};
+
+#endif
@@ -0,0 +1,160 @@
+#ifndef DEADLINE_SCHEDULER_H
+#define DEADLINE_SCHEDULER_H
+
+#include <stdint.h>
+
+// Deadline scheduler for loop(): a binary min-heap of up to N tasks keyed
+// on their next millis() deadline.
+//
+// Replaces the "millis() - lastX >= interval" checks that loop() used to
+// repeat on every pass. Tasks are identified by a small id (0..N-1) and
+// are either periodic (every()) or one-shot (at()); a task may reschedule
+// itself or others while it runs. runDue() pops and runs whatever is due,
+// and msUntilNext() tells the caller how long it may idle before the next
+// one.
+//
+// Deadlines are compared as (int32_t)(a - b), so ordering survives the
+// 49.7-day millis() wrap as long as every pending deadline is within
+// 24.8 days of now.
+template <uint8_t N>
+class DeadlineScheduler {
+public:
+  typedef void (*Task)();
+  static const uint32_t NO_DEADLINE = 0xFFFFFFFFUL;
+
+  DeadlineScheduler() : _size(0) {
+    for (uint8_t i = 0; i < N; i++) {
+      _fn[i] = 0;
+      _period[i] = 0;
+      _deadline[i] = 0;
+      _slot[i] = NOT_QUEUED;
+    }
+  }
+
+  // Run fn every periodMs, first at firstAt. Periodic deadlines advance by
+  // the period (no drift); a task that fell a whole period behind skips
+  // ahead instead of running back to back.
+  void every(uint8_t id, Task fn, uint32_t periodMs, uint32_t firstAt) {
+    if (id >= N) return;
+    _fn[id] = fn;
+    _period[id] = periodMs;
+    at(id, firstAt);
+  }
+
+  // Register a one-shot task; it runs only when scheduled with at()
+  void add(uint8_t id, Task fn) {
+    if (id >= N) return;
+    _fn[id] = fn;
+    _period[id] = 0;
+  }
+
+  // (Re)schedule a task's next run
+  void at(uint8_t id, uint32_t deadline) {
+    if (id >= N || !_fn[id]) return;
+    _deadline[id] = deadline;
+    if (_slot[id] == NOT_QUEUED) {
+      _slot[id] = _size;
+      _heap[_size++] = id;
+    }
+    siftUp(_slot[id]);
+    siftDown(_slot[id]);
+  }
+
+  // Schedule at `deadline` unless the task is already due earlier
+  void atOrBefore(uint8_t id, uint32_t deadline) {
+    if (id < N && scheduled(id) && !before(deadline, _deadline[id])) return;
+    at(id, deadline);
+  }
+
+  void cancel(uint8_t id) {
+    if (id >= N || _slot[id] == NOT_QUEUED) return;
+    uint8_t slot = _slot[id];
+    _slot[id] = NOT_QUEUED;
+    if (--_size == slot) return;
+    uint8_t moved = _heap[_size];
+    _heap[slot] = moved;
+    _slot[moved] = slot;
+    siftUp(slot);
+    siftDown(_slot[moved]);
+  }
+
+  bool scheduled(uint8_t id) const { return id < N && _slot[id] != NOT_QUEUED; }
+  uint32_t deadline(uint8_t id) const { return _deadline[id]; }
+  uint8_t pending() const { return _size; }
+
+  // Run the tasks due at `now`, earliest first, at most N per call so a
+  // task that keeps rescheduling itself for now cannot starve the rest of
+  // loop(). Returns the number of tasks run.
+  uint8_t runDue(uint32_t now) {
+    uint8_t ran = 0;
+    for (uint8_t budget = N; budget > 0 && _size > 0 && !before(now, _deadline[_heap[0]]);
+         budget--) {
+      uint8_t id = _heap[0];
+      if (_period[id] > 0) {
+        uint32_t next = _deadline[id] + _period[id];
+        at(id, before(next, now) ? now + _period[id] : next);
+      } else {
+        cancel(id);
+      }
+      _fn[id]();
+      ran++;
+    }
+    return ran;
+  }
+
+  // Milliseconds until the earliest deadline (0 if one is due), or
+  // NO_DEADLINE with nothing scheduled
+  uint32_t msUntilNext(uint32_t now) const {
+    if (_size == 0) return NO_DEADLINE;
+    uint32_t next = _deadline[_heap[0]];
+    return before(now, next) ? next - now : 0;
+  }
+
+  static bool before(uint32_t a, uint32_t b) { return (int32_t)(a - b) < 0; }
+
+private:
+  static const uint8_t NOT_QUEUED = 0xFF;
+
+  void siftUp(uint8_t i) {
+    while (i > 0) {
+      uint8_t parent = (uint8_t)((i - 1) / 2);
+      if (!before(_deadline[_heap[i]], _deadline[_heap[parent]])) break;
+      swap(i, parent);
+      i = parent;
+    }
+  }
+
+  void siftDown(uint8_t i) {
+    for (;;) {
+      uint8_t smallest = i;
+      uint8_t left = (uint8_t)(2 * i + 1);
+      uint8_t right = (uint8_t)(left + 1);
+      if (left < _size && before(_deadline[_heap[left]], _deadline[_heap[smallest]])) {
+        smallest = left;
+      }
+      if (right < _size && before(_deadline[_heap[right]], _deadline[_heap[smallest]])) {
+        smallest = right;
+      }
+      if (smallest == i) return;
+      swap(i, smallest);
+      i = smallest;
+    }
+  }
+
+  void swap(uint8_t a, uint8_t b) {
+    uint8_t t = _heap[a];
+    _heap[a] = _heap[b];
+    _heap[b] = t;
+    _slot[_heap[a]] = a;
+    _slot[_heap[b]] = b;
+  }
+
+  Task _fn[N];
+  uint32_t _period[N];
+  uint32_t _deadline[N];
+  uint8_t _slot[N];   // Heap position of each task, NOT_QUEUED if idle
+  uint8_t _heap[N];   // Task ids, earliest deadline at 0
+  uint8_t _size;
+};
+
+#endif
@@ -0,0 +1,407 @@
+#ifndef HTTP_UPLOADER_H
+#define HTTP_UPLOADER_H
+
+#include <Arduino.h>
+#include <WiFiS3.h>
+#include <stdlib.h>
+#include <string.h>
+#include "SensorConversion.h"
+#include "ReadingBuffer.h"
+
+// Zero-heap HTTP uploader with a persistent (keep-alive) connection.
+//
+// Replaces uploadToServer(), which built each request from String
+// concatenations, reconnected for every upload and busy-waited up to 5 s
+// for the response. Here the request is formatted into a fixed buffer and
+// written in one call, the socket is kept open across uploads and only
+// reopened when the server has closed it, and poll() drains the response a
+// few bytes at a time from loop() without blocking.
+//
+// uploadBatch() sends up to MAX_BATCH_ROWS buffered readings as one
+// POST /update/batch with a CSV body, one reading per line:
+//   age_ms,voltage,pressure,depth,volume[,tank]
+// age_ms is how long before the request the reading was taken; the other
+// fields are the packed integers (mV, 0.01 kPa, mm, 0.01 L). The tank
+// index is only written for tanks other than 0, so single-tank rows are
+// unchanged. The rows are discarded from the ring only after a 2xx
+// response.
+//
+// setExtraHeader() adds one caller-formatted "X-Device-Stats" header to
+// every request (the loop profile summary, when enabled); the string must
+// stay valid while set.
+//
+// A request header that would not fit REQUEST_BUFFER_SIZE (a long host or
+// extra header) is never sent cut short: upload()/uploadBatch() return
+// false, the rows stay buffered and oversized() counts the skip.
+class HttpUploader {
+public:
+  static const size_t REQUEST_BUFFER_SIZE = 256;
+  static const uint8_t MAX_BATCH_ROWS = 24;
+  static const size_t MAX_ROW_LENGTH = 45;  // "4294967295,65535,65535,65535,2000000000,255\n"
+  static const size_t BODY_BUFFER_SIZE = MAX_BATCH_ROWS * MAX_ROW_LENGTH;
+  static const size_t LINE_BUFFER_SIZE = 48;
+  static const unsigned long RESPONSE_TIMEOUT_MS = 5000;
+  static const uint8_t MAX_BYTES_PER_POLL = 64;
+
+  HttpUploader(WiFiClient& client, const char* host, uint16_t port)
+    : _client(client), _host(host), _port(port), _state(IDLE),
+      _requestLength(0), _bodyLength(0), _sentAt(0), _lineLength(0),
+      _status(0), _contentLength(-1), _closeAfter(false), _batchRing(0),
+      _batchLastSeq(0), _lastOk(false), _connects(0), _completed(0),
+      _failures(0), _oversized(0), _overflow(false), _extraHeader(0) {
+    _request[0] = '\0';
+    _body[0] = '\0';
+  }
+
+  // Send one reading as GET /update. Returns false without sending if WiFi
+  // is down, the previous response is still pending, or the connect fails.
+  bool upload(const PackedReading& reading) {
+    if (WiFi.status() != WL_CONNECTED) {
+      Serial.println("WiFi not connected. Skipping WiFi upload.");
+      return false;
+    }
+    if (_state != IDLE) {
+      Serial.println("Previous upload still pending. Skipping WiFi upload.");
+      return false;
+    }
+    if (!ensureConnected()) {
+      Serial.println("Connection to server failed!");
+      _failures++;
+      return false;
+    }
+
+    _body[0] = '\0';
+    _bodyLength = 0;
+    _batchRing = 0;
+    if (!formatRequest(reading)) return skipOversized();
+    return sendRequest();
+  }
+
+  // Send the oldest buffered readings (up to MAX_BATCH_ROWS) in one request.
+  // Same preconditions as upload(); also false if the ring is empty.
+  bool uploadBatch(ReadingRing& ring) {
+    if (ring.empty()) return false;
+    if (WiFi.status() != WL_CONNECTED) {
+      Serial.println("WiFi not connected. Keeping readings buffered.");
+      return false;
+    }
+    if (_state != IDLE) return false;
+    if (!ensureConnected()) {
+      Serial.println("Connection to server failed!");
+      _failures++;
+      return false;
+    }
+
+    uint8_t rows = formatBatchBody(ring, millis());
+    if (!formatBatchHeader()) return skipOversized();
+    _batchRing = &ring;
+    _batchLastSeq = ring.firstSeq() + rows - 1;
+    return sendRequest();
+  }
+
+  // Consume whatever response bytes have arrived. Call every loop().
+  void poll() {
+    if (_state == IDLE) return;
+
+    uint8_t budget = MAX_BYTES_PER_POLL;
+    while (budget-- > 0 && _state != IDLE && _client.available() > 0) {
+      int c = _client.read();
+      if (c < 0) break;
+      consume((char)c);
+    }
+    if (_state == IDLE) return;
+
+    if (!_client.connected() && _client.available() <= 0) {
+      // Body delimited by connection close counts as complete
+      if (_state == BODY && _contentLength < 0) {
+        finishResponse();
+      } else {
+        fail("Server closed connection!");
+      }
+      return;
+    }
+
+    if (millis() - _sentAt > RESPONSE_TIMEOUT_MS) {
+      fail("Server timeout!");
+    }
+  }
+
+  bool busy() const { return _state != IDLE; }
+
+  // Header value sent with each request from now on; 0 to stop
+  void setExtraHeader(const char* value) { _extraHeader = value; }
+
+  // True if the most recent request got a 2xx response
+  bool lastSucceeded() const { return _lastOk; }
+  int lastStatus() const { return _status; }
+
+  uint32_t connects() const { return _connects; }
+  uint32_t completed() const { return _completed; }
+  uint32_t failures() const { return _failures; }
+  // Requests skipped because the header did not fit the request buffer
+  uint32_t oversized() const { return _oversized; }
+
+  const char* lastRequest() const { return _request; }
+  size_t lastRequestLength() const { return _requestLength; }
+  const char* lastBody() const { return _body; }
+  size_t lastBodyLength() const { return _bodyLength; }
+
+  // One CSV batch row (see above) into out, newline included, at most
+  // MAX_ROW_LENGTH bytes; returns the length. Shared with MqttUploader.
+  static uint8_t formatRow(char* out, const TimedReading& t, uint32_t now) {
+    uint8_t n = formatUInt(out, now - t.timestamp);
+    out[n++] = ',';
+    n += formatUInt(out + n, t.reading.voltage);
+    out[n++] = ',';
+    n += formatUInt(out + n, t.reading.pressure);
+    out[n++] = ',';
+    n += formatUInt(out + n, t.reading.depth);
+    out[n++] = ',';
+    n += formatUInt(out + n, t.reading.volume);
+    if (t.tank != 0) {
+      out[n++] = ',';
+      n += formatUInt(out + n, t.tank);
+    }
+    out[n++] = '\n';
+    return n;
+  }
+
+private:
+  enum State { IDLE, STATUS_LINE, HEADERS, BODY };
+
+  bool ensureConnected() {
+    if (_client.connected()) return true;
+    _client.stop();
+    Serial.print("Connecting to server: ");
+    Serial.println(_host);
+    if (!_client.connect(_host, _port)) return false;
+    _connects++;
+    return true;
+  }
+
+  // Each returns false if the request did not fit (see append())
+  bool formatRequest(const PackedReading& r) {
+    _requestLength = 0;
+    _overflow = false;
+    append("GET /update?depth=");
+    appendFixed(r.depth, 3);
+    append("&pressure=");
+    appendFixed(r.pressure, 2);
+    append("&volume=");
+    appendFixed(r.volume, 2);
+    append(" HTTP/1.1\r\nHost: ");
+    append(_host);
+    appendExtraHeader();
+    append("\r\nConnection: keep-alive\r\n\r\n");
+    _request[_requestLength] = '\0';
+    return !_overflow;
+  }
+
+  void appendExtraHeader() {
+    if (!_extraHeader || !*_extraHeader) return;
+    append("\r\nX-Device-Stats: ");
+    append(_extraHeader);
+  }
+
+  bool formatBatchHeader() {
+    _requestLength = 0;
+    _overflow = false;
+    append("POST /update/batch HTTP/1.1\r\nHost: ");
+    append(_host);
+    append("\r\nContent-Type: text/csv\r\nContent-Length: ");
+    appendFixed(_bodyLength, 0);
+    appendExtraHeader();
+    append("\r\nConnection: keep-alive\r\n\r\n");
+    _request[_requestLength] = '\0';
+    return !_overflow;
+  }
+
+  // Returns the number of rows written
+  uint8_t formatBatchBody(const ReadingRing& ring, uint32_t now) {
+    _bodyLength = 0;
+    uint8_t rows = 0;
+    while (rows < MAX_BATCH_ROWS && rows < ring.size()) {
+      _bodyLength += formatRow(_body + _bodyLength, ring.at(rows), now);
+      rows++;
+    }
+    _body[_bodyLength] = '\0';
+    return rows;
+  }
+
+  bool skipOversized() {
+    Serial.println("Request too long for the buffer. Skipping WiFi upload.");
+    _oversized++;
+    return false;
+  }
+
+  bool sendRequest() {
+    bool ok = _client.write((const uint8_t*)_request, _requestLength) == _requestLength;
+    if (ok && _bodyLength > 0) {
+      ok = _client.write((const uint8_t*)_body, _bodyLength) == _bodyLength;
+    }
+    if (!ok) {
+      Serial.println("Server write failed!");
+      _client.stop();
+      _failures++;
+      return false;
+    }
+    beginResponse();
+    return true;
+  }
+
+  // Stops at the end of the buffer (one byte kept for the terminator) and
+  // sets _overflow instead of silently cutting the request short
+  void append(const char* s) {
+    while (*s && _requestLength < REQUEST_BUFFER_SIZE - 1) {
+      _request[_requestLength++] = *s++;
+    }
+    if (*s) _overflow = true;
+  }
+
+  // Write value in decimal to out (no terminator); returns the length
+  static uint8_t formatUInt(char* out, uint32_t value) {
+    char digits[10];
+    uint8_t n = 0;
+    do {
+      digits[n++] = (char)('0' + value % 10);
+      value /= 10;
+    } while (value > 0);
+    for (uint8_t i = 0; i < n; i++) {
+      out[i] = digits[n - 1 - i];
+    }
+    return n;
+  }
+
+  // Append value / 10^decimals with exactly `decimals` fractional digits
+  void appendFixed(uint32_t value, uint8_t decimals) {
+    char digits[12];
+    uint8_t n = 0;
+    do {
+      digits[n++] = (char)('0' + value % 10);
+      value /= 10;
+    } while (value > 0 || n <= decimals);
+
+    while (n > 0 && _requestLength < REQUEST_BUFFER_SIZE - 1) {
+      if (n == decimals) _request[_requestLength++] = '.';
+      if (_requestLength < REQUEST_BUFFER_SIZE - 1) {
+        _request[_requestLength++] = digits[--n];
+      }
+    }
+    if (n > 0) _overflow = true;
+  }
+
+  void beginResponse() {
+    _state = STATUS_LINE;
+    _sentAt = millis();
+    _lineLength = 0;
+    _status = 0;
+    _contentLength = -1;
+    _closeAfter = false;
+  }
+
+  void consume(char c) {
+    if (_state == BODY) {
+      if (_contentLength > 0 && --_contentLength == 0) {
+        finishResponse();
+      }
+      return;
+    }
+
+    if (c == '\r') return;
+    if (c != '\n') {
+      if (_lineLength < LINE_BUFFER_SIZE - 1) _line[_lineLength++] = c;
+      return;
+    }
+    _line[_lineLength] = '\0';
+
+    if (_state == STATUS_LINE) {
+      // "HTTP/1.1 200 OK"
+      const char* sp = strchr(_line, ' ');
+      _status = sp ? atoi(sp + 1) : 0;
+      _state = HEADERS;
+    } else if (_lineLength == 0) {
+      // End of headers
+      _state = BODY;
+      if (_contentLength == 0) finishResponse();
+    } else if (startsWithIgnoreCase(_line, "content-length:")) {
+      _contentLength = atol(_line + 15);
+    } else if (startsWithIgnoreCase(_line, "connection:") &&
+               containsIgnoreCase(_line + 11, "close")) {
+      _closeAfter = true;
+    }
+    _lineLength = 0;
+  }
+
+  void finishResponse() {
+    _state = IDLE;
+    _completed++;
+    _lastOk = _status >= 200 && _status < 300;
+    if (_lastOk) {
+      // Server has the batch: release it from the ring
+      if (_batchRing) _batchRing->discardThrough(_batchLastSeq);
+    } else {
+      Serial.print("Server returned HTTP ");
+      Serial.println(_status);
+    }
+    _batchRing = 0;
+    if (_closeAfter) _client.stop();
+  }
+
+  void fail(const char* reason) {
+    Serial.println(reason);
+    _client.stop();
+    _state = IDLE;
+    _batchRing = 0;  // rows stay buffered for the next attempt
+    _lastOk = false;
+    _failures++;
+  }
+
+  static char lower(char c) {
+    return (c >= 'A' && c <= 'Z') ? (char)(c - 'A' + 'a') : c;
+  }
+
+  static bool startsWithIgnoreCase(const char* s, const char* prefix) {
+    while (*prefix) {
+      if (lower(*s++) != *prefix++) return false;
+    }
+    return true;
+  }
+
+  static bool containsIgnoreCase(const char* s, const char* word) {
+    for (; *s; s++) {
+      if (startsWithIgnoreCase(s, word)) return true;
+    }
+    return false;
+  }
+
+  WiFiClient& _client;
+  const char* _host;
+  uint16_t _port;
+
+  State _state;
+  char _request[REQUEST_BUFFER_SIZE];
+  size_t _requestLength;
+  char _body[BODY_BUFFER_SIZE + 1];
+  size_t _bodyLength;
+  unsigned long _sentAt;
+
+  char _line[LINE_BUFFER_SIZE];
+  uint8_t _lineLength;
+  int _status;
+  long _contentLength;
+  bool _closeAfter;
+
+  ReadingRing* _batchRing;
+  uint32_t _batchLastSeq;
+  bool _lastOk;
+
+  uint32_t _connects;
+  uint32_t _completed;
+  uint32_t _failures;
+  uint32_t _oversized;
+  bool _overflow;
+
+  const char* _extraHeader;
+};
+
+#endif
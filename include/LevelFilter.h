@@ -0,0 +1,117 @@
+#ifndef LEVEL_FILTER_H
+#define LEVEL_FILTER_H
+
+#include <math.h>
+#include <stdint.h>
+
+// Streaming filter for one sensor channel, fed every ADC sample.
+//
+// The block mean used before threw away everything older than the current
+// 5 s block, so slosh and pump noise showed up as jitter between readings,
+// and a real change took a whole block to show. This stage keeps a running
+// estimate across blocks instead, in constant state and constant time per
+// sample:
+//
+//   FILTER_EMA     exponential moving average, weight `alpha` on the newest
+//                  sample
+//   FILTER_KALMAN  scalar Kalman filter on a constant level: `processNoise`
+//                  is the variance the level may drift per sample,
+//                  `measurementNoise` the variance of one sample
+//
+// Spike rejection: a sample further than `spikeLimit` from the estimate is
+// dropped, unless `spikeRun` arrive in a row; then the level really moved
+// and the filter restarts from the newest sample, so a large step shows
+// within a few samples instead of a time constant. spikeLimit 0 turns it
+// off.
+//
+// Units are the caller's (the firmware feeds volts). stddev() is the
+// estimate's uncertainty in the same units: sqrt(P) for the Kalman filter,
+// and for the EMA the running sample variance scaled by alpha / (2 - alpha).
+enum LevelFilterKind : uint8_t { FILTER_EMA, FILTER_KALMAN };
+
+struct LevelFilterSettings {
+  uint8_t kind;            // LevelFilterKind
+  float alpha;             // EMA: 0 < alpha <= 1
+  float processNoise;      // Kalman Q, per sample
+  float measurementNoise;  // Kalman R; also the starting variance for both
+  float spikeLimit;        // Reject samples this far from the estimate (0: off)
+  uint8_t spikeRun;        // Accept after this many rejections in a row
+};
+
+class LevelFilter {
+public:
+  // Pass-through (EMA with alpha 1) until given settings
+  LevelFilter() : LevelFilter(LevelFilterSettings{FILTER_EMA, 1.0f, 0.0f, 0.0f, 0.0f, 0}) {}
+
+  explicit LevelFilter(const LevelFilterSettings& settings)
+    : _settings(settings), _rejected(0) {
+    reset();
+  }
+
+  // Forget the estimate; the next sample starts it again
+  void reset() {
+    _value = 0.0f;
+    _variance = 0.0f;
+    _run = 0;
+    _primed = false;
+  }
+
+  // Feed one sample. Returns false if it was rejected as a spike.
+  bool update(float x) {
+    if (!_primed) {
+      restart(x);
+      return true;
+    }
+    float d = x - _value;
+    if (_settings.spikeLimit > 0.0f && fabsf(d) > _settings.spikeLimit) {
+      if (++_run < _settings.spikeRun) {
+        _rejected++;
+        return false;
+      }
+      restart(x);
+      return true;
+    }
+    _run = 0;
+    if (_settings.kind == FILTER_KALMAN) {
+      float p = _variance + _settings.processNoise;
+      float gain = p / (p + _settings.measurementNoise);
+      _value += gain * d;
+      _variance = (1.0f - gain) * p;
+    } else {
+      float a = _settings.alpha;
+      _value += a * d;
+      _variance = (1.0f - a) * (_variance + a * d * d);
+    }
+    return true;
+  }
+
+  bool primed() const { return _primed; }
+  float value() const { return _value; }
+
+  float stddev() const {
+    if (_settings.kind == FILTER_KALMAN) return sqrtf(_variance);
+    float a = _settings.alpha;
+    return sqrtf(_variance * a / (2.0f - a));
+  }
+
+  // Samples dropped as spikes since construction
+  uint32_t rejected() const { return _rejected; }
+  const LevelFilterSettings& settings() const { return _settings; }
+
+private:
+  void restart(float x) {
+    _value = x;
+    _variance = _settings.measurementNoise;
+    _run = 0;
+    _primed = true;
+  }
+
+  LevelFilterSettings _settings;
+  float _value;
+  float _variance;  // Kalman: P. EMA: running variance of the samples.
+  uint32_t _rejected;
+  uint8_t _run;
+  bool _primed;
+};
+
+#endif
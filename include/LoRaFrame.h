@@ -0,0 +1,301 @@
+#ifndef LORA_FRAME_H
+#define LORA_FRAME_H
+
+#include <stdint.h>
+#include "PackedReading.h"
+
+// Multi-sample LoRaWAN uplink frame, version 1 (sent on LORA_FRAME_PORT).
+//
+// One uplink carries the newest reading in full plus the readings before
+// it as per-field deltas, so a minute of 5 s samples costs little more
+// airtime than the old single-reading payload:
+//
+//   byte 0       version (LORA_FRAME_VERSION)
+//   byte 1       sample count n
+//   byte 2       seconds between samples
+//   bytes 3-10   newest reading: voltage, pressure, depth, volume as
+//                big-endian uint16 (same layout as the legacy 8-byte payload)
+//   then n - 1 records, newest to oldest, each four zig-zag varints
+//   (voltage, pressure, depth, volume) holding newer - older
+//
+// A level that barely moves encodes to 4 bytes per extra sample. The
+// encoder stops adding history when the next record would not fit the
+// byte budget, so older samples are the ones left out.
+//
+// Version 2 carries several tanks per sample (see TankArray.h). It is only
+// used for two or more tanks, so single-tank frames stay version 1:
+//
+//   byte 0       version (LORA_FRAME_VERSION_MULTI)
+//   byte 1       sample count n
+//   byte 2       seconds between samples
+//   byte 3       tank count t
+//   then the newest sample, t readings of 8 bytes as above, tank 0 first
+//   then n - 1 records, newest to oldest, each t groups of four zig-zag
+//   varints holding that tank's newer - older
+//
+// Versions 1 and 2 carry volume in 16 bits (up to 655.35 L). When a volume
+// in the newest sample is larger the frame is version 3, the version 2
+// layout (for any tank count) with each newest reading 10 bytes, volume a
+// big-endian uint32:
+//
+//   byte 0       version (LORA_FRAME_VERSION_WIDE)
+//   bytes 1-3    sample count n, seconds between samples, tank count t
+//   then the newest sample, t readings of voltage, pressure, depth as
+//   big-endian uint16 and volume as big-endian uint32
+//   then n - 1 records as in version 2 (volume deltas up to 5 bytes)
+//
+// A version 1 or 2 frame ends early at an older sample whose volume does
+// not fit 16 bits (a tank that just drained below 655.35 L).
+//
+// Header-only and free of Arduino dependencies: the firmware encodes with
+// it and host-side tools decode with the same code.
+
+const uint8_t LORA_FRAME_VERSION = 1;
+const uint8_t LORA_FRAME_VERSION_MULTI = 2;
+const uint8_t LORA_FRAME_VERSION_WIDE = 3;
+const uint8_t LORA_FRAME_PORT = 2;        // Legacy 8-byte payload used port 1
+const uint8_t LORA_FRAME_HEADER_SIZE = 3;
+const uint8_t LORA_FRAME_MULTI_HEADER_SIZE = 4;
+const uint8_t LORA_FRAME_BASE_SIZE = LORA_FRAME_HEADER_SIZE + 8;
+const uint8_t LORA_FRAME_WIDE_READING_SIZE = 10;
+const uint8_t LORA_FRAME_MAX_TANKS = 8;
+const uint8_t LORA_FRAME_MAX_PAYLOAD = 242;
+
+// Largest application payload for an AU915 uplink data rate (LoRaWAN
+// Regional Parameters). Dwell time off: DR0-2 51, DR3 115, DR4-6 242.
+// Under the 400 ms uplink dwell limit (TxParamSetupReq): DR2 11, DR3 53,
+// DR4 125, DR5-6 242, and DR0-1 carry nothing. Unknown data rates get the
+// smallest limit.
+constexpr uint8_t au915MaxPayload(uint8_t dataRate, bool uplinkDwell) {
+  return uplinkDwell
+             ? (dataRate == 2 ? 11 : dataRate == 3 ? 53 : dataRate == 4 ? 125
+                : (dataRate == 5 || dataRate == 6) ? 242 : 0)
+             : (dataRate == 3 ? 115 : (dataRate >= 4 && dataRate <= 6) ? 242 : 51);
+}
+
+inline uint32_t zigZagEncode(int32_t v) {
+  return ((uint32_t)v << 1) ^ (uint32_t)(v >> 31);
+}
+
+inline int32_t zigZagDecode(uint32_t v) {
+  return (int32_t)(v >> 1) ^ -(int32_t)(v & 1);
+}
+
+inline uint8_t varintSize(uint32_t v) {
+  uint8_t n = 1;
+  while (v >= 0x80) {
+    v >>= 7;
+    n++;
+  }
+  return n;
+}
+
+inline uint8_t writeVarint(uint8_t* out, uint32_t v) {
+  uint8_t n = 0;
+  while (v >= 0x80) {
+    out[n++] = (uint8_t)(v | 0x80);
+    v >>= 7;
+  }
+  out[n++] = (uint8_t)v;
+  return n;
+}
+
+// Builds a frame in a caller-supplied buffer. Add samples newest first:
+// add() with one tank, addSample() with `tanks` readings per sample.
+class LoRaFrameEncoder {
+public:
+  LoRaFrameEncoder(uint8_t* buffer, uint8_t capacity, uint8_t intervalSec, uint8_t tanks = 1)
+    : _buf(buffer), _capacity(capacity), _interval(intervalSec),
+      _tanks(tanks < 1 ? 1 : (tanks > LORA_FRAME_MAX_TANKS ? LORA_FRAME_MAX_TANKS : tanks)),
+      _length(0), _count(0), _wide(false), _prev() {}
+
+  // Append the next older reading (single tank). Returns false, leaving
+  // the frame unchanged, once it no longer fits.
+  bool add(const PackedReading& r) { return addSample(&r); }
+
+  // Append the next older sample: one reading per tank, tank 0 first
+  bool addSample(const PackedReading* readings) {
+    if (_count == 0) {
+      bool wide = false;
+      for (uint8_t t = 0; t < _tanks; t++) wide = wide || readings[t].volume > 0xFFFF;
+      bool multi = wide || _tanks > 1;
+      uint8_t header = multi ? LORA_FRAME_MULTI_HEADER_SIZE : LORA_FRAME_HEADER_SIZE;
+      uint8_t readingSize = wide ? LORA_FRAME_WIDE_READING_SIZE : 8;
+      if (_capacity < header + readingSize * _tanks) return false;
+      _buf[0] = wide ? LORA_FRAME_VERSION_WIDE : (multi ? LORA_FRAME_VERSION_MULTI : LORA_FRAME_VERSION);
+      _buf[2] = _interval;
+      if (multi) _buf[3] = _tanks;
+      _length = header;
+      _wide = wide;
+      for (uint8_t t = 0; t < _tanks; t++) {
+        const PackedReading& r = readings[t];
+        writeU16(r.voltage);
+        writeU16(r.pressure);
+        writeU16(r.depth);
+        if (wide) writeU16((uint16_t)(r.volume >> 16));
+        writeU16((uint16_t)r.volume);
+      }
+    } else {
+      uint32_t deltas[4 * LORA_FRAME_MAX_TANKS];
+      uint16_t size = 0;
+      for (uint8_t t = 0; t < _tanks; t++) {
+        const PackedReading& r = readings[t];
+        if (!_wide && r.volume > 0xFFFF) return false;
+        uint32_t* d = deltas + 4 * t;
+        d[0] = delta(_prev[t].voltage, r.voltage);
+        d[1] = delta(_prev[t].pressure, r.pressure);
+        d[2] = delta(_prev[t].depth, r.depth);
+        d[3] = delta(_prev[t].volume, r.volume);
+        size += varintSize(d[0]) + varintSize(d[1]) + varintSize(d[2]) + varintSize(d[3]);
+      }
+      if (_count == 255 || _length + size > _capacity) return false;
+      for (uint8_t i = 0; i < 4 * _tanks; i++) {
+        _length += writeVarint(_buf + _length, deltas[i]);
+      }
+    }
+    for (uint8_t t = 0; t < _tanks; t++) _prev[t] = readings[t];
+    _buf[1] = ++_count;
+    return true;
+  }
+
+  uint8_t length() const { return _length; }
+  uint8_t count() const { return _count; }
+  uint8_t tanks() const { return _tanks; }
+
+private:
+  // Volumes are at most PACKED_VOLUME_MAX, so the difference fits
+  static uint32_t delta(uint32_t newer, uint32_t older) {
+    return zigZagEncode((int32_t)(newer - older));
+  }
+
+  void writeU16(uint16_t v) {
+    _buf[_length++] = (uint8_t)(v >> 8);
+    _buf[_length++] = (uint8_t)v;
+  }
+
+  uint8_t* _buf;
+  uint8_t _capacity;
+  uint8_t _interval;
+  uint8_t _tanks;
+  uint8_t _length;
+  uint8_t _count;
+  bool _wide;  // Version 3
+  PackedReading _prev[LORA_FRAME_MAX_TANKS];
+};
+
+// Walks a received frame (any version) without copying it. next()
+// yields single-tank readings newest first, nextSample() one reading per
+// tank; both return false at the end of the frame or on malformed input
+// (check malformed() to tell the two apart).
+class LoRaFrameReader {
+public:
+  LoRaFrameReader(const uint8_t* data, uint16_t length)
+    : _data(data), _length(length), _pos(0), _read(0), _tanks(1), _malformed(false), _prev() {
+    if (length < LORA_FRAME_BASE_SIZE || data[1] == 0) {
+      _malformed = true;
+    } else if (data[0] == LORA_FRAME_VERSION_MULTI || data[0] == LORA_FRAME_VERSION_WIDE) {
+      _tanks = data[3];
+      uint8_t readingSize = data[0] == LORA_FRAME_VERSION_WIDE ? LORA_FRAME_WIDE_READING_SIZE : 8;
+      if (_tanks == 0 || _tanks > LORA_FRAME_MAX_TANKS ||
+          length < LORA_FRAME_MULTI_HEADER_SIZE + readingSize * _tanks) {
+        _malformed = true;
+      }
+    } else if (data[0] != LORA_FRAME_VERSION) {
+      _malformed = true;
+    }
+  }
+
+  bool valid() const { return !_malformed; }
+  bool malformed() const { return _malformed; }
+  uint8_t version() const { return _length > 0 ? _data[0] : 0; }
+  uint8_t count() const { return _length >= LORA_FRAME_HEADER_SIZE ? _data[1] : 0; }
+  uint8_t intervalSec() const { return _length >= LORA_FRAME_HEADER_SIZE ? _data[2] : 0; }
+  uint8_t tanks() const { return _tanks; }
+
+  // Single-tank frames only
+  bool next(PackedReading& out) {
+    if (_tanks != 1) return false;
+    return nextSample(&out);
+  }
+
+  // Fills out[0..tanks())
+  bool nextSample(PackedReading* out) {
+    if (_malformed || _read == count()) return false;
+    bool wide = version() == LORA_FRAME_VERSION_WIDE;
+    if (_read == 0) {
+      _pos = version() == LORA_FRAME_VERSION ? LORA_FRAME_HEADER_SIZE
+                                             : LORA_FRAME_MULTI_HEADER_SIZE;
+      for (uint8_t t = 0; t < _tanks; t++) {
+        _prev[t].voltage = readU16();
+        _prev[t].pressure = readU16();
+        _prev[t].depth = readU16();
+        _prev[t].volume = wide ? ((uint32_t)readU16() << 16) : 0;
+        _prev[t].volume |= readU16();
+      }
+    } else {
+      uint32_t volumeMax = wide ? PACKED_VOLUME_MAX : 0xFFFF;
+      uint8_t volumeBytes = wide ? MAX_WIDE_VARINT_BYTES : MAX_VARINT_BYTES;
+      for (uint8_t t = 0; t < _tanks; t++) {
+        if (!applyDelta(_prev[t].voltage) || !applyDelta(_prev[t].pressure) ||
+            !applyDelta(_prev[t].depth) ||
+            !applyDelta(_prev[t].volume, volumeMax, volumeBytes)) {
+          _malformed = true;
+          return false;
+        }
+      }
+    }
+    _read++;
+    // Trailing bytes after the last record mean the count is wrong
+    if (_read == count() && _pos != _length) {
+      _malformed = true;
+      return false;
+    }
+    for (uint8_t t = 0; t < _tanks; t++) out[t] = _prev[t];
+    return true;
+  }
+
+private:
+  // Deltas span at most +/-65535, i.e. 17 zig-zag bits in 3 varint bytes;
+  // version 3 volume deltas take up to 32 bits in 5
+  static const uint8_t MAX_VARINT_BYTES = 3;
+  static const uint8_t MAX_WIDE_VARINT_BYTES = 5;
+
+  uint16_t readU16() {
+    uint16_t v = (uint16_t)((_data[_pos] << 8) | _data[_pos + 1]);
+    _pos += 2;
+    return v;
+  }
+
+  bool applyDelta(uint16_t& value) {
+    uint32_t wide = value;
+    if (!applyDelta(wide, 0xFFFF, MAX_VARINT_BYTES)) return false;
+    value = (uint16_t)wide;
+    return true;
+  }
+
+  // value - the next delta, if it is within 0..max
+  bool applyDelta(uint32_t& value, uint32_t max, uint8_t maxBytes) {
+    uint32_t raw = 0;
+    for (uint8_t i = 0;; i++) {
+      if (i == maxBytes || _pos >= _length) return false;
+      uint8_t b = _data[_pos++];
+      if (i == 4 && b > 0x0F) return false;  // Past 32 bits
+      raw |= (uint32_t)(b & 0x7F) << (7 * i);
+      if (!(b & 0x80)) break;
+    }
+    int64_t older = (int64_t)value - zigZagDecode(raw);
+    if (older < 0 || older > (int64_t)max) return false;
+    value = (uint32_t)older;
+    return true;
+  }
+
+  const uint8_t* _data;
+  uint16_t _length;
+  uint16_t _pos;
+  uint8_t _read;
+  uint8_t _tanks;
+  bool _malformed;
+  PackedReading _prev[LORA_FRAME_MAX_TANKS];
+};
+
+#endif
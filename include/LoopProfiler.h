@@ -0,0 +1,224 @@
+#ifndef LOOP_PROFILER_H
+#define LOOP_PROFILER_H
+
+#include <Arduino.h>
+#include <stdint.h>
+
+// Hot-path timing for loop(): where each pass spends its time, how long
+// passes take, and how long the LMIC run loop goes unserviced.
+//
+// Each section of loop() ends with lap(section), which charges the ticks
+// since the previous lap (or loopStart()) to that section: one counter read
+// and a few adds per section, so it stays on in production builds. Ticks
+// are DWT cycles on the RA4M1 (48 per us) and micros() elsewhere; deltas
+// are 32-bit, which covers any single pass (the cycle counter wraps every
+// 89 s).
+//
+// Per section: passes, total and max ticks. Per loop() pass (loopStart() to
+// loopStart()): a log2 histogram, bucket b counting passes of 2^b to
+// 2^(b+1) - 1 us. noteRunloop() before each os_runloop_once() tracks the
+// largest gap between calls, the number that decides whether LMIC misses
+// an RX window.
+//
+// Define LOOP_PROFILER_DISABLED to compile every call to nothing.
+class LoopProfiler {
+public:
+  static const uint8_t MAX_SECTIONS = 12;
+  static const uint8_t HISTOGRAM_BUCKETS = 24;  // Up to 16.7 s per pass
+  static const size_t SUMMARY_SIZE = 64;
+
+  struct Section {
+    uint32_t passes;
+    uint32_t maxTicks;
+    uint64_t totalTicks;
+  };
+
+  // Names index the sections: names[i] for lap(i)
+  LoopProfiler(const char* const* names, uint8_t sections)
+    : _names(names), _sections(sections > MAX_SECTIONS ? MAX_SECTIONS : sections),
+      _ticksPerUs(1) {
+    reset();
+  }
+
+  // Start the tick source (call once from setup())
+  void begin() {
+#if defined(ARDUINO_ARCH_RENESAS) && !defined(LOOP_PROFILER_DISABLED)
+    CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+    DWT->CYCCNT = 0;
+    DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+    _ticksPerUs = SystemCoreClock / 1000000;
+#endif
+    reset();
+  }
+
+  void reset() {
+    for (uint8_t i = 0; i < MAX_SECTIONS; i++) {
+      _stats[i].passes = 0;
+      _stats[i].maxTicks = 0;
+      _stats[i].totalTicks = 0;
+    }
+    for (uint8_t b = 0; b < HISTOGRAM_BUCKETS; b++) _histogram[b] = 0;
+    _loops = 0;
+    _maxLoopTicks = 0;
+    _maxRunloopGapTicks = 0;
+    _started = false;
+    _runloopSeen = false;
+  }
+
+#ifndef LOOP_PROFILER_DISABLED
+  // First thing in loop()
+  void loopStart() {
+    uint32_t now = ticks();
+    if (_started) {
+      uint32_t pass = now - _loopStart;
+      if (pass > _maxLoopTicks) _maxLoopTicks = pass;
+      _histogram[bucket(pass / _ticksPerUs)]++;
+      _loops++;
+    }
+    _started = true;
+    _loopStart = now;
+    _lap = now;
+  }
+
+  // End of a section: charge the time since the last lap to it
+  void lap(uint8_t section) {
+    uint32_t now = ticks();
+    uint32_t elapsed = now - _lap;
+    _lap = now;
+    if (section >= _sections) return;
+    Section& s = _stats[section];
+    s.passes++;
+    s.totalTicks += elapsed;
+    if (elapsed > s.maxTicks) s.maxTicks = elapsed;
+  }
+
+  // Just before os_runloop_once()
+  void noteRunloop() {
+    uint32_t now = ticks();
+    if (_runloopSeen) {
+      uint32_t gap = now - _lastRunloop;
+      if (gap > _maxRunloopGapTicks) _maxRunloopGapTicks = gap;
+    }
+    _runloopSeen = true;
+    _lastRunloop = now;
+  }
+#else
+  void loopStart() {}
+  void lap(uint8_t) {}
+  void noteRunloop() {}
+#endif
+
+  const Section& section(uint8_t i) const { return _stats[i]; }
+  uint32_t loops() const { return _loops; }
+  uint32_t histogram(uint8_t b) const { return _histogram[b]; }
+  uint32_t maxLoopUs() const { return _maxLoopTicks / _ticksPerUs; }
+  uint32_t maxRunloopGapUs() const { return _maxRunloopGapTicks / _ticksPerUs; }
+  uint32_t ticksToUs(uint64_t t) const { return (uint32_t)(t / _ticksPerUs); }
+
+  // Log2 bucket of a pass length in us
+  static uint8_t bucket(uint32_t us) {
+    uint8_t b = 0;
+    while (us > 1 && b < HISTOGRAM_BUCKETS - 1) {
+      us >>= 1;
+      b++;
+    }
+    return b;
+  }
+
+  // Full report, e.g. printTo(Serial) when asked on the console
+  template <typename Out>
+  void printTo(Out& out) const {
+    out.print(F("--- Loop profile: "));
+    out.print(_loops);
+    out.println(F(" passes ---"));
+    out.print(F("max pass us: "));
+    out.print(maxLoopUs());
+    out.print(F(", max os_runloop_once gap us: "));
+    out.println(maxRunloopGapUs());
+    for (uint8_t i = 0; i < _sections; i++) {
+      const Section& s = _stats[i];
+      out.print(_names[i]);
+      out.print(F(": total us "));
+      out.print(ticksToUs(s.totalTicks));
+      out.print(F(", mean us "));
+      out.print(s.passes ? ticksToUs(s.totalTicks / s.passes) : 0);
+      out.print(F(", max us "));
+      out.println(ticksToUs(s.maxTicks));
+    }
+    out.println(F("pass length histogram (us: passes)"));
+    for (uint8_t b = 0; b < HISTOGRAM_BUCKETS; b++) {
+      if (!_histogram[b]) continue;
+      out.print(b == 0 ? 0UL : 1UL << b);
+      out.print(F("+: "));
+      out.println(_histogram[b]);
+    }
+  }
+
+  // One-line summary for an upload header: passes, max pass, max
+  // os_runloop_once gap and the slowest section with its max, e.g.
+  //   "loops=1200;max_us=5210;lmic_gap_us=5230;worst=wifi_upload:5100"
+  // Returns the length (truncated to fit size - 1).
+  size_t formatSummary(char* out, size_t size) const {
+    uint8_t worst = 0;
+    for (uint8_t i = 1; i < _sections; i++) {
+      if (_stats[i].maxTicks > _stats[worst].maxTicks) worst = i;
+    }
+    size_t n = 0;
+    n = put(out, size, n, "loops=");
+    n = putUInt(out, size, n, _loops);
+    n = put(out, size, n, ";max_us=");
+    n = putUInt(out, size, n, maxLoopUs());
+    n = put(out, size, n, ";lmic_gap_us=");
+    n = putUInt(out, size, n, maxRunloopGapUs());
+    if (_sections > 0) {
+      n = put(out, size, n, ";worst=");
+      n = put(out, size, n, _names[worst]);
+      n = put(out, size, n, ":");
+      n = putUInt(out, size, n, ticksToUs(_stats[worst].maxTicks));
+    }
+    if (size > 0) out[n] = '\0';
+    return n;
+  }
+
+private:
+  uint32_t ticks() const {
+#if defined(ARDUINO_ARCH_RENESAS)
+    return DWT->CYCCNT;
+#else
+    return (uint32_t)micros();
+#endif
+  }
+
+  static size_t put(char* out, size_t size, size_t n, const char* s) {
+    while (*s && n + 1 < size) out[n++] = *s++;
+    return n;
+  }
+
+  static size_t putUInt(char* out, size_t size, size_t n, uint32_t value) {
+    char digits[10];
+    uint8_t d = 0;
+    do {
+      digits[d++] = (char)('0' + value % 10);
+      value /= 10;
+    } while (value > 0);
+    while (d > 0 && n + 1 < size) out[n++] = digits[--d];
+    return n;
+  }
+
+  const char* const* _names;
+  uint8_t _sections;
+  uint32_t _ticksPerUs;
+
+  Section _stats[MAX_SECTIONS];
+  uint32_t _histogram[HISTOGRAM_BUCKETS];
+  uint32_t _loops;
+  uint32_t _maxLoopTicks;
+  uint32_t _maxRunloopGapTicks;
+  uint32_t _loopStart;
+  uint32_t _lap;
+  uint32_t _lastRunloop;
+  bool _started;
+  bool _runloopSeen;
+};
+
+#endif
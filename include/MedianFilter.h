@@ -0,0 +1,250 @@
+#ifndef MEDIAN_FILTER_H
+#define MEDIAN_FILTER_H
+
+#include <stdint.h>
+
+// Median filters for raw ADC codes.
+//
+// medianSelect() is a drop-in for the insertion sort in readA0VoltageMedian():
+// quickselect with a median-of-three pivot, expected O(n) instead of O(n^2).
+//
+// BlockMedian<N> and RunningMedian<N> both keep the last N samples and share
+// the add()/median()/count() interface:
+//   - BlockMedian   O(1) add, O(n) median() (quickselect on a copy)
+//   - RunningMedian O(log n) add, O(1) median() (indexed min/max heaps)
+// MedianFilter<N> picks one at compile time: build with
+// -D MEDIAN_FILTER_RUNNING=1 to get the running median.
+//
+// For an even number of samples the median is the mean of the two middle
+// values (integer division), matching both implementations.
+
+#ifndef MEDIAN_FILTER_RUNNING
+#define MEDIAN_FILTER_RUNNING 0
+#endif
+
+namespace median_detail {
+
+inline void swapInt(int& a, int& b) {
+  int t = a;
+  a = b;
+  b = t;
+}
+
+}  // namespace median_detail
+
+// Partially reorders vals[0..n) so vals[k] holds the k-th smallest value,
+// everything before it is <= and everything after it is >=. Returns vals[k].
+inline int selectKth(int* vals, int n, int k) {
+  int lo = 0;
+  int hi = n - 1;
+  while (lo < hi) {
+    int mid = lo + (hi - lo) / 2;
+    if (vals[mid] < vals[lo]) median_detail::swapInt(vals[mid], vals[lo]);
+    if (vals[hi] < vals[lo]) median_detail::swapInt(vals[hi], vals[lo]);
+    if (vals[hi] < vals[mid]) median_detail::swapInt(vals[hi], vals[mid]);
+    int pivot = vals[mid];
+
+    int i = lo;
+    int j = hi;
+    while (i <= j) {
+      while (vals[i] < pivot) i++;
+      while (vals[j] > pivot) j--;
+      if (i <= j) {
+        median_detail::swapInt(vals[i], vals[j]);
+        i++;
+        j--;
+      }
+    }
+
+    if (k <= j) {
+      hi = j;
+    } else if (k >= i) {
+      lo = i;
+    } else {
+      break;  // vals[j+1..i-1] all equal the pivot
+    }
+  }
+  return vals[k];
+}
+
+// Median of vals[0..n), reordering vals in place.
+inline int medianSelect(int* vals, int n) {
+  if (n <= 0) return 0;
+  int k = n / 2;
+  int upper = selectKth(vals, n, k);
+  if (n & 1) return upper;
+
+  // Lower middle is the largest value left of k after selection
+  int lower = vals[0];
+  for (int i = 1; i < k; i++) {
+    if (vals[i] > lower) lower = vals[i];
+  }
+  return (lower + upper) / 2;
+}
+
+// Sliding-window median, recomputed by selection on demand.
+template <uint8_t N>
+class BlockMedian {
+public:
+  BlockMedian() { reset(); }
+
+  void reset() {
+    _count = 0;
+    _head = 0;
+  }
+
+  void add(int v) {
+    _vals[_head] = v;
+    _head = (_head + 1 == N) ? 0 : _head + 1;
+    if (_count < N) _count++;
+  }
+
+  int median() const {
+    int scratch[N];
+    for (uint8_t i = 0; i < _count; i++) {
+      scratch[i] = _vals[i];
+    }
+    return medianSelect(scratch, _count);
+  }
+
+  uint8_t count() const { return _count; }
+  bool full() const { return _count == N; }
+
+private:
+  int _vals[N];
+  uint8_t _count;
+  uint8_t _head;
+};
+
+// Sliding-window median maintained incrementally.
+//
+// The window is stored as a ring (_data) plus one heap array split around
+// the median: positions 1..minCt form a min-heap of the upper half, positions
+// -1..-maxCt a max-heap of the lower half, and position 0 is the median.
+// _pos maps each ring slot to its heap position so the sample being evicted
+// can be replaced in place and sifted up or down in O(log n).
+template <uint8_t N>
+class RunningMedian {
+public:
+  RunningMedian() { reset(); }
+
+  void reset() {
+    _count = 0;
+    _idx = 0;
+    // Initial fill pattern: median, max, min, max, min, ...
+    for (int k = N - 1; k >= 0; k--) {
+      int p = ((k + 1) / 2) * ((k & 1) ? -1 : 1);
+      _pos[k] = (int16_t)p;
+      heap(p) = (uint8_t)k;
+      _data[k] = 0;
+    }
+  }
+
+  void add(int v) {
+    bool isNew = _count < N;
+    int p = _pos[_idx];
+    int old = _data[_idx];
+    _data[_idx] = v;
+    _idx = (_idx + 1 == N) ? 0 : _idx + 1;
+    if (isNew) _count++;
+
+    if (p > 0) {
+      // Slot lives in the min-heap (upper half)
+      if (!isNew && old < v) {
+        minSortDown(p * 2);
+      } else if (minSortUp(p)) {
+        maxSortDown(-1);
+      }
+    } else if (p < 0) {
+      // Slot lives in the max-heap (lower half)
+      if (!isNew && v < old) {
+        maxSortDown(p * 2);
+      } else if (maxSortUp(p)) {
+        minSortDown(1);
+      }
+    } else {
+      // Slot is the median itself
+      if (maxCt()) maxSortDown(-1);
+      if (minCt()) minSortDown(1);
+    }
+  }
+
+  int median() const {
+    if (_count == 0) return 0;
+    int v = _data[heapAt(0)];
+    if ((_count & 1) == 0) {
+      v = (_data[heapAt(-1)] + v) / 2;
+    }
+    return v;
+  }
+
+  uint8_t count() const { return _count; }
+  bool full() const { return _count == N; }
+
+private:
+  // _count never exceeds N; saying so here lets the compiler see that the
+  // sift loops stay inside _heap
+  int filled() const { return _count < N ? _count : N; }
+  int minCt() const { return (filled() - 1) / 2; }
+  int maxCt() const { return filled() / 2; }
+
+  uint8_t& heap(int i) { return _heap[i + N / 2]; }
+  uint8_t heapAt(int i) const { return _heap[i + N / 2]; }
+
+  bool less(int i, int j) const { return _data[heapAt(i)] < _data[heapAt(j)]; }
+
+  void exchange(int i, int j) {
+    uint8_t t = heap(i);
+    heap(i) = heap(j);
+    heap(j) = t;
+    _pos[heap(i)] = (int16_t)i;
+    _pos[heap(j)] = (int16_t)j;
+  }
+
+  bool cmpExch(int i, int j) {
+    if (!less(i, j)) return false;
+    exchange(i, j);
+    return true;
+  }
+
+  // Sift down the min-heap starting at child position i
+  void minSortDown(int i) {
+    for (; i <= minCt(); i *= 2) {
+      if (i > 1 && i < minCt() && less(i + 1, i)) ++i;
+      if (!cmpExch(i, i / 2)) break;
+    }
+  }
+
+  // Sift down the max-heap starting at child position i (negative)
+  void maxSortDown(int i) {
+    for (; i >= -maxCt(); i *= 2) {
+      if (i < -1 && i > -maxCt() && less(i, i - 1)) --i;
+      if (!cmpExch(i / 2, i)) break;
+    }
+  }
+
+  // Sift up towards the median; true if the median changed
+  bool minSortUp(int i) {
+    while (i > 0 && cmpExch(i, i / 2)) i /= 2;
+    return i == 0;
+  }
+
+  bool maxSortUp(int i) {
+    while (i < 0 && cmpExch(i / 2, i)) i /= 2;
+    return i == 0;
+  }
+
+  int _data[N];
+  int16_t _pos[N];
+  uint8_t _heap[N];
+  uint8_t _count;
+  uint8_t _idx;
+};
+
+#if MEDIAN_FILTER_RUNNING
+template <uint8_t N> using MedianFilter = RunningMedian<N>;
+#else
+template <uint8_t N> using MedianFilter = BlockMedian<N>;
+#endif
+
+#endif
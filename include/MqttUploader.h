@@ -0,0 +1,443 @@
+#ifndef MQTT_UPLOADER_H
+#define MQTT_UPLOADER_H
+
+#include <Arduino.h>
+#include <WiFiS3.h>
+#include <string.h>
+#include "HttpUploader.h"
+#include "ReadingBuffer.h"
+
+// Zero-heap MQTT 3.1.1 publisher, a drop-in for HttpUploader (build with
+// -D WIFI_TRANSPORT_MQTT).
+//
+// An HTTP batch costs about 110 bytes of request headers and 200 of
+// response to carry a 24-byte row, and a round trip before the next one.
+// Here the connection carries a persistent session (CleanSession 0, so the
+// broker keeps it across reconnects) and each batch is one PUBLISH to
+// "wt/<clientId>" with a 2-byte fixed header and the topic. The CONNECT of
+// a new connection goes out in the same write as the first PUBLISH, so
+// connecting costs no extra round trip beyond TCP's.
+//
+// Delivery follows the QoS:
+//   0  fire and forget: the rows leave the ring once written, nothing
+//      comes back (a refused CONNECT loses that batch)
+//   1  the rows leave the ring on the broker's PUBACK; on a timeout or a
+//      dropped connection they are sent again, so a subscriber can see a
+//      row twice (as with a lost HTTP response). As the session persists,
+//      the resend is the same PUBLISH [MQTT-4.4.0-1]: its packet id, the
+//      DUP flag set and the rows still buffered of the unacknowledged
+//      batch (ages restated as of the resend); newer rows follow in the
+//      next batch
+//
+// Payload formats:
+//   MQTT_PAYLOAD_TEXT    the /update/batch CSV rows (HttpUploader::formatRow)
+//   MQTT_PAYLOAD_BINARY  byte 0 MQTT_BINARY_VERSION, then 15 bytes per row:
+//                        age_ms as big-endian uint32, voltage, pressure
+//                        and depth as big-endian uint16, volume as
+//                        big-endian uint32 (packed units), tank index.
+//                        Version 1 rows were 13 bytes, volume in 16 bits.
+//
+// A PINGREQ goes out after KEEP_ALIVE_S without other traffic, so slow
+// change-driven reporting does not let the broker drop the session's
+// connection. poll() reads replies without blocking, like HttpUploader.
+//
+// setStats() publishes a caller-formatted string to "wt/<clientId>/stats"
+// (QoS 0) with every batch: the loop profile summary, when enabled.
+enum MqttPayloadFormat : uint8_t { MQTT_PAYLOAD_TEXT, MQTT_PAYLOAD_BINARY };
+
+const uint8_t MQTT_BINARY_VERSION = 2;
+const uint8_t MQTT_BINARY_ROW_SIZE = 15;
+
+struct MqttSettings {
+  const char* host;
+  uint16_t port;
+  const char* clientId;  // Up to 23 characters; also names the topic
+  const char* username;  // 0: no username or password
+  const char* password;  // 0: username only
+  uint8_t qos;           // 0 or 1
+  uint8_t payload;       // MqttPayloadFormat
+};
+
+class MqttUploader {
+public:
+  static const uint8_t MAX_BATCH_ROWS = HttpUploader::MAX_BATCH_ROWS;
+  static const uint16_t KEEP_ALIVE_S = 120;
+  static const unsigned long RESPONSE_TIMEOUT_MS = 5000;
+  static const uint8_t MAX_BYTES_PER_POLL = 64;
+  static const uint8_t MAX_TOPIC_LENGTH = 40;
+  static const size_t CONNECT_BUFFER_SIZE = 128;
+  static const size_t PAYLOAD_BUFFER_SIZE = MAX_BATCH_ROWS * HttpUploader::MAX_ROW_LENGTH;
+  // CONNECT, the batch PUBLISH (header at most 5 + topic), the stats PUBLISH
+  static const size_t PACKET_BUFFER_SIZE =
+      CONNECT_BUFFER_SIZE + 5 + MAX_TOPIC_LENGTH + PAYLOAD_BUFFER_SIZE + 5 + MAX_TOPIC_LENGTH + 64;
+
+  explicit MqttUploader(WiFiClient& client, const MqttSettings& settings)
+    : _client(client), _settings(settings), _topicLength(0), _packetLength(0),
+      _payloadLength(0), _connAckPending(false), _pubAckPending(false),
+      _pingPending(false), _sentAt(0), _lastSendAt(0), _packetId(0),
+      _rxState(RX_TYPE), _rxType(0), _rxRemaining(0), _rxShift(0), _rxPos(0),
+      _batchRing(0), _batchLastSeq(0), _unacked(false), _lastOk(false), _sessionPresent(false),
+      _returnCode(0), _connects(0), _completed(0), _failures(0), _stats(0) {
+    const char* prefix = "wt/";
+    while (*prefix) _topic[_topicLength++] = *prefix++;
+    for (const char* c = settings.clientId; c && *c && _topicLength < MAX_TOPIC_LENGTH - 7; c++) {
+      _topic[_topicLength++] = *c;
+    }
+    _topic[_topicLength] = '\0';
+  }
+
+  // Publish the oldest buffered readings (up to MAX_BATCH_ROWS). Returns
+  // false without sending if the ring is empty, WiFi is down, a reply is
+  // still pending or the connect fails.
+  bool uploadBatch(ReadingRing& ring) {
+    if (ring.empty()) return false;
+    if (WiFi.status() != WL_CONNECTED) {
+      Serial.println("WiFi not connected. Keeping readings buffered.");
+      return false;
+    }
+    if (busy()) return false;
+    _packetLength = 0;
+    if (!ensureConnected()) {
+      Serial.println("Connection to broker failed!");
+      _failures++;
+      return false;
+    }
+
+    uint32_t now = millis();
+    uint8_t qos = _settings.qos > 0 ? 1 : 0;
+    // Rows of an unacknowledged batch still at the front of the ring (the
+    // oldest may have been dropped since)
+    bool resend = qos && _unacked && (int32_t)(_batchLastSeq - ring.firstSeq()) >= 0;
+    uint8_t rows = formatPayload(ring, now,
+        resend ? (uint8_t)(_batchLastSeq - ring.firstSeq() + 1) : MAX_BATCH_ROWS);
+    if (qos && !resend) _packetId = (uint16_t)(_packetId == 0xFFFF ? 1 : _packetId + 1);
+    appendPublish(_topic, _topicLength, (const uint8_t*)_payload, _payloadLength, qos, resend);
+    if (_stats && *_stats) {
+      char topic[MAX_TOPIC_LENGTH];
+      memcpy(topic, _topic, _topicLength);
+      memcpy(topic + _topicLength, "/stats", 6);
+      appendPublish(topic, (uint16_t)(_topicLength + 6), (const uint8_t*)_stats,
+                    (uint16_t)strnlen(_stats, 64), 0, false);
+    }
+    if (!send()) return false;
+
+    uint32_t lastSeq = ring.firstSeq() + rows - 1;
+    if (qos) {
+      _pubAckPending = true;
+      _unacked = true;
+      _batchRing = &ring;
+      _batchLastSeq = lastSeq;
+    } else {
+      ring.discardThrough(lastSeq);
+      _completed++;
+      _lastOk = true;
+    }
+    return true;
+  }
+
+  // Consume whatever reply bytes have arrived and keep the connection
+  // alive. Call every loop().
+  void poll() {
+    if (!busy()) {
+      if (_connects > 0 && millis() - _lastSendAt >= (unsigned long)KEEP_ALIVE_S * 1000 &&
+          _client.connected()) {
+        static const uint8_t PINGREQ[2] = {0xC0, 0x00};
+        _packetLength = 0;
+        appendBytes(PINGREQ, 2);
+        if (send()) _pingPending = true;
+      }
+      return;
+    }
+
+    uint8_t budget = MAX_BYTES_PER_POLL;
+    while (budget-- > 0 && busy() && _client.available() > 0) {
+      int c = _client.read();
+      if (c < 0) break;
+      consume((uint8_t)c);
+    }
+    if (!busy()) return;
+
+    if (!_client.connected() && _client.available() <= 0) {
+      fail("Broker closed connection!");
+      return;
+    }
+    if (millis() - _sentAt > RESPONSE_TIMEOUT_MS) {
+      fail("Broker timeout!");
+    }
+  }
+
+  // Waiting for a CONNACK, PUBACK or PINGRESP
+  bool busy() const { return _connAckPending || _pubAckPending || _pingPending; }
+
+  // Stats string published with each batch from now on; 0 to stop
+  void setStats(const char* value) { _stats = value; }
+
+  // True if the most recent batch was written (QoS 0) or acknowledged (QoS 1)
+  bool lastSucceeded() const { return _lastOk; }
+  // CONNACK of the current connection: return code, and whether the broker
+  // still had the session
+  uint8_t lastReturnCode() const { return _returnCode; }
+  bool sessionPresent() const { return _sessionPresent; }
+
+  uint32_t connects() const { return _connects; }
+  uint32_t completed() const { return _completed; }
+  uint32_t failures() const { return _failures; }
+
+  const char* topic() const { return _topic; }
+  const uint8_t* lastPacket() const { return _packet; }
+  size_t lastPacketLength() const { return _packetLength; }
+  const uint8_t* lastPayload() const { return (const uint8_t*)_payload; }
+  size_t lastPayloadLength() const { return _payloadLength; }
+
+private:
+  enum RxState { RX_TYPE, RX_LENGTH, RX_BODY };
+
+  bool ensureConnected() {
+    if (_client.connected()) return true;
+    _client.stop();
+    Serial.print("Connecting to broker: ");
+    Serial.println(_settings.host);
+    if (!_client.connect(_settings.host, _settings.port)) return false;
+    _connects++;
+    _rxState = RX_TYPE;
+    _sessionPresent = false;
+    // CONNECT rides in the same write as the first PUBLISH
+    appendConnect();
+    _connAckPending = true;
+    return true;
+  }
+
+  void appendConnect() {
+    uint16_t idLength = clampedLength(_settings.clientId, 23);
+    uint16_t userLength = clampedLength(_settings.username, 32);
+    uint16_t passLength = _settings.username ? clampedLength(_settings.password, 32) : 0;
+    uint8_t flags = 0x00;  // CleanSession 0: persistent session
+    uint16_t remaining = 10 + 2 + idLength;
+    if (_settings.username) {
+      flags |= 0x80;
+      remaining += 2 + userLength;
+      if (_settings.password) {
+        flags |= 0x40;
+        remaining += 2 + passLength;
+      }
+    }
+    static const uint8_t PROTOCOL[7] = {0x00, 0x04, 'M', 'Q', 'T', 'T', 0x04};
+    appendByte(0x10);
+    appendLength(remaining);
+    appendBytes(PROTOCOL, sizeof(PROTOCOL));
+    appendByte(flags);
+    appendByte((uint8_t)(KEEP_ALIVE_S >> 8));
+    appendByte((uint8_t)KEEP_ALIVE_S);
+    appendString(_settings.clientId, idLength);
+    if (flags & 0x80) appendString(_settings.username, userLength);
+    if (flags & 0x40) appendString(_settings.password, passLength);
+  }
+
+  void appendPublish(const char* topic, uint16_t topicLength, const uint8_t* payload,
+                     uint16_t length, uint8_t qos, bool dup) {
+    uint16_t remaining = 2 + topicLength + (qos ? 2 : 0) + length;
+    appendByte((uint8_t)(0x30 | (dup ? 0x08 : 0x00) | (qos << 1)));
+    appendLength(remaining);
+    appendString(topic, topicLength);
+    if (qos) {
+      appendByte((uint8_t)(_packetId >> 8));
+      appendByte((uint8_t)_packetId);
+    }
+    appendBytes(payload, length);
+  }
+
+  // Up to maxRows of the oldest; returns the number of rows written
+  uint8_t formatPayload(const ReadingRing& ring, uint32_t now, uint8_t maxRows) {
+    _payloadLength = 0;
+    uint8_t rows = 0;
+    if (maxRows > MAX_BATCH_ROWS) maxRows = MAX_BATCH_ROWS;
+    if (_settings.payload == MQTT_PAYLOAD_BINARY) {
+      uint8_t* out = (uint8_t*)_payload;
+      out[_payloadLength++] = MQTT_BINARY_VERSION;
+      while (rows < maxRows && rows < ring.size()) {
+        const TimedReading& t = ring.at(rows);
+        uint32_t age = now - t.timestamp;
+        uint8_t* row = out + _payloadLength;
+        writeU32(row, age);
+        writeU16(row + 4, t.reading.voltage);
+        writeU16(row + 6, t.reading.pressure);
+        writeU16(row + 8, t.reading.depth);
+        writeU32(row + 10, t.reading.volume);
+        row[14] = t.tank;
+        _payloadLength += MQTT_BINARY_ROW_SIZE;
+        rows++;
+      }
+    } else {
+      while (rows < maxRows && rows < ring.size()) {
+        _payloadLength += HttpUploader::formatRow(_payload + _payloadLength, ring.at(rows), now);
+        rows++;
+      }
+    }
+    return rows;
+  }
+
+  bool send() {
+    if (_client.write(_packet, _packetLength) != _packetLength) {
+      Serial.println("Broker write failed!");
+      _client.stop();
+      _connAckPending = false;
+      _failures++;
+      return false;
+    }
+    _sentAt = _lastSendAt = millis();
+    return true;
+  }
+
+  void consume(uint8_t c) {
+    switch (_rxState) {
+      case RX_TYPE:
+        _rxType = c;
+        _rxRemaining = 0;
+        _rxShift = 0;
+        _rxPos = 0;
+        _rxState = RX_LENGTH;
+        return;
+      case RX_LENGTH:
+        _rxRemaining |= (uint32_t)(c & 0x7F) << _rxShift;
+        _rxShift += 7;
+        if (c & 0x80) return;
+        if (_rxRemaining == 0) {
+          handlePacket();
+        } else {
+          _rxState = RX_BODY;
+        }
+        return;
+      case RX_BODY:
+        // Only the first bytes matter for the packets a publisher receives
+        if (_rxPos < sizeof(_rxBody)) _rxBody[_rxPos] = c;
+        _rxPos++;
+        if (_rxPos == _rxRemaining) handlePacket();
+        return;
+    }
+  }
+
+  void handlePacket() {
+    _rxState = RX_TYPE;
+    switch (_rxType >> 4) {
+      case 2:  // CONNACK
+        if (_rxPos < 2) break;
+        _returnCode = _rxBody[1];
+        if (_returnCode != 0) {
+          Serial.print("Broker refused connection: ");
+          Serial.println(_returnCode);
+          fail(0);
+          return;
+        }
+        _sessionPresent = (_rxBody[0] & 0x01) != 0;
+        _connAckPending = false;
+        break;
+      case 4:  // PUBACK
+        if (_rxPos >= 2 && _pubAckPending &&
+            (uint16_t)((_rxBody[0] << 8) | _rxBody[1]) == _packetId) {
+          _pubAckPending = false;
+          _unacked = false;
+          _completed++;
+          _lastOk = true;
+          // Broker has the batch: release it from the ring
+          if (_batchRing) _batchRing->discardThrough(_batchLastSeq);
+          _batchRing = 0;
+        }
+        break;
+      case 13:  // PINGRESP
+        _pingPending = false;
+        break;
+      default:
+        break;
+    }
+  }
+
+  void fail(const char* reason) {
+    if (reason) Serial.println(reason);
+    _client.stop();
+    _connAckPending = false;
+    _pubAckPending = false;
+    _pingPending = false;
+    _batchRing = 0;  // rows stay buffered (and _unacked) for the next attempt
+    _lastOk = false;
+    _failures++;
+  }
+
+  static uint16_t clampedLength(const char* s, uint16_t max) {
+    if (!s) return 0;
+    uint16_t n = 0;
+    while (n < max && s[n]) n++;
+    return n;
+  }
+
+  static void writeU16(uint8_t* out, uint16_t v) {
+    out[0] = (uint8_t)(v >> 8);
+    out[1] = (uint8_t)v;
+  }
+
+  static void writeU32(uint8_t* out, uint32_t v) {
+    writeU16(out, (uint16_t)(v >> 16));
+    writeU16(out + 2, (uint16_t)v);
+  }
+
+  void appendByte(uint8_t b) {
+    if (_packetLength < PACKET_BUFFER_SIZE) _packet[_packetLength++] = b;
+  }
+
+  void appendBytes(const uint8_t* data, size_t length) {
+    for (size_t i = 0; i < length; i++) appendByte(data[i]);
+  }
+
+  void appendString(const char* s, uint16_t length) {
+    appendByte((uint8_t)(length >> 8));
+    appendByte((uint8_t)length);
+    appendBytes((const uint8_t*)s, length);
+  }
+
+  // MQTT remaining length: 7 bits per byte, low first
+  void appendLength(uint32_t length) {
+    do {
+      uint8_t b = length & 0x7F;
+      length >>= 7;
+      appendByte(length ? (uint8_t)(b | 0x80) : b);
+    } while (length);
+  }
+
+  WiFiClient& _client;
+  MqttSettings _settings;
+  char _topic[MAX_TOPIC_LENGTH];
+  uint8_t _topicLength;
+
+  uint8_t _packet[PACKET_BUFFER_SIZE];
+  size_t _packetLength;
+  char _payload[PAYLOAD_BUFFER_SIZE];
+  size_t _payloadLength;
+
+  bool _connAckPending;
+  bool _pubAckPending;
+  bool _pingPending;
+  unsigned long _sentAt;
+  unsigned long _lastSendAt;
+  uint16_t _packetId;
+
+  RxState _rxState;
+  uint8_t _rxType;
+  uint32_t _rxRemaining;
+  uint8_t _rxShift;
+  uint32_t _rxPos;
+  uint8_t _rxBody[4];
+
+  ReadingRing* _batchRing;
+  uint32_t _batchLastSeq;
+  bool _unacked;  // The batch PUBLISH _packetId awaits its PUBACK
+  bool _lastOk;
+  bool _sessionPresent;
+  uint8_t _returnCode;
+
+  uint32_t _connects;
+  uint32_t _completed;
+  uint32_t _failures;
+
+  const char* _stats;
+};
+
+#endif
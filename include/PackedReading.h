@@ -0,0 +1,22 @@
+#ifndef PACKED_READING_H
+#define PACKED_READING_H
+
+#include <stdint.h>
+
+// Packed reading, same resolutions as the LoRaWAN payload.
+// Kept free of Arduino headers so host-side decoders can share it.
+//
+// Volume is 32 bits: tanks of a few kilolitres are common and 16 bits of
+// 0.01 L stop at 655.35 L. Formats that carried it in 16 bits (LoRa frame
+// versions 1 and 2, MQTT binary rows version 1) have wider successors.
+struct PackedReading {
+  uint16_t voltage;   // 0.001 V
+  uint16_t pressure;  // 0.01 kPa
+  uint16_t depth;     // 0.001 m
+  uint32_t volume;    // 0.01 L
+};
+
+// Largest packed volume (20,000 kL); deltas between two volumes fit an int32
+const uint32_t PACKED_VOLUME_MAX = 2000000000;
+
+#endif
@@ -0,0 +1,89 @@
+#ifndef READING_BUFFER_H
+#define READING_BUFFER_H
+
+#include <stdint.h>
+#include "SensorConversion.h"
+
+// Timestamped reading held until the server has acknowledged it
+struct TimedReading {
+  uint32_t timestamp;  // millis() at capture
+  PackedReading reading;
+  uint8_t tank;        // Channel index (see TankArray.h), 0 for a single tank
+};
+
+// Fixed-size FIFO of readings waiting for upload.
+//
+// Readings are pushed whether or not WiFi is up, so nothing measured during
+// an outage is lost until the ring wraps (then the oldest are dropped and
+// counted). Every reading gets a monotonically increasing sequence number;
+// the uploader remembers the last sequence it sent and calls
+// discardThrough() once the server acknowledges, which stays correct even
+// if the ring overwrote old entries while the request was in flight.
+//
+// A multi-tank reading is pushed as one entry per tank with the same
+// timestamp, tank 0 first.
+class ReadingRing {
+public:
+  void push(uint32_t timestamp, const PackedReading& reading, uint8_t tank = 0) {
+    if (_count == _capacity) {
+      // Full: drop the oldest
+      _head = next(_head);
+      _count--;
+      _firstSeq++;
+      _dropped++;
+    }
+    uint16_t tail = (uint16_t)((_head + _count) % _capacity);
+    _slots[tail].timestamp = timestamp;
+    _slots[tail].reading = reading;
+    _slots[tail].tank = tank;
+    _count++;
+  }
+
+  // i = 0 is the oldest reading
+  const TimedReading& at(uint16_t i) const {
+    return _slots[(_head + i) % _capacity];
+  }
+
+  // Sequence number of at(0); at(i) has firstSeq() + i
+  uint32_t firstSeq() const { return _firstSeq; }
+
+  // Remove every reading with sequence number <= seq
+  void discardThrough(uint32_t seq) {
+    while (_count > 0 && (int32_t)(seq - _firstSeq) >= 0) {
+      _head = next(_head);
+      _count--;
+      _firstSeq++;
+    }
+  }
+
+  uint16_t size() const { return _count; }
+  uint16_t capacity() const { return _capacity; }
+  bool empty() const { return _count == 0; }
+  uint32_t dropped() const { return _dropped; }
+
+protected:
+  ReadingRing(TimedReading* slots, uint16_t capacity)
+    : _slots(slots), _capacity(capacity), _head(0), _count(0),
+      _firstSeq(0), _dropped(0) {}
+
+private:
+  uint16_t next(uint16_t i) const { return (uint16_t)((i + 1) % _capacity); }
+
+  TimedReading* _slots;
+  uint16_t _capacity;
+  uint16_t _head;
+  uint16_t _count;
+  uint32_t _firstSeq;
+  uint32_t _dropped;
+};
+
+template <uint16_t N>
+class ReadingBuffer : public ReadingRing {
+public:
+  ReadingBuffer() : ReadingRing(_storage, N) {}
+
+private:
+  TimedReading _storage[N];
+};
+
+#endif
@@ -0,0 +1,18 @@
+#ifndef SENSOR_CONFIG_H
+#define SENSOR_CONFIG_H
+
+// Sensor and tank configuration.
+// constexpr so the ADC lookup table in SensorConversion.h is built at compile time.
+
+// Sensor configuration
+constexpr float ADC_REF_V = 5.00f;
+constexpr int   ADC_MAX   = 1023;
+constexpr float V_MIN  = 0.50f;
+constexpr float V_MAX  = 4.50f;
+constexpr float FS_KPA = 10.0f;
+
+// Tank configuration
+constexpr float TANK_DIAMETER_MM = 100.0f;
+constexpr float TANK_RADIUS_M = (TANK_DIAMETER_MM / 2.0f) / 1000.0f;
+
+#endif
@@ -0,0 +1,104 @@
+#ifndef SENSOR_CONVERSION_H
+#define SENSOR_CONVERSION_H
+
+#include <Arduino.h>
+#include "SensorConfig.h"
+#include "PackedReading.h"
+
+// Conversion from raw ADC code to pressure, depth and volume.
+//
+// The float functions are the reference pipeline. Since only ADC_MAX + 1 raw
+// codes exist, the whole pipeline is also evaluated at compile time into a
+// flash-resident table of packed readings, so the hot path is one array
+// index with no float math. The float steps are written exactly as the
+// runtime path so the table matches it bit-for-bit after packing.
+// TankArray.h converts a channel configured like SensorConfig.h (filter
+// estimates included) through the table.
+
+constexpr float clampf(float x, float a, float b) {
+  return (x < a) ? a : ((x > b) ? b : x);
+}
+
+constexpr float voltageToKpa(float v) {
+  return (V_MAX - V_MIN < 0.001f)
+      ? 0.0f
+      : clampf((v - V_MIN) / (V_MAX - V_MIN), 0.0f, 1.0f) * FS_KPA;
+}
+
+constexpr float adcToVoltage(float avgRaw) {
+  return (avgRaw * ADC_REF_V) / (float)ADC_MAX;
+}
+
+constexpr float kpaToDepthM(float pressure_kpa) {
+  return pressure_kpa * 0.10197162f;
+}
+
+constexpr float depthToLiters(float depth_m) {
+  return (float)(PI * TANK_RADIUS_M * TANK_RADIUS_M) * depth_m * 1000.0f;
+}
+
+constexpr PackedReading packReading(float voltage) {
+  return PackedReading{
+    (uint16_t)(voltage * 1000.0f),
+    (uint16_t)(voltageToKpa(voltage) * 100.0f),
+    (uint16_t)(kpaToDepthM(voltageToKpa(voltage)) * 1000.0f),
+    (uint32_t)(depthToLiters(kpaToDepthM(voltageToKpa(voltage))) * 100.0f)
+  };
+}
+
+struct SensorTable {
+  PackedReading entries[ADC_MAX + 1];
+};
+
+constexpr SensorTable makeSensorTable() {
+  SensorTable table = {};
+  for (int code = 0; code <= ADC_MAX; code++) {
+    table.entries[code] = packReading(adcToVoltage((float)code));
+  }
+  return table;
+}
+
+// Packed reading for a raw (or window-averaged) ADC code
+inline const PackedReading& readingForCode(uint16_t code) {
+  static constexpr SensorTable table = makeSensorTable();
+  return table.entries[code > ADC_MAX ? ADC_MAX : code];
+}
+
+// x + (y - x) * f / 256, rounded
+inline uint32_t lerpField(uint32_t x, uint32_t y, uint16_t f) {
+  int64_t step = ((int64_t)y - (int64_t)x) * f;
+  return (uint32_t)((int64_t)x + (step >= 0 ? (step + 128) / 256 : -((-step + 128) / 256)));
+}
+
+// Packed reading at `pos`, a position in table codes with 8 fractional
+// bits. Interpolates linearly between the two nearest table codes, so
+// resolution beyond ADC_MAX is kept without a bigger table; on a whole code
+// it equals readingForCode().
+inline PackedReading readingAtPosition(uint32_t pos) {
+  uint16_t code = (uint16_t)(pos >> 8);
+  uint16_t frac = (uint16_t)(pos & 0xFF);
+  if (code >= ADC_MAX) return readingForCode(ADC_MAX);
+  const PackedReading& a = readingForCode(code);
+  const PackedReading& b = readingForCode(code + 1);
+  return PackedReading{(uint16_t)lerpField(a.voltage, b.voltage, frac),
+                       (uint16_t)lerpField(a.pressure, b.pressure, frac),
+                       (uint16_t)lerpField(a.depth, b.depth, frac), lerpField(a.volume, b.volume, frac)};
+}
+
+// Packed reading for `sum` out of `fullScale` (e.g. a block of 14-bit
+// oversampled samples, see BlockAdc.h)
+inline PackedReading readingForLevel(uint32_t sum, uint32_t fullScale) {
+  if (fullScale == 0) return readingForCode(0);
+  return readingAtPosition((uint32_t)(((uint64_t)sum * ADC_MAX * 256 + fullScale / 2) / fullScale));
+}
+
+// Packed reading for sensor volts (e.g. a LevelFilter estimate): one
+// multiply to a table position, then readingAtPosition()
+inline PackedReading readingForVolts(float voltage) {
+  float pos = voltage * ((float)ADC_MAX * 256.0f / ADC_REF_V) + 0.5f;
+  if (!(pos > 0.0f)) return readingForCode(0);
+  if (pos >= (float)ADC_MAX * 256.0f) return readingForCode(ADC_MAX);
+  return readingAtPosition((uint32_t)pos);
+}
+
+#endif
@@ -0,0 +1,144 @@
+#ifndef TANK_ARRAY_H
+#define TANK_ARRAY_H
+
+#include <stdint.h>
+#include "SensorConversion.h"
+#include "TankGeometry.h"
+
+// One sensor channel: where it is wired, its output span and the tank it
+// sits in. SensorConfig.h holds the values for a single-tank build;
+// sensorConfig() makes that channel.
+struct TankChannel {
+  uint8_t pin;
+  float vMin;                     // Sensor output at 0 kPa (V)
+  float vMax;                     // Sensor output at fsKpa (V)
+  float fsKpa;                    // Full-scale pressure
+  const TankGeometry* geometry;   // Depth to volume; must outlive the array
+  bool useTable;                  // Convert through SensorConversion.h's table
+
+  // The SensorConfig.h sensor in a verticalCylinder(TANK_DIAMETER_MM), read
+  // through the compile-time table
+  static TankChannel sensorConfig(uint8_t pin, const TankGeometry* geometry) {
+    return TankChannel{pin, V_MIN, V_MAX, FS_KPA, geometry, true};
+  }
+};
+
+// Per-channel conversion for C tanks, structure of arrays.
+//
+// The channel configs are split into one array per coefficient, and
+// convert() runs each pipeline stage (voltage, pressure, depth, volume)
+// across all channels before the next, so a reading of the whole tank farm
+// is a handful of short loops over contiguous floats. The arithmetic is
+// the float pipeline of SensorConversion.h with the channel's constants in
+// place of SensorConfig.h and the tank's TankGeometry for volume, so a
+// channel configured like SensorConfig.h (a verticalCylinder()) converts a
+// code exactly as readingForCode() does.
+//
+// A channel with useTable set (TankChannel::sensorConfig()) skips the
+// float pipeline: its readings come from the compile-time table of
+// SensorConversion.h, interpolated between codes (readingForLevel(),
+// readingForVolts()). When every channel does, as in the single-tank
+// build, the float loops are not run at all. The constructor checks that
+// such a channel has SensorConfig.h's span and tank; one that does not
+// goes through the float pipeline instead and clears valid().
+template <uint8_t C>
+class TankArray {
+public:
+  explicit TankArray(const TankChannel (&channels)[C]) : _tableChannels(0), _valid(true) {
+    for (uint8_t c = 0; c < C; c++) {
+      _pins[c] = channels[c].pin;
+      _vMin[c] = channels[c].vMin;
+      _vSpan[c] = channels[c].vMax - channels[c].vMin;
+      _fsKpa[c] = channels[c].fsKpa;
+      _geometry[c] = channels[c].geometry;
+      _table[c] = channels[c].useTable && tableFits(channels[c]);
+      if (channels[c].useTable && !_table[c]) _valid = false;
+      if (_table[c]) _tableChannels++;
+    }
+  }
+
+  // False if a channel asked for the table without the sensor and tank it
+  // was built for
+  bool valid() const { return _valid; }
+
+  // Pins in channel order, for AdcSettings
+  const uint8_t* pins() const { return _pins; }
+  static uint8_t size() { return C; }
+
+  // sums[c] out of fullScale (a block sum, or a raw code out of ADC_MAX)
+  // to one packed reading per channel
+  void convert(const uint32_t* sums, uint32_t fullScale, PackedReading* out) const {
+    float volts[C];
+    float scale = fullScale ? (float)fullScale : 1.0f;
+    for (uint8_t c = 0; c < C; c++) {
+      volts[c] = ((float)sums[c] * ADC_REF_V) / scale;
+      if (_table[c]) out[c] = readingForLevel(sums[c], fullScale);
+    }
+    convertFloat(volts, out);
+  }
+
+  // Sensor volts per channel (e.g. LevelFilter estimates) to one packed
+  // reading per channel
+  void convertVolts(const float* volts, PackedReading* out) const {
+    for (uint8_t c = 0; c < C; c++) {
+      if (_table[c]) out[c] = readingForVolts(volts[c]);
+    }
+    convertFloat(volts, out);
+  }
+
+  // Whether channel c converts through the SensorConversion.h table
+  bool usesTable(uint8_t c) const { return _table[c]; }
+
+  // Metres of depth per sensor volt, inside the sensor's span
+  float depthPerVolt(uint8_t c) const {
+    return _vSpan[c] < 0.001f ? 0.0f : kpaToDepthM(_fsKpa[c] / _vSpan[c]);
+  }
+
+private:
+  static bool near(float a, float b) {
+    float d = a - b;
+    float tolerance = 1e-5f * (b < 0.0f ? -b : b);
+    return d <= tolerance && -d <= tolerance;
+  }
+
+  static bool tableFits(const TankChannel& ch) {
+    return near(ch.vMin, V_MIN) && near(ch.vMax, V_MAX) && near(ch.fsKpa, FS_KPA) &&
+           ch.geometry && ch.geometry->kind() == TankGeometry::PRISM &&
+           near(ch.geometry->areaM2(), TankGeometry::verticalCylinder(TANK_DIAMETER_MM).areaM2());
+  }
+
+  // The float pipeline for every channel not converted through the table
+  void convertFloat(const float* volts, PackedReading* out) const {
+    if (_tableChannels == C) return;
+    float kpa[C], depth[C], liters[C];
+    for (uint8_t c = 0; c < C; c++) {
+      kpa[c] = (_vSpan[c] < 0.001f)
+          ? 0.0f
+          : clampf((volts[c] - _vMin[c]) / _vSpan[c], 0.0f, 1.0f) * _fsKpa[c];
+    }
+    for (uint8_t c = 0; c < C; c++) {
+      depth[c] = kpaToDepthM(kpa[c]);
+    }
+    for (uint8_t c = 0; c < C; c++) {
+      liters[c] = _geometry[c] ? _geometry[c]->liters(depth[c]) : 0.0f;
+    }
+    for (uint8_t c = 0; c < C; c++) {
+      if (_table[c]) continue;
+      out[c].voltage = (uint16_t)(volts[c] * 1000.0f);
+      out[c].pressure = (uint16_t)(kpa[c] * 100.0f);
+      out[c].depth = (uint16_t)(depth[c] * 1000.0f);
+      out[c].volume = (uint32_t)clampf(liters[c] * 100.0f, 0.0f, (float)PACKED_VOLUME_MAX);
+    }
+  }
+
+  uint8_t _pins[C];
+  float _vMin[C];
+  float _vSpan[C];
+  float _fsKpa[C];
+  const TankGeometry* _geometry[C];
+  bool _table[C];
+  uint8_t _tableChannels;
+  bool _valid;
+};
+
+#endif
@@ -0,0 +1,171 @@
+#ifndef TANK_GEOMETRY_H
+#define TANK_GEOMETRY_H
+
+#include <Arduino.h>
+#include <math.h>
+#include <stdint.h>
+
+// One point of a manufacturer's strapping (calibration) table
+struct StrappingPoint {
+  float depthMm;
+  float liters;
+};
+
+// Depth to volume for one tank.
+//
+// Replaces the hardcoded vertical cylinder of SensorConfig.h. Straight-sided
+// tanks (vertical cylinder, rectangular) are a cross-section area times the
+// depth. Every other shape is preprocessed once, when it is built, so
+// liters() never calls acos() or sqrt():
+//
+//   - Horizontal cylinders and cone-bottom silos are sampled into a table of
+//     TABLE_POINTS volumes at equal depth steps from 0 to the full height;
+//     a lookup is one multiply to find the step and a linear interpolation.
+//   - A strapping table keeps its own (unevenly spaced) points, with volumes
+//     made non-decreasing, and is searched with a binary search.
+//
+// Depths beyond the top give the full volume (straight-sided tanks have no
+// top). A geometry built from bad parameters is !valid() and reads 0 L.
+class TankGeometry {
+public:
+  static const uint8_t TABLE_POINTS = 65;
+  static const uint8_t MAX_STRAPPING_POINTS = 32;
+
+  enum Kind : uint8_t { NONE, PRISM, UNIFORM_TABLE, STRAPPING };
+
+  TankGeometry() : _kind(NONE), _points(0), _areaM2(0.0f), _heightM(0.0f), _stepsPerM(0.0f) {}
+
+  static TankGeometry verticalCylinder(float diameterMm) {
+    TankGeometry g;
+    if (diameterMm <= 0.0f) return g;
+    float r = (diameterMm / 2.0f) / 1000.0f;
+    g._kind = PRISM;
+    g._areaM2 = (float)(PI * r * r);
+    return g;
+  }
+
+  static TankGeometry rectangular(float lengthMm, float widthMm) {
+    TankGeometry g;
+    if (lengthMm <= 0.0f || widthMm <= 0.0f) return g;
+    g._kind = PRISM;
+    g._areaM2 = (lengthMm / 1000.0f) * (widthMm / 1000.0f);
+    return g;
+  }
+
+  // Cylinder on its side: depth 0 to diameterMm
+  static TankGeometry horizontalCylinder(float diameterMm, float lengthMm) {
+    TankGeometry g;
+    if (diameterMm <= 0.0f || lengthMm <= 0.0f) return g;
+    double r = diameterMm / 2000.0;
+    double length = lengthMm / 1000.0;
+    g.buildUniform(diameterMm / 1000.0f, [r, length](double h) {
+      // Circular segment of height h times the length
+      double c = r - h;
+      double cosine = c / r < -1.0 ? -1.0 : (c / r > 1.0 ? 1.0 : c / r);
+      double halfChord2 = 2.0 * r * h - h * h;
+      double segment = r * r * acos(cosine) - c * sqrt(halfChord2 > 0.0 ? halfChord2 : 0.0);
+      return segment * length;
+    });
+    return g;
+  }
+
+  // Vertical cylinder with a conical bottom (apex down) of coneHeightMm,
+  // heightMm tall overall
+  static TankGeometry coneBottom(float diameterMm, float coneHeightMm, float heightMm) {
+    TankGeometry g;
+    if (diameterMm <= 0.0f || coneHeightMm < 0.0f || heightMm <= 0.0f || coneHeightMm > heightMm) {
+      return g;
+    }
+    double r = diameterMm / 2000.0;
+    double cone = coneHeightMm / 1000.0;
+    g.buildUniform(heightMm / 1000.0f, [r, cone](double h) {
+      if (h >= cone) return PI * r * r * (cone / 3.0 + (h - cone));
+      double rh = r * h / cone;
+      return PI * rh * rh * h / 3.0;
+    });
+    return g;
+  }
+
+  // Irregular tank from 2 to MAX_STRAPPING_POINTS calibration points,
+  // depths strictly increasing. A volume below an earlier one (a typo or
+  // rounding in the table) is raised to it so lookups stay monotone.
+  static TankGeometry strapping(const StrappingPoint* points, uint8_t count) {
+    TankGeometry g;
+    if (!points || count < 2 || count > MAX_STRAPPING_POINTS) return g;
+    for (uint8_t i = 0; i < count; i++) {
+      if (points[i].depthMm < 0.0f || (i > 0 && points[i].depthMm <= points[i - 1].depthMm)) {
+        return g;
+      }
+      float liters = points[i].liters < 0.0f ? 0.0f : points[i].liters;
+      g._depthM[i] = points[i].depthMm / 1000.0f;
+      g._liters[i] = (i > 0 && liters < g._liters[i - 1]) ? g._liters[i - 1] : liters;
+    }
+    g._kind = STRAPPING;
+    g._points = count;
+    g._heightM = g._depthM[count - 1];
+    return g;
+  }
+
+  bool valid() const { return _kind != NONE; }
+  Kind kind() const { return _kind; }
+
+  // Cross-section of a straight-sided tank in square metres (0 otherwise)
+  float areaM2() const { return _kind == PRISM ? _areaM2 : 0.0f; }
+
+  // Full height in metres (0 for straight-sided tanks: no top)
+  float heightM() const { return _heightM; }
+
+  float liters(float depthM) const {
+    switch (_kind) {
+      case PRISM:
+        return _areaM2 * depthM * 1000.0f;
+      case UNIFORM_TABLE: {
+        if (depthM <= 0.0f) return _liters[0];
+        float pos = depthM * _stepsPerM;
+        if (pos >= (float)(TABLE_POINTS - 1)) return _liters[TABLE_POINTS - 1];
+        uint8_t i = (uint8_t)pos;
+        return _liters[i] + (_liters[i + 1] - _liters[i]) * (pos - (float)i);
+      }
+      case STRAPPING: {
+        if (depthM <= _depthM[0]) return _liters[0];
+        if (depthM >= _depthM[_points - 1]) return _liters[_points - 1];
+        // Last point at or below depthM
+        uint8_t lo = 0, hi = _points - 1;
+        while (hi - lo > 1) {
+          uint8_t mid = (uint8_t)((lo + hi) / 2);
+          if (_depthM[mid] <= depthM) {
+            lo = mid;
+          } else {
+            hi = mid;
+          }
+        }
+        float f = (depthM - _depthM[lo]) / (_depthM[hi] - _depthM[lo]);
+        return _liters[lo] + (_liters[hi] - _liters[lo]) * f;
+      }
+      default:
+        return 0.0f;
+    }
+  }
+
+private:
+  template <typename VolumeM3>
+  void buildUniform(float heightM, VolumeM3 volumeAt) {
+    _kind = UNIFORM_TABLE;
+    _heightM = heightM;
+    _stepsPerM = (float)(TABLE_POINTS - 1) / heightM;
+    for (uint8_t i = 0; i < TABLE_POINTS; i++) {
+      double h = (double)heightM * i / (TABLE_POINTS - 1);
+      _liters[i] = (float)(volumeAt(h) * 1000.0);
+    }
+  }
+
+  Kind _kind;
+  uint8_t _points;
+  float _areaM2;
+  float _heightM;
+  float _stepsPerM;
+  float _liters[TABLE_POINTS];
+  float _depthM[MAX_STRAPPING_POINTS];
+};
+
+#endif
@@ -0,0 +1,134 @@
+#ifndef WIFI_CONNECTION_H
+#define WIFI_CONNECTION_H
+
+#include <Arduino.h>
+#include <WiFiS3.h>
+
+// Non-blocking WiFi connection manager.
+//
+// Replaces connectWiFi(), which spun in delay(500) for up to 15 s (in setup()
+// and every 30 s from loop() while the link was down) and so stopped
+// os_runloop_once() exactly when LoRa was needed most. tick() is called on
+// every loop() pass: it issues WiFi.begin() once per attempt, then polls
+// WiFi.status() at most every STATUS_POLL_MS until the attempt times out.
+// Failed attempts back off exponentially (5 s, 10 s, 20 s, ... capped at 5
+// minutes) so a dead access point costs almost nothing.
+//
+// The one wait left is inside WiFi.begin(). WiFiS3 sends the join to the
+// ESP32-S3 modem (one AT command round trip) and then polls for the link
+// for up to 10 s. The manager polls status() itself, so it sets that
+// timeout to BEGIN_WAIT_MS first; an attempt then holds up loop() for the
+// round trip plus BEGIN_WAIT_MS at most.
+//
+//   IDLE --begin()--> CONNECTING --status OK--> CONNECTED
+//                       |    ^                      |
+//               timeout |    | backoff elapsed      | link lost
+//                       v    |                      |
+//                     BACKOFF <---------------------+ (reconnects at once)
+class WiFiConnectionManager {
+public:
+  enum State { IDLE, CONNECTING, CONNECTED, BACKOFF };
+
+  static const unsigned long STATUS_POLL_MS = 250;
+  static const unsigned long BEGIN_WAIT_MS = 10;
+  static const unsigned long ATTEMPT_TIMEOUT_MS = 15000;
+  static const unsigned long CONNECTED_CHECK_MS = 30000;
+  static const unsigned long BACKOFF_BASE_MS = 5000;
+  static const unsigned long BACKOFF_MAX_MS = 300000;
+
+  WiFiConnectionManager(const char* ssid, const char* password)
+    : _ssid(ssid), _password(password), _state(IDLE), _stateSince(0),
+      _lastStatusPoll(0), _backoffMs(0), _consecutiveFailures(0),
+      _attempts(0) {}
+
+  // Start connecting (returns immediately)
+  void begin() {
+    if (_state == IDLE) startAttempt(millis());
+  }
+
+  // Advance the state machine. Call every loop().
+  void tick() {
+    unsigned long now = millis();
+    switch (_state) {
+      case IDLE:
+        break;
+
+      case CONNECTING:
+        if (now - _lastStatusPoll < STATUS_POLL_MS) break;
+        _lastStatusPoll = now;
+        if (WiFi.status() == WL_CONNECTED) {
+          enter(CONNECTED, now);
+          _consecutiveFailures = 0;
+          _backoffMs = 0;
+          Serial.println("WiFi connected!");
+          Serial.print("IP address: ");
+          Serial.println(WiFi.localIP());
+        } else if (now - _stateSince >= ATTEMPT_TIMEOUT_MS) {
+          _consecutiveFailures++;
+          _backoffMs = backoffFor(_consecutiveFailures);
+          enter(BACKOFF, now);
+          Serial.print("WiFi connection failed! Retrying in ");
+          Serial.print((int)(_backoffMs / 1000));
+          Serial.println(" s");
+        }
+        break;
+
+      case CONNECTED:
+        if (now - _lastStatusPoll < CONNECTED_CHECK_MS) break;
+        _lastStatusPoll = now;
+        if (WiFi.status() != WL_CONNECTED) {
+          Serial.println("WiFi disconnected. Reconnecting...");
+          startAttempt(now);
+        }
+        break;
+
+      case BACKOFF:
+        if (now - _stateSince >= _backoffMs) startAttempt(now);
+        break;
+    }
+  }
+
+  bool connected() const { return _state == CONNECTED; }
+  State state() const { return _state; }
+
+  unsigned long backoffMs() const { return _backoffMs; }
+  uint16_t consecutiveFailures() const { return _consecutiveFailures; }
+  uint32_t attempts() const { return _attempts; }
+
+private:
+  void enter(State s, unsigned long now) {
+    _state = s;
+    _stateSince = now;
+    _lastStatusPoll = now;
+  }
+
+  void startAttempt(unsigned long now) {
+    Serial.print("Connecting to WiFi: ");
+    Serial.println(_ssid);
+    WiFi.setTimeout(BEGIN_WAIT_MS);
+    WiFi.begin(_ssid, _password);
+    _attempts++;
+    enter(CONNECTING, now);
+  }
+
+  static unsigned long backoffFor(uint16_t failures) {
+    unsigned long delayMs = BACKOFF_BASE_MS;
+    for (uint16_t i = 1; i < failures && delayMs < BACKOFF_MAX_MS; i++) {
+      delayMs *= 2;
+    }
+    return delayMs < BACKOFF_MAX_MS ? delayMs : BACKOFF_MAX_MS;
+  }
+
+  const char* _ssid;
+  const char* _password;
+
+  State _state;
+  unsigned long _stateSince;
+  unsigned long _lastStatusPoll;
+
+  unsigned long _backoffMs;
+  uint16_t _consecutiveFailures;
+  uint32_t _attempts;
+};
+
+#endif
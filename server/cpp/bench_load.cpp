@@ -0,0 +1,368 @@
+// HTTP load generator for comparing the C++ and Python sensor servers.
+//
+// Opens -c connections to the server and keeps one request in flight on
+// each for -d seconds, recording the latency of every response. Requests
+// mimic the real clients: the firmware's keep-alive GET /update and the
+// dashboard's GET /api/readings poll. With -k0 every request uses a new
+// connection (Connection: close), which is the only way a server that
+// handles one connection at a time can serve more than one client.
+//
+// With -s N, N dashboards also hold /api/stream open for the whole run.
+// Each should receive one event per upload; the share received and the
+// bytes per viewer are reported.
+//
+// Usage: bench_load [-h host] [-p port] [-c connections] [-d seconds]
+//                   [-r dashboard_percent] [-k 0|1] [-s stream_viewers]
+// Prints requests/s, errors and p50/p99/max latency.
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace {
+
+using SteadyClock = std::chrono::steady_clock;
+
+const int REQUEST_TIMEOUT_MS = 5000;
+
+struct Options {
+  const char* host = "127.0.0.1";
+  int port = 8080;
+  int connections = 64;
+  int seconds = 10;
+  int dashboardPercent = 10;
+  bool keepAlive = true;
+  int viewers = 0;
+};
+
+struct Client {
+  int fd = -1;
+  bool connecting = false;
+  std::string request;
+  size_t sent = 0;
+  std::string response;
+  SteadyClock::time_point started;
+  bool upload = false;
+};
+
+// An /api/stream reader
+struct Viewer {
+  int fd = -1;
+  std::string pending;  // Incomplete event
+  bool snapshot = false;
+  long events = 0;  // "event: readings" received
+  long bytes = 0;
+};
+
+struct Stats {
+  std::vector<double> latenciesUs;
+  long errors = 0;
+  long timeouts = 0;
+  long uploads = 0;  // Completed while the viewers were connected
+  std::vector<Viewer> viewers;
+};
+
+std::string makeRequest(const Options& opt, std::mt19937& rng, bool& upload) {
+  const char* connection = opt.keepAlive ? "keep-alive" : "close";
+  char buf[256];
+  upload = (int)(rng() % 100) >= opt.dashboardPercent;
+  if (!upload) {
+    snprintf(buf, sizeof(buf), "GET /api/readings HTTP/1.1\r\nHost: %s\r\nConnection: %s\r\n\r\n",
+             opt.host, connection);
+  } else {
+    // Same shape as HttpUploader::upload()
+    unsigned depth = rng() % 2000;
+    snprintf(buf, sizeof(buf),
+             "GET /update?depth=%u.%03u&pressure=%u.%02u&volume=%u.%02u HTTP/1.1\r\n"
+             "Host: %s\r\nConnection: %s\r\n\r\n",
+             depth / 1000, depth % 1000, depth * 98 / 1000, depth % 100,
+             depth * 785 / 100000, depth % 100, opt.host, connection);
+  }
+  return buf;
+}
+
+// Complete once the headers and Content-Length bytes of body have arrived
+bool responseComplete(const std::string& r) {
+  size_t headerEnd = r.find("\r\n\r\n");
+  if (headerEnd == std::string::npos) return false;
+  size_t length = 0;
+  for (size_t pos = r.find("\r\n"); pos < headerEnd; pos = r.find("\r\n", pos + 2)) {
+    if (strncasecmp(r.c_str() + pos + 2, "content-length:", 15) == 0) {
+      length = strtoul(r.c_str() + pos + 17, nullptr, 10);
+      break;
+    }
+  }
+  return r.size() >= headerEnd + 4 + length;
+}
+
+class LoadGenerator {
+public:
+  explicit LoadGenerator(const Options& opt) : _opt(opt), _rng(12345) {
+    _addr.sin_family = AF_INET;
+    _addr.sin_port = htons((uint16_t)opt.port);
+    inet_pton(AF_INET, opt.host, &_addr.sin_addr);
+    _epollFd = epoll_create1(0);
+    _clients.resize((size_t)opt.connections);
+    _stats.viewers.resize((size_t)opt.viewers);
+  }
+
+  Stats run() {
+    if (!openViewers()) return std::move(_stats);
+    for (auto& c : _clients) startRequest(c);
+
+    auto end = SteadyClock::now() + std::chrono::seconds(_opt.seconds);
+    epoll_event events[256];
+    while (SteadyClock::now() < end) {
+      int n = epoll_wait(_epollFd, events, 256, 50);
+      for (int i = 0; i < n; i++) {
+        if (isViewer(events[i].data.ptr)) {
+          readViewer(*static_cast<Viewer*>(events[i].data.ptr));
+          continue;
+        }
+        Client& c = *static_cast<Client*>(events[i].data.ptr);
+        if (events[i].events & (EPOLLERR | EPOLLHUP) && c.response.empty()) {
+          fail(c, false);
+        } else if (events[i].events & EPOLLOUT) {
+          onWritable(c);
+        } else if (events[i].events & EPOLLIN) {
+          onReadable(c);
+        }
+      }
+      auto now = SteadyClock::now();
+      for (auto& c : _clients) {
+        if (now - c.started > std::chrono::milliseconds(REQUEST_TIMEOUT_MS)) fail(c, true);
+      }
+    }
+    // Events for the last uploads may still be on their way
+    auto drainEnd = SteadyClock::now() + std::chrono::milliseconds(500);
+    while (_opt.viewers > 0 && SteadyClock::now() < drainEnd) {
+      int n = epoll_wait(_epollFd, events, 256, 50);
+      for (int i = 0; i < n; i++) {
+        if (isViewer(events[i].data.ptr)) readViewer(*static_cast<Viewer*>(events[i].data.ptr));
+      }
+    }
+    for (auto& c : _clients) {
+      if (c.fd >= 0) close(c.fd);
+    }
+    for (auto& v : _stats.viewers) {
+      if (v.fd >= 0) close(v.fd);
+    }
+    return std::move(_stats);
+  }
+
+private:
+  bool isViewer(void* ptr) const {
+    return !_stats.viewers.empty() && ptr >= (const void*)_stats.viewers.data() &&
+           ptr < (const void*)(_stats.viewers.data() + _stats.viewers.size());
+  }
+
+  // Blocking connect and request, then wait for every snapshot so that
+  // each viewer sees all the uploads
+  bool openViewers() {
+    for (auto& v : _stats.viewers) {
+      v.fd = socket(AF_INET, SOCK_STREAM, 0);
+      const char request[] = "GET /api/stream HTTP/1.1\r\n\r\n";
+      if (connect(v.fd, (sockaddr*)&_addr, sizeof(_addr)) != 0 ||
+          send(v.fd, request, sizeof(request) - 1, MSG_NOSIGNAL) != (ssize_t)sizeof(request) - 1) {
+        fprintf(stderr, "Could not open /api/stream: %s\n", strerror(errno));
+        return false;
+      }
+      int on = 1;
+      ioctl(v.fd, FIONBIO, &on);
+      epoll_event ev{};
+      ev.events = EPOLLIN;
+      ev.data.ptr = &v;
+      epoll_ctl(_epollFd, EPOLL_CTL_ADD, v.fd, &ev);
+    }
+    auto end = SteadyClock::now() + std::chrono::seconds(5);
+    epoll_event events[256];
+    while (SteadyClock::now() < end) {
+      bool ready = true;
+      for (auto& v : _stats.viewers) ready = ready && v.snapshot;
+      if (ready) return true;
+      int n = epoll_wait(_epollFd, events, 256, 50);
+      for (int i = 0; i < n; i++) readViewer(*static_cast<Viewer*>(events[i].data.ptr));
+    }
+    fprintf(stderr, "No snapshot from /api/stream\n");
+    return false;
+  }
+
+  void readViewer(Viewer& v) {
+    char buf[65536];
+    while (true) {
+      ssize_t n = recv(v.fd, buf, sizeof(buf), 0);
+      if (n == 0 || (n < 0 && errno != EAGAIN && errno != EINTR)) {
+        // Dropped by the server: stop counting
+        epoll_ctl(_epollFd, EPOLL_CTL_DEL, v.fd, nullptr);
+        close(v.fd);
+        v.fd = -1;
+      }
+      if (n <= 0) return;
+      v.bytes += n;
+      v.pending.append(buf, (size_t)n);
+      size_t pos = 0;
+      for (size_t end; (end = v.pending.find("\n\n", pos)) != std::string::npos; pos = end + 2) {
+        if (v.pending.compare(pos, 15, "event: readings") == 0) v.events++;
+        if (v.pending.compare(pos, 15, "event: snapshot") == 0) v.snapshot = true;
+      }
+      v.pending.erase(0, pos);
+    }
+  }
+
+  void startRequest(Client& c) {
+    c.request = makeRequest(_opt, _rng, c.upload);
+    c.sent = 0;
+    c.response.clear();
+    c.started = SteadyClock::now();
+    if (c.fd < 0) {
+      c.fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK, 0);
+      int one = 1;
+      setsockopt(c.fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+      c.connecting = true;
+      connect(c.fd, (sockaddr*)&_addr, sizeof(_addr));
+      watch(c, EPOLLOUT, EPOLL_CTL_ADD);
+    } else {
+      watch(c, EPOLLOUT, EPOLL_CTL_MOD);
+    }
+  }
+
+  void watch(Client& c, uint32_t events, int op) {
+    epoll_event ev{};
+    ev.events = events;
+    ev.data.ptr = &c;
+    epoll_ctl(_epollFd, op, c.fd, &ev);
+  }
+
+  void onWritable(Client& c) {
+    if (c.connecting) {
+      int err = 0;
+      socklen_t len = sizeof(err);
+      getsockopt(c.fd, SOL_SOCKET, SO_ERROR, &err, &len);
+      if (err != 0) {
+        fail(c, false);
+        return;
+      }
+      c.connecting = false;
+    }
+    ssize_t n = send(c.fd, c.request.data() + c.sent, c.request.size() - c.sent, MSG_NOSIGNAL);
+    if (n < 0) {
+      if (errno != EAGAIN) fail(c, false);
+      return;
+    }
+    c.sent += (size_t)n;
+    if (c.sent == c.request.size()) watch(c, EPOLLIN, EPOLL_CTL_MOD);
+  }
+
+  void onReadable(Client& c) {
+    char buf[65536];
+    ssize_t n = recv(c.fd, buf, sizeof(buf), 0);
+    if (n > 0) c.response.append(buf, (size_t)n);
+    if (n < 0 && errno == EAGAIN) return;
+
+    if (responseComplete(c.response)) {
+      auto us = std::chrono::duration<double, std::micro>(SteadyClock::now() - c.started).count();
+      if (c.response.compare(0, 12, "HTTP/1.1 200") == 0) {
+        _stats.latenciesUs.push_back(us);
+        if (c.upload) _stats.uploads++;
+      } else {
+        _stats.errors++;
+      }
+      bool reuse = _opt.keepAlive && n != 0;
+      if (!reuse) reconnect(c);
+      startRequest(c);
+    } else if (n <= 0) {
+      fail(c, false);
+    }
+  }
+
+  void reconnect(Client& c) {
+    if (c.fd >= 0) {
+      epoll_ctl(_epollFd, EPOLL_CTL_DEL, c.fd, nullptr);
+      close(c.fd);
+    }
+    c.fd = -1;
+  }
+
+  void fail(Client& c, bool timeout) {
+    if (timeout) _stats.timeouts++;
+    else _stats.errors++;
+    reconnect(c);
+    startRequest(c);
+  }
+
+  Options _opt;
+  std::mt19937 _rng;
+  sockaddr_in _addr{};
+  int _epollFd;
+  std::vector<Client> _clients;
+  Stats _stats;
+};
+
+double percentile(std::vector<double>& sorted, double p) {
+  if (sorted.empty()) return 0.0;
+  size_t i = (size_t)(p / 100.0 * (double)(sorted.size() - 1) + 0.5);
+  return sorted[std::min(i, sorted.size() - 1)];
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  Options opt;
+  int c;
+  while ((c = getopt(argc, argv, "h:p:c:d:r:k:s:")) != -1) {
+    switch (c) {
+      case 'h': opt.host = optarg; break;
+      case 'p': opt.port = atoi(optarg); break;
+      case 'c': opt.connections = atoi(optarg); break;
+      case 'd': opt.seconds = atoi(optarg); break;
+      case 'r': opt.dashboardPercent = atoi(optarg); break;
+      case 'k': opt.keepAlive = atoi(optarg) != 0; break;
+      case 's': opt.viewers = atoi(optarg); break;
+      default:
+        fprintf(stderr, "Usage: %s [-h host] [-p port] [-c connections] [-d seconds] "
+                        "[-r dashboard_percent] [-k 0|1] [-s stream_viewers]\n", argv[0]);
+        return 2;
+    }
+  }
+
+  Stats stats = LoadGenerator(opt).run();
+  std::sort(stats.latenciesUs.begin(), stats.latenciesUs.end());
+  printf("%-10s %6d conns  %s  %8.0f req/s  p50 %8.2f ms  p99 %8.2f ms  max %8.2f ms  "
+         "errors %ld  timeouts %ld\n",
+         opt.keepAlive ? "keep-alive" : "close", opt.connections,
+         opt.dashboardPercent ? "mixed " : "update",
+         (double)stats.latenciesUs.size() / opt.seconds,
+         percentile(stats.latenciesUs, 50) / 1000.0,
+         percentile(stats.latenciesUs, 99) / 1000.0,
+         stats.latenciesUs.empty() ? 0.0 : stats.latenciesUs.back() / 1000.0,
+         stats.errors, stats.timeouts);
+  if (!stats.viewers.empty()) {
+    long events = 0;
+    long bytes = 0;
+    for (const auto& v : stats.viewers) {
+      events += v.events;
+      bytes += v.bytes;
+    }
+    double perViewer = (double)events / (double)stats.viewers.size();
+    printf("stream     %6zu viewers  %5.1f%% of %ld uploads received  %8.1f KB/s  "
+           "%6.0f bytes/upload per viewer\n",
+           stats.viewers.size(), stats.uploads ? 100.0 * perViewer / (double)stats.uploads : 0.0,
+           stats.uploads, (double)bytes / stats.viewers.size() / opt.seconds / 1000.0,
+           perViewer > 0 ? (double)bytes / (double)stats.viewers.size() / perViewer : 0.0);
+  }
+  return 0;
+}
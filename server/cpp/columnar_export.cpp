@@ -0,0 +1,481 @@
+#include "columnar_export.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include <functional>
+
+static_assert(__BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__, "exports are written in host byte order");
+
+namespace {
+
+const char COLUMNS_MAGIC[8] = {'W', 'T', 'C', 'O', 'L', '0', '0', '1'};
+const int FIELDS = 5;  // timestamp and the four floats
+const size_t FLOAT_OFFSET[4] = {offsetof(StoredRecord, voltage), offsetof(StoredRecord, pressureKpa),
+                                offsetof(StoredRecord, depthM), offsetof(StoredRecord, volumeL)};
+const char* const FLOAT_NAMES[4] = {"voltage", "pressure_kpa", "water_depth_m", "volume_liters"};
+
+uint64_t pad8(uint64_t n) {
+  return (n + 7) & ~(uint64_t)7;
+}
+
+template <typename T>
+void put(std::string& out, T value) {
+  out.append(reinterpret_cast<const char*>(&value), sizeof(value));
+}
+
+void padTo8(std::string& out, uint64_t length) {
+  out.append((size_t)(pad8(length) - length), '\0');
+}
+
+// Copies one field of each record into a contiguous array
+void gather(char* dst, const StoredRecord* records, size_t count, size_t offset, size_t width) {
+  const char* src = reinterpret_cast<const char*>(records) + offset;
+  for (size_t i = 0; i < count; i++) memcpy(dst + i * width, src + i * sizeof(StoredRecord), width);
+}
+
+// ---------------------------------------------------------------------------
+// Arrow IPC metadata
+// ---------------------------------------------------------------------------
+
+// Minimal FlatBuffers writer for the Arrow Message tables. Objects are
+// written front to back: a table is preceded by its vtable and followed
+// by the objects it points to, so every offset points forward as the
+// format requires.
+class FlatBuilder {
+public:
+  // Writes an object and returns its position
+  using Writer = std::function<size_t(FlatBuilder&)>;
+
+  struct Slot {
+    int id;
+    int size;  // 1, 2, 4 or 8 for scalars; 4 for an offset to a child
+    uint64_t scalar;
+    Writer child;
+  };
+
+  static Slot scalar(int id, int size, uint64_t value) { return Slot{id, size, value, nullptr}; }
+  static Slot child(int id, Writer writer) { return Slot{id, 4, 0, std::move(writer)}; }
+
+  std::string finish(const std::vector<Slot>& root) {
+    _buf.assign(4, '\0');
+    patch(0, table(root));
+    return _buf;
+  }
+
+  size_t table(const std::vector<Slot>& slots) {
+    int maxId = -1;
+    for (const Slot& s : slots) maxId = std::max(maxId, s.id);
+    align(2);
+    size_t vtable = _buf.size();
+    size_t vtableSize = 4 + 2 * (size_t)(maxId + 1);
+
+    // soffset to the vtable, then the fields, largest first
+    size_t start = (size_t)pad8(vtable + vtableSize);
+    std::vector<size_t> order(slots.size());
+    for (size_t i = 0; i < order.size(); i++) order[i] = i;
+    std::stable_sort(order.begin(), order.end(),
+                     [&](size_t a, size_t b) { return slots[a].size > slots[b].size; });
+    std::vector<size_t> at(slots.size());
+    size_t end = start + 4;
+    for (size_t i : order) {
+      size_t size = (size_t)slots[i].size;
+      end = (end + size - 1) / size * size;
+      at[i] = end;
+      end += size;
+    }
+
+    _buf.resize(end, '\0');
+    set<uint16_t>(vtable, (uint16_t)vtableSize);
+    set<uint16_t>(vtable + 2, (uint16_t)(end - start));
+    for (size_t i = 0; i < slots.size(); i++) {
+      set<uint16_t>(vtable + 4 + 2 * (size_t)slots[i].id, (uint16_t)(at[i] - start));
+    }
+    set<int32_t>(start, (int32_t)(start - vtable));
+    for (size_t i = 0; i < slots.size(); i++) {
+      if (!slots[i].child) memcpy(&_buf[at[i]], &slots[i].scalar, (size_t)slots[i].size);
+    }
+    for (size_t i = 0; i < slots.size(); i++) {
+      if (slots[i].child) patch(at[i], slots[i].child(*this));
+    }
+    return start;
+  }
+
+  size_t string(const std::string& s) {
+    align(4);
+    size_t pos = _buf.size();
+    put<uint32_t>(_buf, (uint32_t)s.size());
+    _buf += s;
+    _buf += '\0';
+    return pos;
+  }
+
+  size_t tables(const std::vector<Writer>& writers) {
+    align(4);
+    size_t pos = _buf.size();
+    put<uint32_t>(_buf, (uint32_t)writers.size());
+    _buf.append(4 * writers.size(), '\0');
+    for (size_t i = 0; i < writers.size(); i++) patch(pos + 4 + 4 * i, writers[i](*this));
+    return pos;
+  }
+
+  // Vector of 16-byte structs of two int64s (FieldNode, Buffer)
+  size_t structs(const std::vector<std::pair<int64_t, int64_t>>& items) {
+    while ((_buf.size() + 4) % 8 != 0) _buf += '\0';
+    size_t pos = _buf.size();
+    put<uint32_t>(_buf, (uint32_t)items.size());
+    for (const auto& item : items) {
+      put<int64_t>(_buf, item.first);
+      put<int64_t>(_buf, item.second);
+    }
+    return pos;
+  }
+
+private:
+  void align(size_t n) {
+    while (_buf.size() % n != 0) _buf += '\0';
+  }
+
+  template <typename T>
+  void set(size_t pos, T value) {
+    memcpy(&_buf[pos], &value, sizeof(value));
+  }
+
+  // uoffset from a slot to an object written after it
+  void patch(size_t slot, size_t target) {
+    set<uint32_t>(slot, (uint32_t)(target - slot));
+  }
+
+  std::string _buf;
+};
+
+using Slot = FlatBuilder::Slot;
+using Writer = FlatBuilder::Writer;
+
+// Schema.fbs / Message.fbs enum values
+const uint16_t METADATA_V5 = 4;
+const uint8_t HEADER_SCHEMA = 1;
+const uint8_t HEADER_DICTIONARY_BATCH = 2;
+const uint8_t HEADER_RECORD_BATCH = 3;
+const uint8_t TYPE_INT = 2;
+const uint8_t TYPE_FLOATING_POINT = 3;
+const uint8_t TYPE_UTF8 = 5;
+const uint8_t TYPE_TIMESTAMP = 10;
+const uint16_t PRECISION_SINGLE = 1;
+const uint16_t UNIT_MICROSECOND = 2;
+
+// Encapsulated message: continuation marker, metadata length, then the
+// Message flatbuffer padded so that the body starts 8-byte aligned
+std::string message(uint8_t headerType, const Writer& header, int64_t bodyLength) {
+  std::string meta = FlatBuilder().finish({
+      FlatBuilder::scalar(0, 2, METADATA_V5),
+      FlatBuilder::scalar(1, 1, headerType),
+      FlatBuilder::child(2, header),
+      FlatBuilder::scalar(3, 8, (uint64_t)bodyLength),
+  });
+  meta.append((size_t)(pad8(meta.size()) - meta.size()), '\0');
+  std::string out;
+  put<uint32_t>(out, 0xFFFFFFFFu);
+  put<int32_t>(out, (int32_t)meta.size());
+  return out + meta;
+}
+
+Writer field(const std::string& name, uint8_t typeType, Writer type, Writer dictionary = nullptr) {
+  return [=](FlatBuilder& b) {
+    std::vector<Slot> slots = {
+        FlatBuilder::child(0, [=](FlatBuilder& b) { return b.string(name); }),
+        FlatBuilder::scalar(1, 1, 0),  // Not nullable
+        FlatBuilder::scalar(2, 1, typeType),
+        FlatBuilder::child(3, type),
+        FlatBuilder::child(5, [](FlatBuilder& b) { return b.tables({}); }),
+    };
+    if (dictionary) slots.push_back(FlatBuilder::child(4, dictionary));
+    return b.table(slots);
+  };
+}
+
+std::string schemaMessage() {
+  std::vector<Writer> fields;
+  Writer int32 = [](FlatBuilder& b) {
+    return b.table({FlatBuilder::scalar(0, 4, 32), FlatBuilder::scalar(1, 1, 1)});
+  };
+  Writer dictionary = [=](FlatBuilder& b) {
+    return b.table({FlatBuilder::scalar(0, 8, 0), FlatBuilder::child(1, int32)});
+  };
+  fields.push_back(field("device", TYPE_UTF8, [](FlatBuilder& b) { return b.table({}); }, dictionary));
+  fields.push_back(field("timestamp", TYPE_TIMESTAMP, [](FlatBuilder& b) {
+    return b.table({FlatBuilder::scalar(0, 2, UNIT_MICROSECOND),
+                    FlatBuilder::child(1, [](FlatBuilder& b) { return b.string("UTC"); })});
+  }));
+  for (const char* name : FLOAT_NAMES) {
+    fields.push_back(field(name, TYPE_FLOATING_POINT, [](FlatBuilder& b) {
+      return b.table({FlatBuilder::scalar(0, 2, PRECISION_SINGLE)});
+    }));
+  }
+  return message(HEADER_SCHEMA, [=](FlatBuilder& b) {
+    return b.table({FlatBuilder::scalar(0, 2, 0),  // Little-endian
+                    FlatBuilder::child(1, [=](FlatBuilder& b) { return b.tables(fields); })});
+  }, 0);
+}
+
+Writer recordBatch(int64_t length, std::vector<std::pair<int64_t, int64_t>> nodes,
+                   std::vector<std::pair<int64_t, int64_t>> buffers) {
+  return [=](FlatBuilder& b) {
+    return b.table({FlatBuilder::scalar(0, 8, (uint64_t)length),
+                    FlatBuilder::child(1, [=](FlatBuilder& b) { return b.structs(nodes); }),
+                    FlatBuilder::child(2, [=](FlatBuilder& b) { return b.structs(buffers); })});
+  };
+}
+
+// Dictionary 0: the device names, in the order requested
+std::string dictionaryMessage(const std::vector<std::string>& names) {
+  std::string offsets;
+  std::string data;
+  put<int32_t>(offsets, 0);
+  for (const auto& name : names) {
+    data += name;
+    put<int32_t>(offsets, (int32_t)data.size());
+  }
+  int64_t dataAt = (int64_t)pad8(offsets.size());
+  int64_t bodyLength = dataAt + (int64_t)pad8(data.size());
+  Writer batch = recordBatch((int64_t)names.size(), {{(int64_t)names.size(), 0}},
+                             {{0, 0}, {0, (int64_t)offsets.size()}, {dataAt, (int64_t)data.size()}});
+  std::string out = message(HEADER_DICTIONARY_BATCH, [=](FlatBuilder& b) {
+    return b.table({FlatBuilder::scalar(0, 8, 0), FlatBuilder::child(1, batch)});
+  }, bodyLength);
+  out += offsets;
+  padTo8(out, offsets.size());
+  out += data;
+  padTo8(out, data.size());
+  return out;
+}
+
+// Body of a record batch of n rows: device indices, timestamps, floats,
+// each buffer starting 8-byte aligned
+struct BatchLayout {
+  uint64_t timestamps;
+  uint64_t floats[4];
+  uint64_t length;
+
+  explicit BatchLayout(uint64_t n) {
+    timestamps = pad8(4 * n);
+    uint64_t at = timestamps + 8 * n;
+    for (uint64_t& f : floats) {
+      f = at;
+      at += pad8(4 * n);
+    }
+    length = at;
+  }
+};
+
+std::string recordBatchMessage(uint64_t n) {
+  BatchLayout layout(n);
+  std::vector<std::pair<int64_t, int64_t>> nodes(6, {(int64_t)n, 0});
+  std::vector<std::pair<int64_t, int64_t>> buffers = {
+      {0, 0}, {0, (int64_t)(4 * n)},
+      {(int64_t)layout.timestamps, 0}, {(int64_t)layout.timestamps, (int64_t)(8 * n)}};
+  for (uint64_t f : layout.floats) {
+    buffers.push_back({(int64_t)f, 0});
+    buffers.push_back({(int64_t)f, (int64_t)(4 * n)});
+  }
+  return message(HEADER_RECORD_BATCH, recordBatch((int64_t)n, nodes, buffers), (int64_t)layout.length);
+}
+
+}  // namespace
+
+// ---------------------------------------------------------------------------
+// ColumnarExport
+// ---------------------------------------------------------------------------
+
+ColumnarExport::ColumnarExport(TimeSeriesStore& store, std::vector<std::string> devices,
+                               int64_t fromUs, int64_t toUs, ExportFormat format, size_t batchRows)
+  : _store(store), _fromUs(fromUs), _toUs(toUs), _format(format),
+    _batchRows(std::min(std::max(batchRows, (size_t)1), MAX_BATCH_ROWS)) {
+  auto none = [](const StoredRecord*, size_t) {};
+  for (auto& device : devices) {
+    uint64_t rows = store.scan(device, fromUs, toUs, none);
+    _rows += rows;
+    _parts.push_back(Part{std::move(device), rows});
+  }
+  if (format == ExportFormat::ARROW) {
+    std::vector<std::string> names;
+    for (const Part& p : _parts) names.push_back(p.device);
+    _prologue = schemaMessage() + dictionaryMessage(names);
+    _batchMetadataSize = recordBatchMessage(0).size();
+    _size = arrowSize();
+  } else {
+    _size = columnsSize();
+  }
+}
+
+const char* ColumnarExport::contentType(ExportFormat format) {
+  return format == ExportFormat::ARROW ? "application/vnd.apache.arrow.stream"
+                                       : "application/octet-stream";
+}
+
+uint64_t ColumnarExport::columnsSize() const {
+  uint64_t size = sizeof(COLUMNS_MAGIC) + 16;
+  for (const Part& p : _parts) size += 16 + pad8(p.device.size()) + 8 * p.rows + 4 * pad8(4 * p.rows);
+  return size;
+}
+
+uint64_t ColumnarExport::arrowSize() const {
+  uint64_t size = _prologue.size() + 8;
+  for (const Part& p : _parts) {
+    uint64_t full = p.rows / _batchRows;
+    uint64_t rest = p.rows % _batchRows;
+    size += full * (_batchMetadataSize + BatchLayout(_batchRows).length);
+    if (rest) size += _batchMetadataSize + BatchLayout(rest).length;
+  }
+  return size;
+}
+
+void ColumnarExport::rewind() {
+  _resumeUs = _fromUs;
+  _resumeSkip = 0;
+}
+
+template <typename Fn>
+uint64_t ColumnarExport::read(uint64_t count, Fn fn) {
+  uint64_t taken = 0;
+  uint64_t skip = _resumeSkip;
+  int64_t lastUs = _resumeUs;
+  uint64_t lastRun = _resumeSkip;  // Records at lastUs exported so far
+  _store.scan(_parts[_part].device, _resumeUs, _toUs, [&](const StoredRecord* records, size_t n) {
+    size_t i = 0;
+    while (skip > 0 && i < n && records[i].timestampUs == _resumeUs) {
+      i++;
+      skip--;
+    }
+    size_t k = (size_t)std::min<uint64_t>(n - i, count - taken);
+    if (k == 0) return;
+    fn(records + i, k);
+    taken += k;
+
+    // Equal timestamps may straddle pieces: remember how many were taken
+    int64_t last = records[i + k - 1].timestampUs;
+    size_t j = i + k - 1;
+    while (j > i && records[j - 1].timestampUs == last) j--;
+    if (j == i && last == lastUs) {
+      lastRun += k;
+    } else {
+      lastUs = last;
+      lastRun = i + k - j;
+    }
+  });
+  _resumeUs = lastUs;
+  _resumeSkip = lastRun;
+  return taken;
+}
+
+bool ColumnarExport::next(std::string& out, size_t maxBytes) {
+  return _format == ExportFormat::ARROW ? nextArrow(out) : nextColumns(out, maxBytes);
+}
+
+bool ColumnarExport::nextColumns(std::string& out, size_t maxBytes) {
+  size_t start = out.size();
+  while (_stage != DONE && out.size() - start < maxBytes) {
+    if (_stage == START) {
+      out.append(COLUMNS_MAGIC, sizeof(COLUMNS_MAGIC));
+      _stage = _parts.empty() ? END : PARTS;
+      continue;
+    }
+    if (_stage == END) {
+      put<uint64_t>(out, 0);
+      put<uint32_t>(out, 0);
+      put<uint32_t>(out, 0);
+      _stage = DONE;
+      break;
+    }
+
+    const Part& part = _parts[_part];
+    if (_column < 0) {
+      put<uint64_t>(out, part.rows);
+      put<uint32_t>(out, (uint32_t)part.device.size());
+      put<uint32_t>(out, 0);
+      out += part.device;
+      padTo8(out, part.device.size());
+      _column = 0;
+      _written = 0;
+      rewind();
+      continue;
+    }
+
+    // One pass over the range per column
+    size_t width = _column == 0 ? 8 : 4;
+    size_t offset = _column == 0 ? offsetof(StoredRecord, timestampUs) : FLOAT_OFFSET[_column - 1];
+    uint64_t room = std::max<uint64_t>(1, (maxBytes - (out.size() - start)) / width);
+    uint64_t want = std::min(part.rows - _written, room);
+    if (want > 0) {
+      size_t at = out.size();
+      out.resize(at + want * width);
+      char* dst = &out[at];
+      uint64_t got = read(want, [&](const StoredRecord* records, size_t n) {
+        gather(dst, records, n, offset, width);
+        dst += n * width;
+      });
+      if (got < want) {
+        out.resize(at + got * width);
+        return false;
+      }
+      _written += got;
+    }
+    if (_written < part.rows) continue;
+
+    padTo8(out, part.rows * width);
+    _written = 0;
+    rewind();
+    if (++_column == FIELDS) {
+      _column = -1;
+      if (++_part == _parts.size()) _stage = END;
+    }
+  }
+  return true;
+}
+
+bool ColumnarExport::nextArrow(std::string& out) {
+  if (_stage == START) {
+    out += _prologue;
+    _stage = PARTS;
+    _part = 0;
+    _written = 0;
+    rewind();
+  }
+  while (_stage == PARTS && (_part == _parts.size() || _written == _parts[_part].rows)) {
+    if (_part == _parts.size() || ++_part == _parts.size()) {
+      _stage = END;
+      break;
+    }
+    _written = 0;
+    rewind();
+  }
+  if (_stage == END) {
+    put<uint32_t>(out, 0xFFFFFFFFu);
+    put<uint32_t>(out, 0);
+    _stage = DONE;
+    return true;
+  }
+  if (_stage == DONE) return true;
+
+  // One record batch; every row has the part's dictionary index
+  uint64_t n = std::min<uint64_t>(_batchRows, _parts[_part].rows - _written);
+  BatchLayout layout(n);
+  out += recordBatchMessage(n);
+  size_t body = out.size();
+  out.resize(body + layout.length, '\0');
+  int32_t index = (int32_t)_part;
+  for (uint64_t i = 0; i < n; i++) memcpy(&out[body + 4 * i], &index, 4);
+
+  uint64_t row = 0;
+  uint64_t got = read(n, [&](const StoredRecord* records, size_t count) {
+    gather(&out[body + layout.timestamps + 8 * row], records, count,
+           offsetof(StoredRecord, timestampUs), 8);
+    for (int f = 0; f < 4; f++) {
+      gather(&out[body + layout.floats[f] + 4 * row], records, count, FLOAT_OFFSET[f], 4);
+    }
+    row += count;
+  });
+  if (got < n) return false;
+  _written += n;
+  return true;
+}
@@ -0,0 +1,96 @@
+#ifndef SENSOR_SERVER_COLUMNAR_EXPORT_H
+#define SENSOR_SERVER_COLUMNAR_EXPORT_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "timeseries_store.h"
+
+// Bulk export of stored readings as columnar binary, for /api/export.
+//
+// Records are read straight from the store's mmap()ed segments and their
+// fields copied into contiguous arrays; nothing is built per row. The
+// export is produced a piece at a time as the client drains it, and its
+// exact size is known before the first byte (the range is counted
+// first, and only the records counted are exported), so it can be sent
+// with a Content-Length.
+//
+// COLUMNS (application/octet-stream), little-endian:
+//
+//   "WTCOL001"
+//   per device, in the order requested:
+//     uint64 rows, uint32 name length, uint32 0
+//     name, zero-padded to a multiple of 8 bytes
+//     int64   timestamp_us[rows]     Unix microseconds
+//     float32 voltage[rows]          each array zero-padded to a multiple
+//     float32 pressure_kpa[rows]     of 8 bytes
+//     float32 water_depth_m[rows]
+//     float32 volume_liters[rows]
+//   uint64 0, uint32 0, uint32 0     end (a block with an empty name)
+//
+// ARROW (application/vnd.apache.arrow.stream): an Arrow IPC stream with
+// columns device (dictionary-encoded string), timestamp (timestamp[us,
+// tz=UTC]) and the four float32 fields, in record batches of up to
+// batchRows rows of one device each.
+
+enum class ExportFormat { COLUMNS, ARROW };
+
+class ColumnarExport {
+public:
+  static const size_t DEFAULT_BATCH_ROWS = 65536;
+  static const size_t MAX_BATCH_ROWS = 1 << 18;
+
+  ColumnarExport(TimeSeriesStore& store, std::vector<std::string> devices, int64_t fromUs,
+                 int64_t toUs, ExportFormat format, size_t batchRows = DEFAULT_BATCH_ROWS);
+
+  static const char* contentType(ExportFormat format);
+
+  uint64_t rows() const { return _rows; }
+  uint64_t size() const { return _size; }
+  bool done() const { return _stage == DONE; }
+
+  // Appends the next piece of the export to out: about maxBytes of
+  // COLUMNS output, or one Arrow record batch. Returns false if the store
+  // gave fewer records than were counted, which leaves the output short.
+  bool next(std::string& out, size_t maxBytes);
+
+private:
+  enum Stage { START, PARTS, END, DONE };
+
+  struct Part {
+    std::string device;
+    uint64_t rows;
+  };
+
+  // Up to `count` records of the current part from where the last read
+  // stopped, passed to fn in runs. Returns the number read.
+  template <typename Fn>
+  uint64_t read(uint64_t count, Fn fn);
+  void rewind();
+
+  bool nextColumns(std::string& out, size_t maxBytes);
+  bool nextArrow(std::string& out);
+  uint64_t columnsSize() const;
+  uint64_t arrowSize() const;
+
+  TimeSeriesStore& _store;
+  int64_t _fromUs;
+  int64_t _toUs;
+  ExportFormat _format;
+  size_t _batchRows;
+  std::vector<Part> _parts;
+  uint64_t _rows = 0;
+  uint64_t _size = 0;
+  std::string _prologue;  // Arrow schema and dictionary messages
+  size_t _batchMetadataSize = 0;
+
+  Stage _stage = START;
+  size_t _part = 0;
+  int _column = -1;  // COLUMNS: -1 for the part header
+  uint64_t _written = 0;  // Rows of the current column or part
+  int64_t _resumeUs = 0;  // Next read starts here...
+  uint64_t _resumeSkip = 0;  // ...after this many records at exactly _resumeUs
+};
+
+#endif
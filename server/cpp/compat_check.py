@@ -0,0 +1,239 @@
+#!/usr/bin/env python3
+"""
+Wire-compatibility check: C++ sensor server vs the Python server.
+
+Starts both servers on spare ports with their own log files, replays the
+same requests against each over raw sockets and compares status lines,
+headers (except Server/Date), bodies and log lines. Timestamps are
+replaced by a placeholder before comparing.
+
+Usage: python3 compat_check.py ./sensor_server ../python/sensor_server.py
+"""
+
+import base64
+import json
+import os
+import re
+import socket
+import struct
+import subprocess
+import sys
+import tempfile
+import time
+
+TIMESTAMP = re.compile(r'\d{4}-\d\d-\d\dT\d\d:\d\d:\d\d(\.\d{6})?')
+
+
+def post_batch(body):
+    return (b'POST /update/batch HTTP/1.1\r\nContent-Type: text/csv\r\nContent-Length: %d\r\n\r\n'
+            % len(body)) + body
+
+
+# (description, raw request)
+CASES = [
+    ('firmware /update', b'GET /update?depth=1.500&pressure=14.71&volume=11.78 HTTP/1.1\r\nHost: x\r\n\r\n'),
+    ('sensor-data all fields', b'GET /api/sensor-data?voltage=2.345&pressure_kpa=9.5&water_depth_m=0.969&volume_liters=7.61 HTTP/1.1\r\n\r\n'),
+    ('full names win over aliases', b'GET /update?depth=1&water_depth_m=2&depth=3 HTTP/1.1\r\n\r\n'),
+    ('float repr edge cases', b'GET /api/sensor-data?voltage=1e-5&pressure_kpa=0.0001&water_depth_m=1e16&volume_liters=-0 HTTP/1.1\r\n\r\n'),
+    ('float parsing', b'GET /api/sensor-data?voltage=+2.5%20&pressure_kpa=1_000&water_depth_m=inf&volume_liters=12345678901234567890 HTTP/1.1\r\n\r\n'),
+    ('blank and bare params', b'GET /update?depth=&pressure&volume=5#frag HTTP/1.1\r\n\r\n'),
+    ('bad float', b'GET /api/sensor-data?voltage=abc HTTP/1.1\r\n\r\n'),
+    ('batch', post_batch(b'100,1234,1471,1500,1178\r\n\r\n0, 1 ,2,3,+4\n\x0c\n')),
+    ('short batch row', post_batch(b'1,2,3\n')),
+    ('multi-tank batch', post_batch(b'100,1234,1471,1500,1178\n100,2000,800,815,640,1\n0,1,2,3,4, 2 \n')),
+    ('batch volume past 16 bits', post_batch(b'100,1234,1471,900,270150\n0,1234,1471,899,4294967295,1\n')),
+    ('bad tank', post_batch(b'1,2,3,4,5,x\n')),
+    ('long batch row', post_batch(b'1,2,3,4,5,6,7\n')),
+    ('non-numeric batch', post_batch(b'1,2,x,4,5\n')),
+    ('readings', b'GET /api/readings HTTP/1.1\r\n\r\n'),
+    ('latest', b'GET /api/latest?x=1 HTTP/1.1\r\n\r\n'),
+    ('dashboard', b'GET / HTTP/1.1\r\n\r\n'),
+    ('unknown path', b'GET /nope HTTP/1.1\r\n\r\n'),
+    ('unknown POST path', b'POST /update HTTP/1.1\r\nContent-Length: 0\r\n\r\n'),
+    ('unsupported method', b'PUT /update HTTP/1.1\r\n\r\n'),
+    ('HTTP/1.0 closes', b'GET /api/latest HTTP/1.0\r\n\r\n'),
+]
+
+
+def lora_uplink(event, body):
+    return (b'POST /api/lora/uplink?event=%s HTTP/1.1\r\nContent-Type: application/json\r\n'
+            b'Content-Length: %d\r\n\r\n' % (event, len(body))) + body
+
+
+def check_lora_uplink(port):
+    """C++ only: a ChirpStack HTTP integration uplink lands in the history store once"""
+    payload = base64.b64encode(struct.pack('>4H', 2345, 950, 969, 761)).decode()
+    event = json.dumps({'time': '2025-01-02T03:04:05Z', 'fPort': 1, 'data': payload,
+                        'deviceInfo': {'deviceName': 'lora-1', 'devEui': '0011223344556677'}})
+    first = exchange(port, lora_uplink(b'up', event.encode()))
+    replay = exchange(port, lora_uplink(b'up', event.encode()))
+    join = exchange(port, lora_uplink(b'join', b'{}'))
+    bad = exchange(port, lora_uplink(b'up', event.replace('"fPort": 1', '"fPort": 9').encode()))
+    history = exchange(port, b'GET /api/readings?device=lora-1&from=1735787000&to=1735787100'
+                             b'&resolution=raw HTTP/1.1\r\n\r\n')
+    points = json.loads(history.partition(b'\r\n\r\n')[2])['points']
+    return (b'"stored": 1, "duplicates": 0' in first and b'"stored": 0, "duplicates": 1' in replay
+            and b'"ignored"' in join and bad.startswith(b'HTTP/1.1 400 ') and len(points) == 1
+            and points[0]['volume_liters'] == 7.61 and points[0]['timestamp'].startswith('2025-01-0'))
+
+
+def free_port():
+    with socket.socket() as s:
+        s.bind(('127.0.0.1', 0))
+        return s.getsockname()[1]
+
+
+def wait_for(port):
+    for _ in range(100):
+        try:
+            socket.create_connection(('127.0.0.1', port), timeout=0.2).close()
+            return
+        except OSError:
+            time.sleep(0.05)
+    raise RuntimeError(f'server on port {port} did not start')
+
+
+def exchange(port, raw):
+    """Send one request on a fresh connection and read until the response is complete"""
+    with socket.create_connection(('127.0.0.1', port), timeout=5) as s:
+        s.sendall(raw)
+        data = b''
+        while True:
+            head, sep, body = data.partition(b'\r\n\r\n')
+            if sep:
+                m = re.search(rb'content-length: *(\d+)', head, re.I)
+                if m and len(body) >= int(m.group(1)):
+                    break
+            chunk = s.recv(65536)
+            if not chunk:
+                break
+            data += chunk
+    return data
+
+
+def read_event(s, data):
+    """Read up to the end of the next server-sent event; returns (event, rest)"""
+    while b'\n\n' not in data:
+        chunk = s.recv(65536)
+        if not chunk:
+            raise RuntimeError('stream closed')
+        data += chunk
+    event, _, rest = data.partition(b'\n\n')
+    return event + b'\n\n', rest
+
+
+def stream(port, trigger):
+    """Open /api/stream, then send trigger on another connection.
+
+    Returns the response head, the snapshot event and the event the trigger
+    produced.
+    """
+    with socket.create_connection(('127.0.0.1', port), timeout=5) as s:
+        s.sendall(b'GET /api/stream HTTP/1.1\r\n\r\n')
+        data = b''
+        while b'\r\n\r\n' not in data:
+            data += s.recv(65536)
+        head, _, data = data.partition(b'\r\n\r\n')
+        retry, data = read_event(s, data)
+        snapshot, data = read_event(s, data)
+        exchange(port, trigger)
+        update, _ = read_event(s, data)
+    return normalise(head + b'\r\n\r\n' + retry), TIMESTAMP.sub('<ts>', snapshot.decode()), \
+        TIMESTAMP.sub('<ts>', update.decode())
+
+
+def normalise(response):
+    head, _, body = response.partition(b'\r\n\r\n')
+    lines = head.decode('latin-1').split('\r\n')
+    headers = [h for h in lines[1:] if not h.lower().startswith(('server:', 'date:'))]
+    body = TIMESTAMP.sub('<ts>', body.decode('utf-8', 'replace'))
+    return [lines[0]] + headers, body
+
+
+def start_cpp(binary, port, log):
+    store = os.path.join(os.path.dirname(log), 'store')
+    return subprocess.Popen([binary, '-p', str(port), '-l', log, '-s', store, '-t', '2', '-q'],
+                            stdout=subprocess.DEVNULL, stderr=subprocess.DEVNULL)
+
+
+def start_python(script, port, log):
+    code = ('import sys; sys.path.insert(0, sys.argv[1]); import sensor_server as s; '
+            f's.PORT = {port}; s.LOG_FILE = {log!r}; s.run_server()')
+    return subprocess.Popen([sys.executable, '-c', code, os.path.dirname(os.path.abspath(script))],
+                            stdout=subprocess.DEVNULL, stderr=subprocess.DEVNULL)
+
+
+def main():
+    if len(sys.argv) != 3:
+        print(__doc__)
+        return 2
+    binary, script = sys.argv[1], sys.argv[2]
+
+    tmp = tempfile.mkdtemp()
+    cpp_port, py_port = free_port(), free_port()
+    cpp_log, py_log = os.path.join(tmp, 'cpp.log'), os.path.join(tmp, 'py.log')
+    servers = [start_cpp(binary, cpp_port, cpp_log), start_python(script, py_port, py_log)]
+
+    failures = 0
+    try:
+        wait_for(cpp_port)
+        wait_for(py_port)
+        for name, raw in CASES:
+            cpp = normalise(exchange(cpp_port, raw))
+            py = normalise(exchange(py_port, raw))
+            if cpp == py:
+                print(f'ok    {name}')
+            else:
+                failures += 1
+                print(f'FAIL  {name}\n  python: {py}\n  c++:    {cpp}')
+
+        # Pipelined keep-alive requests on one connection
+        pipelined = CASES[0][1] + CASES[-1][1].replace(b'1.0', b'1.1')
+        with socket.create_connection(('127.0.0.1', cpp_port), timeout=5) as s:
+            s.sendall(pipelined)
+            time.sleep(0.3)
+            data = s.recv(65536)
+        if data.count(b'HTTP/1.1 200 OK') == 2:
+            print('ok    pipelined keep-alive')
+        else:
+            failures += 1
+            print(f'FAIL  pipelined keep-alive: {data!r}')
+
+        time.sleep(0.3)  # Let the C++ log writer flush
+        with open(cpp_log) as f:
+            cpp_lines = [TIMESTAMP.sub('<ts>', l) for l in f][:-1]  # minus the pipelined reading
+        with open(py_log) as f:
+            py_lines = [TIMESTAMP.sub('<ts>', l) for l in f]
+        if cpp_lines == py_lines:
+            print(f'ok    log file ({len(py_lines)} lines)')
+        else:
+            failures += 1
+            print(f'FAIL  log file\n  python: {py_lines}\n  c++:    {cpp_lines}')
+
+        # Dashboard push: snapshot, then one event with just the new batch.
+        # The Python server gets the pipelined reading first to match.
+        exchange(py_port, CASES[0][1])
+        trigger = dict(CASES)['multi-tank batch']
+        cpp, py = stream(cpp_port, trigger), stream(py_port, trigger)
+        if cpp == py and py[2].startswith('event: readings\ndata: [{') and py[2].count('"tank"') == 2:
+            print('ok    event stream')
+        else:
+            failures += 1
+            print(f'FAIL  event stream\n  python: {py}\n  c++:    {cpp}')
+
+        if check_lora_uplink(cpp_port):
+            print('ok    LoRa uplink endpoint (C++ only)')
+        else:
+            failures += 1
+            print('FAIL  LoRa uplink endpoint (C++ only)')
+    finally:
+        for p in servers:
+            p.terminate()
+            p.wait()
+
+    print(f'\n{len(CASES) + 4 - failures}/{len(CASES) + 4} checks passed')
+    return 1 if failures else 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
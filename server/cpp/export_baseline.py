@@ -0,0 +1,46 @@
+#!/usr/bin/env python3
+"""
+Baseline for export_bench: the Python server's only way to hand out
+readings, json.dumps(list(recent_readings)), timed in rows/s over rows
+shaped like the ones it stores.
+
+Usage: python3 export_baseline.py [rows] [repeats]
+"""
+
+from collections import deque
+from datetime import datetime, timedelta
+import json
+import sys
+import time
+
+
+def main():
+    rows = int(sys.argv[1]) if len(sys.argv) > 1 else 200000
+    repeats = int(sys.argv[2]) if len(sys.argv) > 2 else 3
+
+    start = datetime(2025, 1, 1)
+    recent_readings = deque(maxlen=rows)
+    for i in range(rows):
+        level = 1.0 + (i % 8640) / 8640.0
+        recent_readings.append({
+            'voltage': 1.5 + level * 0.1,
+            'pressure_kpa': level * 9.81,
+            'water_depth_m': level,
+            'volume_liters': level * 1500.0,
+            'timestamp': (start + timedelta(seconds=5 * i)).isoformat()
+        })
+
+    best = None
+    for _ in range(repeats):
+        t = time.perf_counter()
+        body = json.dumps(list(recent_readings)).encode()
+        elapsed = time.perf_counter() - t
+        best = elapsed if best is None else min(best, elapsed)
+
+    print(f"{rows} rows, Python json.dumps(list(recent_readings))")
+    print(f"{'format':<8} {'rows/s':>12} {'MB/s':>10} {'B/row':>10}")
+    print(f"{'json':<8} {rows / best:12.0f} {len(body) / 1e6 / best:10.1f} {len(body) / rows:10.1f}")
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,126 @@
+// Throughput of /api/export (ColumnarExport), in rows/s.
+//
+// Fills a store in a temp dir with -n days of readings every 5 s for each
+// of -d devices, then times exporting all of them, in 256 KB pieces as
+// the server sends them (each piece dropped once produced):
+//
+//   columns   the WTCOL001 column layout
+//   arrow     Arrow IPC stream, record batches of 65536 rows
+//
+// Compare with export_baseline.py, which times the Python server's
+// json.dumps(list(recent_readings)) over the same kind of rows.
+//
+// Usage: export_bench [-d devices] [-n days] [-r repeats]
+
+#include <unistd.h>
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+#include "columnar_export.h"
+#include "timeseries_store.h"
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+const int64_t START_US = 1735689600LL * 1000000;  // 2025-01-01
+const int64_t INTERVAL_US = 5000000;
+const size_t PIECE_BYTES = 256 * 1024;
+
+struct Run {
+  uint64_t rows = 0;
+  uint64_t bytes = 0;
+  double seconds = 0;
+};
+
+Run run(TimeSeriesStore& store, const std::vector<std::string>& devices, ExportFormat format) {
+  Run r;
+  std::string out;
+  auto start = Clock::now();
+  ColumnarExport exporter(store, devices, INT64_MIN, INT64_MAX, format);
+  while (!exporter.done()) {
+    if (!exporter.next(out, PIECE_BYTES)) fprintf(stderr, "short export\n");
+    r.bytes += out.size();
+    out.clear();
+  }
+  r.seconds = std::chrono::duration<double>(Clock::now() - start).count();
+  r.rows = exporter.rows();
+  if (r.bytes != exporter.size()) fprintf(stderr, "size mismatch\n");
+  return r;
+}
+
+void removeTree(const std::string& dir) {
+  std::string cmd = "rm -rf '" + dir + "'";
+  if (system(cmd.c_str()) != 0) fprintf(stderr, "could not remove %s\n", dir.c_str());
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  int devices = 4;
+  int days = 30;
+  int repeats = 3;
+
+  int opt;
+  while ((opt = getopt(argc, argv, "d:n:r:h")) != -1) {
+    switch (opt) {
+      case 'd': devices = atoi(optarg); break;
+      case 'n': days = atoi(optarg); break;
+      case 'r': repeats = atoi(optarg); break;
+      default:
+        fprintf(stderr, "Usage: %s [-d devices] [-n days] [-r repeats]\n", argv[0]);
+        return opt == 'h' ? 0 : 2;
+    }
+  }
+  if (devices < 1) devices = 1;
+  if (days < 1) days = 1;
+  if (repeats < 1) repeats = 1;
+
+  char path[] = "/tmp/export_bench_XXXXXX";
+  std::string dir = mkdtemp(path);
+  TimeSeriesStore store(dir);
+  std::string error;
+  if (!store.open(error)) {
+    fprintf(stderr, "Could not open store: %s\n", error.c_str());
+    return 1;
+  }
+
+  const size_t perDevice = (size_t)days * 86400000000LL / INTERVAL_US;
+  std::vector<std::string> names;
+  std::vector<StoredRecord> records(perDevice);
+  for (int d = 0; d < devices; d++) {
+    names.push_back("tank-" + std::to_string(d));
+    for (size_t i = 0; i < perDevice; i++) {
+      float level = 1.0f + (float)((i + (size_t)d * 977) % 8640) / 8640.0f;
+      records[i] = StoredRecord{START_US + (int64_t)i * INTERVAL_US, 1.5f + level * 0.1f,
+                                level * 9.81f, level, level * 1500.0f};
+    }
+    if (!store.append(names.back(), records.data(), records.size())) {
+      fprintf(stderr, "Could not append\n");
+      return 1;
+    }
+  }
+  // A first pass so every run reads from the page cache
+  run(store, names, ExportFormat::COLUMNS);
+
+  printf("%zu rows (%d devices x %d days at 5 s), %.1f MB stored\n", perDevice * devices,
+         devices, days, perDevice * devices * sizeof(StoredRecord) / 1e6);
+  printf("%-8s %12s %10s %10s\n", "format", "rows/s", "MB/s", "B/row");
+
+  const char* formats[] = {"columns", "arrow"};
+  for (int f = 0; f < 2; f++) {
+    Run best;
+    for (int i = 0; i < repeats; i++) {
+      Run r = run(store, names, f == 0 ? ExportFormat::COLUMNS : ExportFormat::ARROW);
+      if (i == 0 || r.seconds < best.seconds) best = r;
+    }
+    printf("%-8s %12.0f %10.1f %10.1f\n", formats[f], best.rows / best.seconds,
+           best.bytes / 1e6 / best.seconds, (double)best.bytes / best.rows);
+  }
+  removeTree(dir);
+  return 0;
+}
@@ -0,0 +1,332 @@
+// Tests for ColumnarExport: both layouts decoded back and compared with the
+// store's records, across segments, duplicate timestamps that straddle
+// pieces, several devices, and records appended while an export runs.
+//
+// Build and run: make check
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "columnar_export.h"
+#include "timeseries_store.h"
+#include "test_util.h"
+
+namespace {
+
+const int64_t START_US = 1700000000LL * 1000000;
+
+// One reading every 5 s, with runs of equal timestamps long enough to
+// straddle export pieces
+std::vector<StoredRecord> makeTrace(size_t count, float seed) {
+  std::vector<StoredRecord> trace(count);
+  int64_t t = START_US;
+  for (size_t i = 0; i < count; i++) {
+    if (i % 50 >= 20) t += 5000000;
+    trace[i] = StoredRecord{t, seed + 2.5f, (float)i * 0.01f, (float)i * 0.001f, seed + (float)i};
+  }
+  return trace;
+}
+
+std::vector<StoredRecord> scanAll(TimeSeriesStore& store, const std::string& device,
+                                  int64_t from, int64_t to) {
+  std::vector<StoredRecord> out;
+  store.scan(device, from, to, [&](const StoredRecord* r, size_t count) {
+    out.insert(out.end(), r, r + count);
+  });
+  return out;
+}
+
+std::string exportAll(ColumnarExport& exporter, size_t maxBytes) {
+  std::string out;
+  while (!exporter.done()) {
+    size_t before = out.size();
+    CHECK(exporter.next(out, maxBytes));
+    CHECK(out.size() > before);
+  }
+  CHECK(out.size() == exporter.size());
+  return out;
+}
+
+bool sameRecords(const std::vector<StoredRecord>& a, const std::vector<StoredRecord>& b) {
+  return a.size() == b.size() &&
+         (a.empty() || memcmp(a.data(), b.data(), a.size() * sizeof(StoredRecord)) == 0);
+}
+
+template <typename T>
+T at(const std::string& buf, size_t pos) {
+  T value{};
+  if (pos + sizeof(T) <= buf.size()) memcpy(&value, buf.data() + pos, sizeof(T));
+  return value;
+}
+
+// ---------------------------------------------------------------------------
+// COLUMNS decoder
+// ---------------------------------------------------------------------------
+
+struct ColumnsPart {
+  std::string device;
+  std::vector<StoredRecord> records;
+};
+
+size_t pad8(size_t n) {
+  return (n + 7) & ~(size_t)7;
+}
+
+bool decodeColumns(const std::string& buf, std::vector<ColumnsPart>& parts) {
+  if (buf.compare(0, 8, "WTCOL001") != 0) return false;
+  size_t pos = 8;
+  while (true) {
+    uint64_t rows = at<uint64_t>(buf, pos);
+    uint32_t nameLength = at<uint32_t>(buf, pos + 8);
+    pos += 16;
+    if (nameLength == 0) return rows == 0 && pos == buf.size();
+    ColumnsPart part;
+    part.device = buf.substr(pos, nameLength);
+    pos += pad8(nameLength);
+    part.records.resize(rows);
+    for (uint64_t i = 0; i < rows; i++) part.records[i].timestampUs = at<int64_t>(buf, pos + 8 * i);
+    pos += 8 * rows;
+    float StoredRecord::*fields[] = {&StoredRecord::voltage, &StoredRecord::pressureKpa,
+                                     &StoredRecord::depthM, &StoredRecord::volumeL};
+    for (auto field : fields) {
+      for (uint64_t i = 0; i < rows; i++) part.records[i].*field = at<float>(buf, pos + 4 * i);
+      pos += pad8(4 * rows);
+    }
+    if (pos > buf.size()) return false;
+    parts.push_back(std::move(part));
+  }
+}
+
+// ---------------------------------------------------------------------------
+// Arrow decoder: just enough FlatBuffers to walk the Message tables
+// ---------------------------------------------------------------------------
+
+// Position of a table's field, 0 if absent
+size_t fieldPos(const std::string& fb, size_t table, int id) {
+  size_t vtable = table - (size_t)at<int32_t>(fb, table);
+  uint16_t vtableSize = at<uint16_t>(fb, vtable);
+  if (4 + 2 * (size_t)id >= vtableSize) return 0;
+  uint16_t offset = at<uint16_t>(fb, vtable + 4 + 2 * (size_t)id);
+  return offset ? table + offset : 0;
+}
+
+size_t deref(const std::string& fb, size_t pos) {
+  return pos + at<uint32_t>(fb, pos);
+}
+
+struct ArrowMessage {
+  uint8_t headerType = 0;
+  std::string meta;
+  size_t header = 0;  // Position of the header table in meta
+  std::string body;
+};
+
+// Reads messages up to the end-of-stream marker
+bool readArrow(const std::string& buf, std::vector<ArrowMessage>& messages) {
+  size_t pos = 0;
+  while (true) {
+    if (at<uint32_t>(buf, pos) != 0xFFFFFFFFu) return false;
+    int32_t length = at<int32_t>(buf, pos + 4);
+    pos += 8;
+    if (length == 0) return pos == buf.size();
+    if (length % 8 != 0 || pos + (size_t)length > buf.size()) return false;
+
+    ArrowMessage m;
+    m.meta = buf.substr(pos, (size_t)length);
+    pos += (size_t)length;
+    size_t root = deref(m.meta, 0);
+    if (at<uint16_t>(m.meta, fieldPos(m.meta, root, 0)) != 4) return false;  // V5
+    m.headerType = at<uint8_t>(m.meta, fieldPos(m.meta, root, 1));
+    m.header = deref(m.meta, fieldPos(m.meta, root, 2));
+    size_t bodyAt = fieldPos(m.meta, root, 3);
+    int64_t bodyLength = bodyAt ? at<int64_t>(m.meta, bodyAt) : 0;
+    if (bodyLength % 8 != 0 || pos + (size_t)bodyLength > buf.size()) return false;
+    m.body = buf.substr(pos, (size_t)bodyLength);
+    pos += (size_t)bodyLength;
+    messages.push_back(std::move(m));
+  }
+}
+
+// Buffer i (offset, length) of a RecordBatch table
+std::pair<int64_t, int64_t> arrowBuffer(const std::string& fb, size_t batch, size_t i) {
+  size_t vec = deref(fb, fieldPos(fb, batch, 2));
+  return {at<int64_t>(fb, vec + 4 + 16 * i), at<int64_t>(fb, vec + 12 + 16 * i)};
+}
+
+std::string fbString(const std::string& fb, size_t pos) {
+  size_t s = deref(fb, pos);
+  return fb.substr(s + 4, at<uint32_t>(fb, s));
+}
+
+// Decodes the record batches into per-dictionary-index records
+bool decodeArrow(const std::string& buf, std::vector<std::string>& names,
+                 std::vector<std::vector<StoredRecord>>& records, size_t& batches) {
+  std::vector<ArrowMessage> messages;
+  if (!readArrow(buf, messages) || messages.size() < 2) return false;
+
+  // Schema: six fields, device dictionary-encoded
+  const ArrowMessage& schema = messages[0];
+  if (schema.headerType != 1) return false;
+  size_t fields = deref(schema.meta, fieldPos(schema.meta, schema.header, 1));
+  if (at<uint32_t>(schema.meta, fields) != 6) return false;
+  const char* expected[] = {"device", "timestamp", "voltage", "pressure_kpa", "water_depth_m",
+                            "volume_liters"};
+  for (size_t i = 0; i < 6; i++) {
+    size_t field = deref(schema.meta, fields + 4 + 4 * i);
+    if (fbString(schema.meta, fieldPos(schema.meta, field, 0)) != expected[i]) return false;
+    if ((fieldPos(schema.meta, field, 4) != 0) != (i == 0)) return false;
+  }
+
+  // Dictionary: offsets then the names' bytes
+  const ArrowMessage& dict = messages[1];
+  if (dict.headerType != 2) return false;
+  size_t data = deref(dict.meta, fieldPos(dict.meta, dict.header, 1));
+  int64_t count = at<int64_t>(dict.meta, fieldPos(dict.meta, data, 0));
+  auto offsets = arrowBuffer(dict.meta, data, 1);
+  auto bytes = arrowBuffer(dict.meta, data, 2);
+  names.clear();
+  for (int64_t i = 0; i < count; i++) {
+    int32_t a = at<int32_t>(dict.body, (size_t)(offsets.first + 4 * i));
+    int32_t b = at<int32_t>(dict.body, (size_t)(offsets.first + 4 * (i + 1)));
+    names.push_back(dict.body.substr((size_t)(bytes.first + a), (size_t)(b - a)));
+  }
+  records.assign(names.size(), {});
+
+  batches = 0;
+  for (size_t m = 2; m < messages.size(); m++) {
+    const ArrowMessage& msg = messages[m];
+    if (msg.headerType != 3) return false;
+    int64_t rows = at<int64_t>(msg.meta, fieldPos(msg.meta, msg.header, 0));
+    auto indices = arrowBuffer(msg.meta, msg.header, 1);
+    auto timestamps = arrowBuffer(msg.meta, msg.header, 3);
+    if (indices.second != 4 * rows || timestamps.second != 8 * rows) return false;
+    for (int64_t r = 0; r < rows; r++) {
+      int32_t index = at<int32_t>(msg.body, (size_t)(indices.first + 4 * r));
+      if (index < 0 || (size_t)index >= names.size()) return false;
+      StoredRecord rec;
+      rec.timestampUs = at<int64_t>(msg.body, (size_t)(timestamps.first + 8 * r));
+      float StoredRecord::*floats[] = {&StoredRecord::voltage, &StoredRecord::pressureKpa,
+                                       &StoredRecord::depthM, &StoredRecord::volumeL};
+      for (size_t f = 0; f < 4; f++) {
+        auto buffer = arrowBuffer(msg.meta, msg.header, 5 + 2 * f);
+        if (buffer.first % 8 != 0) return false;
+        rec.*floats[f] = at<float>(msg.body, (size_t)(buffer.first + 4 * r));
+      }
+      records[(size_t)index].push_back(rec);
+    }
+    batches++;
+  }
+  return true;
+}
+
+// ---------------------------------------------------------------------------
+// Tests
+// ---------------------------------------------------------------------------
+
+struct Fixture {
+  TempDir tmp{"export_test"};
+  std::string dir = tmp.path();
+  TimeSeriesStore store{dir, 1000};  // Small segments: exports cross several
+  std::vector<StoredRecord> a = makeTrace(3210, 0.0f);
+  std::vector<StoredRecord> b = makeTrace(77, 100.0f);
+
+  Fixture() {
+    std::string error;
+    CHECK(store.open(error));
+    CHECK(store.append("tank-a", a.data(), a.size()));
+    CHECK(store.append("tank-b", b.data(), b.size()));
+  }
+};
+
+void testColumnsMatchStore() {
+  Fixture f;
+  const int64_t from = f.a[25].timestampUs;
+  const int64_t to = f.a[3000].timestampUs;
+  std::vector<std::string> devices = {"tank-b", "tank-a", "missing"};
+  std::vector<StoredRecord> expectA = scanAll(f.store, "tank-a", from, to);
+  std::vector<StoredRecord> expectB = scanAll(f.store, "tank-b", from, to);
+
+  // Pieces from one record to a whole column at a time
+  for (size_t maxBytes : {1, 100, 4096, 1 << 20}) {
+    ColumnarExport exporter(f.store, devices, from, to, ExportFormat::COLUMNS);
+    CHECK(exporter.rows() == expectA.size() + expectB.size());
+    std::string out = exportAll(exporter, maxBytes);
+    std::vector<ColumnsPart> parts;
+    CHECK(decodeColumns(out, parts));
+    CHECK(parts.size() == 3);
+    if (parts.size() != 3) continue;
+    CHECK(parts[0].device == "tank-b" && sameRecords(parts[0].records, expectB));
+    CHECK(parts[1].device == "tank-a" && sameRecords(parts[1].records, expectA));
+    CHECK(parts[2].device == "missing" && parts[2].records.empty());
+  }
+}
+
+void testArrowMatchesStore() {
+  Fixture f;
+  std::vector<std::string> devices = {"tank-a", "tank-b"};
+  for (size_t batchRows : {1, 37, 1000, 65536}) {
+    ColumnarExport exporter(f.store, devices, INT64_MIN, INT64_MAX, ExportFormat::ARROW, batchRows);
+    CHECK(exporter.rows() == f.a.size() + f.b.size());
+    std::string out = exportAll(exporter, 0);
+    std::vector<std::string> names;
+    std::vector<std::vector<StoredRecord>> records;
+    size_t batches = 0;
+    CHECK(decodeArrow(out, names, records, batches));
+    CHECK(names == devices);
+    if (records.size() != 2) continue;
+    CHECK(sameRecords(records[0], f.a));
+    CHECK(sameRecords(records[1], f.b));
+    CHECK(batches == (f.a.size() + batchRows - 1) / batchRows + (f.b.size() + batchRows - 1) / batchRows);
+  }
+}
+
+void testEmptyExports() {
+  Fixture f;
+  ColumnarExport columns(f.store, {}, INT64_MIN, INT64_MAX, ExportFormat::COLUMNS);
+  std::string out = exportAll(columns, 1 << 20);
+  CHECK(out.size() == 24 && out.compare(0, 8, "WTCOL001") == 0);
+
+  ColumnarExport arrow(f.store, {"tank-a"}, START_US - 10, START_US, ExportFormat::ARROW);
+  CHECK(arrow.rows() == 0);
+  out = exportAll(arrow, 0);
+  std::vector<std::string> names;
+  std::vector<std::vector<StoredRecord>> records;
+  size_t batches = 1;
+  CHECK(decodeArrow(out, names, records, batches));
+  CHECK(batches == 0 && names.size() == 1 && records[0].empty());
+}
+
+void testAppendsDuringExportAreLeftOut() {
+  Fixture f;
+  ColumnarExport exporter(f.store, {"tank-b"}, INT64_MIN, INT64_MAX, ExportFormat::COLUMNS);
+  std::string out;
+  CHECK(exporter.next(out, 64));
+  std::vector<StoredRecord> more = makeTrace(10, 200.0f);
+  for (auto& r : more) r.timestampUs += 86400LL * 1000000;
+  CHECK(f.store.append("tank-b", more.data(), more.size()));
+  while (!exporter.done()) CHECK(exporter.next(out, 64));
+  CHECK(out.size() == exporter.size());
+
+  std::vector<ColumnsPart> parts;
+  CHECK(decodeColumns(out, parts));
+  CHECK(parts.size() == 1 && sameRecords(parts[0].records, f.b));
+}
+
+}  // namespace
+
+int main() {
+  testColumnsMatchStore();
+  testArrowMatchesStore();
+  testEmptyExports();
+  testAppendsDuringExportAreLeftOut();
+
+  if (failures) {
+    fprintf(stderr, "export_test: %d failure(s)\n", failures);
+    return 1;
+  }
+  printf("export_test: all checks passed\n");
+  return 0;
+}
@@ -0,0 +1,153 @@
+#ifndef SENSOR_SERVER_HTTP_REQUEST_H
+#define SENSOR_SERVER_HTTP_REQUEST_H
+
+#include <cctype>
+#include <charconv>
+#include <string_view>
+
+// Incremental HTTP/1.x request parser for the C++ sensor server.
+//
+// Works directly on the connection's receive buffer: parseRequest() either
+// reports that more bytes are needed, or fills in views of the first
+// complete request and how many bytes it used, so pipelined requests are
+// handled by calling it again on the remainder. Limits follow
+// BaseHTTPRequestHandler (64 KiB request line, 100 headers).
+
+struct HttpRequest {
+  std::string_view method;
+  std::string_view target;
+  std::string_view path;    // target without query or fragment
+  std::string_view query;
+  std::string_view body;
+  bool keepAlive = true;
+};
+
+struct HttpParseError {
+  int status = 400;
+  const char* message = "Bad request syntax";
+};
+
+enum class HttpParse { INCOMPLETE, COMPLETE, ERROR };
+
+const size_t HTTP_MAX_LINE = 65536;
+const size_t HTTP_MAX_HEADERS = 100;
+const size_t HTTP_MAX_HEADER_BYTES = 256 * 1024;
+const size_t HTTP_MAX_BODY = 1 << 20;
+
+inline bool httpHeaderIs(std::string_view name, const char* expected) {
+  size_t i = 0;
+  for (; i < name.size() && expected[i]; i++) {
+    if (tolower((unsigned char)name[i]) != expected[i]) return false;
+  }
+  return i == name.size() && !expected[i];
+}
+
+inline bool httpValueHasToken(std::string_view value, const char* token) {
+  while (!value.empty()) {
+    size_t comma = value.find(',');
+    std::string_view item = value.substr(0, comma);
+    while (!item.empty() && (item.front() == ' ' || item.front() == '\t')) item.remove_prefix(1);
+    while (!item.empty() && (item.back() == ' ' || item.back() == '\t')) item.remove_suffix(1);
+    if (httpHeaderIs(item, token)) return true;
+    if (comma == std::string_view::npos) break;
+    value.remove_prefix(comma + 1);
+  }
+  return false;
+}
+
+inline HttpParse parseRequest(std::string_view buf, HttpRequest& req, size_t& consumed,
+                              HttpParseError& err) {
+  size_t headerEnd = buf.find("\r\n\r\n");
+  if (headerEnd == std::string_view::npos) {
+    if (buf.size() > HTTP_MAX_HEADER_BYTES) {
+      err = {431, "Request Header Fields Too Large"};
+      return HttpParse::ERROR;
+    }
+    size_t firstLine = buf.find("\r\n");
+    if ((firstLine == std::string_view::npos ? buf.size() : firstLine) > HTTP_MAX_LINE) {
+      err = {414, "Request-URI Too Long"};
+      return HttpParse::ERROR;
+    }
+    return HttpParse::INCOMPLETE;
+  }
+
+  // Request line: METHOD SP target SP HTTP/x.y
+  size_t lineEnd = buf.find("\r\n");
+  std::string_view line = buf.substr(0, lineEnd);
+  if (line.size() > HTTP_MAX_LINE) {
+    err = {414, "Request-URI Too Long"};
+    return HttpParse::ERROR;
+  }
+  size_t sp1 = line.find(' ');
+  size_t sp2 = line.rfind(' ');
+  if (sp1 == std::string_view::npos || sp2 == sp1) {
+    err = {400, "Bad request syntax"};
+    return HttpParse::ERROR;
+  }
+  req.method = line.substr(0, sp1);
+  req.target = line.substr(sp1 + 1, sp2 - sp1 - 1);
+  std::string_view version = line.substr(sp2 + 1);
+  if (version.substr(0, 5) != "HTTP/") {
+    err = {400, "Bad request version"};
+    return HttpParse::ERROR;
+  }
+  if (version != "HTTP/1.1" && version != "HTTP/1.0") {
+    err = {505, "Invalid HTTP version"};
+    return HttpParse::ERROR;
+  }
+  req.keepAlive = version == "HTTP/1.1";
+
+  std::string_view target = req.target;
+  size_t hash = target.find('#');
+  if (hash != std::string_view::npos) target = target.substr(0, hash);
+  size_t qmark = target.find('?');
+  req.path = target.substr(0, qmark);
+  req.query = qmark == std::string_view::npos ? std::string_view() : target.substr(qmark + 1);
+
+  // Headers
+  size_t contentLength = 0;
+  size_t headers = 0;
+  size_t pos = lineEnd + 2;
+  while (pos < headerEnd + 2) {
+    size_t end = buf.find("\r\n", pos);
+    std::string_view header = buf.substr(pos, end - pos);
+    pos = end + 2;
+    if (++headers > HTTP_MAX_HEADERS) {
+      err = {431, "Too many headers"};
+      return HttpParse::ERROR;
+    }
+    size_t colon = header.find(':');
+    if (colon == std::string_view::npos) continue;
+    std::string_view name = header.substr(0, colon);
+    std::string_view value = header.substr(colon + 1);
+    while (!value.empty() && (value.front() == ' ' || value.front() == '\t')) value.remove_prefix(1);
+    while (!value.empty() && (value.back() == ' ' || value.back() == '\t')) value.remove_suffix(1);
+
+    if (httpHeaderIs(name, "content-length")) {
+      auto res = std::from_chars(value.data(), value.data() + value.size(), contentLength);
+      if (res.ec != std::errc() || res.ptr != value.data() + value.size()) {
+        err = {400, "Bad Content-Length"};
+        return HttpParse::ERROR;
+      }
+    } else if (httpHeaderIs(name, "connection")) {
+      if (httpValueHasToken(value, "close")) req.keepAlive = false;
+      else if (httpValueHasToken(value, "keep-alive")) req.keepAlive = true;
+    } else if (httpHeaderIs(name, "transfer-encoding")) {
+      err = {501, "Transfer-Encoding not supported"};
+      return HttpParse::ERROR;
+    }
+  }
+
+  if (contentLength > HTTP_MAX_BODY) {
+    err = {413, "Request Entity Too Large"};
+    return HttpParse::ERROR;
+  }
+  size_t bodyStart = headerEnd + 4;
+  if (buf.size() - bodyStart < contentLength) return HttpParse::INCOMPLETE;
+
+  req.body = buf.substr(bodyStart, contentLength);
+  consumed = bodyStart + contentLength;
+  return HttpParse::COMPLETE;
+}
+
+#endif
@@ -0,0 +1,44 @@
+#!/usr/bin/env python3
+"""
+Baseline for import_bench: the obvious Python import of a sensor log, a
+json.loads loop normalising both schemas into (time, fields) tuples, over
+the first lines of the file import_bench wrote. Storing them would only
+add to its time.
+
+Usage: python3 import_baseline.py log [max_lines]
+"""
+
+from datetime import datetime
+import itertools
+import json
+import sys
+import time
+
+FIELDS = ('voltage', 'pressure_kpa', 'water_depth_m', 'volume_liters')
+
+
+def main():
+    path = sys.argv[1]
+    max_lines = int(sys.argv[2]) if len(sys.argv) > 2 else 500000
+
+    start = time.perf_counter()
+    readings = []
+    lines = size = 0
+    with open(path, 'rb') as f:
+        for line in itertools.islice(f, max_lines):
+            lines += 1
+            size += len(line)
+            entry = json.loads(line)
+            data = entry.get('data', entry)
+            stamp = datetime.fromisoformat(entry['timestamp']).timestamp()
+            readings.append((stamp, entry.get('tank', 0),
+                             *(float(data.get(name, 0)) for name in FIELDS)))
+    elapsed = time.perf_counter() - start
+
+    print(f"{lines} lines, Python json.loads loop")
+    print(f"{'stage':<8} {'threads':>8} {'lines/s':>12} {'MB/s':>10}")
+    print(f"{'parse':<8} {1:8d} {lines / elapsed:12.0f} {size / 1e6 / elapsed:10.1f}")
+
+
+if __name__ == '__main__':
+    main()
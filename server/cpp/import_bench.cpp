@@ -0,0 +1,159 @@
+// Throughput of the log importer (log_import.h), in lines/s.
+//
+// Writes a synthetic log of -n days of readings every 5 s: two thirds
+// sensor_server.py lines (every fourth from a second tank), one third
+// sensor-data.cgi lines. Then times, on 1 thread and on -t threads:
+//
+//   parse     mapping and parsing the file only
+//   import    parsing, sorting and appending to a fresh store
+//
+// Timestamps are written without a zone and read as local time, in UTC
+// here so that no DST change repeats an hour.
+//
+// Compare with import_baseline.py, a Python json.loads loop over the same
+// file (make bench-import runs both).
+//
+// Usage: import_bench [-n days] [-t threads] [-r repeats] [-k keep.log]
+
+#include <unistd.h>
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+#include <string>
+#include <thread>
+
+#include "log_import.h"
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+const int64_t START_SEC = 1735689600;  // 2025-01-01
+
+bool writeLog(const std::string& path, int days, size_t& lines, size_t& bytes) {
+  FILE* f = fopen(path.c_str(), "w");
+  if (!f) return false;
+  lines = 0;
+  bytes = 0;
+  char line[512];
+  for (int64_t i = 0; i < (int64_t)days * 17280; i++) {
+    time_t sec = (time_t)(START_SEC + i * 5);
+    struct tm tm;
+    gmtime_r(&sec, &tm);
+    char stamp[32];
+    strftime(stamp, sizeof(stamp), "%Y-%m-%dT%H:%M:%S", &tm);
+    double level = 1.0 + (double)(i % 8640) / 8640.0;
+    int micros = (int)(i * 7919 % 1000000);
+    int n;
+    if (i % 3 == 2) {
+      n = snprintf(line, sizeof(line),
+                   "{\"timestamp\": \"%s.%06d\", \"data\": {\"voltage\": %.3f, \"pressure_kpa\": "
+                   "%.3f, \"water_depth_m\": %.3f, \"volume_liters\": %.2f}}\n",
+                   stamp, micros, 1.5 + level * 0.1, level * 9.81, level, level * 1500.0);
+    } else {
+      n = snprintf(line, sizeof(line),
+                   "{\"voltage\": %.3f, \"pressure_kpa\": %.3f, \"water_depth_m\": %.3f, "
+                   "\"volume_liters\": %.2f, \"timestamp\": \"%s.%06d\"%s}\n",
+                   1.5 + level * 0.1, level * 9.81, level, level * 1500.0, stamp, micros,
+                   i % 4 == 1 ? ", \"tank\": 1" : "");
+    }
+    fwrite(line, 1, (size_t)n, f);
+    lines++;
+    bytes += (size_t)n;
+  }
+  return fclose(f) == 0;
+}
+
+struct Run {
+  uint64_t lines = 0;
+  uint64_t stored = 0;
+  double seconds = 0;
+};
+
+Run run(const std::string& path, int threads, bool store) {
+  char dirPath[] = "/tmp/import_bench_XXXXXX";
+  std::string dir = mkdtemp(dirPath);
+  Run r;
+  {
+    TimeSeriesStore history(dir);
+    std::string error;
+    if (!history.open(error)) {
+      fprintf(stderr, "Could not open store: %s\n", error.c_str());
+      exit(1);
+    }
+    auto start = Clock::now();
+    LogImporter importer(history, "bench", threads);
+    if (!importer.addFile(path, error)) fprintf(stderr, "%s\n", error.c_str());
+    if (store && !importer.store()) fprintf(stderr, "store failed\n");
+    r.seconds = std::chrono::duration<double>(Clock::now() - start).count();
+    r.lines = importer.totals().lines;
+    r.stored = importer.totals().stored;
+    if (importer.totals().rejected) fprintf(stderr, "%s\n", importer.errors()[0].c_str());
+  }
+  std::string cmd = "rm -rf '" + dir + "'";
+  if (system(cmd.c_str()) != 0) fprintf(stderr, "could not remove %s\n", dir.c_str());
+  return r;
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  int days = 120;
+  int threads = (int)std::thread::hardware_concurrency();
+  int repeats = 3;
+  std::string keep;
+
+  int opt;
+  while ((opt = getopt(argc, argv, "n:t:r:k:h")) != -1) {
+    switch (opt) {
+      case 'n': days = atoi(optarg); break;
+      case 't': threads = atoi(optarg); break;
+      case 'r': repeats = atoi(optarg); break;
+      case 'k': keep = optarg; break;
+      default:
+        fprintf(stderr, "Usage: %s [-n days] [-t threads] [-r repeats] [-k keep.log]\n", argv[0]);
+        return opt == 'h' ? 0 : 2;
+    }
+  }
+  if (days < 1) days = 1;
+  if (threads < 1) threads = 1;
+  if (repeats < 1) repeats = 1;
+  setenv("TZ", "UTC", 1);
+  tzset();
+
+  std::string path = keep;
+  if (path.empty()) {
+    char tmp[] = "/tmp/import_bench_XXXXXX.log";
+    int fd = mkstemps(tmp, 4);
+    if (fd < 0) return 1;
+    close(fd);
+    path = tmp;
+  }
+  size_t lines, bytes;
+  if (!writeLog(path, days, lines, bytes)) {
+    fprintf(stderr, "Could not write %s\n", path.c_str());
+    return 1;
+  }
+  printf("%zu lines (%d days at 5 s, server and cgi formats), %.1f MB\n", lines, days, bytes / 1e6);
+  printf("%-8s %8s %12s %10s\n", "stage", "threads", "lines/s", "MB/s");
+
+  for (int store = 0; store <= 1; store++) {
+    for (int t : {1, threads}) {
+      Run best;
+      for (int i = 0; i < repeats; i++) {
+        Run r = run(path, t, store);
+        if (store && r.stored != lines) {
+          fprintf(stderr, "stored %llu of %zu lines\n", (unsigned long long)r.stored, lines);
+        }
+        if (i == 0 || r.seconds < best.seconds) best = r;
+      }
+      printf("%-8s %8d %12.0f %10.1f\n", store ? "import" : "parse", t, best.lines / best.seconds,
+             bytes / 1e6 / best.seconds);
+      if (threads == 1) break;
+    }
+  }
+  if (keep.empty()) unlink(path.c_str());
+  return 0;
+}
@@ -0,0 +1,121 @@
+// Imports JSON-lines sensor logs into the history store.
+//
+// Takes the logs the servers have been writing, sensor-data.cgi's
+// (/var/log/water-tank-sensor.log) and sensor_server.py's
+// (/tmp/water-tank-sensor.log), and appends their readings to the store
+// the sensor server answers history queries from (see log_import.h):
+//
+//   import_logs -s STORE -d tank-1 /var/log/water-tank-sensor.log /tmp/water-tank-sensor.log
+//
+// Files are parsed in parallel chunks, then each series is sorted and
+// stored. Readings whose timestamp a series already holds are skipped, so
+// re-running an import, or importing a log the live server has been
+// writing to the same store, adds only what is missing; older readings
+// are merged into place behind newer ones. The store admits
+// one writer at a time: stop the sensor server (or give it another store)
+// while importing.
+//
+// Usage: import_logs [-s store] [-d device] [-t threads] [-q] file...
+// Prints a summary to stderr; exits 1 if a file could not be read or the
+// store could not be written.
+
+#include <unistd.h>
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <thread>
+
+#include "log_import.h"
+
+namespace {
+
+const char* const DEFAULT_STORE_DIR = "/tmp/water-tank-store";
+const char* const DEFAULT_DEVICE = "default";
+
+void usage(const char* prog) {
+  fprintf(stderr,
+          "Usage: %s [-s store] [-d device] [-t threads] [-q] file...\n"
+          "  -s DIR   history store directory (default %s)\n"
+          "  -d NAME  device the readings belong to (default %s)\n"
+          "  -t N     parser threads (default: one per core)\n"
+          "  -q       don't report rejected lines\n"
+          "Reads sensor_server.py and sensor-data.cgi logs (JSON lines).\n",
+          prog, DEFAULT_STORE_DIR, DEFAULT_DEVICE);
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  std::string storeDir = DEFAULT_STORE_DIR;
+  std::string device = DEFAULT_DEVICE;
+  int threads = (int)std::thread::hardware_concurrency();
+  bool quiet = false;
+
+  int opt;
+  while ((opt = getopt(argc, argv, "s:d:t:qh")) != -1) {
+    switch (opt) {
+      case 's': storeDir = optarg; break;
+      case 'd': device = optarg; break;
+      case 't': threads = atoi(optarg); break;
+      case 'q': quiet = true; break;
+      default:
+        usage(argv[0]);
+        return opt == 'h' ? 0 : 2;
+    }
+  }
+  if (optind >= argc) {
+    usage(argv[0]);
+    return 2;
+  }
+  if (!TimeSeriesStore::validDeviceName(device)) {
+    fprintf(stderr, "Invalid device name: %s\n", device.c_str());
+    return 2;
+  }
+  if (threads < 1) threads = 1;
+
+  TimeSeriesStore store(storeDir);
+  std::string error;
+  if (!store.open(error)) {
+    fprintf(stderr, "Could not open history store: %s\n", error.c_str());
+    return 1;
+  }
+
+  auto start = std::chrono::steady_clock::now();
+  LogImporter importer(store, device, threads);
+  bool readOk = true;
+  for (int i = optind; i < argc; i++) {
+    if (!importer.addFile(argv[i], error)) {
+      fprintf(stderr, "%s\n", error.c_str());
+      readOk = false;
+    }
+  }
+  bool storeOk = importer.store();
+  double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+  const ImportTotals& t = importer.totals();
+  if (!quiet) {
+    for (const std::string& e : importer.errors()) fprintf(stderr, "%s\n", e.c_str());
+    if (t.rejected > importer.errors().size()) {
+      fprintf(stderr, "... and %llu more rejected lines\n",
+              (unsigned long long)(t.rejected - importer.errors().size()));
+    }
+  }
+  if (!quiet) {
+    for (const SeriesTotals& s : importer.series()) {
+      fprintf(stderr, "%s: %llu stored (%llu merged behind newer readings), %llu already stored\n",
+              s.name.c_str(), (unsigned long long)s.stored, (unsigned long long)s.merged,
+              (unsigned long long)s.skipped);
+    }
+  }
+  fprintf(stderr,
+          "%llu lines (%.1f MB) in %.2f s: %llu stored, %llu already stored, %llu rejected\n",
+          (unsigned long long)t.lines, t.bytes / 1e6, seconds, (unsigned long long)t.stored,
+          (unsigned long long)t.skipped, (unsigned long long)t.rejected);
+  if (!storeOk) {
+    fprintf(stderr, "Some readings could not be written to %s\n", storeDir.c_str());
+    return 1;
+  }
+  return readOk ? 0 : 1;
+}
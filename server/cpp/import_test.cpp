@@ -0,0 +1,261 @@
+// Tests for the log importer: both log schemas and the firmware's short
+// names, malformed lines, chunking at any size and thread count,
+// overlapping files, re-imports and imports behind newer data. Timestamps
+// are covered by parse_test.
+//
+// Build and run: make check
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+#include <string>
+#include <vector>
+
+#include "log_import.h"
+#include "timeseries_store.h"
+#include "test_util.h"
+
+namespace {
+
+// 2025-01-02T03:04:05Z
+const int64_t T0_US = 1735787045LL * 1000000;
+
+std::vector<StoredRecord> scanAll(TimeSeriesStore& store, const std::string& device) {
+  std::vector<StoredRecord> out;
+  store.scan(device, INT64_MIN, INT64_MAX, [&](const StoredRecord* r, size_t count) {
+    out.insert(out.end(), r, r + count);
+  });
+  return out;
+}
+
+// A sensor_server.py line, timestamp in UTC (TZ is UTC in these tests)
+std::string flatLine(int64_t us, double volume, int tank = 0) {
+  time_t sec = (time_t)(us / 1000000);
+  struct tm tm;
+  gmtime_r(&sec, &tm);
+  char stamp[40];
+  strftime(stamp, sizeof(stamp), "%Y-%m-%dT%H:%M:%S", &tm);
+  char line[256];
+  snprintf(line, sizeof(line),
+           "{\"voltage\": 2.5, \"pressure_kpa\": 5.25, \"water_depth_m\": 0.53, "
+           "\"volume_liters\": %.2f, \"timestamp\": \"%s.%06d\"%s}\n",
+           volume, stamp, (int)(us % 1000000),
+           tank ? (", \"tank\": " + std::to_string(tank)).c_str() : "");
+  return line;
+}
+
+void testFlatAndCgiLines() {
+  LogReading r;
+  const char* error = nullptr;
+  CHECK(parseLogLine("{\"voltage\": 2.5, \"pressure_kpa\": 5.2, \"water_depth_m\": 0.53, "
+                     "\"volume_liters\": 25.5, \"timestamp\": \"2025-01-02T03:04:05.123456\"}",
+                     r, error));
+  CHECK(r.timeUs == T0_US + 123456 && r.voltage == 2.5f && r.pressureKpa == 5.2f &&
+        r.depthM == 0.53f && r.volumeL == 25.5f && r.tank == 0);
+
+  CHECK(parseLogLine("{\"timestamp\": \"2025-01-02T03:04:05\", \"data\": {\"voltage\": 2.5, "
+                     "\"pressure_kpa\": 5.2, \"water_depth_m\": 0.53, \"volume_liters\": 25.5}}",
+                     r, error));
+  CHECK(r.timeUs == T0_US && r.volumeL == 25.5f);
+
+  // Firmware short names; a full name wins in either order
+  CHECK(parseLogLine("{\"timestamp\": \"2025-01-02T03:04:05\", \"data\": {\"depth\": 1.5, "
+                     "\"volume_liters\": 7, \"volume\": 9, \"pressure\": 3}}", r, error));
+  CHECK(r.depthM == 1.5f && r.volumeL == 7.0f && r.pressureKpa == 3.0f && r.voltage == 0.0f);
+
+  // Batch rows of multi-tank devices, unknown members, odd spacing, NaN
+  CHECK(parseLogLine(" {\"tank\":2,\"note\":{\"a\":[1,true,null,\"x\\\"y\\u00e9\"]},"
+                     "\"voltage\":NaN,\"timestamp\":\"2025-01-02 03:04:05.5\"} ", r, error));
+  CHECK(r.tank == 2 && std::isnan(r.voltage) && r.timeUs == T0_US + 500000);
+}
+
+void testMalformedLines() {
+  const char* bad[] = {
+      "",
+      "[1, 2]",
+      "{\"voltage\": 2.5}",
+      "{\"timestamp\": \"yesterday\"}",
+      "{\"timestamp\": \"2025-01-02T03:04:05\", \"voltage\": \"2.5\"}",
+      "{\"timestamp\": \"2025-01-02T03:04:05\", \"voltage\": 2.}",
+      "{\"timestamp\": \"2025-01-02T03:04:05\", \"voltage\": 01x}",
+      "{\"timestamp\": \"2025-01-02T03:04:05\", \"tank\": 1.5}",
+      "{\"timestamp\": \"2025-01-02T03:04:05\", \"tank\": 999}",
+      "{\"timestamp\": \"2025-01-02T03:04:05\"",
+      "{\"timestamp\": \"2025-01-02T03:04:05\"} {}",
+      "{\"timestamp\": \"2025-01-02T03:04:05\", \"x\": \"\\q\"}",
+      "{\"timestamp\": \"2025-01-02T03:04:05\", \"x\": [1, 2}",
+  };
+  for (const char* line : bad) {
+    LogReading r;
+    const char* error = nullptr;
+    bool ok = parseLogLine(line, r, error);
+    CHECK(!ok && error != nullptr);
+    if (ok) fprintf(stderr, "  accepted: %s\n", line);
+  }
+}
+
+// The same log through every chunk size and thread count stores the same
+void testChunkingIsInvisible() {
+  std::string log;
+  std::vector<int64_t> tank0, tank3;
+  int64_t t = T0_US;
+  for (int i = 0; i < 2000; i++) {
+    t += 5000000 + i;
+    if (i % 7 == 3) {
+      log += flatLine(t, i, 3);
+      tank3.push_back(t);
+    } else {
+      log += flatLine(t, i);
+      tank0.push_back(t);
+    }
+    if (i % 500 == 250) log += "\n   \ngarbage line\n";
+  }
+  log += flatLine(t + 5000000, 1.0).substr(0, 80);  // Torn last line, no newline
+
+  for (size_t chunkBytes : {1, 100, 4096, 1 << 20}) {
+    for (int threads : {1, 3}) {
+      TempDir tmp("import_test");
+      const std::string& dir = tmp.path();
+      TimeSeriesStore store(dir);
+      std::string error;
+      CHECK(store.open(error));
+      LogImporter importer(store, "tank-a", threads, chunkBytes);
+      importer.addBuffer(log, "log");
+      CHECK(importer.store());
+      const ImportTotals& totals = importer.totals();
+      CHECK(totals.lines == 2000 + 4 + 1);
+      CHECK(totals.readings == 2000 && totals.stored == 2000 && totals.rejected == 5);
+      CHECK(totals.bytes == log.size());
+      CHECK(importer.errors().size() == 5);
+      if (importer.errors().size() == 5) {
+        CHECK(importer.errors()[0] == "log:254: not a JSON object");
+        CHECK(importer.errors()[4].compare(0, 9, "log:2013:") == 0);
+      }
+
+      std::vector<StoredRecord> a = scanAll(store, "tank-a");
+      std::vector<StoredRecord> a3 = scanAll(store, "tank-a-tank3");
+      CHECK(a.size() == tank0.size() && a3.size() == tank3.size());
+      if (a.size() == tank0.size()) {
+        bool same = true;
+        for (size_t i = 0; i < a.size(); i++) same = same && a[i].timestampUs == tank0[i];
+        CHECK(same);
+      }
+      if (!a3.empty()) CHECK(a3.back().timestampUs == tank3.back() && a3.back().pressureKpa == 5.25f);
+    }
+  }
+}
+
+void testOverlappingFilesAndReimport() {
+  TempDir tmp("import_test");
+  const std::string& dir = tmp.path();
+  TimeSeriesStore store(dir);
+  std::string error;
+  CHECK(store.open(error));
+
+  // A cgi log and a server log of one device, interleaved in time, given
+  // newest file first
+  std::string cgi, server;
+  for (int i = 0; i < 100; i++) {
+    int64_t t = T0_US + (int64_t)i * 5000000;
+    if (i % 2) {
+      server += flatLine(t, i);
+    } else {
+      std::string line = flatLine(t, i);
+      size_t stamp = line.find("\"timestamp\"");
+      cgi += "{" + line.substr(stamp, line.size() - stamp - 2) + ", \"data\": " +
+             line.substr(0, stamp - 2) + "}}\n";
+    }
+  }
+  {
+    LogImporter importer(store, "default", 2, 512);
+    importer.addBuffer(server, "server");
+    importer.addBuffer(cgi, "cgi");
+    CHECK(importer.store());
+    CHECK(importer.totals().stored == 100 && importer.totals().rejected == 0);
+  }
+  std::vector<StoredRecord> stored = scanAll(store, "default");
+  CHECK(stored.size() == 100 && store.mergedRecords() == 0);
+  bool inOrder = stored.size() == 100;
+  for (size_t i = 0; inOrder && i < stored.size(); i++) {
+    inOrder = stored[i].volumeL == (float)i && stored[i].timestampUs == T0_US + (int64_t)i * 5000000;
+  }
+  CHECK(inOrder);
+
+  // Again, plus readings newer than the store's: only those are added
+  {
+    LogImporter importer(store, "default", 2);
+    importer.addBuffer(cgi + server + flatLine(T0_US + 1000LL * 1000000, 1000), "again");
+    CHECK(importer.store());
+    CHECK(importer.totals().stored == 1 && importer.totals().skipped == 100);
+  }
+  CHECK(scanAll(store, "default").size() == 101);
+}
+
+// A log older than what the live server has since recorded is merged in
+// behind it, and a reading at a timestamp the series holds is skipped
+void testImportBehindNewerData() {
+  TempDir tmp("import_test");
+  const std::string& dir = tmp.path();
+  TimeSeriesStore store(dir);
+  std::string error;
+  CHECK(store.open(error));
+
+  const int64_t newerUs = T0_US + 1000LL * 1000000;
+  std::vector<StoredRecord> newer;
+  for (int i = 0; i < 10; i++) {
+    newer.push_back(StoredRecord{newerUs + (int64_t)i * 5000000, 2.5f, 0, 0, (float)(1000 + i)});
+  }
+  CHECK(store.append("default", newer.data(), newer.size()));
+
+  std::string log;
+  for (int i = 0; i < 100; i++) log += flatLine(T0_US + (int64_t)i * 5000000, i);
+  log += flatLine(newerUs, 5);
+  for (int run = 0; run < 2; run++) {
+    LogImporter importer(store, "default", 2);
+    importer.addBuffer(log, "log");
+    CHECK(importer.store());
+    const ImportTotals& t = importer.totals();
+    CHECK(t.stored == (run == 0 ? 100u : 0u));
+    CHECK(t.merged == (run == 0 ? 100u : 0u));
+    CHECK(t.skipped == (run == 0 ? 1u : 101u));
+    CHECK(importer.series().size() == 1);
+    if (!importer.series().empty()) {
+      const SeriesTotals& s = importer.series()[0];
+      CHECK(s.name == "default" && s.stored == t.stored && s.merged == t.merged &&
+            s.skipped == t.skipped);
+    }
+
+    std::vector<StoredRecord> stored = scanAll(store, "default");
+    CHECK(stored.size() == 110);
+    bool inOrder = stored.size() == 110;
+    for (size_t i = 0; inOrder && i < 100; i++) {
+      inOrder = stored[i].timestampUs == T0_US + (int64_t)i * 5000000 && stored[i].volumeL == (float)i;
+    }
+    for (size_t i = 0; inOrder && i < 10; i++) {
+      inOrder = stored[100 + i].timestampUs == newer[i].timestampUs &&
+                stored[100 + i].volumeL == newer[i].volumeL;
+    }
+    CHECK(inOrder);
+  }
+}
+
+}  // namespace
+
+int main() {
+  setenv("TZ", "UTC", 1);
+  tzset();
+
+  testFlatAndCgiLines();
+  testMalformedLines();
+  testChunkingIsInvisible();
+  testOverlappingFilesAndReimport();
+  testImportBehindNewerData();
+
+  if (failures) {
+    fprintf(stderr, "import_test: %d failure(s)\n", failures);
+    return 1;
+  }
+  printf("import_test: all checks passed\n");
+  return 0;
+}
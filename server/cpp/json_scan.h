@@ -0,0 +1,231 @@
+#ifndef SENSOR_SERVER_JSON_SCAN_H
+#define SENSOR_SERVER_JSON_SCAN_H
+
+#include <cctype>
+#include <charconv>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <string>
+#include <string_view>
+
+// Just enough JSON for the log importer and the LoRa uplink decoder.
+//
+// Walks the text in place: the caller pulls the members it wants and
+// skips the rest with skipValue(). Strings come back as raw views into
+// the text (escapes checked, not decoded; unescape() decodes one when the
+// caller keeps it) and numbers are converted with from_chars, so nothing
+// is allocated per document.
+
+class JsonScanner {
+public:
+  explicit JsonScanner(std::string_view text)
+    : _begin(text.data()), _p(text.data()), _end(text.data() + text.size()) {}
+
+  bool consume(char c) {
+    skipSpace();
+    if (_p == _end || *_p != c) return false;
+    _p++;
+    return true;
+  }
+
+  bool peek(char c) {
+    skipSpace();
+    return _p != _end && *_p == c;
+  }
+
+  bool atEnd() {
+    skipSpace();
+    return _p == _end;
+  }
+
+  // Bytes consumed so far (error messages)
+  size_t offset() const { return (size_t)(_p - _begin); }
+
+  bool string(std::string_view& raw) {
+    if (!consume('"')) return false;
+    const char* start = _p;
+    while (_p < _end) {
+      unsigned char c = (unsigned char)*_p;
+      if (c == '"') {
+        raw = std::string_view(start, (size_t)(_p - start));
+        _p++;
+        return true;
+      }
+      if (c < 0x20) return false;
+      if (c == '\\' && !escape()) return false;
+      _p++;
+    }
+    return false;
+  }
+
+  bool number(double& out) {
+    skipSpace();
+    // Python's json.dumps writes NaN and Infinity for non-finite floats
+    if (literal("NaN")) {
+      out = std::numeric_limits<double>::quiet_NaN();
+      return true;
+    }
+    if (literal("Infinity")) {
+      out = std::numeric_limits<double>::infinity();
+      return true;
+    }
+    if (literal("-Infinity")) {
+      out = -std::numeric_limits<double>::infinity();
+      return true;
+    }
+    const char* start = _p;
+    if (_p < _end && *_p == '-') _p++;
+    if (!digits()) return false;
+    if (_p < _end && *_p == '.') {
+      _p++;
+      if (!digits()) return false;
+    }
+    if (_p < _end && (*_p == 'e' || *_p == 'E')) {
+      _p++;
+      if (_p < _end && (*_p == '+' || *_p == '-')) _p++;
+      if (!digits()) return false;
+    }
+    auto result = std::from_chars(start, _p, out);
+    // Out of range: the value is too large for any reading anyway
+    return result.ptr == _p && result.ec == std::errc();
+  }
+
+  bool skipValue(int depth = 0) {
+    skipSpace();
+    if (_p == _end || depth > MAX_DEPTH) return false;
+    std::string_view raw;
+    double number;
+    switch (*_p) {
+      case '{':
+        _p++;
+        if (consume('}')) return true;
+        do {
+          if (!string(raw) || !consume(':') || !skipValue(depth + 1)) return false;
+        } while (consume(','));
+        return consume('}');
+      case '[':
+        _p++;
+        if (consume(']')) return true;
+        do {
+          if (!skipValue(depth + 1)) return false;
+        } while (consume(','));
+        return consume(']');
+      case '"':
+        return string(raw);
+      case 't':
+        return literal("true");
+      case 'f':
+        return literal("false");
+      case 'n':
+        return literal("null");
+      default:
+        return this->number(number);
+    }
+  }
+
+  // Decode a raw string from string() (already checked) into out,
+  // replacing its contents; \u escapes become UTF-8
+  static void unescape(std::string_view raw, std::string& out) {
+    out.clear();
+    for (size_t i = 0; i < raw.size(); i++) {
+      char c = raw[i];
+      if (c != '\\') {
+        out += c;
+        continue;
+      }
+      switch (raw[++i]) {
+        case 'b': out += '\b'; break;
+        case 'f': out += '\f'; break;
+        case 'n': out += '\n'; break;
+        case 'r': out += '\r'; break;
+        case 't': out += '\t'; break;
+        case 'u': {
+          uint32_t cp = hex4(raw, i + 1);
+          i += 4;
+          if (cp >= 0xD800 && cp < 0xDC00 && i + 6 < raw.size() && raw[i + 1] == '\\' &&
+              raw[i + 2] == 'u') {
+            uint32_t low = hex4(raw, i + 3);
+            if (low >= 0xDC00 && low < 0xE000) {
+              cp = 0x10000 + ((cp - 0xD800) << 10) + (low - 0xDC00);
+              i += 6;
+            }
+          }
+          putUtf8(out, cp);
+          break;
+        }
+        default: out += raw[i]; break;  // " \ /
+      }
+    }
+  }
+
+private:
+  static const int MAX_DEPTH = 64;
+
+  void skipSpace() {
+    while (_p < _end && (*_p == ' ' || *_p == '\t' || *_p == '\r' || *_p == '\n')) _p++;
+  }
+
+  bool literal(const char* word) {
+    size_t n = strlen(word);
+    if ((size_t)(_end - _p) < n || memcmp(_p, word, n) != 0) return false;
+    _p += n;
+    return true;
+  }
+
+  bool digits() {
+    const char* start = _p;
+    while (_p < _end && *_p >= '0' && *_p <= '9') _p++;
+    return _p > start;
+  }
+
+  // At a backslash; leaves _p on the escape's last character
+  bool escape() {
+    if (++_p == _end) return false;
+    switch (*_p) {
+      case '"': case '\\': case '/': case 'b': case 'f': case 'n': case 'r': case 't':
+        return true;
+      case 'u':
+        for (int i = 0; i < 4; i++) {
+          if (++_p == _end || !isxdigit((unsigned char)*_p)) return false;
+        }
+        return true;
+      default:
+        return false;
+    }
+  }
+
+  // Four hex digits checked by escape()
+  static uint32_t hex4(std::string_view s, size_t pos) {
+    uint32_t v = 0;
+    for (size_t i = pos; i < pos + 4; i++) {
+      char c = s[i];
+      v = v << 4 | (uint32_t)(c <= '9' ? c - '0' : (c | 0x20) - 'a' + 10);
+    }
+    return v;
+  }
+
+  static void putUtf8(std::string& out, uint32_t cp) {
+    if (cp < 0x80) {
+      out += (char)cp;
+    } else if (cp < 0x800) {
+      out += (char)(0xC0 | (cp >> 6));
+      out += (char)(0x80 | (cp & 0x3F));
+    } else if (cp < 0x10000) {
+      out += (char)(0xE0 | (cp >> 12));
+      out += (char)(0x80 | ((cp >> 6) & 0x3F));
+      out += (char)(0x80 | (cp & 0x3F));
+    } else {
+      out += (char)(0xF0 | (cp >> 18));
+      out += (char)(0x80 | ((cp >> 12) & 0x3F));
+      out += (char)(0x80 | ((cp >> 6) & 0x3F));
+      out += (char)(0x80 | (cp & 0x3F));
+    }
+  }
+
+  const char* _begin;
+  const char* _p;
+  const char* _end;
+};
+
+#endif
@@ -0,0 +1,318 @@
+#include "log_import.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cmath>
+#include <cstring>
+#include <thread>
+
+#include "json_scan.h"
+#include "time_parse.h"
+
+// ---------------------------------------------------------------------------
+// Log lines
+// ---------------------------------------------------------------------------
+
+namespace {
+
+struct FieldName {
+  const char* name;
+  bool alias;  // Firmware short name: used only without the full one
+  float LogReading::*field;
+  const char* error;
+};
+
+const FieldName FIELD_NAMES[] = {
+    {"voltage", false, &LogReading::voltage, "invalid voltage"},
+    {"pressure_kpa", false, &LogReading::pressureKpa, "invalid pressure_kpa"},
+    {"water_depth_m", false, &LogReading::depthM, "invalid water_depth_m"},
+    {"volume_liters", false, &LogReading::volumeL, "invalid volume_liters"},
+    {"pressure", true, &LogReading::pressureKpa, "invalid pressure"},
+    {"depth", true, &LogReading::depthM, "invalid depth"},
+    {"volume", true, &LogReading::volumeL, "invalid volume"},
+};
+
+const int FULL_FIELDS = 4;
+
+struct LineState {
+  bool haveTime = false;
+  bool full[FULL_FIELDS] = {};
+};
+
+// Members of the top-level object, or of a cgi "data" object (nested)
+bool readMembers(JsonScanner& json, bool nested, LogReading& out, LineState& state,
+                 const char*& error) {
+  if (json.consume('}')) return true;
+  do {
+    std::string_view key;
+    if (!json.string(key) || !json.consume(':')) {
+      error = "malformed JSON";
+      return false;
+    }
+    if (!nested && key == "timestamp") {
+      std::string_view text;
+      if (!json.string(text) || !parseLogTimestamp(text, out.timeUs)) {
+        error = "invalid timestamp";
+        return false;
+      }
+      state.haveTime = true;
+      continue;
+    }
+    if (!nested && key == "data" && json.peek('{')) {
+      json.consume('{');
+      if (!readMembers(json, true, out, state, error)) return false;
+      continue;
+    }
+    if (key == "tank") {
+      double tank;
+      if (!json.number(tank) || tank != std::floor(tank) || tank < 0 || tank > LogImporter::MAX_TANK) {
+        error = "invalid tank";
+        return false;
+      }
+      out.tank = (int)tank;
+      continue;
+    }
+
+    const FieldName* field = nullptr;
+    for (const FieldName& f : FIELD_NAMES) {
+      if (key == f.name) field = &f;
+    }
+    if (!field) {
+      if (!json.skipValue()) {
+        error = "malformed JSON";
+        return false;
+      }
+      continue;
+    }
+    double value;
+    if (!json.number(value)) {
+      error = field->error;
+      return false;
+    }
+    int index = (int)(field - FIELD_NAMES);
+    if (!field->alias) {
+      state.full[index] = true;
+    } else if (state.full[index - FULL_FIELDS + 1]) {
+      continue;  // pressure/depth/volume follow voltage in FIELD_NAMES
+    }
+    out.*(field->field) = (float)value;
+  } while (json.consume(','));
+
+  if (!json.consume('}')) {
+    error = "malformed JSON";
+    return false;
+  }
+  return true;
+}
+
+}  // namespace
+
+bool parseLogLine(std::string_view line, LogReading& out, const char*& error) {
+  out = LogReading();
+  LineState state;
+  JsonScanner json(line);
+  if (!json.consume('{')) {
+    error = "not a JSON object";
+    return false;
+  }
+  if (!readMembers(json, false, out, state, error)) return false;
+  if (!json.atEnd()) {
+    error = "trailing data after JSON";
+    return false;
+  }
+  if (!state.haveTime) {
+    error = "no timestamp";
+    return false;
+  }
+  return true;
+}
+
+// ---------------------------------------------------------------------------
+// LogImporter
+// ---------------------------------------------------------------------------
+
+namespace {
+
+// Runs fn(0) .. fn(count - 1) on up to `threads` threads
+template <typename Fn>
+void parallelFor(size_t count, int threads, Fn fn) {
+  std::atomic<size_t> next(0);
+  auto work = [&]() {
+    for (size_t i; (i = next.fetch_add(1)) < count;) fn(i);
+  };
+  std::vector<std::thread> pool;
+  size_t extra = std::min((size_t)std::max(threads, 1), count);
+  for (size_t t = 1; t < extra; t++) pool.emplace_back(work);
+  work();
+  for (auto& t : pool) t.join();
+}
+
+bool byTimestamp(const StoredRecord& a, const StoredRecord& b) {
+  return a.timestampUs < b.timestampUs;
+}
+
+}  // namespace
+
+LogImporter::LogImporter(TimeSeriesStore& store, std::string device, int threads, size_t chunkBytes)
+  : _store(store), _device(std::move(device)), _threads(std::max(threads, 1)),
+    _chunkBytes(std::max(chunkBytes, (size_t)1)) {}
+
+std::string LogImporter::seriesName(size_t tank) const {
+  return tank == 0 ? _device : _device + "-tank" + std::to_string(tank);
+}
+
+bool LogImporter::addFile(const std::string& path, std::string& error) {
+  int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  struct stat st;
+  if (fd < 0 || fstat(fd, &st) != 0) {
+    error = path + ": " + strerror(errno);
+    if (fd >= 0) close(fd);
+    return false;
+  }
+  if (st.st_size == 0) {
+    close(fd);
+    return true;
+  }
+  void* data = mmap(nullptr, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (data == MAP_FAILED) {
+    error = path + ": " + strerror(errno);
+    return false;
+  }
+  madvise(data, (size_t)st.st_size, MADV_SEQUENTIAL);
+  addBuffer(std::string_view(static_cast<const char*>(data), (size_t)st.st_size), path);
+  munmap(data, (size_t)st.st_size);
+  return true;
+}
+
+void LogImporter::addBuffer(std::string_view text, const std::string& source) {
+  // Chunks end just after a newline (or at the end of the text)
+  std::vector<std::string_view> pieces;
+  size_t start = 0;
+  while (start < text.size()) {
+    size_t end = start + _chunkBytes;
+    if (end >= text.size()) {
+      end = text.size();
+    } else {
+      const void* nl = memchr(text.data() + end - 1, '\n', text.size() - end + 1);
+      end = nl ? (size_t)(static_cast<const char*>(nl) - text.data()) + 1 : text.size();
+    }
+    pieces.push_back(text.substr(start, end - start));
+    start = end;
+  }
+
+  size_t first = _chunks.size();
+  _chunks.resize(first + pieces.size());
+  parallelFor(pieces.size(), _threads, [&](size_t i) { parseChunk(pieces[i], _chunks[first + i]); });
+
+  _totals.bytes += text.size();
+  uint64_t lineBase = 0;
+  for (size_t i = first; i < _chunks.size(); i++) {
+    const Chunk& chunk = _chunks[i];
+    _totals.lines += chunk.lines;
+    _totals.rejected += chunk.rejected;
+    for (const auto& tank : chunk.tanks) _totals.readings += tank.size();
+    for (const auto& e : chunk.errors) {
+      if (_errors.size() >= MAX_REPORTED_ERRORS) break;
+      _errors.push_back(source + ":" + std::to_string(lineBase + e.first) + ": " + e.second);
+    }
+    lineBase += chunk.newlines;
+  }
+}
+
+void LogImporter::parseChunk(std::string_view text, Chunk& chunk) {
+  const char* p = text.data();
+  const char* end = p + text.size();
+  uint64_t lineNo = 0;
+  LogReading r;
+  const char* error;
+  while (p < end) {
+    const char* nl = static_cast<const char*>(memchr(p, '\n', (size_t)(end - p)));
+    std::string_view line(p, (size_t)((nl ? nl : end) - p));
+    lineNo++;
+    while (!line.empty() && (line.back() == '\r' || line.back() == ' ')) line.remove_suffix(1);
+    if (!line.empty()) {
+      chunk.lines++;
+      if (parseLogLine(line, r, error)) {
+        if ((size_t)r.tank >= chunk.tanks.size()) chunk.tanks.resize((size_t)r.tank + 1);
+        chunk.tanks[(size_t)r.tank].push_back(
+            StoredRecord{r.timeUs, r.voltage, r.pressureKpa, r.depthM, r.volumeL});
+      } else {
+        chunk.rejected++;
+        if (chunk.errors.size() < MAX_REPORTED_ERRORS) chunk.errors.push_back({lineNo, error});
+      }
+    }
+    if (!nl) break;
+    chunk.newlines++;
+    p = nl + 1;
+  }
+}
+
+bool LogImporter::store() {
+  size_t tanks = 0;
+  for (const Chunk& chunk : _chunks) tanks = std::max(tanks, chunk.tanks.size());
+
+  // One series per task: gather its readings from every chunk in file
+  // order, sort them if files overlap, skip the timestamps the store
+  // already has
+  std::vector<SeriesTotals> series(tanks);
+  std::atomic<bool> ok(true);
+  parallelFor(tanks, _threads, [&](size_t tank) {
+    std::vector<StoredRecord> records;
+    size_t total = 0;
+    for (const Chunk& chunk : _chunks) total += tank < chunk.tanks.size() ? chunk.tanks[tank].size() : 0;
+    if (total == 0) return;
+    records.reserve(total);
+    for (Chunk& chunk : _chunks) {
+      if (tank >= chunk.tanks.size()) continue;
+      records.insert(records.end(), chunk.tanks[tank].begin(), chunk.tanks[tank].end());
+      std::vector<StoredRecord>().swap(chunk.tanks[tank]);
+    }
+    if (!std::is_sorted(records.begin(), records.end(), byTimestamp)) {
+      std::stable_sort(records.begin(), records.end(), byTimestamp);
+    }
+
+    SeriesTotals& t = series[tank];
+    t.name = seriesName(tank);
+    int64_t last = _store.lastTimestampUs(t.name);
+    std::vector<int64_t> held;
+    if (records.front().timestampUs <= last) {
+      _store.scan(t.name, records.front().timestampUs, last + 1, [&](const StoredRecord* r, size_t n) {
+        for (size_t i = 0; i < n; i++) held.push_back(r[i].timestampUs);
+      });
+    }
+    size_t kept = 0;
+    auto h = held.begin();
+    for (const StoredRecord& r : records) {
+      if (kept > 0 && r.timestampUs == records[kept - 1].timestampUs) continue;
+      while (h != held.end() && *h < r.timestampUs) ++h;
+      if (h != held.end() && *h == r.timestampUs) continue;
+      if (r.timestampUs < last) t.merged++;
+      records[kept++] = r;
+    }
+    t.skipped = total - kept;
+    if (kept == 0) return;
+    if (_store.append(t.name, records.data(), kept)) {
+      t.stored = kept;
+    } else {
+      t.merged = 0;
+      ok = false;
+    }
+  });
+
+  for (SeriesTotals& t : series) {
+    if (t.name.empty()) continue;
+    _totals.stored += t.stored;
+    _totals.merged += t.merged;
+    _totals.skipped += t.skipped;
+    _series.push_back(std::move(t));
+  }
+  _chunks.clear();
+  return ok;
+}
@@ -0,0 +1,113 @@
+#ifndef SENSOR_SERVER_LOG_IMPORT_H
+#define SENSOR_SERVER_LOG_IMPORT_H
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "time_parse.h"  // parseLogTimestamp()
+#include "timeseries_store.h"
+
+// Bulk import of JSON-lines sensor logs into the history store.
+//
+// Two schemas are accepted, line by line:
+//
+//   sensor_server.py (and sensor_server -l), flat:
+//     {"voltage": 2.5, "pressure_kpa": 5.2, "water_depth_m": 0.53,
+//      "volume_liters": 25.5, "timestamp": "2025-01-02T03:04:05.123456"[, "tank": 1]}
+//   sensor-data.cgi, the POSTed object under "data":
+//     {"timestamp": "2025-01-02T03:04:05.123456", "data": {"voltage": 2.5, ...}}
+//
+// Missing fields are 0, as the Python server reads them; the firmware's
+// short names (depth, pressure, volume) are accepted too. Timestamps
+// without a zone are local time, as both writers produce them (TZ
+// applies). Rows with "tank": N >= 1 go to the "<device>-tankN" series,
+// as with batch uploads.
+//
+// Files are mmap()ed and split into chunks at line boundaries; chunks are
+// parsed in parallel by a scanner that works on the mapped bytes without
+// allocating. The readings are held until store(), which sorts each
+// series by time (so logs of one device can be imported in any order)
+// and appends them, in parallel across series. A reading whose exact
+// timestamp the series already holds (or that appeared earlier in the
+// import) is skipped, so importing a log twice stores it once. Readings
+// older than the series' newest are merged into place by the store. Memory
+// use is 24 bytes per reading, about a sixth of the log's size.
+
+struct LogReading {
+  int64_t timeUs = 0;  // Unix microseconds
+  float voltage = 0;
+  float pressureKpa = 0;
+  float depthM = 0;
+  float volumeL = 0;
+  int tank = 0;
+};
+
+// One log line, either schema. error is a static message on failure.
+bool parseLogLine(std::string_view line, LogReading& out, const char*& error);
+
+struct ImportTotals {
+  uint64_t bytes = 0;
+  uint64_t lines = 0;     // Non-blank
+  uint64_t readings = 0;  // Parsed
+  uint64_t stored = 0;
+  uint64_t merged = 0;    // Of stored: older than the series' newest reading
+  uint64_t skipped = 0;   // Timestamp already stored
+  uint64_t rejected = 0;
+};
+
+struct SeriesTotals {
+  std::string name;
+  uint64_t stored = 0;
+  uint64_t merged = 0;
+  uint64_t skipped = 0;
+};
+
+class LogImporter {
+public:
+  static const size_t DEFAULT_CHUNK_BYTES = 8 << 20;
+  static const int MAX_TANK = 255;
+  static const size_t MAX_REPORTED_ERRORS = 20;
+
+  LogImporter(TimeSeriesStore& store, std::string device, int threads,
+              size_t chunkBytes = DEFAULT_CHUNK_BYTES);
+
+  // Parse a whole file. False (with error) if it cannot be read.
+  bool addFile(const std::string& path, std::string& error);
+  // Parse a buffer as one more file (tests, benchmarks)
+  void addBuffer(std::string_view text, const std::string& source);
+
+  // Append what has been parsed and release it. False if an append
+  // failed.
+  bool store();
+
+  const ImportTotals& totals() const { return _totals; }
+  // Every series store() wrote to or skipped readings of, by tank
+  const std::vector<SeriesTotals>& series() const { return _series; }
+  // "source:line: message", the first MAX_REPORTED_ERRORS rejected lines
+  const std::vector<std::string>& errors() const { return _errors; }
+
+private:
+  struct Chunk {
+    std::vector<std::vector<StoredRecord>> tanks;  // Index: tank
+    uint64_t lines = 0;
+    uint64_t newlines = 0;
+    uint64_t rejected = 0;
+    std::vector<std::pair<uint64_t, const char*>> errors;  // Line within the chunk
+  };
+
+  void parseChunk(std::string_view text, Chunk& chunk);
+  std::string seriesName(size_t tank) const;
+
+  TimeSeriesStore& _store;
+  std::string _device;
+  int _threads;
+  size_t _chunkBytes;
+  std::vector<Chunk> _chunks;  // Parsed, in file order
+  ImportTotals _totals;
+  std::vector<SeriesTotals> _series;
+  std::vector<std::string> _errors;
+};
+
+#endif
@@ -0,0 +1,190 @@
+// Throughput of the LoRaWAN uplink path (lora_uplink.h), in frames/s.
+//
+// Generates a day's worth of synthetic ChirpStack uplink events, one per
+// device per minute: single-tank version 1 frames of 12 samples, 4-tank
+// version 2 frames of 12 samples, and a few legacy 8-byte payloads. Then
+// times, in batches of -b frames:
+//
+//   parse     JSON event parsing only
+//   decode    parsing, base64 and frame decoding, byte swap and scaling
+//   ingest    all of that plus appending to a fresh store in a temp dir
+//
+// Usage: lora_bench [-d devices] [-b batch] [-r repeats]
+
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "LoRaFrame.h"
+#include "lora_uplink.h"
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+std::vector<std::string> makeEvents(int devices, int minutes) {
+  std::vector<std::string> events;
+  events.reserve((size_t)devices * minutes);
+  uint8_t buf[LORA_FRAME_MAX_PAYLOAD];
+  for (int m = 0; m < minutes; m++) {
+    for (int d = 0; d < devices; d++) {
+      int kind = d % 10;  // 0-5 single tank, 6-8 four tanks, 9 legacy
+      uint8_t tanks = kind < 6 ? 1 : 4;
+      int port = LORA_FRAME_PORT;
+      uint8_t length;
+      if (kind == 9) {
+        port = 1;
+        uint16_t level = (uint16_t)(20000 + (m * 7 + d) % 3000);
+        uint8_t legacy[8] = {0x05, 0xDC, 0x07, 0xD0, (uint8_t)(level >> 8), (uint8_t)level,
+                             0xEA, 0x60};
+        std::copy(legacy, legacy + 8, buf);
+        length = 8;
+      } else {
+        LoRaFrameEncoder encoder(buf, sizeof(buf), 5, tanks);
+        for (int s = 11; s >= 0; s--) {
+          PackedReading sample[LORA_FRAME_MAX_TANKS];
+          int i = m * 12 + s;
+          for (uint8_t t = 0; t < tanks; t++) {
+            // Slow drift with a little sensor noise
+            uint16_t noise = (uint16_t)((i * 2654435761u + d * 40503u + t) >> 28);
+            sample[t] = PackedReading{(uint16_t)(1500 + noise), (uint16_t)(2000 + i % 500 + noise),
+                                      (uint16_t)(600 + i % 500), (uint16_t)(30000 + (i % 500) * 60)};
+          }
+          if (!encoder.addSample(sample)) break;
+        }
+        length = encoder.length();
+      }
+      char time[40];
+      snprintf(time, sizeof(time), "2025-01-02T%02d:%02d:00.%06dZ", m / 60, m % 60, d % 1000000);
+      std::string device = "tank-" + std::to_string(d);
+      events.push_back("{\"deduplicationId\":\"6c7f0d2e\",\"time\":\"" + std::string(time) +
+                       "\",\"deviceInfo\":{\"tenantName\":\"Farm\",\"applicationName\":\"tanks\","
+                       "\"deviceName\":\"" + device + "\",\"devEui\":\"00112233" +
+                       std::to_string(10000000 + d) + "\"},\"devAddr\":\"01020304\",\"fCnt\":" +
+                       std::to_string(m) + ",\"fPort\":" + std::to_string(port) +
+                       ",\"data\":\"" + base64Encode(buf, length) +
+                       "\",\"rxInfo\":[{\"gatewayId\":\"0016c001ff10a235\",\"rssi\":-97,"
+                       "\"snr\":7.5}],\"txInfo\":{\"frequency\":916800000}}");
+    }
+  }
+  return events;
+}
+
+struct Run {
+  double seconds = 0;
+  uint64_t frames = 0;
+  uint64_t readings = 0;
+  uint64_t stored = 0;
+};
+
+enum Mode { PARSE, DECODE, INGEST };
+
+Run run(const std::vector<std::string>& events, size_t batchFrames, Mode mode,
+        TimeSeriesStore* store) {
+  Run r;
+  UplinkEvent event;
+  UplinkBatch batch;
+  std::string error;
+  uint64_t duplicates = 0;
+  auto flush = [&]() {
+    r.frames += batch.frames();
+    r.readings += batch.readings();
+    if (mode == INGEST) {
+      r.stored += batch.store(*store, &duplicates, nullptr);
+    } else {
+      // Force the swap and scale of the whole batch
+      batch.records(std::string());
+    }
+    batch.clear();
+  };
+  auto start = Clock::now();
+  for (const std::string& e : events) {
+    if (!parseUplinkEvent(e, event, error)) {
+      fprintf(stderr, "bad event: %s\n", error.c_str());
+      continue;
+    }
+    if (mode == PARSE) {
+      r.frames++;
+      continue;
+    }
+    if (!batch.add(event, error)) fprintf(stderr, "bad frame: %s\n", error.c_str());
+    if (batch.frames() >= batchFrames) flush();
+  }
+  flush();
+  r.seconds = std::chrono::duration<double>(Clock::now() - start).count();
+  return r;
+}
+
+void removeTree(const std::string& dir) {
+  std::string cmd = "rm -rf '" + dir + "'";
+  if (system(cmd.c_str()) != 0) fprintf(stderr, "could not remove %s\n", dir.c_str());
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  int devices = 200;
+  long batchFrames = 4096;
+  int repeats = 3;
+
+  int opt;
+  while ((opt = getopt(argc, argv, "d:b:r:h")) != -1) {
+    switch (opt) {
+      case 'd': devices = atoi(optarg); break;
+      case 'b': batchFrames = atol(optarg); break;
+      case 'r': repeats = atoi(optarg); break;
+      default:
+        fprintf(stderr, "Usage: %s [-d devices] [-b batch] [-r repeats]\n", argv[0]);
+        return opt == 'h' ? 0 : 2;
+    }
+  }
+  if (devices < 1) devices = 1;
+  if (batchFrames < 1) batchFrames = 1;
+  if (repeats < 1) repeats = 1;
+
+  const int minutes = 1440;
+  auto events = makeEvents(devices, minutes);
+  size_t bytes = 0;
+  for (const auto& e : events) bytes += e.size() + 1;
+  printf("%zu events (%d devices x %d uplinks), %.1f MB of JSON, batch %ld\n", events.size(),
+         devices, minutes, bytes / 1e6, batchFrames);
+  printf("%-8s %12s %14s %10s\n", "stage", "frames/s", "readings/s", "MB/s");
+
+  const char* names[] = {"parse", "decode", "ingest"};
+  for (int mode = PARSE; mode <= INGEST; mode++) {
+    Run best;
+    for (int i = 0; i < repeats; i++) {
+      std::string dir;
+      std::unique_ptr<TimeSeriesStore> store;
+      if (mode == INGEST) {
+        char path[] = "/tmp/lora_bench_XXXXXX";
+        dir = mkdtemp(path);
+        store.reset(new TimeSeriesStore(dir));
+        std::string error;
+        if (!store->open(error)) {
+          fprintf(stderr, "Could not open store: %s\n", error.c_str());
+          return 1;
+        }
+      }
+      Run r = run(events, (size_t)batchFrames, (Mode)mode, store.get());
+      if (mode == INGEST && r.stored != r.readings) {
+        fprintf(stderr, "stored %llu of %llu readings\n", (unsigned long long)r.stored,
+                (unsigned long long)r.readings);
+      }
+      store.reset();
+      if (!dir.empty()) removeTree(dir);
+      if (i == 0 || r.seconds < best.seconds) best = r;
+    }
+    char readings[32] = "-";
+    if (mode != PARSE) snprintf(readings, sizeof(readings), "%.0f", best.readings / best.seconds);
+    printf("%-8s %12.0f %14s %10.1f\n", names[mode], best.frames / best.seconds, readings,
+           bytes / 1e6 / best.seconds);
+  }
+  return 0;
+}
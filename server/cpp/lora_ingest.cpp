@@ -0,0 +1,183 @@
+// Backfills LoRaWAN uplinks from the network server into the history store.
+//
+// Reads saved ChirpStack uplink events, one JSON object per line, from
+// files or stdin, decodes them in batches (lora_uplink.h) and appends the
+// readings to the store the sensor server writes. Live uplinks go to the
+// running server instead (POST /api/lora/uplink from the HTTP
+// integration): the store admits one writer at a time, so this runs only
+// against a store no server has open, e.g. to load a capture of the MQTT
+// integration:
+//
+//   mosquitto_sub -h broker -t 'application/+/device/+/event/up' -W 3600 > events.jsonl
+//   lora_ingest -s STORE events.jsonl
+//
+// A batch is stored when it is full or the input goes quiet.
+//
+// Usage: lora_ingest [-s store] [-b batch] [-q] [file|- ...]
+// Prints a summary to stderr; exits 1 if the store could not be written.
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+#include "lora_uplink.h"
+
+namespace {
+
+const char* const DEFAULT_STORE_DIR = "/tmp/water-tank-store";
+
+struct Totals {
+  uint64_t events = 0;
+  uint64_t frames = 0;
+  uint64_t readings = 0;
+  uint64_t stored = 0;
+  uint64_t duplicates = 0;
+  uint64_t rejected = 0;
+};
+
+class Ingest {
+public:
+  Ingest(TimeSeriesStore& store, size_t batchFrames, bool quiet)
+    : _store(store), _batchFrames(batchFrames), _quiet(quiet) {}
+
+  void line(std::string_view text, const char* source, uint64_t lineNo) {
+    while (!text.empty() && (text.back() == '\r' || text.back() == ' ')) text.remove_suffix(1);
+    if (text.empty()) return;
+    _totals.events++;
+    std::string error;
+    if (!parseUplinkEvent(text, _event, error) || !_batch.add(_event, error)) {
+      _totals.rejected++;
+      if (!_quiet) fprintf(stderr, "%s:%llu: %s\n", source, (unsigned long long)lineNo, error.c_str());
+      return;
+    }
+    if (_batch.frames() >= _batchFrames) flush();
+  }
+
+  void flush() {
+    if (_batch.frames() == 0) return;
+    _totals.frames += _batch.frames();
+    _totals.readings += _batch.readings();
+    bool ok = true;
+    _totals.stored += _batch.store(_store, &_totals.duplicates, &ok);
+    if (!ok) _failed = true;
+    _batch.clear();
+  }
+
+  const Totals& totals() const { return _totals; }
+  bool failed() const { return _failed; }
+
+private:
+  TimeSeriesStore& _store;
+  size_t _batchFrames;
+  bool _quiet;
+  bool _failed = false;
+  UplinkEvent _event;
+  UplinkBatch _batch;
+  Totals _totals;
+};
+
+// Split fd into lines. A short read means the writer has nothing more for
+// now, so the batch is flushed instead of waiting for it to fill.
+bool readLines(int fd, const char* source, Ingest& ingest) {
+  static const size_t CHUNK = 1 << 16;
+  std::string pending;
+  char buf[CHUNK];
+  uint64_t lineNo = 0;
+  while (true) {
+    ssize_t n = read(fd, buf, sizeof(buf));
+    if (n < 0) {
+      if (errno == EINTR) continue;
+      fprintf(stderr, "%s: %s\n", source, strerror(errno));
+      return false;
+    }
+    if (n == 0) break;
+    pending.append(buf, (size_t)n);
+    size_t start = 0;
+    size_t nl;
+    while ((nl = pending.find('\n', start)) != std::string::npos) {
+      ingest.line(std::string_view(pending).substr(start, nl - start), source, ++lineNo);
+      start = nl + 1;
+    }
+    pending.erase(0, start);
+    if ((size_t)n < sizeof(buf)) ingest.flush();
+  }
+  ingest.line(pending, source, ++lineNo);
+  ingest.flush();
+  return true;
+}
+
+void usage(const char* prog) {
+  fprintf(stderr,
+          "Usage: %s [-s store] [-b batch] [-q] [file|- ...]\n"
+          "  -s DIR   history store directory (default %s)\n"
+          "  -b N     frames per batch (default 4096)\n"
+          "  -q       don't report rejected events\n"
+          "Reads ChirpStack uplink events (JSON lines) from the files, or stdin.\n",
+          prog, DEFAULT_STORE_DIR);
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  std::string storeDir = DEFAULT_STORE_DIR;
+  long batchFrames = 4096;
+  bool quiet = false;
+
+  int opt;
+  while ((opt = getopt(argc, argv, "s:b:qh")) != -1) {
+    switch (opt) {
+      case 's': storeDir = optarg; break;
+      case 'b': batchFrames = atol(optarg); break;
+      case 'q': quiet = true; break;
+      default:
+        usage(argv[0]);
+        return opt == 'h' ? 0 : 2;
+    }
+  }
+  if (batchFrames < 1) batchFrames = 1;
+
+  TimeSeriesStore store(storeDir);
+  std::string error;
+  if (!store.open(error)) {
+    fprintf(stderr, "Could not open history store: %s\n", error.c_str());
+    return 1;
+  }
+
+  Ingest ingest(store, (size_t)batchFrames, quiet);
+  bool readOk = true;
+  if (optind >= argc) {
+    readOk = readLines(STDIN_FILENO, "stdin", ingest);
+  }
+  for (int i = optind; i < argc; i++) {
+    if (strcmp(argv[i], "-") == 0) {
+      readOk &= readLines(STDIN_FILENO, "stdin", ingest);
+      continue;
+    }
+    int fd = open(argv[i], O_RDONLY);
+    if (fd < 0) {
+      fprintf(stderr, "%s: %s\n", argv[i], strerror(errno));
+      readOk = false;
+      continue;
+    }
+    readOk &= readLines(fd, argv[i], ingest);
+    close(fd);
+  }
+
+  const Totals& t = ingest.totals();
+  fprintf(stderr,
+          "%llu events, %llu frames, %llu readings: %llu stored, %llu duplicates, "
+          "%llu rejected\n",
+          (unsigned long long)t.events, (unsigned long long)t.frames,
+          (unsigned long long)t.readings, (unsigned long long)t.stored,
+          (unsigned long long)t.duplicates, (unsigned long long)t.rejected);
+  if (ingest.failed()) {
+    fprintf(stderr, "Some readings could not be written to %s\n", storeDir.c_str());
+    return 1;
+  }
+  return readOk ? 0 : 1;
+}
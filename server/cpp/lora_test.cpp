@@ -0,0 +1,272 @@
+// Tests for the LoRaWAN uplink decoder: base64, event parsing, frame
+// versions 1-3 and the legacy payload, and ingest into the history store
+// with replayed uplinks skipped. Timestamps are covered by parse_test.
+//
+// Build and run: make check
+
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+#include "LoRaFrame.h"
+#include "lora_uplink.h"
+#include "test_util.h"
+
+namespace {
+
+std::string makeEvent(const std::string& device, const std::string& time, int fPort,
+                      const std::string& data) {
+  return "{\"deduplicationId\":\"3d2a\",\"time\":\"" + time +
+         "\",\"deviceInfo\":{\"tenantName\":\"Farm\",\"deviceName\":\"" + device +
+         "\",\"devEui\":\"0011223344556677\",\"tags\":{\"time\":\"x\"}},\"devAddr\":\"01020304\","
+         "\"fCnt\":12,\"fPort\":" + std::to_string(fPort) + ",\"data\":\"" + data +
+         "\",\"rxInfo\":[{\"gatewayId\":\"aa\",\"time\":\"2000-01-01T00:00:00Z\",\"rssi\":-90}]}";
+}
+
+// Reading i of a slowly rising level, in packed units
+PackedReading packed(uint16_t i, uint8_t tank = 0) {
+  return PackedReading{(uint16_t)(1500 + 10 * i + tank), (uint16_t)(2000 + 3 * i),
+                       (uint16_t)(204 + 3 * i), (uint16_t)(60000 + 70 * i + 100 * tank)};
+}
+
+// A v1 (tanks == 1) or v2 frame of `count` samples, newest (index
+// count - 1) first
+std::string makeFrame(uint16_t count, uint8_t tanks, uint16_t first = 0) {
+  uint8_t buf[LORA_FRAME_MAX_PAYLOAD];
+  LoRaFrameEncoder encoder(buf, sizeof(buf), 5, tanks);
+  for (uint16_t i = count; i > 0; i--) {
+    PackedReading sample[LORA_FRAME_MAX_TANKS];
+    for (uint8_t t = 0; t < tanks; t++) sample[t] = packed((uint16_t)(first + i - 1), t);
+    CHECK(encoder.addSample(sample));
+  }
+  return base64Encode(buf, encoder.length());
+}
+
+bool decodes(const std::string& text, const std::vector<uint8_t>& expected) {
+  std::vector<uint8_t> out;
+  return base64Decode(text, out) && out == expected;
+}
+
+void testBase64() {
+  for (size_t length = 0; length < 20; length++) {
+    std::vector<uint8_t> data(length);
+    for (size_t i = 0; i < length; i++) data[i] = (uint8_t)(i * 37 + 250);
+    std::string text = base64Encode(data.data(), data.size());
+    CHECK(text.size() % 4 == 0);
+    CHECK(decodes(text, data));
+    // Unpadded
+    while (!text.empty() && text.back() == '=') text.pop_back();
+    CHECK(decodes(text, data));
+  }
+  CHECK(base64Encode((const uint8_t*)"foobar", 6) == "Zm9vYmFy");
+  CHECK(decodes("Zm9vYg==", {'f', 'o', 'o', 'b'}));
+  CHECK(decodes("-_8=", {0xFB, 0xFF}));  // URL-safe
+  CHECK(decodes("+/8=", {0xFB, 0xFF}));
+
+  std::vector<uint8_t> out{1, 2};
+  CHECK(base64Decode("AwQ=", out));  // Appends
+  CHECK((out == std::vector<uint8_t>{1, 2, 3, 4}));
+  CHECK(!base64Decode("Zm9v!mFy", out));
+  CHECK(!base64Decode("Zm9vY", out));  // Truncated group
+  CHECK(out.size() == 4);
+}
+
+void testEventParsing() {
+  UplinkEvent event;
+  std::string error;
+  CHECK(parseUplinkEvent(makeEvent("tank-3", "2025-01-02T03:04:05Z", 2, "AQID"), event, error));
+  CHECK(event.device == "tank-3");
+  // Not the gateway's or the tag's "time"
+  CHECK(event.timeUs == 1735787045000000LL);
+  CHECK(event.fPort == 2);
+  CHECK(event.data == "AQID");
+
+  // A display name that is not a series name falls back to the DevEUI
+  CHECK(parseUplinkEvent(makeEvent("Top \\\"Tank\\\" \\u00e9", "2025-01-02T03:04:05Z", 2, ""),
+                         event, error));
+  CHECK(event.device == "0011223344556677");
+  CHECK(event.data.empty());
+
+  CHECK(!parseUplinkEvent("{\"time\":\"2025-01-02T03:04:05Z\",\"fPort\":2,\"data\":\"AQID\"}",
+                          event, error));
+  CHECK(!parseUplinkEvent("{\"deviceInfo\":{\"devEui\":\"00aa\"},\"time\":\"2025-01-02T03:04:05Z\","
+                          "\"fPort\":2}", event, error));  // No payload (e.g. a MAC-only uplink)
+  CHECK(!parseUplinkEvent("{\"deviceInfo\":{\"devEui\":\"00aa\"},\"time\":\"yesterday\","
+                          "\"fPort\":2,\"data\":\"\"}", event, error));
+  CHECK(!parseUplinkEvent("{\"deviceInfo\":{\"devEui\":\"00aa\"},\"time\":\"2025-01-02T03:04:05Z\","
+                          "\"fPort\":2,\"data\":\"\"", event, error));  // Truncated
+  CHECK(!parseUplinkEvent("[1, 2]", event, error));
+  CHECK(!error.empty());
+}
+
+void testSingleTankFrame() {
+  UplinkBatch batch;
+  UplinkEvent event{"tank-1", 1735787045000000LL, LORA_FRAME_PORT, makeFrame(12, 1)};
+  std::string error;
+  CHECK(batch.add(event, error));
+  CHECK(batch.frames() == 1);
+  CHECK(batch.readings() == 12);
+
+  auto records = batch.records("tank-1");
+  CHECK(records.size() == 12);
+  for (size_t i = 0; i < records.size() && i < 12; i++) {
+    PackedReading r = packed((uint16_t)i);
+    // Oldest first, 5 s apart, ending at the uplink's time
+    CHECK(records[i].timestampUs == event.timeUs - (int64_t)(11 - i) * 5000000);
+    // As the WiFi path stores them
+    CHECK(records[i].voltage == (float)(r.voltage / 1000.0));
+    CHECK(records[i].pressureKpa == (float)(r.pressure / 100.0));
+    CHECK(records[i].depthM == (float)(r.depth / 1000.0));
+    CHECK(records[i].volumeL == (float)(r.volume / 100.0));
+  }
+}
+
+void testMultiTankFrame() {
+  UplinkBatch batch;
+  UplinkEvent event{"farm", 1735787045000000LL, LORA_FRAME_PORT, makeFrame(6, 4)};
+  std::string error;
+  CHECK(batch.add(event, error));
+  CHECK(batch.readings() == 24);
+
+  const char* names[] = {"farm", "farm-tank1", "farm-tank2", "farm-tank3"};
+  for (uint8_t t = 0; t < 4; t++) {
+    auto records = batch.records(names[t]);
+    CHECK(records.size() == 6);
+    for (size_t i = 0; i < records.size() && i < 6; i++) {
+      CHECK(records[i].timestampUs == event.timeUs - (int64_t)(5 - i) * 5000000);
+      CHECK(records[i].volumeL == (float)(packed((uint16_t)i, t).volume / 100.0));
+    }
+  }
+}
+
+// Volumes past 655.35 L come as version 3 frames
+void testWideVolumeFrame() {
+  uint8_t buf[LORA_FRAME_MAX_PAYLOAD];
+  LoRaFrameEncoder encoder(buf, sizeof(buf), 5, 2);
+  for (uint32_t i = 3; i > 0; i--) {
+    PackedReading sample[2] = {packed((uint16_t)i), packed((uint16_t)i, 1)};
+    sample[0].volume = 270000 + 150 * i;  // A 2.7 kL tank
+    CHECK(encoder.addSample(sample));
+  }
+  CHECK(buf[0] == LORA_FRAME_VERSION_WIDE);
+
+  UplinkBatch batch;
+  std::string error;
+  CHECK(batch.add(UplinkEvent{"big", 1735787045000000LL, LORA_FRAME_PORT,
+                              base64Encode(buf, encoder.length())}, error));
+  auto records = batch.records("big");
+  auto small = batch.records("big-tank1");
+  CHECK(records.size() == 3 && small.size() == 3);
+  for (size_t i = 0; i < records.size() && i < 3; i++) {
+    CHECK(records[i].volumeL == (float)((270000 + 150 * (i + 1)) / 100.0));
+    CHECK(small.size() == 3 && small[i].volumeL == (float)(packed((uint16_t)(i + 1), 1).volume / 100.0));
+  }
+}
+
+void testLegacyPayload() {
+  const uint8_t payload[8] = {0x05, 0xDC, 0x07, 0xD0, 0x00, 0xCC, 0xEA, 0x60};
+  UplinkBatch batch;
+  UplinkEvent event{"old-node", 1735787045000000LL, 1, base64Encode(payload, 8)};
+  std::string error;
+  CHECK(batch.add(event, error));
+  // Mixed in with frames: the swap must land in the right rows
+  UplinkEvent frame{"tank-1", 1735787045000000LL, LORA_FRAME_PORT, makeFrame(3, 1)};
+  CHECK(batch.add(frame, error));
+  CHECK(batch.add(UplinkEvent{"old-node", event.timeUs + 60000000, 1, event.data}, error));
+
+  auto records = batch.records("old-node");
+  CHECK(records.size() == 2);
+  if (records.size() == 2) {
+    CHECK(records[0].timestampUs == event.timeUs);
+    CHECK(records[1].timestampUs == event.timeUs + 60000000);
+    CHECK(records[0].voltage == (float)(1500 / 1000.0));
+    CHECK(records[0].pressureKpa == (float)(2000 / 100.0));
+    CHECK(records[0].depthM == (float)(204 / 1000.0));
+    CHECK(records[1].volumeL == (float)(60000 / 100.0));
+  }
+  CHECK(batch.records("tank-1").size() == 3);
+  CHECK(batch.records("tank-1")[2].voltage == (float)(packed(2).voltage / 1000.0));
+}
+
+void testRejectedPayloads() {
+  UplinkBatch batch;
+  std::string error;
+  std::string frame = makeFrame(4, 1);
+  std::vector<uint8_t> bytes;
+  CHECK(base64Decode(frame, bytes));
+
+  CHECK(!batch.add(UplinkEvent{"tank-1", 0, 3, frame}, error));  // Other port
+  CHECK(!batch.add(UplinkEvent{"tank-1", 0, LORA_FRAME_PORT, "not base64!"}, error));
+  CHECK(!batch.add(UplinkEvent{"tank-1", 0, LORA_FRAME_PORT,
+                               base64Encode(bytes.data(), bytes.size() - 1)}, error));
+  CHECK(!batch.add(UplinkEvent{"tank-1", 0, 1, base64Encode(bytes.data(), 7)}, error));
+  CHECK(!batch.add(UplinkEvent{"tank-1", 0, LORA_FRAME_PORT, ""}, error));
+  CHECK(batch.frames() == 0);
+  CHECK(batch.readings() == 0);
+}
+
+void testStoreSkipsReplays() {
+  TempDir tmp("lora_test");
+  const std::string& dir = tmp.path();
+  TimeSeriesStore store(dir);
+  std::string error;
+  CHECK(store.open(error));
+
+  const int64_t t0 = 1735787045000000LL;
+  UplinkBatch batch;
+  // Two uplinks a minute apart, twelve 5 s samples each: no overlap
+  CHECK(batch.add(UplinkEvent{"tank-1", t0, LORA_FRAME_PORT, makeFrame(12, 1, 0)}, error));
+  CHECK(batch.add(UplinkEvent{"tank-1", t0 + 60000000, LORA_FRAME_PORT, makeFrame(12, 1, 12)},
+                  error));
+  CHECK(batch.add(UplinkEvent{"farm", t0, LORA_FRAME_PORT, makeFrame(2, 2)}, error));
+  uint64_t duplicates = 0;
+  bool ok = false;
+  CHECK(batch.store(store, &duplicates, &ok) == 28);
+  CHECK(ok);
+  CHECK(duplicates == 0);
+  CHECK(store.recordCount("tank-1") == 24);
+  CHECK(store.recordCount("farm") == 2);
+  CHECK(store.recordCount("farm-tank1") == 2);
+
+  // The second uplink delivered again, and a next one overlapping it by
+  // half (a retransmission after a missed ACK)
+  batch.clear();
+  CHECK(batch.add(UplinkEvent{"tank-1", t0 + 60000000, LORA_FRAME_PORT, makeFrame(12, 1, 12)},
+                  error));
+  CHECK(batch.add(UplinkEvent{"tank-1", t0 + 90000000, LORA_FRAME_PORT, makeFrame(12, 1, 18)},
+                  error));
+  CHECK(batch.store(store, &duplicates, &ok) == 6);
+  CHECK(duplicates == 18);
+  CHECK(store.recordCount("tank-1") == 30);
+
+  std::vector<StoredRecord> stored;
+  store.scan("tank-1", 0, INT64_MAX, [&](const StoredRecord* r, size_t count) {
+    stored.insert(stored.end(), r, r + count);
+  });
+  CHECK(stored.size() == 30);
+  for (size_t i = 0; i < stored.size(); i++) {
+    CHECK(stored[i].timestampUs == t0 - 55000000 + (int64_t)i * 5000000);
+    CHECK(stored[i].depthM == (float)(packed((uint16_t)i).depth / 1000.0));
+  }
+}
+
+}  // namespace
+
+int main() {
+  testBase64();
+  testEventParsing();
+  testSingleTankFrame();
+  testMultiTankFrame();
+  testWideVolumeFrame();
+  testLegacyPayload();
+  testRejectedPayloads();
+  testStoreSkipsReplays();
+
+  if (failures) {
+    fprintf(stderr, "lora_test: %d failure(s)\n", failures);
+    return 1;
+  }
+  printf("lora_test: all checks passed\n");
+  return 0;
+}
@@ -0,0 +1,356 @@
+#include "lora_uplink.h"
+
+#include <algorithm>
+#include <cstring>
+
+#include "LoRaFrame.h"
+#include "json_scan.h"
+
+// ---------------------------------------------------------------------------
+// Base64
+// ---------------------------------------------------------------------------
+
+namespace {
+
+const char BASE64_ALPHABET[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+struct Base64Table {
+  int8_t value[256];
+  Base64Table() {
+    memset(value, -1, sizeof(value));
+    for (int i = 0; i < 64; i++) value[(unsigned char)BASE64_ALPHABET[i]] = (int8_t)i;
+    value['-'] = 62;  // URL-safe alphabet
+    value['_'] = 63;
+  }
+};
+
+const Base64Table BASE64;
+
+}  // namespace
+
+bool base64Decode(std::string_view in, std::vector<uint8_t>& out) {
+  while (!in.empty() && in.back() == '=') in.remove_suffix(1);
+  if (in.size() % 4 == 1) return false;
+  size_t start = out.size();
+  out.resize(start + in.size() / 4 * 3 + (in.size() % 4 ? in.size() % 4 - 1 : 0));
+  uint8_t* o = out.data() + start;
+  const unsigned char* p = reinterpret_cast<const unsigned char*>(in.data());
+  size_t whole = in.size() / 4 * 4;
+  int bad = 0;
+  for (size_t i = 0; i < whole; i += 4) {
+    int a = BASE64.value[p[i]], b = BASE64.value[p[i + 1]];
+    int c = BASE64.value[p[i + 2]], d = BASE64.value[p[i + 3]];
+    bad |= a | b | c | d;
+    uint32_t v = (uint32_t)a << 18 | (uint32_t)b << 12 | (uint32_t)c << 6 | (uint32_t)d;
+    *o++ = (uint8_t)(v >> 16);
+    *o++ = (uint8_t)(v >> 8);
+    *o++ = (uint8_t)v;
+  }
+  size_t rest = in.size() - whole;
+  if (rest > 0) {
+    uint32_t v = 0;
+    for (size_t k = 0; k < rest; k++) {
+      int x = BASE64.value[p[whole + k]];
+      bad |= x;
+      v |= (uint32_t)(x & 63) << (18 - 6 * k);
+    }
+    *o++ = (uint8_t)(v >> 16);
+    if (rest == 3) *o++ = (uint8_t)(v >> 8);
+  }
+  if (bad < 0) {
+    out.resize(start);
+    return false;
+  }
+  return true;
+}
+
+std::string base64Encode(const uint8_t* data, size_t length) {
+  std::string out;
+  out.reserve((length + 2) / 3 * 4);
+  for (size_t i = 0; i < length; i += 3) {
+    uint32_t v = (uint32_t)data[i] << 16;
+    if (i + 1 < length) v |= (uint32_t)data[i + 1] << 8;
+    if (i + 2 < length) v |= data[i + 2];
+    out += BASE64_ALPHABET[v >> 18];
+    out += BASE64_ALPHABET[(v >> 12) & 63];
+    out += i + 1 < length ? BASE64_ALPHABET[(v >> 6) & 63] : '=';
+    out += i + 2 < length ? BASE64_ALPHABET[v & 63] : '=';
+  }
+  return out;
+}
+
+// ---------------------------------------------------------------------------
+// Uplink event JSON
+// ---------------------------------------------------------------------------
+
+namespace {
+
+// deviceInfo.deviceName and deviceInfo.devEui; other members are skipped
+bool readDeviceInfo(JsonScanner& json, std::string_view& deviceName, std::string_view& devEui) {
+  if (json.consume('}')) return true;
+  do {
+    std::string_view key;
+    if (!json.string(key) || !json.consume(':')) return false;
+    if ((key == "deviceName" || key == "devEui") && json.peek('"')) {
+      if (!json.string(key == "deviceName" ? deviceName : devEui)) return false;
+    } else if (!json.skipValue()) {
+      return false;
+    }
+  } while (json.consume(','));
+  return json.consume('}');
+}
+
+// Top-level members of an event; false on malformed JSON
+bool readEvent(JsonScanner& json, std::string_view& deviceName, std::string_view& devEui,
+               std::string_view& time, double& fPort, std::string_view& data, bool& haveData) {
+  if (!json.consume('{')) return false;
+  if (json.consume('}')) return true;
+  do {
+    std::string_view key;
+    if (!json.string(key) || !json.consume(':')) return false;
+    bool ok;
+    if (key == "deviceInfo" && json.peek('{')) {
+      json.consume('{');
+      ok = readDeviceInfo(json, deviceName, devEui);
+    } else if (key == "time" && json.peek('"')) {
+      ok = json.string(time);
+    } else if (key == "fPort" && !json.peek('"') && !json.peek('{') && !json.peek('[')) {
+      ok = json.number(fPort);
+    } else if (key == "data" && json.peek('"')) {
+      ok = haveData = json.string(data);
+    } else {
+      ok = json.skipValue();
+    }
+    if (!ok) return false;
+  } while (json.consume(','));
+  return json.consume('}');
+}
+
+}  // namespace
+
+bool parseUplinkEvent(std::string_view text, UplinkEvent& out, std::string& error) {
+  std::string_view deviceName, devEui, time, data;
+  double fPort = -1;
+  bool haveData = false;
+  JsonScanner json(text);
+  if (!readEvent(json, deviceName, devEui, time, fPort, data, haveData)) {
+    error = "malformed JSON at offset " + std::to_string(json.offset());
+    return false;
+  }
+  if (!json.atEnd()) {
+    error = "trailing data after JSON at offset " + std::to_string(json.offset());
+    return false;
+  }
+
+  JsonScanner::unescape(deviceName, out.device);
+  if (!TimeSeriesStore::validDeviceName(out.device)) {
+    JsonScanner::unescape(devEui, out.device);
+    if (!TimeSeriesStore::validDeviceName(out.device)) {
+      error = "no usable deviceInfo.deviceName or devEui";
+      return false;
+    }
+  }
+  if (!parseRfc3339(time, out.timeUs)) {
+    error = "missing or invalid time";
+    return false;
+  }
+  if (!(fPort >= 0 && fPort <= 255) || fPort != (int)fPort) {
+    error = "missing or invalid fPort";
+    return false;
+  }
+  out.fPort = (int)fPort;
+  if (!haveData) {
+    error = "no data (uplink without payload)";
+    return false;
+  }
+  JsonScanner::unescape(data, out.data);
+  return true;
+}
+
+// ---------------------------------------------------------------------------
+// UplinkBatch
+// ---------------------------------------------------------------------------
+
+uint32_t UplinkBatch::seriesId(const std::string& device, uint8_t tank) {
+  std::string name = tank == 0 ? device : device + "-tank" + std::to_string(tank);
+  auto it = _ids.find(name);
+  if (it != _ids.end()) return it->second;
+  uint32_t id = (uint32_t)_names.size();
+  _names.push_back(name);
+  _ids.emplace(std::move(name), id);
+  return id;
+}
+
+void UplinkBatch::pushReading(uint32_t series, int64_t timeUs, uint16_t v, uint16_t p,
+                              uint16_t d, uint32_t l) {
+  _series.push_back(series);
+  _timeUs.push_back(timeUs);
+  _voltage.push_back(v);
+  _pressure.push_back(p);
+  _depth.push_back(d);
+  _volume.push_back(l);
+}
+
+bool UplinkBatch::add(const UplinkEvent& event, std::string& error) {
+  _payload.clear();
+  if (!base64Decode(event.data, _payload)) {
+    error = "invalid base64 payload";
+    return false;
+  }
+
+  if (event.fPort == 1) {
+    // Original firmware: one reading, four big-endian uint16, swapped in
+    // bulk by swapLegacy()
+    if (_payload.size() != 8) {
+      error = "legacy payload is not 8 bytes";
+      return false;
+    }
+    uint16_t words[4];
+    memcpy(words, _payload.data(), sizeof(words));
+    _legacyRows.push_back((uint32_t)_timeUs.size());
+    _legacyWords.insert(_legacyWords.end(), words, words + 4);
+    pushReading(seriesId(event.device, 0), event.timeUs, 0, 0, 0, 0);
+    _frames++;
+    return true;
+  }
+  if (event.fPort != LORA_FRAME_PORT) {
+    error = "not a tank frame (fPort " + std::to_string(event.fPort) + ")";
+    return false;
+  }
+
+  LoRaFrameReader reader(_payload.data(), (uint16_t)std::min<size_t>(_payload.size(), 0xFFFF));
+  uint8_t tanks = reader.tanks();
+  // Newest first in the frame; the store wants oldest first
+  std::vector<PackedReading> samples;
+  samples.reserve((size_t)reader.count() * tanks);
+  PackedReading sample[LORA_FRAME_MAX_TANKS];
+  while (reader.nextSample(sample)) samples.insert(samples.end(), sample, sample + tanks);
+  if (reader.malformed() || samples.empty()) {
+    error = "malformed frame";
+    return false;
+  }
+
+  uint32_t ids[LORA_FRAME_MAX_TANKS];
+  for (uint8_t t = 0; t < tanks; t++) ids[t] = seriesId(event.device, t);
+  size_t count = samples.size() / tanks;
+  int64_t stepUs = (int64_t)reader.intervalSec() * 1000000;
+  for (size_t i = count; i > 0; i--) {
+    int64_t timeUs = event.timeUs - (int64_t)(i - 1) * stepUs;
+    for (uint8_t t = 0; t < tanks; t++) {
+      const PackedReading& r = samples[(i - 1) * tanks + t];
+      pushReading(ids[t], timeUs, r.voltage, r.pressure, r.depth, r.volume);
+    }
+  }
+  _frames++;
+  return true;
+}
+
+void UplinkBatch::clear() {
+  _frames = 0;
+  _names.clear();
+  _ids.clear();
+  _series.clear();
+  _timeUs.clear();
+  _voltage.clear();
+  _pressure.clear();
+  _depth.clear();
+  _volume.clear();
+  _legacyWords.clear();
+  _legacyRows.clear();
+}
+
+void UplinkBatch::swapLegacy() {
+  size_t n = _legacyWords.size();
+  uint16_t* w = _legacyWords.data();
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+#pragma omp simd
+  for (size_t i = 0; i < n; i++) w[i] = (uint16_t)((w[i] >> 8) | (w[i] << 8));
+#endif
+  for (size_t k = 0; k < _legacyRows.size(); k++) {
+    uint32_t row = _legacyRows[k];
+    _voltage[row] = w[4 * k];
+    _pressure[row] = w[4 * k + 1];
+    _depth[row] = w[4 * k + 2];
+    _volume[row] = w[4 * k + 3];
+  }
+  _legacyWords.clear();
+  _legacyRows.clear();
+}
+
+// Packed units to floats, as the WiFi path stores them ((float)(x / 1000.0)).
+// The simd pragmas (with -fopenmp-simd) vectorize these at -O2, whose
+// default cost model gives up on loops that need a scalar tail.
+void UplinkBatch::scale() {
+  size_t n = _timeUs.size();
+  _volts.resize(n);
+  _kpa.resize(n);
+  _depthM.resize(n);
+  _liters.resize(n);
+  const uint16_t* v = _voltage.data();
+  const uint16_t* p = _pressure.data();
+  const uint16_t* d = _depth.data();
+  const uint32_t* l = _volume.data();
+  float* vo = _volts.data();
+  float* po = _kpa.data();
+  float* dout = _depthM.data();
+  float* lo = _liters.data();
+#pragma omp simd
+  for (size_t i = 0; i < n; i++) vo[i] = (float)(v[i] / 1000.0);
+#pragma omp simd
+  for (size_t i = 0; i < n; i++) po[i] = (float)(p[i] / 100.0);
+#pragma omp simd
+  for (size_t i = 0; i < n; i++) dout[i] = (float)(d[i] / 1000.0);
+#pragma omp simd
+  for (size_t i = 0; i < n; i++) lo[i] = (float)(l[i] / 100.0);
+}
+
+std::vector<StoredRecord> UplinkBatch::records(const std::string& name) {
+  swapLegacy();
+  scale();
+  std::vector<StoredRecord> out;
+  auto it = _ids.find(name);
+  if (it == _ids.end()) return out;
+  for (size_t i = 0; i < _series.size(); i++) {
+    if (_series[i] != it->second) continue;
+    out.push_back(StoredRecord{_timeUs[i], _volts[i], _kpa[i], _depthM[i], _liters[i]});
+  }
+  return out;
+}
+
+size_t UplinkBatch::store(TimeSeriesStore& store, uint64_t* duplicates, bool* ok) {
+  swapLegacy();
+  scale();
+  if (ok) *ok = true;
+
+  // Counting sort of the readings by series, keeping batch order
+  size_t n = _series.size();
+  std::vector<size_t> start(_names.size() + 1, 0);
+  for (size_t i = 0; i < n; i++) start[_series[i] + 1]++;
+  for (size_t s = 0; s < _names.size(); s++) start[s + 1] += start[s];
+  std::vector<uint32_t> order(n);
+  std::vector<size_t> next(start.begin(), start.end() - 1);
+  for (size_t i = 0; i < n; i++) order[next[_series[i]]++] = (uint32_t)i;
+
+  size_t stored = 0;
+  std::vector<StoredRecord> records;
+  for (size_t s = 0; s < _names.size(); s++) {
+    int64_t last = store.lastTimestampUs(_names[s]);
+    records.clear();
+    for (size_t k = start[s]; k < start[s + 1]; k++) {
+      uint32_t i = order[k];
+      if (_timeUs[i] <= last) {
+        if (duplicates) (*duplicates)++;
+        continue;
+      }
+      last = _timeUs[i];
+      records.push_back(StoredRecord{_timeUs[i], _volts[i], _kpa[i], _depthM[i], _liters[i]});
+    }
+    if (records.empty()) continue;
+    if (store.append(_names[s], records.data(), records.size())) {
+      stored += records.size();
+    } else if (ok) {
+      *ok = false;
+    }
+  }
+  return stored;
+}
@@ -0,0 +1,98 @@
+#ifndef SENSOR_SERVER_LORA_UPLINK_H
+#define SENSOR_SERVER_LORA_UPLINK_H
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "time_parse.h"  // parseRfc3339()
+#include "timeseries_store.h"
+
+// Server-side consumer of the firmware's LoRaWAN uplinks.
+//
+// The network server (ChirpStack v4, behind Basic Station gateways)
+// delivers each uplink as a JSON event, on MQTT topic
+// application/<id>/device/<devEui>/event/up or POSTed by the HTTP
+// integration, with the frame base64-encoded in "data". This decodes
+// batches of those events into the history store the WiFi path writes:
+//
+//   fPort 2   multi-sample frames, versions 1-3 (include/LoRaFrame.h)
+//   fPort 1   the original single 8-byte reading
+//
+// A frame's readings are timestamped back from the event's "time" at the
+// frame's interval. Tank N >= 1 of a multi-tank frame goes to the
+// "<device>-tankN" series, as with WiFi batch rows.
+//
+// Decoding is column-wise: base64 and the varint deltas are serial per
+// frame, but the fixed-width big-endian fields and the scaling from packed
+// units to floats run as flat loops over the whole batch, which the
+// compiler vectorizes.
+
+// Standard or URL-safe base64, padding optional. Appends to out; false on
+// any other character or a truncated final group.
+bool base64Decode(std::string_view in, std::vector<uint8_t>& out);
+
+// Standard base64 with padding (test and benchmark events)
+std::string base64Encode(const uint8_t* data, size_t length);
+
+struct UplinkEvent {
+  std::string device;     // deviceInfo.deviceName if usable as a series name, else devEui
+  int64_t timeUs = 0;     // "time", Unix microseconds
+  int fPort = -1;
+  std::string data;       // Base64 payload
+};
+
+// One uplink event (JSON object). Fails on malformed JSON or a missing
+// device, time or payload.
+bool parseUplinkEvent(std::string_view json, UplinkEvent& out, std::string& error);
+
+// Decoded readings of many uplinks, kept as columns until store()
+class UplinkBatch {
+public:
+  // Decode one event's payload. Returns false for a payload that is not a
+  // tank frame (nothing is added).
+  bool add(const UplinkEvent& event, std::string& error);
+
+  size_t frames() const { return _frames; }
+  size_t readings() const { return _timeUs.size(); }
+  void clear();
+
+  // Scale to records and append them to `store`, each series oldest
+  // first. Readings no newer than what the series already holds (frames
+  // overlapping an earlier uplink, or an event replayed) are skipped and
+  // counted in *duplicates. Returns the number stored; false in *ok if an
+  // append failed.
+  size_t store(TimeSeriesStore& store, uint64_t* duplicates, bool* ok);
+
+  // The scaled records of series `name` in batch order (tests, benchmarks)
+  std::vector<StoredRecord> records(const std::string& name);
+
+private:
+  uint32_t seriesId(const std::string& device, uint8_t tank);
+  void pushReading(uint32_t series, int64_t timeUs, uint16_t v, uint16_t p, uint16_t d, uint32_t l);
+  void swapLegacy();
+  void scale();
+
+  std::vector<uint8_t> _payload;  // Scratch for one decoded frame
+  size_t _frames = 0;
+
+  std::vector<std::string> _names;
+  std::unordered_map<std::string, uint32_t> _ids;
+
+  // One entry per reading
+  std::vector<uint32_t> _series;
+  std::vector<int64_t> _timeUs;
+  std::vector<uint16_t> _voltage, _pressure, _depth;
+  std::vector<uint32_t> _volume;
+
+  // Legacy 8-byte payloads, still big-endian, and the reading each fills
+  std::vector<uint16_t> _legacyWords;
+  std::vector<uint32_t> _legacyRows;
+
+  // Scaled columns
+  std::vector<float> _volts, _kpa, _depthM, _liters;
+};
+
+#endif
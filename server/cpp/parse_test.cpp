@@ -0,0 +1,129 @@
+// Tests for the parsing shared by the LoRa decoder and the log importer:
+// JsonScanner (strings, escapes, numbers, skipping nested values,
+// malformed input) and RFC 3339 and log timestamps.
+//
+// Build and run: make check
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+#include <string>
+
+#include "json_scan.h"
+#include "time_parse.h"
+#include "test_util.h"
+
+namespace {
+
+// 2025-01-02T03:04:05Z
+const int64_t T0_US = 1735787045LL * 1000000;
+
+bool skips(const std::string& text) {
+  JsonScanner json(text);
+  return json.skipValue() && json.atEnd();
+}
+
+void testScannerValues() {
+  std::string input = " {\"a\" : \"x\\\"y\\u00e9\\ud83d\\ude00\\/\", \"b\":-1.5e2, \"c\":NaN} ";
+  JsonScanner json(input);
+  std::string_view raw;
+  std::string text;
+  double number = 0;
+  CHECK(json.consume('{'));
+  CHECK(json.string(raw) && raw == "a" && json.consume(':'));
+  CHECK(json.string(raw) && raw == "x\\\"y\\u00e9\\ud83d\\ude00\\/");
+  JsonScanner::unescape(raw, text);
+  CHECK(text == "x\"y\xc3\xa9\xf0\x9f\x98\x80/");
+  CHECK(json.consume(',') && json.string(raw) && raw == "b" && json.consume(':'));
+  CHECK(json.peek('-') && json.number(number) && number == -150.0);
+  CHECK(json.consume(',') && json.string(raw) && json.consume(':'));
+  CHECK(json.number(number) && std::isnan(number));
+  CHECK(json.consume('}') && json.atEnd());
+  CHECK(json.offset() == input.size());
+
+  JsonScanner big("1e999");
+  CHECK(!big.number(number));  // Out of range
+}
+
+void testScannerSkipsAndRejects() {
+  CHECK(skips("{\"a\":[1,true,null,{\"b\":[]},\"x\\\\\"],\"c\":{}}"));
+  CHECK(skips("[]"));
+  CHECK(skips("-Infinity"));
+  CHECK(!skips("{\"a\":1,}"));
+  CHECK(!skips("[1 2]"));
+  CHECK(!skips("\"tab\there\""));  // Control character
+  CHECK(!skips("\"\\x\""));
+  CHECK(!skips("\"\\u12g4\""));
+  CHECK(!skips("-"));
+  CHECK(!skips("1."));
+  CHECK(!skips("tru"));
+  CHECK(!skips("{\"a\":1"));
+  CHECK(skips(std::string(64, '[') + std::string(64, ']')));
+  CHECK(!skips(std::string(100, '[') + std::string(100, ']')));  // Too deep
+}
+
+void testRfc3339() {
+  int64_t us = -1;
+  CHECK(parseRfc3339("1970-01-01T00:00:00Z", us) && us == 0);
+  CHECK(parseRfc3339("2025-01-02T03:04:05Z", us) && us == T0_US);
+  CHECK(parseRfc3339("2025-01-02T03:04:05.123456789Z", us) && us == T0_US + 123456);
+  CHECK(parseRfc3339("2025-01-02T13:04:05.5+10:00", us) && us == T0_US + 500000);
+  CHECK(parseRfc3339("2024-02-29T23:59:59-00:00", us) && us == 1709251199000000LL);
+  CHECK(parseRfc3339("2025-01-02t03:04:05z", us) && us == T0_US);
+  CHECK(!parseRfc3339("2025-01-02T03:04:05", us));  // No zone
+  CHECK(!parseRfc3339("2025-13-02T03:04:05Z", us));
+  CHECK(!parseRfc3339("2025-01-02T03:04:05.Z", us));
+  CHECK(!parseRfc3339("2025-01-02T03:04:05Zjunk", us));
+  CHECK(!parseRfc3339("", us));
+}
+
+void testLogTimestamps() {
+  int64_t us = 0;
+  CHECK(parseLogTimestamp("2025-01-02T03:04:05Z", us) && us == T0_US);
+  CHECK(parseLogTimestamp("2025-01-02T05:04:05.25+02:00", us) && us == T0_US + 250000);
+  CHECK(parseLogTimestamp("2025-01-02T01:34:05-01:30", us) && us == T0_US);
+  CHECK(parseLogTimestamp("2025-01-02 03:04:05.5Z", us) && us == T0_US + 500000);
+
+  // Naive timestamps are local time
+  setenv("TZ", "EST5EDT", 1);
+  tzset();
+  CHECK(parseLogTimestamp("2025-01-01T22:04:05", us) && us == T0_US);
+  CHECK(parseLogTimestamp("2025-07-01T12:00:00", us) && us == 1751385600LL * 1000000);
+  setenv("TZ", "UTC", 1);
+  tzset();
+  CHECK(parseLogTimestamp("2025-01-02T03:04:05", us) && us == T0_US);
+
+  CHECK(!parseLogTimestamp("2025-01-02", us));
+  CHECK(!parseLogTimestamp("2025-13-02T03:04:05", us));
+  CHECK(!parseLogTimestamp("2025-01-02T03:04:05.", us));
+  CHECK(!parseLogTimestamp("2025-01-02T03:04:05+0200", us));
+  CHECK(!parseLogTimestamp("2025-01-02T03:04:05Zx", us));
+}
+
+void testDaysFromCivil() {
+  CHECK(daysFromCivil(1970, 1, 1) == 0);
+  CHECK(daysFromCivil(2000, 3, 1) == 11017);
+  CHECK(daysFromCivil(1969, 12, 31) == -1);
+  CHECK(daysFromCivil(2025, 1, 2) * 86400 == 1735776000LL);
+}
+
+}  // namespace
+
+int main() {
+  setenv("TZ", "UTC", 1);
+  tzset();
+
+  testScannerValues();
+  testScannerSkipsAndRejects();
+  testRfc3339();
+  testLogTimestamps();
+  testDaysFromCivil();
+
+  if (failures) {
+    fprintf(stderr, "parse_test: %d failure(s)\n", failures);
+    return 1;
+  }
+  printf("parse_test: all checks passed\n");
+  return 0;
+}
@@ -0,0 +1,604 @@
+#include "readings.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <charconv>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <fcntl.h>
+#include <unistd.h>
+
+// ---------------------------------------------------------------------------
+// Python-compatible formatting
+// ---------------------------------------------------------------------------
+
+namespace {
+
+// Shortest round-trip digits (from to_chars scientific) laid out the way
+// float.__repr__ does: positional for exponents -4..15, otherwise d.ddde+XX
+std::string reprLayout(std::string_view s) {
+  std::string out;
+  if (s[0] == '-') {
+    out += '-';
+    s.remove_prefix(1);
+  }
+  size_t e = s.find('e');
+  std::string digits(1, s[0]);
+  if (e > 2) digits.append(s.substr(2, e - 2));
+  int exp = 0;
+  std::string_view expText = s.substr(e + 1);
+  if (expText[0] == '+') expText.remove_prefix(1);
+  std::from_chars(expText.data(), expText.data() + expText.size(), exp);
+
+  if (exp >= -4 && exp < 16) {
+    if (exp < 0) {
+      out += "0.";
+      out.append((size_t)(-exp - 1), '0');
+      out += digits;
+    } else if (digits.size() <= (size_t)exp + 1) {
+      out += digits;
+      out.append((size_t)exp + 1 - digits.size(), '0');
+      out += ".0";
+    } else {
+      out.append(digits, 0, (size_t)exp + 1);
+      out += '.';
+      out.append(digits, (size_t)exp + 1, std::string::npos);
+    }
+  } else {
+    out += digits[0];
+    if (digits.size() > 1) {
+      out += '.';
+      out.append(digits, 1, std::string::npos);
+    }
+    char expBuf[16];
+    snprintf(expBuf, sizeof(expBuf), "e%c%02d", exp < 0 ? '-' : '+', std::abs(exp));
+    out += expBuf;
+  }
+  return out;
+}
+
+}  // namespace
+
+std::string pythonFloat(double v) {
+  if (std::isnan(v)) return "NaN";
+  if (std::isinf(v)) return v > 0 ? "Infinity" : "-Infinity";
+  char sci[32];
+  auto res = std::to_chars(sci, sci + sizeof(sci), v, std::chars_format::scientific);
+  return reprLayout(std::string_view(sci, res.ptr - sci));
+}
+
+std::string shortFloat(float v) {
+  if (std::isnan(v)) return "NaN";
+  if (std::isinf(v)) return v > 0 ? "Infinity" : "-Infinity";
+  char sci[32];
+  auto res = std::to_chars(sci, sci + sizeof(sci), v, std::chars_format::scientific);
+  return reprLayout(std::string_view(sci, res.ptr - sci));
+}
+
+std::string isoTimestamp(Clock::time_point t) {
+  auto us = std::chrono::duration_cast<std::chrono::microseconds>(t.time_since_epoch()).count();
+  time_t sec = (time_t)(us / 1000000);
+  long frac = (long)(us % 1000000);
+  if (frac < 0) {
+    frac += 1000000;
+    sec--;
+  }
+
+  // localtime_r() takes the timezone lock; most calls land in the same second
+  thread_local time_t cachedSec = -1;
+  thread_local char cachedPrefix[32];
+  if (sec != cachedSec) {
+    struct tm tmLocal;
+    localtime_r(&sec, &tmLocal);
+    strftime(cachedPrefix, sizeof(cachedPrefix), "%Y-%m-%dT%H:%M:%S", &tmLocal);
+    cachedSec = sec;
+  }
+
+  std::string out(cachedPrefix);
+  if (frac != 0) {
+    char fracBuf[8];
+    snprintf(fracBuf, sizeof(fracBuf), ".%06ld", frac);
+    out += fracBuf;
+  }
+  return out;
+}
+
+void appendReadingJson(std::string& out, const Reading& r) {
+  out += "{\"voltage\": ";
+  out += pythonFloat(r.voltage);
+  out += ", \"pressure_kpa\": ";
+  out += pythonFloat(r.pressure_kpa);
+  out += ", \"water_depth_m\": ";
+  out += pythonFloat(r.water_depth_m);
+  out += ", \"volume_liters\": ";
+  out += pythonFloat(r.volume_liters);
+  out += ", \"timestamp\": \"";
+  out += r.timestamp;
+  out += '"';
+  if (r.hasTank) {
+    out += ", \"tank\": ";
+    out += std::to_string(r.tank);
+  }
+  out += '}';
+}
+
+// ---------------------------------------------------------------------------
+// Request parsing
+// ---------------------------------------------------------------------------
+
+namespace {
+
+// str.strip() whitespace for ASCII input
+bool isPySpace(char c) {
+  return c == ' ' || (c >= '\t' && c <= '\r') || (c >= 0x1c && c <= 0x1f);
+}
+
+std::string_view strip(std::string_view s) {
+  while (!s.empty() && isPySpace(s.front())) s.remove_prefix(1);
+  while (!s.empty() && isPySpace(s.back())) s.remove_suffix(1);
+  return s;
+}
+
+// repr(str), for error messages
+std::string pyRepr(std::string_view s) {
+  char quote = (s.find('\'') != std::string_view::npos &&
+                s.find('"') == std::string_view::npos) ? '"' : '\'';
+  std::string out(1, quote);
+  for (unsigned char c : s) {
+    if (c == '\\' || c == (unsigned char)quote) {
+      out += '\\';
+      out += (char)c;
+    } else if (c == '\n') {
+      out += "\\n";
+    } else if (c == '\r') {
+      out += "\\r";
+    } else if (c == '\t') {
+      out += "\\t";
+    } else if (c < 0x20 || c == 0x7f) {
+      char hex[8];
+      snprintf(hex, sizeof(hex), "\\x%02x", c);
+      out += hex;
+    } else {
+      out += (char)c;
+    }
+  }
+  out += quote;
+  return out;
+}
+
+// Python allows single underscores between digits ("1_000")
+bool removeDigitUnderscores(std::string_view s, std::string& out) {
+  out.clear();
+  for (size_t i = 0; i < s.size(); i++) {
+    if (s[i] == '_') {
+      if (i == 0 || i + 1 == s.size() || !isdigit((unsigned char)s[i - 1]) ||
+          !isdigit((unsigned char)s[i + 1])) {
+        return false;
+      }
+      continue;
+    }
+    out += s[i];
+  }
+  return true;
+}
+
+bool equalsIgnoreCase(std::string_view a, const char* b) {
+  size_t n = strlen(b);
+  if (a.size() != n) return false;
+  for (size_t i = 0; i < n; i++) {
+    if (tolower((unsigned char)a[i]) != b[i]) return false;
+  }
+  return true;
+}
+
+// float(text)
+bool parsePyFloat(std::string_view text, double& out) {
+  std::string s;
+  if (!removeDigitUnderscores(strip(text), s) || s.empty()) return false;
+
+  std::string_view body(s);
+  bool negative = false;
+  if (body[0] == '+' || body[0] == '-') {
+    negative = body[0] == '-';
+    body.remove_prefix(1);
+  }
+  double value;
+  if (equalsIgnoreCase(body, "inf") || equalsIgnoreCase(body, "infinity")) {
+    value = HUGE_VAL;
+  } else if (equalsIgnoreCase(body, "nan")) {
+    value = NAN;
+  } else {
+    // Decimal only: keeps strtod from accepting hex or a second sign
+    bool digit = false;
+    for (char c : body) {
+      if (isdigit((unsigned char)c)) {
+        digit = true;
+      } else if (c != '.' && c != 'e' && c != 'E' && c != '+' && c != '-') {
+        return false;
+      }
+    }
+    if (!digit || body[0] == '+' || body[0] == '-') return false;
+    std::string digits(body);
+    char* end = nullptr;
+    value = strtod(digits.c_str(), &end);
+    if (end != digits.c_str() + digits.size()) return false;
+  }
+  out = negative ? -value : value;
+  return true;
+}
+
+// int(text), limited to 64 bits
+bool parsePyInt(std::string_view text, long long& out) {
+  std::string s;
+  if (!removeDigitUnderscores(strip(text), s) || s.empty()) return false;
+  const char* first = s.data();
+  const char* last = s.data() + s.size();
+  if (*first == '+') first++;
+  if (first == last || *first == '+') return false;
+  auto res = std::from_chars(first, last, out);
+  return res.ec == std::errc() && res.ptr == last;
+}
+
+int hexValue(char c) {
+  if (c >= '0' && c <= '9') return c - '0';
+  if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+  if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+  return -1;
+}
+
+// urllib.parse.unquote_plus()
+std::string unquotePlus(std::string_view s) {
+  std::string out;
+  out.reserve(s.size());
+  for (size_t i = 0; i < s.size(); i++) {
+    if (s[i] == '+') {
+      out += ' ';
+    } else if (s[i] == '%' && i + 2 < s.size() && hexValue(s[i + 1]) >= 0 &&
+               hexValue(s[i + 2]) >= 0) {
+      out += (char)(hexValue(s[i + 1]) * 16 + hexValue(s[i + 2]));
+      i += 2;
+    } else {
+      out += s[i];
+    }
+  }
+  return out;
+}
+
+}  // namespace
+
+bool parseSensorQuery(std::string_view query, Clock::time_point now,
+                      Reading& out, std::string& error) {
+  // parse_qs(): first value wins, blank values and bare names are dropped
+  static const char* const FIELDS[] = {"voltage", "pressure_kpa", "water_depth_m", "volume_liters"};
+  // Short names sent by the firmware's /update requests (FIRMWARE_PARAM_ALIASES)
+  static const char* const ALIASES[] = {nullptr, "pressure", "depth", "volume"};
+  std::string values[4];
+  bool have[4] = {false, false, false, false};
+  std::string aliasValues[4];
+  bool haveAlias[4] = {false, false, false, false};
+
+  while (!query.empty()) {
+    size_t amp = query.find('&');
+    std::string_view pair = query.substr(0, amp);
+    query = amp == std::string_view::npos ? std::string_view() : query.substr(amp + 1);
+
+    size_t eq = pair.find('=');
+    if (eq == std::string_view::npos || eq + 1 == pair.size()) continue;
+    std::string name = unquotePlus(pair.substr(0, eq));
+    for (int f = 0; f < 4; f++) {
+      if (!have[f] && name == FIELDS[f]) {
+        values[f] = unquotePlus(pair.substr(eq + 1));
+        have[f] = true;
+      } else if (!haveAlias[f] && ALIASES[f] && name == ALIASES[f]) {
+        aliasValues[f] = unquotePlus(pair.substr(eq + 1));
+        haveAlias[f] = true;
+      }
+    }
+  }
+
+  double parsed[4] = {0.0, 0.0, 0.0, 0.0};
+  for (int f = 0; f < 4; f++) {
+    const std::string* text = have[f] ? &values[f] : (haveAlias[f] ? &aliasValues[f] : nullptr);
+    if (text && !parsePyFloat(*text, parsed[f])) {
+      error = "could not convert string to float: " + pyRepr(*text);
+      return false;
+    }
+  }
+
+  out.voltage = parsed[0];
+  out.pressure_kpa = parsed[1];
+  out.water_depth_m = parsed[2];
+  out.volume_liters = parsed[3];
+  out.timestamp = isoTimestamp(now);
+  out.timeUs = toUnixMicros(now);
+  return true;
+}
+
+std::string queryParam(std::string_view query, std::string_view name) {
+  while (!query.empty()) {
+    size_t amp = query.find('&');
+    std::string_view pair = query.substr(0, amp);
+    query = amp == std::string_view::npos ? std::string_view() : query.substr(amp + 1);
+
+    size_t eq = pair.find('=');
+    if (eq == std::string_view::npos || eq + 1 == pair.size()) continue;
+    if (unquotePlus(pair.substr(0, eq)) == name) return unquotePlus(pair.substr(eq + 1));
+  }
+  return std::string();
+}
+
+bool parseBatchCsv(std::string_view body, Clock::time_point receivedAt,
+                   std::vector<Reading>& out, std::string& error) {
+  for (size_t i = 0; i < body.size(); i++) {
+    if ((unsigned char)body[i] >= 0x80) {
+      char msg[128];
+      snprintf(msg, sizeof(msg),
+               "'ascii' codec can't decode byte 0x%02x in position %zu: ordinal not in range(128)",
+               (unsigned char)body[i], i);
+      error = msg;
+      return false;
+    }
+  }
+
+  out.clear();
+  size_t pos = 0;
+  while (pos < body.size()) {
+    // str.splitlines() boundaries for ASCII text
+    size_t end = pos;
+    while (end < body.size() && body[end] != '\n' && body[end] != '\r' &&
+           body[end] != '\v' && body[end] != '\f' &&
+           !(body[end] >= 0x1c && body[end] <= 0x1e)) {
+      end++;
+    }
+    std::string_view line = body.substr(pos, end - pos);
+    pos = end + ((end + 1 < body.size() && body[end] == '\r' && body[end + 1] == '\n') ? 2 : 1);
+
+    if (strip(line).empty()) continue;
+
+    // A sixth field is the tank index, parsed after the other five
+    std::string_view tankField;
+    bool hasTank = std::count(line.begin(), line.end(), ',') == 5;
+    if (hasTank) {
+      size_t comma = line.rfind(',');
+      tankField = line.substr(comma + 1);
+      line = line.substr(0, comma);
+    }
+
+    long long fields[5];
+    size_t count = 0;
+    size_t start = 0;
+    while (true) {
+      size_t comma = line.find(',', start);
+      std::string_view field = line.substr(start, comma == std::string_view::npos ? std::string_view::npos : comma - start);
+      long long value;
+      if (!parsePyInt(field, value)) {
+        error = "invalid literal for int() with base 10: " + pyRepr(field);
+        return false;
+      }
+      if (count == 5) {
+        error = "too many values to unpack (expected 5)";
+        return false;
+      }
+      fields[count++] = value;
+      if (comma == std::string_view::npos) break;
+      start = comma + 1;
+    }
+    if (count < 5) {
+      error = "not enough values to unpack (expected 5, got " + std::to_string(count) + ")";
+      return false;
+    }
+
+    Reading r;
+    if (hasTank) {
+      if (!parsePyInt(tankField, r.tank)) {
+        error = "invalid literal for int() with base 10: " + pyRepr(tankField);
+        return false;
+      }
+      r.hasTank = true;
+    }
+    r.voltage = fields[1] / 1000.0;
+    r.pressure_kpa = fields[2] / 100.0;
+    r.water_depth_m = fields[3] / 1000.0;
+    r.volume_liters = fields[4] / 100.0;
+    Clock::time_point taken = receivedAt - std::chrono::milliseconds(fields[0]);
+    r.timestamp = isoTimestamp(taken);
+    r.timeUs = toUnixMicros(taken);
+    out.push_back(std::move(r));
+  }
+  return true;
+}
+
+// ---------------------------------------------------------------------------
+// ReadingStore
+// ---------------------------------------------------------------------------
+
+void ReadingStore::add(const Reading& r) {
+  std::vector<std::string> encoded(1);
+  appendReadingJson(encoded[0], r);
+
+  std::lock_guard<std::mutex> lock(_mutex);
+  addEncodedLocked(encoded);
+}
+
+void ReadingStore::add(const std::vector<Reading>& readings) {
+  if (readings.empty()) return;
+  std::vector<std::string> encoded(readings.size());
+  for (size_t i = 0; i < readings.size(); i++) appendReadingJson(encoded[i], readings[i]);
+
+  std::lock_guard<std::mutex> lock(_mutex);
+  addEncodedLocked(encoded);
+}
+
+std::shared_ptr<const std::string> ReadingStore::readingsJson() {
+  std::lock_guard<std::mutex> lock(_mutex);
+  if (_dirty) rebuildLocked();
+  return _readings;
+}
+
+std::shared_ptr<const std::string> ReadingStore::latestJson() {
+  std::lock_guard<std::mutex> lock(_mutex);
+  if (_dirty) rebuildLocked();
+  return _latest;
+}
+
+std::shared_ptr<const std::string> ReadingStore::streamSnapshot(uint64_t& sequence) {
+  std::lock_guard<std::mutex> lock(_mutex);
+  if (_dirty) rebuildLocked();
+  if (!_snapshot) {
+    _snapshot = std::make_shared<const std::string>("event: snapshot\ndata: " + *_readings + "\n\n");
+  }
+  sequence = _sequence;
+  return _snapshot;
+}
+
+void ReadingStore::streamEvents(uint64_t since, std::vector<StreamEvent>& out) {
+  out.clear();
+  std::lock_guard<std::mutex> lock(_mutex);
+  if (since >= _sequence) return;
+  size_t skip = _sequence - since >= _events.size() ? 0 : _events.size() - (size_t)(_sequence - since);
+  out.assign(_events.begin() + (ptrdiff_t)skip, _events.end());
+}
+
+void ReadingStore::addEncodedLocked(std::vector<std::string>& encoded) {
+  // "event: readings" with the same JSON array layout as /api/readings
+  size_t total = 32;
+  for (const auto& json : encoded) total += json.size() + 2;
+  auto event = std::make_shared<std::string>();
+  event->reserve(total);
+  *event += "event: readings\ndata: [";
+  for (size_t i = 0; i < encoded.size(); i++) {
+    if (i > 0) *event += ", ";
+    *event += encoded[i];
+  }
+  *event += "]\n\n";
+  _events.push_back(StreamEvent{++_sequence, std::move(event)});
+  if (_events.size() > MAX_STREAM_EVENTS) _events.pop_front();
+
+  for (auto& json : encoded) {
+    _json.push_back(std::move(json));
+    if (_json.size() > MAX_READINGS) _json.pop_front();
+  }
+  _dirty = true;
+}
+
+void ReadingStore::rebuildLocked() {
+  size_t total = 2;
+  for (const auto& json : _json) total += json.size() + 2;
+
+  auto readings = std::make_shared<std::string>();
+  readings->reserve(total);
+  *readings += '[';
+  for (size_t i = 0; i < _json.size(); i++) {
+    if (i > 0) *readings += ", ";
+    *readings += _json[i];
+  }
+  *readings += ']';
+
+  _snapshot.reset();  // Built by the next streamSnapshot()
+  _readings = std::move(readings);
+  _latest = std::make_shared<const std::string>(_json.empty() ? "{}" : _json.back());
+  _dirty = false;
+}
+
+// ---------------------------------------------------------------------------
+// LogWriter
+// ---------------------------------------------------------------------------
+
+LogWriter::LogWriter(std::string path, bool quiet)
+  : _path(std::move(path)), _quiet(quiet), _thread(&LogWriter::run, this) {}
+
+LogWriter::~LogWriter() {
+  {
+    std::lock_guard<std::mutex> lock(_mutex);
+    _stopping = true;
+  }
+  _wake.notify_one();
+  _thread.join();
+  if (_fd >= 0) close(_fd);
+}
+
+void LogWriter::logReading(const Reading& r) {
+  std::string line;
+  if (!_path.empty()) {
+    appendReadingJson(line, r);
+    line += '\n';
+  }
+
+  char console[256];
+  snprintf(console, sizeof(console),
+           "[%s] Received: V=%.3fV, P=%.3fkPa, D=%.3fm, Vol=%.2fL\n",
+           r.timestamp.c_str(), r.voltage, r.pressure_kpa, r.water_depth_m, r.volume_liters);
+
+  std::lock_guard<std::mutex> lock(_mutex);
+  _pendingLines += line;
+  if (!_quiet) _pendingConsole += console;
+}
+
+void LogWriter::logBatch(const std::vector<Reading>& readings) {
+  std::string lines;
+  for (size_t i = 0; !_path.empty() && i < readings.size(); i++) {
+    appendReadingJson(lines, readings[i]);
+    lines += '\n';
+  }
+
+  char console[256] = "";
+  if (!readings.empty()) {
+    const Reading& latest = readings.back();
+    snprintf(console, sizeof(console),
+             "[%s] Received batch of %zu: D=%.3fm, Vol=%.2fL\n",
+             latest.timestamp.c_str(), readings.size(), latest.water_depth_m, latest.volume_liters);
+  }
+
+  std::lock_guard<std::mutex> lock(_mutex);
+  _pendingLines += lines;
+  if (!_quiet) _pendingConsole += console;
+}
+
+void LogWriter::run() {
+  std::string lines;
+  std::string console;
+  std::unique_lock<std::mutex> lock(_mutex);
+  while (true) {
+    // Batch whatever arrives within 100 ms into one write()
+    _wake.wait_for(lock, std::chrono::milliseconds(100));
+    lines.swap(_pendingLines);
+    console.swap(_pendingConsole);
+    bool stopping = _stopping;
+
+    lock.unlock();
+    flush(lines, console);
+    lock.lock();
+
+    if (stopping && _pendingLines.empty()) break;
+  }
+}
+
+void LogWriter::flush(std::string& lines, std::string& console) {
+  if (!console.empty()) {
+    fwrite(console.data(), 1, console.size(), stdout);
+    fflush(stdout);
+    console.clear();
+  }
+  if (lines.empty()) return;
+
+  if (_fd < 0) _fd = open(_path.c_str(), O_WRONLY | O_APPEND | O_CREAT | O_CLOEXEC, 0644);
+  size_t written = 0;
+  while (_fd >= 0 && written < lines.size()) {
+    ssize_t n = write(_fd, lines.data() + written, lines.size() - written);
+    if (n < 0 && errno == EINTR) continue;
+    if (n <= 0) break;
+    written += (size_t)n;
+  }
+  if (written < lines.size()) {
+    printf("Warning: Could not write to log file: [Errno %d] %s: '%s'\n",
+           errno, strerror(errno), _path.c_str());
+    fflush(stdout);
+    // Reopen on the next batch (the file may have been rotated or fixed)
+    if (_fd >= 0) close(_fd);
+    _fd = -1;
+  }
+  lines.clear();
+}
@@ -0,0 +1,144 @@
+#ifndef SENSOR_SERVER_READINGS_H
+#define SENSOR_SERVER_READINGS_H
+
+#include <chrono>
+#include <cstdint>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+// Reading model and JSON output for the C++ sensor server.
+//
+// Everything that reaches the wire or the log file is formatted exactly as
+// server/python/sensor_server.py formats it (json.dumps separators, Python
+// float repr, datetime.isoformat()), so clients and log consumers cannot
+// tell the two servers apart.
+
+using Clock = std::chrono::system_clock;
+
+struct Reading {
+  double voltage = 0.0;
+  double pressure_kpa = 0.0;
+  double water_depth_m = 0.0;
+  double volume_liters = 0.0;
+  std::string timestamp;
+  int64_t timeUs = 0;  // Same instant as timestamp, Unix microseconds
+  bool hasTank = false;  // Batch rows from a multi-tank device
+  long long tank = 0;
+};
+
+inline int64_t toUnixMicros(Clock::time_point t) {
+  return std::chrono::duration_cast<std::chrono::microseconds>(t.time_since_epoch()).count();
+}
+
+// repr(float) as json.dumps writes it (NaN/Infinity included)
+std::string pythonFloat(double v);
+
+// A float32 value with the fewest digits that read back as the same float,
+// in the pythonFloat() layout (0.1f is "0.1", not "0.10000000149011612")
+std::string shortFloat(float v);
+
+// datetime.fromtimestamp(t).isoformat(): local time, microseconds omitted
+// when zero
+std::string isoTimestamp(Clock::time_point t);
+
+// json.dumps(reading) with the Python key order
+void appendReadingJson(std::string& out, const Reading& r);
+
+// Query string of /update or /api/sensor-data, parsed like parse_qs() plus
+// float(). On failure returns false and sets error to the Python exception
+// text.
+bool parseSensorQuery(std::string_view query, Clock::time_point now,
+                      Reading& out, std::string& error);
+
+// First value of a query parameter (percent-decoded), or "" if absent
+std::string queryParam(std::string_view query, std::string_view name);
+
+// CSV body of /update/batch: age_ms,voltage_mv,pressure_ckpa,depth_mm,volume_cl
+// per line, oldest first, with an optional sixth tank field from
+// multi-tank devices
+bool parseBatchCsv(std::string_view body, Clock::time_point receivedAt,
+                   std::vector<Reading>& out, std::string& error);
+
+// One server-sent event of /api/stream, numbered from 1 in arrival order
+struct StreamEvent {
+  uint64_t sequence;
+  std::shared_ptr<const std::string> data;
+};
+
+// Last MAX_READINGS readings plus cached JSON for the dashboard endpoints.
+//
+// Each reading is serialised once on arrival; /api/readings and
+// /api/latest share an immutable snapshot that is rebuilt only after new
+// data, so polling clients cost a pointer copy instead of a re-encode.
+//
+// /api/stream clients get the snapshot as an "event: snapshot" and then
+// one "event: readings" per add() with just the new readings. Each event
+// is encoded once and the last MAX_STREAM_EVENTS are kept, so a worker can
+// hand the same bytes to all of its stream clients.
+class ReadingStore {
+public:
+  static const size_t MAX_READINGS = 100;
+  static const size_t MAX_STREAM_EVENTS = 64;
+
+  void add(const Reading& r);
+  void add(const std::vector<Reading>& readings);
+
+  std::shared_ptr<const std::string> readingsJson();
+  std::shared_ptr<const std::string> latestJson();
+
+  // Snapshot event for a new stream client, and the sequence of the last
+  // readings event it includes
+  std::shared_ptr<const std::string> streamSnapshot(uint64_t& sequence);
+  // Readings events after `since`, oldest first. Events older than the
+  // last MAX_STREAM_EVENTS are gone: a client that fell that far behind
+  // needs a new snapshot.
+  void streamEvents(uint64_t since, std::vector<StreamEvent>& out);
+
+private:
+  void addEncodedLocked(std::vector<std::string>& encoded);
+  void rebuildLocked();
+
+  std::mutex _mutex;
+  std::deque<std::string> _json;  // One encoded reading per entry
+  bool _dirty = true;
+  std::shared_ptr<const std::string> _readings;
+  std::shared_ptr<const std::string> _latest;
+  std::shared_ptr<const std::string> _snapshot;
+  std::deque<StreamEvent> _events;
+  uint64_t _sequence = 0;
+};
+
+// Appends readings to LOG_FILE (one JSON object per line) and echoes them
+// to the console from a background thread. Request handlers only append to
+// an in-memory buffer; the file stays open and is written in batches.
+// An empty path disables the file (history lives in TimeSeriesStore).
+class LogWriter {
+public:
+  LogWriter(std::string path, bool quiet);
+  ~LogWriter();
+
+  void logReading(const Reading& r);
+  void logBatch(const std::vector<Reading>& readings);
+
+private:
+  void run();
+  void flush(std::string& lines, std::string& console);
+
+  std::string _path;
+  bool _quiet;
+  int _fd = -1;
+  std::mutex _mutex;
+  std::condition_variable _wake;
+  std::string _pendingLines;
+  std::string _pendingConsole;
+  bool _stopping = false;
+  std::thread _thread;
+};
+
+#endif
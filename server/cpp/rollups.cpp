@@ -0,0 +1,164 @@
+#include "rollups.h"
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstring>
+
+#include "timeseries_store.h"
+
+namespace {
+
+const char ROLLUP_MAGIC[8] = {'W', 'T', 'S', 'R', 'O', 'L', '0', '1'};
+const uint32_t FORMAT_VERSION = 1;
+
+struct RollupHeader {
+  char magic[8];
+  uint32_t version;
+  uint32_t bucketSize;
+  int64_t widthUs;
+  uint8_t reserved[40];
+};
+static_assert(sizeof(RollupHeader) == RollupTier::HEADER_SIZE, "rollup header size");
+
+void foldFirst(RollupStats& s, float v) {
+  s.min = s.max = s.last = v;
+}
+
+void fold(RollupStats& s, float v) {
+  s.min = std::min(s.min, v);
+  s.max = std::max(s.max, v);
+  s.last = v;
+}
+
+}  // namespace
+
+RollupTier::~RollupTier() {
+  if (_fd >= 0) close(_fd);
+}
+
+bool RollupTier::open(const std::string& path, int tier, std::string& error) {
+  _path = path;
+  _tier = tier;
+  _fd = ::open(path.c_str(), O_RDWR | O_APPEND | O_CREAT | O_CLOEXEC, 0644);
+  struct stat st;
+  if (_fd < 0 || fstat(_fd, &st) != 0) {
+    error = "cannot open " + path;
+    return false;
+  }
+
+  RollupHeader header;
+  if ((size_t)st.st_size < HEADER_SIZE) {
+    // New file, or a crash before the header was complete
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, ROLLUP_MAGIC, sizeof(ROLLUP_MAGIC));
+    header.version = FORMAT_VERSION;
+    header.bucketSize = sizeof(RollupBucket);
+    header.widthUs = ROLLUP_WIDTH_US[tier];
+    if (ftruncate(_fd, 0) != 0 || write(_fd, &header, sizeof(header)) != (ssize_t)sizeof(header)) {
+      error = "cannot write " + path;
+      return false;
+    }
+    return true;
+  }
+
+  if (pread(_fd, &header, sizeof(header), 0) != (ssize_t)sizeof(header) ||
+      memcmp(header.magic, ROLLUP_MAGIC, sizeof(ROLLUP_MAGIC)) != 0 ||
+      header.version != FORMAT_VERSION || header.bucketSize != sizeof(RollupBucket) ||
+      header.widthUs != ROLLUP_WIDTH_US[tier]) {
+    error = "bad rollup file " + path;
+    return false;
+  }
+  _written = ((uint64_t)st.st_size - HEADER_SIZE) / sizeof(RollupBucket);
+  off_t whole = (off_t)(HEADER_SIZE + _written * sizeof(RollupBucket));
+  if (st.st_size != whole && ftruncate(_fd, whole) != 0) {
+    error = "cannot repair " + path;
+    return false;
+  }
+  RollupBucket last;
+  if (_written > 0) {
+    if (pread(_fd, &last, sizeof(last), whole - (off_t)sizeof(last)) != (ssize_t)sizeof(last)) {
+      error = "cannot read " + path;
+      return false;
+    }
+    _resumeUs = last.startUs + ROLLUP_WIDTH_US[tier];
+  }
+  return true;
+}
+
+bool RollupTier::add(const StoredRecord& r) {
+  if (r.timestampUs < _resumeUs) return true;
+
+  int64_t start = rollupBucketStart(_tier, r.timestampUs);
+  bool ok = true;
+  if (_open.count > 0 && start != _open.startUs) ok = writeOpenBucket();
+
+  const float values[4] = {r.voltage, r.pressureKpa, r.depthM, r.volumeL};
+  RollupStats* stats[4] = {&_open.voltage, &_open.pressureKpa, &_open.depthM, &_open.volumeL};
+  if (_open.count == 0) {
+    _open.startUs = start;
+    for (int i = 0; i < 4; i++) {
+      foldFirst(*stats[i], values[i]);
+      _sums[i] = values[i];
+    }
+  } else {
+    for (int i = 0; i < 4; i++) {
+      fold(*stats[i], values[i]);
+      _sums[i] += values[i];
+    }
+  }
+  _open.count++;
+  return ok;
+}
+
+bool RollupTier::rewind(int64_t us) {
+  _open.count = 0;
+  int64_t start = rollupBucketStart(_tier, us);
+  if (start >= _resumeUs) return true;
+
+  // Written buckets are in start order; keep those before start
+  uint64_t lo = 0, hi = _written;
+  while (lo < hi) {
+    uint64_t mid = lo + (hi - lo) / 2;
+    RollupBucket b;
+    off_t offset = (off_t)(HEADER_SIZE + mid * sizeof(RollupBucket));
+    if (pread(_fd, &b, sizeof(b), offset) != (ssize_t)sizeof(b)) return false;
+    if (b.startUs < start) lo = mid + 1;
+    else hi = mid;
+  }
+  RollupBucket last;
+  if (lo > 0 && pread(_fd, &last, sizeof(last),
+                      (off_t)(HEADER_SIZE + (lo - 1) * sizeof(RollupBucket))) != (ssize_t)sizeof(last)) {
+    return false;
+  }
+  if (ftruncate(_fd, (off_t)(HEADER_SIZE + lo * sizeof(RollupBucket))) != 0) return false;
+  _written = lo;
+  _resumeUs = lo > 0 ? last.startUs + ROLLUP_WIDTH_US[_tier] : INT64_MIN;
+  return true;
+}
+
+bool RollupTier::openBucket(RollupBucket& out) const {
+  if (_open.count == 0) return false;
+  out = _open;
+  RollupStats* stats[4] = {&out.voltage, &out.pressureKpa, &out.depthM, &out.volumeL};
+  for (int i = 0; i < 4; i++) stats[i]->mean = (float)(_sums[i] / out.count);
+  return true;
+}
+
+bool RollupTier::writeOpenBucket() {
+  RollupBucket done;
+  openBucket(done);
+  _open.count = 0;
+  _resumeUs = done.startUs + ROLLUP_WIDTH_US[_tier];
+  if (write(_fd, &done, sizeof(done)) != (ssize_t)sizeof(done)) {
+    // Keep the file at a whole number of buckets; this one is lost
+    if (ftruncate(_fd, (off_t)(HEADER_SIZE + _written * sizeof(RollupBucket))) != 0) {
+      perror("rollups: truncate after failed write");
+    }
+    return false;
+  }
+  _written++;
+  return true;
+}
@@ -0,0 +1,97 @@
+#ifndef SENSOR_SERVER_ROLLUPS_H
+#define SENSOR_SERVER_ROLLUPS_H
+
+#include <cstdint>
+#include <string>
+
+struct StoredRecord;
+
+// Rollup tiers for history queries: per device, the min/max/mean/last of
+// every field over each UTC-aligned minute, hour and day.
+//
+// Each tier folds a record into its open bucket in O(1) as it is appended
+// to the store. When a record lands in a later bucket the open one is
+// finished and appended to the tier file:
+//
+//   <root>/<device>/rollup-1m.dat   64-byte header, then 80-byte buckets
+//
+// so a 90-day query reads 90 day buckets (or 2160 hour buckets) instead of
+// 1.5 million records. The open bucket lives only in memory; on startup it
+// is rebuilt from the store records after the tier's last written bucket.
+
+const int ROLLUP_TIERS = 3;
+const int64_t ROLLUP_WIDTH_US[ROLLUP_TIERS] = {60000000LL, 3600000000LL, 86400000000LL};
+const char* const ROLLUP_NAMES[ROLLUP_TIERS] = {"1m", "1h", "1d"};
+
+#pragma pack(push, 1)
+struct RollupStats {
+  float min;
+  float max;
+  float mean;
+  float last;
+};
+
+struct RollupBucket {
+  int64_t startUs;  // Unix microseconds, a multiple of the tier width
+  uint32_t count;   // Records folded in
+  uint32_t reserved;
+  RollupStats voltage;
+  RollupStats pressureKpa;
+  RollupStats depthM;
+  RollupStats volumeL;
+};
+#pragma pack(pop)
+static_assert(sizeof(RollupBucket) == 80, "on-disk bucket layout");
+
+// Start of the tier bucket that contains us
+inline int64_t rollupBucketStart(int tier, int64_t us) {
+  int64_t width = ROLLUP_WIDTH_US[tier];
+  int64_t q = us / width;
+  if (us % width < 0) q--;
+  return q * width;
+}
+
+class RollupTier {
+public:
+  static const size_t HEADER_SIZE = 64;
+
+  RollupTier() = default;
+  ~RollupTier();
+
+  RollupTier(const RollupTier&) = delete;
+  RollupTier& operator=(const RollupTier&) = delete;
+
+  // Open or create the tier file, dropping a bucket torn by a crash
+  bool open(const std::string& path, int tier, std::string& error);
+
+  // Records before this are already in a written bucket
+  int64_t resumeUs() const { return _resumeUs; }
+
+  // Fold one record in. Records must arrive in timestamp order; older
+  // ones than resumeUs() are ignored (replay after a restart).
+  bool add(const StoredRecord& r);
+
+  // Drop the open bucket and any written bucket from the one containing
+  // us on, before the store cuts its records there. The records from
+  // resumeUs() on must then be folded in again.
+  bool rewind(int64_t us);
+
+  const std::string& path() const { return _path; }
+  uint64_t writtenBuckets() const { return _written; }
+
+  // The bucket still accumulating, with its mean so far
+  bool openBucket(RollupBucket& out) const;
+
+private:
+  bool writeOpenBucket();
+
+  std::string _path;
+  int _tier = 0;
+  int _fd = -1;
+  uint64_t _written = 0;
+  int64_t _resumeUs = INT64_MIN;
+  RollupBucket _open{};
+  double _sums[4] = {0, 0, 0, 0};
+};
+
+#endif
@@ -0,0 +1,37 @@
+#!/bin/sh
+# Load benchmark: C++ sensor server vs the Python server on the same box.
+#
+# Both servers log to throwaway files. Each scenario runs for DURATION
+# seconds against each server in turn:
+#   - firmware-style keep-alive uploads with 10% dashboard polls
+#   - the same with a new connection per request (Connection: close)
+#
+# Usage: ./run_load_bench.sh [connections...]   (default: 1 16 256)
+# Environment: DURATION (default 10), THREADS for the C++ server.
+
+set -e
+cd "$(dirname "$0")"
+make -s sensor_server bench_load
+
+DURATION=${DURATION:-10}
+THREADS=${THREADS:-$(nproc)}
+CONNS=${*:-1 16 256}
+CPP_PORT=18180
+PY_PORT=18181
+TMP=$(mktemp -d)
+
+./sensor_server -q -p $CPP_PORT -t "$THREADS" -l "$TMP/cpp.log" >/dev/null &
+CPP_PID=$!
+python3 -c "import sys; sys.path.insert(0, '../python'); import sensor_server as s; \
+s.PORT = $PY_PORT; s.LOG_FILE = '$TMP/py.log'; s.run_server()" >/dev/null 2>&1 &
+PY_PID=$!
+trap 'kill $CPP_PID $PY_PID 2>/dev/null; rm -rf "$TMP"' EXIT
+sleep 1
+
+echo "$(nproc) CPUs, C++ server with $THREADS worker threads, ${DURATION}s per run"
+for mode in 1 0; do
+  for c in $CONNS; do
+    printf 'c++    '; ./bench_load -p $CPP_PORT -c "$c" -d "$DURATION" -k $mode
+    printf 'python '; ./bench_load -p $PY_PORT -c "$c" -d "$DURATION" -k $mode
+  done
+done
@@ -0,0 +1,1029 @@
+// Native HTTP server for the water tank monitor, wire-compatible with
+// server/python/sensor_server.py.
+//
+// Same endpoints, status lines, headers, JSON and log format as the Python
+// server, but built to take hundreds of tanks and dashboards at once:
+//
+// - One worker thread per core, each with its own SO_REUSEPORT listening
+//   socket and epoll instance, so the kernel spreads connections across
+//   workers and no lock is taken on the accept or I/O path.
+// - Non-blocking sockets with per-connection buffers: keep-alive and
+//   pipelined requests are served without a thread per client.
+// - Readings are encoded to JSON once on arrival; /api/readings and
+//   /api/latest hand out a cached snapshot (see ReadingStore).
+// - History is appended to a binary time-series store, one series per
+//   device (?device=, default "default"), instead of a JSON-lines log
+//   (see TimeSeriesStore). The Python-format log is still available with
+//   -l and is appended by a background thread in batches (see LogWriter).
+// - /api/readings?from=&to= answers from the raw records or the
+//   minute/hour/day rollups, whichever is finest within the point budget,
+//   so a 90-day chart costs about as much as a 5-minute one.
+// - /api/stream pushes new readings to dashboards as server-sent events.
+//   Uploads wake only the workers holding stream clients (an eventfd
+//   each), which append the once-encoded event to every client.
+// - /api/export sends ranges of raw records as columnar binary or Arrow,
+//   copied out of the store's mapped segments a piece at a time as the
+//   client reads (see ColumnarExport).
+// - /api/lora/uplink takes ChirpStack uplink events from its HTTP
+//   integration and stores their frames (see UplinkBatch) in the same
+//   history, since the store admits only this process as a writer.
+//
+// Usage: sensor_server [-p port] [-t threads] [-s store_dir] [-l log_file]
+//                      [-d dashboard.html] [-q]
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <signal.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <fstream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "columnar_export.h"
+#include "http_request.h"
+#include "lora_uplink.h"
+#include "readings.h"
+#include "timeseries_store.h"
+
+#ifndef DEFAULT_DASHBOARD_PATH
+#define DEFAULT_DASHBOARD_PATH "../web/dashboard.html"
+#endif
+
+namespace {
+
+const int DEFAULT_PORT = 8080;
+const char* const DEFAULT_STORE_DIR = "/tmp/water-tank-store";
+const char* const DEFAULT_DEVICE = "default";
+const char* const SERVER_NAME = "sensor_server_cpp/1.0";
+
+const size_t READ_CHUNK = 16384;
+const int MAX_EVENTS = 256;
+const int IDLE_TIMEOUT_S = 300;  // Firmware keep-alive uploads come every 5 s
+
+// /api/stream: a comment line after this long without an event keeps
+// proxies from timing the stream out; a client this far behind on output
+// is dropped (EventSource reconnects and gets a fresh snapshot)
+const int STREAM_HEARTBEAT_S = 15;
+const size_t MAX_STREAM_BACKLOG = 1 << 20;
+
+// History queries: points=N caps the answer (about one per pixel of a wide
+// chart by default); an explicit resolution may return up to the hard cap
+const size_t DEFAULT_MAX_POINTS = 1500;
+const size_t HARD_MAX_POINTS = 20000;
+const int64_t DEFAULT_RANGE_US = 86400LL * 1000000;
+const int RAW_TIER = -1;
+
+// /api/export is produced in pieces of about this size as the socket
+// drains, and yields to other connections after a few of them
+const size_t EXPORT_PIECE_BYTES = 256 * 1024;
+const int EXPORT_PIECES_PER_FLUSH = 4;
+
+std::atomic<bool> stopRequested(false);
+
+// A worker's eventfd, written after new readings while it holds
+// /api/stream clients
+struct StreamWake {
+  int fd = -1;
+  std::atomic<size_t> clients{0};
+};
+
+struct ServerContext {
+  ReadingStore store;
+  LogWriter log;
+  TimeSeriesStore history;
+  std::string dashboard;
+  bool haveDashboard = false;
+  std::vector<std::unique_ptr<StreamWake>> streamWakes;  // One per worker, fixed at startup
+  // One uplink stored at a time, so an event retried onto another worker
+  // sees the first copy's readings and is skipped as a duplicate
+  std::mutex loraMutex;
+
+  ServerContext(const std::string& logFile, bool quiet, const std::string& storeDir)
+    : log(logFile, quiet), history(storeDir) {}
+
+  void notifyStreams() {
+    for (auto& wake : streamWakes) {
+      if (wake->clients.load(std::memory_order_relaxed) == 0) continue;
+      uint64_t one = 1;
+      if (write(wake->fd, &one, sizeof(one)) < 0) {
+        // EAGAIN: the counter is already non-zero, the worker will wake
+      }
+    }
+  }
+};
+
+// Set by handleRequest() when the response goes on after it returns: the
+// connection becomes an /api/stream feed, or sends an /api/export as the
+// client drains it
+struct Continuation {
+  bool stream = false;
+  uint64_t sequence = 0;  // Last readings event in the snapshot sent
+  std::unique_ptr<ColumnarExport> exporter;
+};
+
+// ---------------------------------------------------------------------------
+// Responses (same header order as BaseHTTPRequestHandler)
+// ---------------------------------------------------------------------------
+
+const std::string& httpDate() {
+  thread_local time_t cachedSec = 0;
+  thread_local std::string cached;
+  time_t now = time(nullptr);
+  if (now != cachedSec) {
+    struct tm tmUtc;
+    gmtime_r(&now, &tmUtc);
+    char buf[64];
+    strftime(buf, sizeof(buf), "%a, %d %b %Y %H:%M:%S GMT", &tmUtc);
+    cached = buf;
+    cachedSec = now;
+  }
+  return cached;
+}
+
+void appendStatusLine(std::string& out, int status, std::string_view reason) {
+  out += "HTTP/1.1 ";
+  out += std::to_string(status);
+  out += ' ';
+  out += reason;
+  out += "\r\nServer: ";
+  out += SERVER_NAME;
+  out += "\r\nDate: ";
+  out += httpDate();
+  out += "\r\n";
+}
+
+void appendOk(std::string& out, std::string_view contentType, std::string_view body, bool cors) {
+  appendStatusLine(out, 200, "OK");
+  out += "Content-type: ";
+  out += contentType;
+  out += "\r\nContent-Length: ";
+  out += std::to_string(body.size());
+  out += "\r\n";
+  if (cors) out += "Access-Control-Allow-Origin: *\r\n";
+  out += "\r\n";
+  out += body;
+}
+
+const char* explainStatus(int status) {
+  switch (status) {
+    case 400: return "Bad request syntax or unsupported method";
+    case 404: return "Nothing matches the given URI";
+    case 413: return "Entity is too large";
+    case 414: return "URI is too long";
+    case 431: return "The server is unwilling to process the request because its header fields are too large";
+    case 500: return "Server got itself in trouble";
+    case 501: return "Server does not support this operation";
+    case 505: return "Cannot fulfill request";
+    default: return "???";
+  }
+}
+
+std::string htmlEscape(std::string_view s) {
+  std::string out;
+  for (char c : s) {
+    if (c == '&') out += "&amp;";
+    else if (c == '<') out += "&lt;";
+    else if (c == '>') out += "&gt;";
+    else out += c;
+  }
+  return out;
+}
+
+// send_error(): HTML body and Connection: close
+void appendError(std::string& out, int status, std::string_view message) {
+  std::string body =
+      "<!DOCTYPE HTML>\n"
+      "<html lang=\"en\">\n"
+      "    <head>\n"
+      "        <meta charset=\"utf-8\">\n"
+      "        <title>Error response</title>\n"
+      "    </head>\n"
+      "    <body>\n"
+      "        <h1>Error response</h1>\n"
+      "        <p>Error code: " + std::to_string(status) + "</p>\n"
+      "        <p>Message: " + htmlEscape(message) + ".</p>\n"
+      "        <p>Error code explanation: " + std::to_string(status) + " - " +
+      explainStatus(status) + ".</p>\n"
+      "    </body>\n"
+      "</html>\n";
+
+  // The reason phrase must stay on one line
+  std::string reason(message);
+  for (char& c : reason) {
+    if (c == '\r' || c == '\n') c = ' ';
+  }
+  appendStatusLine(out, status, reason);
+  out += "Connection: close\r\nContent-Type: text/html;charset=utf-8\r\nContent-Length: ";
+  out += std::to_string(body.size());
+  out += "\r\n\r\n";
+  out += body;
+}
+
+// ---------------------------------------------------------------------------
+// Endpoints
+// ---------------------------------------------------------------------------
+
+StoredRecord toStoredRecord(const Reading& r) {
+  return StoredRecord{r.timeUs, (float)r.voltage, (float)r.pressure_kpa,
+                      (float)r.water_depth_m, (float)r.volume_liters};
+}
+
+// ?device= names the series; the firmware sends none
+bool deviceFromQuery(std::string_view query, std::string& device, std::string& out) {
+  device = queryParam(query, "device");
+  if (device.empty()) device = DEFAULT_DEVICE;
+  if (!TimeSeriesStore::validDeviceName(device)) {
+    appendError(out, 400, "Invalid device name");
+    return false;
+  }
+  return true;
+}
+
+void storeHistory(ServerContext& ctx, const std::string& device, const StoredRecord* records,
+                  size_t count) {
+  if (count > 0 && !ctx.history.append(device, records, count)) {
+    fprintf(stderr, "Warning: Could not append to the history store (%s)\n", device.c_str());
+  }
+}
+
+// Returns false when the connection must close after the response
+bool handleSensorData(ServerContext& ctx, std::string_view query, std::string& out) {
+  Reading r;
+  std::string error;
+  std::string device;
+  if (!deviceFromQuery(query, device, out)) return false;
+  if (!parseSensorQuery(query, Clock::now(), r, error)) {
+    appendError(out, 400, "Invalid parameters: " + error);
+    return false;
+  }
+  ctx.store.add(r);
+  ctx.notifyStreams();
+  StoredRecord record = toStoredRecord(r);
+  storeHistory(ctx, device, &record, 1);
+  ctx.log.logReading(r);
+
+  std::string body = "{\"status\": \"success\", \"message\": \"Sensor data received\", \"data\": ";
+  appendReadingJson(body, r);
+  body += '}';
+  appendOk(out, "application/json", body, false);
+  return true;
+}
+
+bool handleSensorBatch(ServerContext& ctx, std::string_view query, std::string_view csv,
+                       std::string& out) {
+  std::vector<Reading> readings;
+  std::string error;
+  std::string device;
+  if (!deviceFromQuery(query, device, out)) return false;
+  if (!parseBatchCsv(csv, Clock::now(), readings, error)) {
+    appendError(out, 400, "Invalid batch: " + error);
+    return false;
+  }
+  ctx.store.add(readings);
+  if (!readings.empty()) ctx.notifyStreams();
+  // Tank 0 (or no tank column) is the device's own series, tank N its
+  // "<device>-tankN" series
+  std::map<long long, std::vector<StoredRecord>> records;
+  for (const auto& r : readings) {
+    records[r.hasTank && r.tank > 0 ? r.tank : 0].push_back(toStoredRecord(r));
+  }
+  for (const auto& entry : records) {
+    std::string series = entry.first == 0 ? device : device + "-tank" + std::to_string(entry.first);
+    storeHistory(ctx, series, entry.second.data(), entry.second.size());
+  }
+  ctx.log.logBatch(readings);
+
+  std::string body = "{\"status\": \"success\", \"message\": \"Sensor batch received\", \"accepted\": " +
+                     std::to_string(readings.size()) + "}";
+  appendOk(out, "application/json", body, false);
+  return true;
+}
+
+// POST /api/lora/uplink?event=up: one ChirpStack uplink event (JSON), as
+// the HTTP integration sends it. The integration posts every event type to
+// the same URL; the others are acknowledged and dropped.
+bool handleLoRaUplink(ServerContext& ctx, std::string_view query, std::string_view json,
+                      std::string& out) {
+  std::string event = queryParam(query, "event");
+  if (!event.empty() && event != "up") {
+    appendOk(out, "application/json",
+             "{\"status\": \"ignored\", \"message\": \"Not an uplink event\"}", false);
+    return true;
+  }
+
+  UplinkEvent uplink;
+  UplinkBatch batch;
+  std::string error;
+  if (!parseUplinkEvent(json, uplink, error) || !batch.add(uplink, error)) {
+    appendError(out, 400, "Invalid uplink: " + error);
+    return false;
+  }
+  uint64_t duplicates = 0;
+  bool ok;
+  size_t stored;
+  {
+    std::lock_guard<std::mutex> lock(ctx.loraMutex);
+    stored = batch.store(ctx.history, &duplicates, &ok);
+  }
+  if (!ok) {
+    fprintf(stderr, "Warning: Could not append to the history store (%s)\n", uplink.device.c_str());
+    appendError(out, 500, "Could not write to the history store");
+    return false;
+  }
+
+  std::string body = "{\"status\": \"success\", \"message\": \"Uplink received\", \"device\": \"" +
+                     uplink.device + "\", \"stored\": " + std::to_string(stored) +
+                     ", \"duplicates\": " + std::to_string(duplicates) + "}";
+  appendOk(out, "application/json", body, false);
+  return true;
+}
+
+// Unix seconds, possibly fractional
+bool parseSeconds(const std::string& text, int64_t& us) {
+  char* end = nullptr;
+  errno = 0;
+  double sec = strtod(text.c_str(), &end);
+  if (text.empty() || *end != '\0' || errno != 0 || !std::isfinite(sec) ||
+      sec < -9.0e12 || sec > 9.0e12) {
+    return false;
+  }
+  us = (int64_t)(sec * 1e6);
+  return true;
+}
+
+// ?from=&to= in Unix seconds, by default the last 24 hours
+bool rangeFromQuery(std::string_view query, int64_t& fromUs, int64_t& toUs, std::string& out) {
+  toUs = toUnixMicros(Clock::now()) + 1;
+  std::string to = queryParam(query, "to");
+  std::string from = queryParam(query, "from");
+  if (!to.empty() && !parseSeconds(to, toUs)) {
+    appendError(out, 400, "Invalid parameters: to must be Unix seconds");
+    return false;
+  }
+  fromUs = toUs - DEFAULT_RANGE_US;
+  if (!from.empty() && !parseSeconds(from, fromUs)) {
+    appendError(out, 400, "Invalid parameters: from must be Unix seconds");
+    return false;
+  }
+  return true;
+}
+
+void appendStats(std::string& out, const char* name, const RollupStats& s) {
+  out += ", \"";
+  out += name;
+  out += "\": {\"min\": ";
+  out += shortFloat(s.min);
+  out += ", \"max\": ";
+  out += shortFloat(s.max);
+  out += ", \"mean\": ";
+  out += shortFloat(s.mean);
+  out += ", \"last\": ";
+  out += shortFloat(s.last);
+  out += '}';
+}
+
+std::string isoFromMicros(int64_t us) {
+  return isoTimestamp(Clock::time_point(std::chrono::microseconds(us)));
+}
+
+// GET /api/readings?from=&to=[&resolution=auto|raw|1m|1h|1d][&points=N][&device=]
+//
+// from/to are Unix seconds (default: the last 24 hours). Raw points have
+// the /api/readings reading fields; rollup points carry min/max/mean/last
+// per field and the number of readings behind them.
+bool handleReadingsRange(ServerContext& ctx, std::string_view query, std::string& out) {
+  std::string device;
+  int64_t fromUs, toUs;
+  if (!deviceFromQuery(query, device, out) || !rangeFromQuery(query, fromUs, toUs, out)) {
+    return false;
+  }
+
+  size_t maxPoints = DEFAULT_MAX_POINTS;
+  std::string points = queryParam(query, "points");
+  if (!points.empty()) {
+    char* end = nullptr;
+    unsigned long n = strtoul(points.c_str(), &end, 10);
+    if (*end != '\0' || n == 0) {
+      appendError(out, 400, "Invalid parameters: points must be a positive integer");
+      return false;
+    }
+    maxPoints = std::min((size_t)n, HARD_MAX_POINTS);
+  }
+
+  // Finest tier whose answer fits in maxPoints; counting is a few binary
+  // searches, no records are read
+  std::string resolution = queryParam(query, "resolution");
+  int tier;
+  if (resolution.empty() || resolution == "auto") {
+    auto none = [](const void*, size_t) {};
+    tier = RAW_TIER;
+    size_t count = ctx.history.scan(device, fromUs, toUs, none);
+    while (count > maxPoints && tier + 1 < ROLLUP_TIERS) {
+      tier++;
+      count = ctx.history.scanRollups(device, tier, fromUs, toUs, none);
+    }
+  } else if (resolution == "raw") {
+    tier = RAW_TIER;
+  } else {
+    tier = (int)(std::find(ROLLUP_NAMES, ROLLUP_NAMES + ROLLUP_TIERS, resolution) - ROLLUP_NAMES);
+    if (tier == ROLLUP_TIERS) {
+      appendError(out, 400, "Invalid parameters: resolution must be auto, raw, 1m, 1h or 1d");
+      return false;
+    }
+  }
+
+  std::string body = "{\"device\": \"" + device + "\", \"resolution\": \"";
+  body += tier == RAW_TIER ? "raw" : ROLLUP_NAMES[tier];
+  body += "\", \"points\": [";
+  size_t emitted = 0;
+  if (tier == RAW_TIER) {
+    ctx.history.scan(device, fromUs, toUs, [&](const StoredRecord* records, size_t count) {
+      for (size_t i = 0; i < count && emitted < HARD_MAX_POINTS; i++, emitted++) {
+        const StoredRecord& r = records[i];
+        if (emitted) body += ", ";
+        body += "{\"voltage\": " + shortFloat(r.voltage) +
+                ", \"pressure_kpa\": " + shortFloat(r.pressureKpa) +
+                ", \"water_depth_m\": " + shortFloat(r.depthM) +
+                ", \"volume_liters\": " + shortFloat(r.volumeL) +
+                ", \"timestamp\": \"" + isoFromMicros(r.timestampUs) + "\"}";
+      }
+    });
+  } else {
+    ctx.history.scanRollups(device, tier, fromUs, toUs, [&](const RollupBucket* buckets, size_t count) {
+      for (size_t i = 0; i < count && emitted < HARD_MAX_POINTS; i++, emitted++) {
+        const RollupBucket& b = buckets[i];
+        if (emitted) body += ", ";
+        body += "{\"timestamp\": \"" + isoFromMicros(b.startUs) +
+                "\", \"count\": " + std::to_string(b.count);
+        appendStats(body, "voltage", b.voltage);
+        appendStats(body, "pressure_kpa", b.pressureKpa);
+        appendStats(body, "water_depth_m", b.depthM);
+        appendStats(body, "volume_liters", b.volumeL);
+        body += '}';
+      }
+    });
+  }
+  body += "]}";
+  appendOk(out, "application/json", body, true);
+  return true;
+}
+
+bool isRangeQuery(std::string_view query) {
+  for (const char* name : {"from", "to", "resolution", "points"}) {
+    if (!queryParam(query, name).empty()) return true;
+  }
+  return false;
+}
+
+// GET /api/export?device=a,b|*[&from=&to=][&format=columns|arrow][&batch=N]
+//
+// Raw records of one or more devices ("*": all of them) as columnar
+// binary, see ColumnarExport for the layouts. batch is the number of rows
+// per Arrow record batch. Only the headers are written here; the body
+// follows as the client reads it.
+bool handleExport(ServerContext& ctx, std::string_view query, std::string& out,
+                  Continuation& cont) {
+  int64_t fromUs, toUs;
+  if (!rangeFromQuery(query, fromUs, toUs, out)) return false;
+
+  std::vector<std::string> devices;
+  std::string names = queryParam(query, "device");
+  if (names == "*") {
+    devices = ctx.history.devices();
+  } else {
+    std::stringstream list(names.empty() ? DEFAULT_DEVICE : names);
+    std::string device;
+    while (std::getline(list, device, ',')) {
+      if (!TimeSeriesStore::validDeviceName(device)) {
+        appendError(out, 400, "Invalid device name");
+        return false;
+      }
+      devices.push_back(device);
+    }
+  }
+
+  ExportFormat format;
+  std::string formatName = queryParam(query, "format");
+  if (formatName.empty() || formatName == "columns") {
+    format = ExportFormat::COLUMNS;
+  } else if (formatName == "arrow") {
+    format = ExportFormat::ARROW;
+  } else {
+    appendError(out, 400, "Invalid parameters: format must be columns or arrow");
+    return false;
+  }
+
+  size_t batchRows = ColumnarExport::DEFAULT_BATCH_ROWS;
+  std::string batch = queryParam(query, "batch");
+  if (!batch.empty()) {
+    char* end = nullptr;
+    unsigned long n = strtoul(batch.c_str(), &end, 10);
+    if (*end != '\0' || n == 0 || n > ColumnarExport::MAX_BATCH_ROWS) {
+      appendError(out, 400, "Invalid parameters: batch must be 1-" +
+                                std::to_string(ColumnarExport::MAX_BATCH_ROWS));
+      return false;
+    }
+    batchRows = n;
+  }
+
+  cont.exporter.reset(new ColumnarExport(ctx.history, devices, fromUs, toUs, format, batchRows));
+  appendStatusLine(out, 200, "OK");
+  out += "Content-type: ";
+  out += ColumnarExport::contentType(format);
+  out += "\r\nContent-Length: ";
+  out += std::to_string(cont.exporter->size());
+  out += "\r\nAccess-Control-Allow-Origin: *\r\n\r\n";
+  return true;
+}
+
+// GET /api/stream: server-sent events, a snapshot of /api/readings and then
+// each upload's readings as they arrive. No Content-Length: the response
+// runs until either side closes.
+void startStream(ServerContext& ctx, std::string& out, Continuation& cont) {
+  appendStatusLine(out, 200, "OK");
+  out += "Content-type: text/event-stream\r\nCache-Control: no-cache\r\n"
+         "Access-Control-Allow-Origin: *\r\n\r\nretry: 5000\n\n";
+  out += *ctx.store.streamSnapshot(cont.sequence);
+  cont.stream = true;
+}
+
+bool handleRequest(ServerContext& ctx, const HttpRequest& req, std::string& out,
+                   Continuation& cont) {
+  if (req.method == "GET") {
+    if (req.path == "/") {
+      if (!ctx.haveDashboard) {
+        appendError(out, 404, "Dashboard not installed");
+        return false;
+      }
+      appendOk(out, "text/html", ctx.dashboard, false);
+      return true;
+    }
+    if (req.path == "/api/sensor-data" || req.path == "/update") {
+      return handleSensorData(ctx, req.query, out);
+    }
+    if (req.path == "/api/readings") {
+      // Without range parameters: the last readings, as the Python server
+      if (isRangeQuery(req.query)) return handleReadingsRange(ctx, req.query, out);
+      appendOk(out, "application/json", *ctx.store.readingsJson(), true);
+      return true;
+    }
+    if (req.path == "/api/latest") {
+      appendOk(out, "application/json", *ctx.store.latestJson(), true);
+      return true;
+    }
+    if (req.path == "/api/stream") {
+      startStream(ctx, out, cont);
+      return true;
+    }
+    if (req.path == "/api/export") {
+      return handleExport(ctx, req.query, out, cont);
+    }
+  } else if (req.method == "POST") {
+    if (req.path == "/update/batch") {
+      return handleSensorBatch(ctx, req.query, req.body, out);
+    }
+    if (req.path == "/api/lora/uplink") {
+      return handleLoRaUplink(ctx, req.query, req.body, out);
+    }
+  } else {
+    appendError(out, 501, "Unsupported method ('" + std::string(req.method) + "')");
+    return false;
+  }
+  appendError(out, 404, "Endpoint not found");
+  return false;
+}
+
+// ---------------------------------------------------------------------------
+// Event loop
+// ---------------------------------------------------------------------------
+
+struct Connection {
+  int fd;
+  std::string in;
+  std::string out;
+  size_t outPos = 0;
+  bool closeAfterWrite = false;
+  bool waitingForWrite = false;
+  time_t lastActive = 0;  // Streams: last event or heartbeat sent
+  bool streaming = false;
+  uint64_t streamSequence = 0;  // Last readings event queued
+  std::unique_ptr<ColumnarExport> exporter;  // /api/export body still to send
+  bool closed = false;  // Freed once the current epoll batch is done
+};
+
+class Worker {
+public:
+  Worker(ServerContext& ctx, int listenFd, StreamWake& wake)
+    : _ctx(ctx), _listenFd(listenFd), _wake(wake) {}
+
+  ~Worker() {
+    for (auto& entry : _connections) close(entry.first);
+    if (_epollFd >= 0) close(_epollFd);
+    if (_wake.fd >= 0) close(_wake.fd);
+    close(_listenFd);
+  }
+
+  bool init() {
+    _epollFd = epoll_create1(EPOLL_CLOEXEC);
+    _wake.fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (_epollFd < 0 || _wake.fd < 0) return false;
+    epoll_event ev{};
+    ev.events = EPOLLIN;
+    ev.data.ptr = nullptr;
+    if (epoll_ctl(_epollFd, EPOLL_CTL_ADD, _listenFd, &ev) != 0) return false;
+    ev.data.ptr = &_wake;
+    return epoll_ctl(_epollFd, EPOLL_CTL_ADD, _wake.fd, &ev) == 0;
+  }
+
+  void run() {
+    epoll_event events[MAX_EVENTS];
+    time_t lastSweep = time(nullptr);
+    while (!stopRequested.load(std::memory_order_relaxed)) {
+      int n = epoll_wait(_epollFd, events, MAX_EVENTS, 1000);
+      for (int i = 0; i < n; i++) {
+        if (events[i].data.ptr == &_wake) {
+          uint64_t count;
+          if (read(_wake.fd, &count, sizeof(count)) > 0) publish();
+          continue;
+        }
+        Connection* conn = static_cast<Connection*>(events[i].data.ptr);
+        if (!conn) {
+          acceptAll();
+          continue;
+        }
+        // Closed earlier in this batch, e.g. by publish()
+        if (conn->closed) continue;
+        uint32_t ev = events[i].events;
+        if (ev & EPOLLERR) {
+          closeConnection(conn);
+          continue;
+        }
+        if ((ev & EPOLLOUT) && !flush(conn)) continue;
+        if ((ev & (EPOLLIN | EPOLLHUP)) && !conn->waitingForWrite) onReadable(conn);
+      }
+
+      time_t now = time(nullptr);
+      if (now != lastSweep) {
+        sweepIdle(now);
+        lastSweep = now;
+      }
+      _closed.clear();
+    }
+  }
+
+private:
+  void acceptAll() {
+    while (true) {
+      int fd = accept4(_listenFd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+      if (fd < 0) return;  // EAGAIN, or another worker won the race
+      int one = 1;
+      setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+      auto conn = std::make_unique<Connection>();
+      conn->fd = fd;
+      conn->lastActive = time(nullptr);
+      epoll_event ev{};
+      ev.events = EPOLLIN | EPOLLRDHUP;
+      ev.data.ptr = conn.get();
+      if (epoll_ctl(_epollFd, EPOLL_CTL_ADD, fd, &ev) != 0) {
+        close(fd);
+        continue;
+      }
+      _connections.emplace(fd, std::move(conn));
+    }
+  }
+
+  // Returns false if the connection was closed
+  bool onReadable(Connection* conn) {
+    bool peerClosed = false;
+    char buf[READ_CHUNK];
+    while (true) {
+      ssize_t n = recv(conn->fd, buf, sizeof(buf), 0);
+      if (n > 0) {
+        conn->in.append(buf, (size_t)n);
+        if ((size_t)n < sizeof(buf)) break;
+      } else if (n == 0) {
+        peerClosed = true;
+        break;
+      } else if (errno == EINTR) {
+        continue;
+      } else if (errno == EAGAIN || errno == EWOULDBLOCK) {
+        break;
+      } else {
+        closeConnection(conn);
+        return false;
+      }
+    }
+    conn->lastActive = time(nullptr);
+
+    // Serve every complete (possibly pipelined) request in the buffer
+    size_t pos = 0;
+    while (!conn->closeAfterWrite && !conn->streaming && !conn->exporter && pos < conn->in.size()) {
+      HttpRequest req;
+      HttpParseError err;
+      size_t consumed = 0;
+      HttpParse result = parseRequest(std::string_view(conn->in).substr(pos), req, consumed, err);
+      if (result == HttpParse::INCOMPLETE) break;
+      if (result == HttpParse::ERROR) {
+        appendError(conn->out, err.status, err.message);
+        conn->closeAfterWrite = true;
+        break;
+      }
+      Continuation cont;
+      if (!handleRequest(_ctx, req, conn->out, cont) || (!req.keepAlive && !cont.stream)) {
+        conn->closeAfterWrite = true;
+      }
+      conn->exporter = std::move(cont.exporter);
+      if (cont.stream) {
+        conn->streaming = true;
+        conn->streamSequence = cont.sequence;
+        _wake.clients.fetch_add(1, std::memory_order_relaxed);
+        // Readings stored after the snapshot but before the count went up
+        _ctx.store.streamEvents(conn->streamSequence, _events);
+        queueEvents(conn);
+      }
+      pos += consumed;
+    }
+    // A stream client has nothing more to say
+    if (conn->streaming) pos = conn->in.size();
+    conn->in.erase(0, pos);
+
+    if (peerClosed && conn->out.empty()) {
+      closeConnection(conn);
+      return false;
+    }
+    if (peerClosed) conn->closeAfterWrite = true;
+    return flush(conn);
+  }
+
+  // Returns false if the connection was closed
+  bool flush(Connection* conn) {
+    int pieces = 0;
+    bool exported = false;
+    while (true) {
+      while (conn->outPos < conn->out.size()) {
+        ssize_t n = send(conn->fd, conn->out.data() + conn->outPos,
+                         conn->out.size() - conn->outPos, MSG_NOSIGNAL);
+        if (n > 0) {
+          conn->outPos += (size_t)n;
+        } else if (n < 0 && errno == EINTR) {
+          continue;
+        } else if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+          // Stop reading until the client drains its responses
+          setWaitingForWrite(conn, true);
+          return true;
+        } else {
+          closeConnection(conn);
+          return false;
+        }
+      }
+      conn->out.clear();
+      conn->outPos = 0;
+      if (!conn->exporter) break;
+
+      // Next piece of an export, once the last one is out
+      if (conn->exporter->done()) {
+        conn->exporter.reset();
+        exported = true;
+        break;
+      }
+      if (++pieces > EXPORT_PIECES_PER_FLUSH) {
+        // Let other connections have a turn; EPOLLOUT brings us back
+        setWaitingForWrite(conn, true);
+        return true;
+      }
+      if (!conn->exporter->next(conn->out, EXPORT_PIECE_BYTES)) {
+        // Fewer records than counted: the body is short of its Content-Length
+        conn->exporter.reset();
+        conn->closeAfterWrite = true;
+      }
+      conn->lastActive = time(nullptr);
+    }
+    if (conn->closeAfterWrite) {
+      closeConnection(conn);
+      return false;
+    }
+    if (conn->waitingForWrite || exported) {
+      setWaitingForWrite(conn, false);
+      // Requests that arrived while we were blocked on output
+      if (!conn->in.empty()) return onReadable(conn);
+    }
+    return true;
+  }
+
+  void setWaitingForWrite(Connection* conn, bool waiting) {
+    if (conn->waitingForWrite == waiting) return;
+    conn->waitingForWrite = waiting;
+    epoll_event ev{};
+    ev.events = (waiting ? EPOLLOUT : EPOLLIN) | EPOLLRDHUP;
+    ev.data.ptr = conn;
+    epoll_ctl(_epollFd, EPOLL_CTL_MOD, conn->fd, &ev);
+  }
+
+  // Queue the readings events each stream client hasn't had yet. The
+  // events are fetched once for all of this worker's clients.
+  void publish() {
+    if (_wake.clients.load(std::memory_order_relaxed) == 0) return;
+    uint64_t since = UINT64_MAX;
+    std::vector<Connection*> streams;
+    for (auto& entry : _connections) {
+      Connection* conn = entry.second.get();
+      if (!conn->streaming) continue;
+      since = std::min(since, conn->streamSequence);
+      streams.push_back(conn);
+    }
+    _ctx.store.streamEvents(since, _events);
+    if (_events.empty()) return;
+
+    for (Connection* conn : streams) {
+      if (conn->streamSequence >= _events.back().sequence) continue;
+      queueEvents(conn);
+      if (conn->out.size() - conn->outPos > MAX_STREAM_BACKLOG) {
+        closeConnection(conn);
+      } else if (!conn->waitingForWrite) {
+        flush(conn);
+      }
+    }
+  }
+
+  // Appends the events in _events that conn hasn't had
+  void queueEvents(Connection* conn) {
+    if (_events.empty() || conn->streamSequence >= _events.back().sequence) return;
+    if (_events.front().sequence > conn->streamSequence + 1) {
+      // Missed events that are no longer held: start over
+      conn->out += *_ctx.store.streamSnapshot(conn->streamSequence);
+    }
+    for (const StreamEvent& event : _events) {
+      if (event.sequence > conn->streamSequence) conn->out += *event.data;
+    }
+    conn->streamSequence = std::max(conn->streamSequence, _events.back().sequence);
+    conn->lastActive = time(nullptr);
+  }
+
+  void sweepIdle(time_t now) {
+    std::vector<Connection*> idle;
+    std::vector<Connection*> quiet;
+    for (auto& entry : _connections) {
+      Connection* conn = entry.second.get();
+      if (conn->streaming) {
+        if (now - conn->lastActive >= STREAM_HEARTBEAT_S) quiet.push_back(conn);
+      } else if (now - conn->lastActive > IDLE_TIMEOUT_S) {
+        idle.push_back(conn);
+      }
+    }
+    for (Connection* conn : idle) closeConnection(conn);
+    for (Connection* conn : quiet) {
+      conn->out += ":\n\n";
+      conn->lastActive = now;
+      if (!conn->waitingForWrite) flush(conn);
+    }
+  }
+
+  // Later events of the same epoll batch may still point at conn, so it
+  // is only marked closed here and freed after the batch (see run())
+  void closeConnection(Connection* conn) {
+    if (conn->streaming) _wake.clients.fetch_sub(1, std::memory_order_relaxed);
+    int fd = conn->fd;
+    epoll_ctl(_epollFd, EPOLL_CTL_DEL, fd, nullptr);
+    close(fd);
+    conn->closed = true;
+    auto it = _connections.find(fd);
+    _closed.push_back(std::move(it->second));
+    _connections.erase(it);
+  }
+
+  ServerContext& _ctx;
+  int _listenFd;
+  StreamWake& _wake;
+  int _epollFd = -1;
+  std::unordered_map<int, std::unique_ptr<Connection>> _connections;
+  std::vector<std::unique_ptr<Connection>> _closed;  // Closed this batch
+  std::vector<StreamEvent> _events;  // Scratch for publish()
+};
+
+int openListener(int port) {
+  int fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+  if (fd < 0) return -1;
+  int one = 1;
+  setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+  setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &one, sizeof(one));
+
+  sockaddr_in addr{};
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_ANY);
+  addr.sin_port = htons((uint16_t)port);
+  if (bind(fd, (sockaddr*)&addr, sizeof(addr)) != 0 || listen(fd, SOMAXCONN) != 0) {
+    close(fd);
+    return -1;
+  }
+  return fd;
+}
+
+void onSignal(int) {
+  stopRequested.store(true);
+}
+
+void usage(const char* argv0) {
+  fprintf(stderr, "Usage: %s [-p port] [-t threads] [-s store_dir] [-l log_file] "
+                  "[-d dashboard.html] [-q]\n", argv0);
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  int port = DEFAULT_PORT;
+  int threads = (int)std::thread::hardware_concurrency();
+  std::string storeDir = DEFAULT_STORE_DIR;
+  std::string logFile;
+  std::string dashboardPath = DEFAULT_DASHBOARD_PATH;
+  bool quiet = false;
+
+  int opt;
+  while ((opt = getopt(argc, argv, "p:t:s:l:d:qh")) != -1) {
+    switch (opt) {
+      case 'p': port = atoi(optarg); break;
+      case 't': threads = atoi(optarg); break;
+      case 's': storeDir = optarg; break;
+      case 'l': logFile = optarg; break;
+      case 'd': dashboardPath = optarg; break;
+      case 'q': quiet = true; break;
+      default:
+        usage(argv[0]);
+        return opt == 'h' ? 0 : 2;
+    }
+  }
+  if (threads < 1) threads = 1;
+
+  signal(SIGPIPE, SIG_IGN);
+  struct sigaction sa{};
+  sa.sa_handler = onSignal;
+  sigaction(SIGINT, &sa, nullptr);
+  sigaction(SIGTERM, &sa, nullptr);
+
+  ServerContext ctx(logFile, quiet, storeDir);
+  std::string storeError;
+  if (!ctx.history.open(storeError)) {
+    fprintf(stderr, "Could not open history store: %s\n", storeError.c_str());
+    return 1;
+  }
+  std::ifstream dashboard(dashboardPath, std::ios::binary);
+  if (dashboard) {
+    std::ostringstream html;
+    html << dashboard.rdbuf();
+    ctx.dashboard = html.str();
+    ctx.haveDashboard = true;
+  } else {
+    fprintf(stderr, "Warning: dashboard not found at %s (use -d)\n", dashboardPath.c_str());
+  }
+
+  std::vector<std::unique_ptr<Worker>> workers;
+  for (int i = 0; i < threads; i++) {
+    int fd = openListener(port);
+    if (fd < 0) {
+      fprintf(stderr, "Could not listen on port %d: %s\n", port, strerror(errno));
+      return 1;
+    }
+    ctx.streamWakes.push_back(std::make_unique<StreamWake>());
+    workers.push_back(std::make_unique<Worker>(ctx, fd, *ctx.streamWakes.back()));
+    if (!workers.back()->init()) {
+      fprintf(stderr, "epoll setup failed: %s\n", strerror(errno));
+      return 1;
+    }
+  }
+
+  printf("=== Water Tank Sensor Server (C++) ===\n");
+  printf("Starting server on port %d with %d worker thread%s...\n", port, threads, threads == 1 ? "" : "s");
+  printf("Dashboard: http://localhost:%d/\n", port);
+  printf("History store: %s\n", storeDir.c_str());
+  if (!logFile.empty()) printf("Logging data to: %s\n", logFile.c_str());
+  printf("Press Ctrl+C to stop\n\n");
+  fflush(stdout);
+
+  std::vector<std::thread> pool;
+  for (auto& worker : workers) pool.emplace_back(&Worker::run, worker.get());
+  for (auto& t : pool) t.join();
+
+  printf("\n\nShutting down server...\n");
+  workers.clear();
+  printf("Server stopped.\n");
+  return 0;
+}
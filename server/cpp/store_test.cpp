@@ -0,0 +1,342 @@
+// Tests for TimeSeriesStore: range scans and rollups against brute-force
+// references, segment roll-over, reopening, crash repair, index rebuild,
+// merging older records and the single-writer lock.
+//
+// Build and run: make check
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "timeseries_store.h"
+#include "test_util.h"
+
+namespace {
+
+// One reading every 5 s with a few duplicate timestamps
+std::vector<StoredRecord> makeTrace(size_t count, int64_t startUs) {
+  std::vector<StoredRecord> trace(count);
+  int64_t t = startUs;
+  for (size_t i = 0; i < count; i++) {
+    if (i % 97 != 0) t += 5000000;
+    trace[i] = StoredRecord{t, 2.5f, (float)i * 0.01f, (float)i * 0.001f, (float)i};
+  }
+  return trace;
+}
+
+std::vector<StoredRecord> scanAll(TimeSeriesStore& store, const std::string& device,
+                                  int64_t from, int64_t to) {
+  std::vector<StoredRecord> out;
+  size_t n = store.scan(device, from, to, [&](const StoredRecord* r, size_t count) {
+    out.insert(out.end(), r, r + count);
+  });
+  CHECK(n == out.size());
+  return out;
+}
+
+bool sameRecords(const std::vector<StoredRecord>& a, const std::vector<StoredRecord>& b) {
+  if (a.size() != b.size()) return false;
+  for (size_t i = 0; i < a.size(); i++) {
+    if (a[i].timestampUs != b[i].timestampUs || a[i].volumeL != b[i].volumeL) return false;
+  }
+  return true;
+}
+
+void checkRanges(TimeSeriesStore& store, const std::vector<StoredRecord>& trace) {
+  const int64_t start = trace.front().timestampUs;
+  const int64_t end = trace.back().timestampUs;
+  const int64_t ranges[][2] = {
+    {start - 1000, end + 1},                // everything
+    {start, start + 1},                     // first instant
+    {start + 5000000LL * 300, start + 5000000LL * 301},
+    {start + 5000000LL * 999, start + 5000000LL * 1501},   // spans a segment boundary
+    {end, end + 1},
+    {end + 1, end + 1000000},               // after the end
+    {start - 1000000, start},               // before the start
+  };
+  for (const auto& r : ranges) {
+    std::vector<StoredRecord> expected;
+    for (const auto& rec : trace) {
+      if (rec.timestampUs >= r[0] && rec.timestampUs < r[1]) expected.push_back(rec);
+    }
+    CHECK(sameRecords(scanAll(store, "tank-1", r[0], r[1]), expected));
+  }
+}
+
+void testScanMatchesReference() {
+  TempDir tmp("store_test");
+  const std::string& dir = tmp.path();
+  TimeSeriesStore store(dir, 1000);
+  std::string error;
+  CHECK(store.open(error));
+
+  auto trace = makeTrace(3500, 1700000000000000);
+  // Mixed single and batched appends
+  CHECK(store.append("tank-1", trace.data(), 1));
+  CHECK(store.append("tank-1", trace.data() + 1, 1200));
+  for (size_t i = 1201; i < trace.size(); i++) CHECK(store.append("tank-1", &trace[i], 1));
+
+  CHECK(store.recordCount("tank-1") == trace.size());
+  checkRanges(store, trace);
+  CHECK(scanAll(store, "missing", 0, INT64_MAX).empty());
+}
+
+void testReopenContinuesSeries() {
+  TempDir tmp("store_test");
+  const std::string& dir = tmp.path();
+  auto trace = makeTrace(2600, 1700000000000000);
+  {
+    TimeSeriesStore store(dir, 1000);
+    std::string error;
+    CHECK(store.open(error));
+    CHECK(store.append("tank-1", trace.data(), 1800));
+  }
+  TimeSeriesStore store(dir, 1000);
+  std::string error;
+  CHECK(store.open(error));
+  CHECK(store.devices() == std::vector<std::string>{"tank-1"});
+  CHECK(store.recordCount("tank-1") == 1800);
+  CHECK(store.append("tank-1", trace.data() + 1800, 800));
+  checkRanges(store, trace);
+}
+
+void testTornWriteAndLostIndexAreRepaired() {
+  TempDir tmp("store_test");
+  const std::string& dir = tmp.path();
+  auto trace = makeTrace(700, 1700000000000000);
+  {
+    TimeSeriesStore store(dir, 1000);
+    std::string error;
+    CHECK(store.open(error));
+    CHECK(store.append("tank-1", trace.data(), trace.size()));
+  }
+  // Half a record at the end, and the index gone
+  int fd = open((dir + "/tank-1/00000001.seg").c_str(), O_WRONLY | O_APPEND);
+  CHECK(write(fd, "garbage", 7) == 7);
+  close(fd);
+  CHECK(unlink((dir + "/tank-1/00000001.idx").c_str()) == 0);
+
+  TimeSeriesStore store(dir, 1000);
+  std::string error;
+  CHECK(store.open(error));
+  CHECK(store.recordCount("tank-1") == 700);
+  auto more = makeTrace(1, trace.back().timestampUs + 5000000);
+  CHECK(store.append("tank-1", more.data(), 1));
+  trace.push_back(more[0]);
+  CHECK(sameRecords(scanAll(store, "tank-1", 0, INT64_MAX), trace));
+}
+
+std::vector<RollupBucket> scanTier(TimeSeriesStore& store, int tier, int64_t from, int64_t to) {
+  std::vector<RollupBucket> out;
+  size_t n = store.scanRollups("tank-1", tier, from, to, [&](const RollupBucket* b, size_t count) {
+    out.insert(out.end(), b, b + count);
+  });
+  CHECK(n == out.size());
+  return out;
+}
+
+// Volume rollups of every tier recomputed from the trace
+void checkRollups(TimeSeriesStore& store, const std::vector<StoredRecord>& trace) {
+  for (int tier = 0; tier < ROLLUP_TIERS; tier++) {
+    struct Ref {
+      uint32_t count = 0;
+      float min = INFINITY, max = -INFINITY, last = 0;
+      double sum = 0;
+    };
+    std::map<int64_t, Ref> expected;
+    for (const auto& r : trace) {
+      Ref& b = expected[rollupBucketStart(tier, r.timestampUs)];
+      b.count++;
+      b.min = std::min(b.min, r.volumeL);
+      b.max = std::max(b.max, r.volumeL);
+      b.last = r.volumeL;
+      b.sum += r.volumeL;
+    }
+    auto got = scanTier(store, tier, INT64_MIN, INT64_MAX);
+    CHECK(got.size() == expected.size());
+    auto it = expected.begin();
+    for (size_t i = 0; i < got.size() && it != expected.end(); i++, ++it) {
+      const Ref& e = it->second;
+      CHECK(got[i].startUs == it->first);
+      CHECK(got[i].count == e.count);
+      CHECK(got[i].volumeL.min == e.min);
+      CHECK(got[i].volumeL.max == e.max);
+      CHECK(got[i].volumeL.last == e.last);
+      CHECK(std::fabs(got[i].volumeL.mean - e.sum / e.count) <= 1e-3 * std::fabs(e.max) + 1e-6);
+    }
+  }
+
+  // A range starts at the bucket holding `from`
+  const int64_t hour = ROLLUP_WIDTH_US[1];
+  const int64_t mid = rollupBucketStart(1, trace[trace.size() / 2].timestampUs);
+  auto hours = scanTier(store, 1, mid + 1, mid + 2 * hour);
+  CHECK(hours.size() == 2);
+  CHECK(!hours.empty() && hours[0].startUs == mid);
+}
+
+void testRollupsMatchReference() {
+  TempDir tmp("store_test");
+  const std::string& dir = tmp.path();
+  auto trace = makeTrace(60000, 1700000000000000);  // ~3.5 days
+  {
+    TimeSeriesStore store(dir, 20000);
+    std::string error;
+    CHECK(store.open(error));
+    CHECK(store.append("tank-1", trace.data(), 30000));
+    for (size_t i = 30000; i < trace.size(); i++) CHECK(store.append("tank-1", &trace[i], 1));
+    checkRollups(store, trace);
+  }
+
+  // Open buckets come back from the records
+  {
+    TimeSeriesStore store(dir, 20000);
+    std::string error;
+    CHECK(store.open(error));
+    checkRollups(store, trace);
+  }
+
+  // So does a whole tier (e.g. a store from before rollups)
+  CHECK(unlink((dir + "/tank-1/rollup-1h.dat").c_str()) == 0);
+  TimeSeriesStore store(dir, 20000);
+  std::string error;
+  CHECK(store.open(error));
+  auto more = makeTrace(2000, trace.back().timestampUs + 5000000);
+  CHECK(store.append("tank-1", more.data(), more.size()));
+  trace.insert(trace.end(), more.begin(), more.end());
+  checkRollups(store, trace);
+}
+
+void testOutOfOrderRecordsAreMerged() {
+  TempDir tmp("store_test");
+  const std::string& dir = tmp.path();
+  TimeSeriesStore store(dir, 1000);
+  std::string error;
+  CHECK(store.open(error));
+
+  StoredRecord records[3] = {{2000, 0, 0, 0, 1}, {1000, 0, 0, 0, 2}, {3000, 0, 0, 0, 3}};
+  CHECK(store.append("tank-1", records, 3));
+  auto stored = scanAll(store, "tank-1", 0, INT64_MAX);
+  CHECK(stored.size() == 3);
+  CHECK(stored[0].timestampUs == 1000 && stored[0].volumeL == 2);
+  CHECK(stored[1].timestampUs == 2000 && stored[1].volumeL == 1);
+  CHECK(stored[2].timestampUs == 3000 && stored[2].volumeL == 3);
+  CHECK(store.mergedRecords() == 1);
+}
+
+// A gap filled in later, spanning a segment boundary, ends up as if the
+// trace had arrived in order; so do the rollups and a reopened store
+void testOlderBatchIsMergedAcrossSegments() {
+  TempDir tmp("store_test");
+  const std::string& dir = tmp.path();
+  auto trace = makeTrace(3500, 1700000000000000);
+  std::vector<StoredRecord> gap(trace.begin() + 900, trace.begin() + 1300);
+  std::vector<StoredRecord> rest(trace.begin(), trace.begin() + 900);
+  rest.insert(rest.end(), trace.begin() + 1300, trace.end());
+  {
+    TimeSeriesStore store(dir, 1000);
+    std::string error;
+    CHECK(store.open(error));
+    CHECK(store.append("tank-1", rest.data(), rest.size()));
+    CHECK(store.append("tank-1", gap.data(), gap.size()));
+    CHECK(store.mergedRecords() == gap.size());
+    CHECK(store.recordCount("tank-1") == trace.size());
+    CHECK(store.lastTimestampUs("tank-1") == trace.back().timestampUs);
+    checkRanges(store, trace);
+    checkRollups(store, trace);
+  }
+  TimeSeriesStore store(dir, 1000);
+  std::string error;
+  CHECK(store.open(error));
+  checkRanges(store, trace);
+  checkRollups(store, trace);
+}
+
+// A merge.jnl left by a crash is replayed on open: the series is cut where
+// the merge cut it and the journalled tail appended again
+void testInterruptedMergeIsReplayed() {
+  TempDir tmp("store_test");
+  const std::string& dir = tmp.path();
+  auto trace = makeTrace(3500, 1700000000000000);
+  {
+    TimeSeriesStore store(dir, 1000);
+    std::string error;
+    CHECK(store.open(error));
+    CHECK(store.append("tank-1", trace.data(), 900));
+    CHECK(store.append("tank-1", trace.data() + 1300, trace.size() - 1300));
+  }
+  struct {
+    char magic[8];
+    int64_t cutUs;
+  } header = {{'W', 'T', 'S', 'M', 'R', 'G', '0', '1'}, trace[900].timestampUs};
+  int fd = open((dir + "/tank-1/merge.jnl").c_str(), O_WRONLY | O_CREAT, 0644);
+  CHECK(write(fd, &header, sizeof(header)) == (ssize_t)sizeof(header));
+  size_t tailBytes = (trace.size() - 900) * sizeof(StoredRecord);
+  CHECK(write(fd, trace.data() + 900, tailBytes) == (ssize_t)tailBytes);
+  close(fd);
+
+  TimeSeriesStore store(dir, 1000);
+  std::string error;
+  CHECK(store.open(error));
+  CHECK(access((dir + "/tank-1/merge.jnl").c_str(), F_OK) != 0);
+  CHECK(store.recordCount("tank-1") == trace.size());
+  checkRanges(store, trace);
+  checkRollups(store, trace);
+}
+
+void testDeviceNames() {
+  CHECK(TimeSeriesStore::validDeviceName("tank-1_north"));
+  CHECK(!TimeSeriesStore::validDeviceName(""));
+  CHECK(!TimeSeriesStore::validDeviceName(".."));
+  CHECK(!TimeSeriesStore::validDeviceName("a/b"));
+  CHECK(!TimeSeriesStore::validDeviceName(std::string(65, 'a')));
+}
+
+void testSecondWriterIsRefused() {
+  TempDir tmp("store_test");
+  const std::string& dir = tmp.path();
+  auto trace = makeTrace(10, 1700000000000000);
+  {
+    TimeSeriesStore store(dir);
+    std::string error;
+    CHECK(store.open(error));
+    CHECK(store.lastTimestampUs("tank-1") == INT64_MIN);
+    CHECK(store.append("tank-1", trace.data(), trace.size()));
+    CHECK(store.lastTimestampUs("tank-1") == trace.back().timestampUs);
+
+    TimeSeriesStore other(dir);
+    CHECK(!other.open(error));
+    CHECK(error.find("in use") != std::string::npos);
+  }
+  // Released when the first one closes
+  TimeSeriesStore store(dir);
+  std::string error;
+  CHECK(store.open(error));
+  CHECK(store.lastTimestampUs("tank-1") == trace.back().timestampUs);
+}
+
+}  // namespace
+
+int main() {
+  testScanMatchesReference();
+  testReopenContinuesSeries();
+  testTornWriteAndLostIndexAreRepaired();
+  testRollupsMatchReference();
+  testOutOfOrderRecordsAreMerged();
+  testOlderBatchIsMergedAcrossSegments();
+  testInterruptedMergeIsReplayed();
+  testDeviceNames();
+  testSecondWriterIsRefused();
+
+  if (failures) {
+    fprintf(stderr, "store_test: %d failure(s)\n", failures);
+    return 1;
+  }
+  printf("store_test: all checks passed\n");
+  return 0;
+}
@@ -0,0 +1,56 @@
+// Harness shared by the server tests (store_test, lora_test, export_test,
+// import_test): CHECK() records a failure and carries on, so one run
+// reports every broken case, and TempDir is a scratch directory removed
+// with everything in it when the test is done.
+
+#ifndef TEST_UTIL_H
+#define TEST_UTIL_H
+
+#include <ftw.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include <string>
+
+inline int failures = 0;
+
+#define CHECK(cond)                                                      \
+  do {                                                                   \
+    if (!(cond)) {                                                       \
+      fprintf(stderr, "%s:%d: CHECK failed: %s\n", __FILE__, __LINE__, #cond); \
+      failures++;                                                        \
+    }                                                                    \
+  } while (0)
+
+// /tmp/<prefix>_XXXXXX, created on construction and removed recursively on
+// destruction. Declare it before anything that keeps files open inside it
+// (a TimeSeriesStore), so those close first.
+class TempDir {
+public:
+  explicit TempDir(const char* prefix) {
+    std::string pattern = std::string("/tmp/") + prefix + "_XXXXXX";
+    if (!mkdtemp(&pattern[0])) {
+      fprintf(stderr, "mkdtemp(%s): %s\n", pattern.c_str(), strerror(errno));
+      exit(1);
+    }
+    _path = pattern;
+  }
+
+  ~TempDir() {
+    nftw(_path.c_str(), [](const char* path, const struct stat*, int, struct FTW*) {
+      return remove(path);
+    }, 16, FTW_DEPTH | FTW_PHYS);
+  }
+
+  TempDir(const TempDir&) = delete;
+  TempDir& operator=(const TempDir&) = delete;
+
+  const std::string& path() const { return _path; }
+
+private:
+  std::string _path;
+};
+
+#endif
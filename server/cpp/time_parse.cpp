@@ -0,0 +1,101 @@
+#include "time_parse.h"
+
+#include <climits>
+#include <ctime>
+
+namespace {
+
+bool parseDigits(std::string_view s, size_t pos, size_t count, int& out) {
+  if (pos + count > s.size()) return false;
+  out = 0;
+  for (size_t i = 0; i < count; i++) {
+    char c = s[pos + i];
+    if (c < '0' || c > '9') return false;
+    out = out * 10 + (c - '0');
+  }
+  return true;
+}
+
+// Seconds to subtract from a local wall-clock time to get UTC. mktime()
+// takes the timezone lock, so the answer is kept per thread for the hour
+// being parsed (logs are written in time order).
+int64_t localOffsetSec(int64_t wallSec) {
+  thread_local int64_t cachedHour = INT64_MIN;
+  thread_local int64_t cachedOffset = 0;
+  int64_t hour = wallSec >= 0 ? wallSec / 3600 : -((-wallSec + 3599) / 3600);
+  if (hour != cachedHour) {
+    time_t start = (time_t)(hour * 3600);
+    struct tm tm;
+    gmtime_r(&start, &tm);
+    tm.tm_isdst = -1;
+    time_t utc = mktime(&tm);
+    cachedOffset = utc == (time_t)-1 ? 0 : hour * 3600 - (int64_t)utc;
+    cachedHour = hour;
+  }
+  return cachedOffset;
+}
+
+bool parseTimestamp(std::string_view t, bool localWithoutZone, int64_t& us) {
+  int year, month, day, hour, minute, second;
+  if (!parseDigits(t, 0, 4, year) || t.size() < 19 || t[4] != '-' ||
+      !parseDigits(t, 5, 2, month) || t[7] != '-' || !parseDigits(t, 8, 2, day) ||
+      (t[10] != 'T' && t[10] != 't' && t[10] != ' ') || !parseDigits(t, 11, 2, hour) ||
+      t[13] != ':' || !parseDigits(t, 14, 2, minute) || t[16] != ':' ||
+      !parseDigits(t, 17, 2, second)) {
+    return false;
+  }
+  if (month < 1 || month > 12 || day < 1 || day > 31 || hour > 23 || minute > 59 || second > 60) {
+    return false;
+  }
+  size_t pos = 19;
+  int64_t fraction = 0;
+  if (pos < t.size() && t[pos] == '.') {
+    pos++;
+    int64_t scale = 100000;
+    size_t digits = 0;
+    while (pos < t.size() && t[pos] >= '0' && t[pos] <= '9') {
+      fraction += (t[pos] - '0') * scale;
+      scale /= 10;
+      pos++;
+      digits++;
+    }
+    if (digits == 0) return false;
+  }
+  int64_t seconds = daysFromCivil(year, month, day) * 86400 + hour * 3600 + minute * 60 + second;
+  if (pos == t.size()) {
+    if (!localWithoutZone) return false;
+    seconds -= localOffsetSec(seconds);
+  } else if (t[pos] == 'Z' || t[pos] == 'z') {
+    if (pos + 1 != t.size()) return false;
+  } else if (t[pos] == '+' || t[pos] == '-') {
+    int oh, om;
+    if (!parseDigits(t, pos + 1, 2, oh) || pos + 3 >= t.size() || t[pos + 3] != ':' ||
+        !parseDigits(t, pos + 4, 2, om) || pos + 6 != t.size()) {
+      return false;
+    }
+    seconds -= (oh * 3600 + om * 60) * (t[pos] == '-' ? -1 : 1);
+  } else {
+    return false;
+  }
+  us = seconds * 1000000 + fraction;
+  return true;
+}
+
+}  // namespace
+
+int64_t daysFromCivil(int y, int m, int d) {
+  y -= m <= 2;
+  int64_t era = (y >= 0 ? y : y - 399) / 400;
+  int64_t yoe = y - era * 400;
+  int64_t doy = (153 * (m + (m > 2 ? -3 : 9)) + 2) / 5 + d - 1;
+  int64_t doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+  return era * 146097 + doe - 719468;
+}
+
+bool parseRfc3339(std::string_view text, int64_t& us) {
+  return parseTimestamp(text, false, us);
+}
+
+bool parseLogTimestamp(std::string_view text, int64_t& us) {
+  return parseTimestamp(text, true, us);
+}
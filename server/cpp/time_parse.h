@@ -0,0 +1,24 @@
+#ifndef SENSOR_SERVER_TIME_PARSE_H
+#define SENSOR_SERVER_TIME_PARSE_H
+
+#include <cstdint>
+#include <string_view>
+
+// ISO 8601 timestamps as the network server and the log writers produce
+// them, to Unix microseconds:
+//
+//   YYYY-MM-DD(T| )HH:MM:SS[.fff...][Z|+HH:MM|-HH:MM]
+//
+// Fractions beyond microseconds are truncated.
+
+// RFC 3339: the zone is required ("2025-01-02T03:04:05.123456789Z")
+bool parseRfc3339(std::string_view text, int64_t& us);
+
+// Log timestamps: without a zone the time is local (TZ applies), as
+// sensor_server.py and sensor-data.cgi write it
+bool parseLogTimestamp(std::string_view text, int64_t& us);
+
+// Days since 1970-01-01 of a proleptic Gregorian date
+int64_t daysFromCivil(int y, int m, int d);
+
+#endif
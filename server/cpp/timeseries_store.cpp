@@ -0,0 +1,659 @@
+#include "timeseries_store.h"
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+
+namespace {
+
+const char SEGMENT_MAGIC[8] = {'W', 'T', 'S', 'S', 'E', 'G', '0', '1'};
+const uint32_t FORMAT_VERSION = 1;
+
+struct SegmentHeader {
+  char magic[8];
+  uint32_t version;
+  uint32_t recordSize;
+  int64_t firstUs;
+  uint8_t reserved[40];
+};
+static_assert(sizeof(SegmentHeader) == TimeSeriesStore::HEADER_SIZE, "segment header size");
+
+bool writeAll(int fd, const void* data, size_t size) {
+  const char* p = static_cast<const char*>(data);
+  while (size > 0) {
+    ssize_t n = write(fd, p, size);
+    if (n < 0 && errno == EINTR) continue;
+    if (n <= 0) return false;
+    p += n;
+    size -= (size_t)n;
+  }
+  return true;
+}
+
+// Read-only mapping of the first `length` bytes of a file, or all of it
+// if a merge has since cut it shorter
+class MappedFile {
+public:
+  MappedFile(const std::string& path, size_t length) : _length(length) {
+    int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return;
+    struct stat st;
+    if (fstat(fd, &st) == 0 && (size_t)st.st_size < _length) _length = (size_t)st.st_size;
+    void* p = _length > 0 ? mmap(nullptr, _length, PROT_READ, MAP_SHARED, fd, 0) : MAP_FAILED;
+    close(fd);
+    if (p == MAP_FAILED) return;
+    madvise(p, _length, MADV_SEQUENTIAL);
+    _data = static_cast<const uint8_t*>(p);
+  }
+  ~MappedFile() {
+    if (_data) munmap(const_cast<uint8_t*>(_data), _length);
+  }
+  const uint8_t* data() const { return _data; }
+  size_t length() const { return _length; }
+
+private:
+  const uint8_t* _data = nullptr;
+  size_t _length;
+};
+
+const char JOURNAL_MAGIC[8] = {'W', 'T', 'S', 'M', 'R', 'G', '0', '1'};
+
+// merge.jnl: the records after cutUs as they are to be stored
+struct JournalHeader {
+  char magic[8];
+  int64_t cutUs;
+};
+
+bool byTimestamp(const StoredRecord& r, int64_t us) { return r.timestampUs < us; }
+bool recordsInOrder(const StoredRecord& a, const StoredRecord& b) {
+  return a.timestampUs < b.timestampUs;
+}
+bool indexByTimestamp(const SegmentIndexEntry& e, int64_t us) { return e.timestampUs < us; }
+bool bucketByStart(const RollupBucket& b, int64_t us) { return b.startUs < us; }
+
+}  // namespace
+
+TimeSeriesStore::TimeSeriesStore(std::string root, uint32_t segmentRecords)
+  : _root(std::move(root)), _segmentRecords(segmentRecords) {}
+
+TimeSeriesStore::~TimeSeriesStore() {
+  for (auto& entry : _series) {
+    if (entry.second->segFd >= 0) close(entry.second->segFd);
+    if (entry.second->idxFd >= 0) close(entry.second->idxFd);
+  }
+  if (_lockFd >= 0) close(_lockFd);
+}
+
+bool TimeSeriesStore::validDeviceName(const std::string& device) {
+  if (device.empty() || device.size() > 64) return false;
+  for (char c : device) {
+    if (!isalnum((unsigned char)c) && c != '-' && c != '_') return false;
+  }
+  return true;
+}
+
+bool TimeSeriesStore::open(std::string& error) {
+  if (mkdir(_root.c_str(), 0755) != 0 && errno != EEXIST) {
+    error = "cannot create " + _root + ": " + strerror(errno);
+    return false;
+  }
+  // One writer per store: the server and lora_ingest must not append to
+  // the same series at once
+  std::string lockPath = _root + "/.lock";
+  _lockFd = ::open(lockPath.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+  if (_lockFd < 0) {
+    error = "cannot open " + lockPath + ": " + strerror(errno);
+    return false;
+  }
+  if (flock(_lockFd, LOCK_EX | LOCK_NB) != 0) {
+    error = _root + " is in use by another process";
+    return false;
+  }
+  DIR* dir = opendir(_root.c_str());
+  if (!dir) {
+    error = "cannot open " + _root + ": " + strerror(errno);
+    return false;
+  }
+  std::vector<std::string> names;
+  while (dirent* entry = readdir(dir)) {
+    if (validDeviceName(entry->d_name)) names.push_back(entry->d_name);
+  }
+  closedir(dir);
+
+  for (const auto& name : names) {
+    auto s = std::make_unique<Series>();
+    s->dir = _root + "/" + name;
+    if (!openSeries(*s, error) || !openRollups(*s, error)) return false;
+    {
+      std::lock_guard<std::mutex> lock(s->mutex);
+      replayRollups(*s);
+      if (!replayJournal(*s, error)) return false;
+    }
+    std::lock_guard<std::mutex> lock(_seriesMutex);
+    _series[name] = std::move(s);
+  }
+  return true;
+}
+
+bool TimeSeriesStore::openRollups(Series& s, std::string& error) {
+  for (int tier = 0; tier < ROLLUP_TIERS; tier++) {
+    std::string path = s.dir + "/rollup-" + ROLLUP_NAMES[tier] + ".dat";
+    if (!s.rollups[tier].open(path, tier, error)) return false;
+  }
+  return true;
+}
+
+// Rebuild the open buckets (and any the tier files missed, e.g. for a store
+// written before rollups existed) from the records. Caller holds s.mutex.
+void TimeSeriesStore::replayRollups(Series& s) {
+  int64_t from = INT64_MAX;
+  for (const auto& tier : s.rollups) from = std::min(from, tier.resumeUs());
+  if (from > s.lastUs) return;
+  readRanges(s, scanRanges(s, from, INT64_MAX), from, INT64_MAX,
+             [&](const StoredRecord* records, size_t count) {
+               for (size_t i = 0; i < count; i++) {
+                 for (auto& tier : s.rollups) tier.add(records[i]);
+               }
+             });
+}
+
+std::string TimeSeriesStore::segmentPath(const Series& s, uint32_t seq, const char* ext) const {
+  char name[32];
+  snprintf(name, sizeof(name), "/%08u.%s", seq, ext);
+  return s.dir + name;
+}
+
+bool TimeSeriesStore::openSeries(Series& s, std::string& error) {
+  DIR* dir = opendir(s.dir.c_str());
+  if (!dir) {
+    error = "cannot open " + s.dir + ": " + strerror(errno);
+    return false;
+  }
+  std::vector<uint32_t> seqs;
+  while (dirent* entry = readdir(dir)) {
+    unsigned seq;
+    char ext[8];
+    if (sscanf(entry->d_name, "%8u.%7s", &seq, ext) == 2 && strcmp(ext, "seg") == 0) {
+      seqs.push_back(seq);
+    }
+  }
+  closedir(dir);
+  std::sort(seqs.begin(), seqs.end());
+
+  for (uint32_t seq : seqs) {
+    std::string path = segmentPath(s, seq, "seg");
+    int fd = ::open(path.c_str(), O_RDWR | O_APPEND | O_CLOEXEC);
+    SegmentHeader header;
+    struct stat st;
+    if (fd < 0 || pread(fd, &header, sizeof(header), 0) != (ssize_t)sizeof(header) ||
+        memcmp(header.magic, SEGMENT_MAGIC, sizeof(SEGMENT_MAGIC)) != 0 ||
+        header.version != FORMAT_VERSION || header.recordSize != sizeof(StoredRecord) ||
+        fstat(fd, &st) != 0) {
+      error = "bad segment " + path;
+      if (fd >= 0) close(fd);
+      return false;
+    }
+
+    Segment seg;
+    seg.seq = seq;
+    seg.firstUs = header.firstUs;
+    seg.records = ((uint64_t)st.st_size - HEADER_SIZE) / sizeof(StoredRecord);
+    bool active = seq == seqs.back();
+    if (active) {
+      // Drop a record torn by a crash mid-write
+      off_t whole = (off_t)(HEADER_SIZE + seg.records * sizeof(StoredRecord));
+      if (st.st_size != whole && ftruncate(fd, whole) != 0) {
+        error = "cannot repair " + path;
+        close(fd);
+        return false;
+      }
+      StoredRecord last;
+      if (seg.records > 0 &&
+          pread(fd, &last, sizeof(last), whole - (off_t)sizeof(last)) == (ssize_t)sizeof(last)) {
+        s.lastUs = last.timestampUs;
+      }
+      s.segFd = fd;
+    } else {
+      close(fd);
+    }
+    s.segments.push_back(seg);
+  }
+
+  if (!s.segments.empty()) {
+    if (!loadIndex(s, s.segments.back())) {
+      error = "cannot load index for " + s.dir;
+      return false;
+    }
+    std::string idxPath = segmentPath(s, s.segments.back().seq, "idx");
+    s.idxFd = ::open(idxPath.c_str(), O_WRONLY | O_APPEND | O_CREAT | O_CLOEXEC, 0644);
+    if (s.idxFd < 0) {
+      error = "cannot open " + idxPath;
+      return false;
+    }
+  }
+  return true;
+}
+
+// Load a segment's sparse index, rebuilding it from the records if the
+// file is missing or does not match them (e.g. after a crash)
+bool TimeSeriesStore::loadIndex(Series& s, Segment& seg) {
+  if (seg.indexLoaded) return true;
+  uint64_t expected = (seg.records + INDEX_STRIDE - 1) / INDEX_STRIDE;
+  std::string idxPath = segmentPath(s, seg.seq, "idx");
+
+  seg.index.assign(expected, SegmentIndexEntry{0, 0});
+  int fd = ::open(idxPath.c_str(), O_RDONLY | O_CLOEXEC);
+  ssize_t want = (ssize_t)(expected * sizeof(SegmentIndexEntry));
+  bool valid = fd >= 0 && pread(fd, seg.index.data(), (size_t)want, 0) == want;
+  for (uint64_t i = 0; valid && i < expected; i++) {
+    valid = seg.index[i].record == i * INDEX_STRIDE;
+  }
+  if (fd >= 0) close(fd);
+
+  if (!valid) {
+    std::string segPath = segmentPath(s, seg.seq, "seg");
+    fd = ::open(segPath.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return false;
+    for (uint64_t i = 0; i < expected; i++) {
+      StoredRecord r;
+      off_t offset = (off_t)(HEADER_SIZE + i * INDEX_STRIDE * sizeof(StoredRecord));
+      if (pread(fd, &r, sizeof(r), offset) != (ssize_t)sizeof(r)) {
+        close(fd);
+        return false;
+      }
+      seg.index[i] = SegmentIndexEntry{r.timestampUs, i * INDEX_STRIDE};
+    }
+    close(fd);
+    fd = ::open(idxPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd >= 0) {
+      writeAll(fd, seg.index.data(), seg.index.size() * sizeof(SegmentIndexEntry));
+      close(fd);
+    }
+  } else {
+    // Drop entries past the records (index written, record write lost)
+    if (truncate(idxPath.c_str(), want) != 0) return false;
+  }
+  seg.indexLoaded = true;
+  return true;
+}
+
+bool TimeSeriesStore::startSegment(Series& s, int64_t firstUs) {
+  uint32_t seq = s.segments.empty() ? 1 : s.segments.back().seq + 1;
+  std::string segPath = segmentPath(s, seq, "seg");
+  std::string idxPath = segmentPath(s, seq, "idx");
+
+  int segFd = ::open(segPath.c_str(), O_RDWR | O_APPEND | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+  if (segFd < 0) return false;
+  SegmentHeader header{};
+  memcpy(header.magic, SEGMENT_MAGIC, sizeof(SEGMENT_MAGIC));
+  header.version = FORMAT_VERSION;
+  header.recordSize = sizeof(StoredRecord);
+  header.firstUs = firstUs;
+  int idxFd = ::open(idxPath.c_str(), O_WRONLY | O_APPEND | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+  if (idxFd < 0 || !writeAll(segFd, &header, sizeof(header))) {
+    close(segFd);
+    if (idxFd >= 0) close(idxFd);
+    unlink(segPath.c_str());
+    return false;
+  }
+
+  if (s.segFd >= 0) close(s.segFd);
+  if (s.idxFd >= 0) close(s.idxFd);
+  s.segFd = segFd;
+  s.idxFd = idxFd;
+
+  // Sealed segments keep their index only until it is needed again
+  if (!s.segments.empty()) {
+    s.segments.back().index = std::vector<SegmentIndexEntry>();
+    s.segments.back().indexLoaded = false;
+  }
+  Segment seg;
+  seg.seq = seq;
+  seg.firstUs = firstUs;
+  seg.indexLoaded = true;
+  s.segments.push_back(std::move(seg));
+  return true;
+}
+
+TimeSeriesStore::Series* TimeSeriesStore::series(const std::string& device, bool create) {
+  std::lock_guard<std::mutex> lock(_seriesMutex);
+  auto it = _series.find(device);
+  if (it != _series.end()) return it->second.get();
+  if (!create || !validDeviceName(device)) return nullptr;
+
+  std::string dir = _root + "/" + device;
+  if (mkdir(dir.c_str(), 0755) != 0 && errno != EEXIST) return nullptr;
+  auto s = std::make_unique<Series>();
+  s->dir = dir;
+  std::string error;
+  if (!openRollups(*s, error)) {
+    fprintf(stderr, "timeseries: %s\n", error.c_str());
+    return nullptr;
+  }
+  Series* raw = s.get();
+  _series[device] = std::move(s);
+  return raw;
+}
+
+bool TimeSeriesStore::append(const std::string& device, const StoredRecord* records, size_t count) {
+  Series* s = series(device, true);
+  if (!s) return false;
+  std::lock_guard<std::mutex> lock(s->mutex);
+
+  // The in-order run goes straight on the end; the first older record and
+  // everything after it are merged in
+  size_t inOrder = 0;
+  int64_t last = s->lastUs;
+  while (inOrder < count && records[inOrder].timestampUs >= last) {
+    last = records[inOrder++].timestampUs;
+  }
+  bool ok = appendInOrder(*s, records, inOrder);
+  if (ok && inOrder < count) ok = merge(*s, records + inOrder, count - inOrder);
+  return ok;
+}
+
+// Records no older than s.lastUs, in timestamp order. Caller holds s.mutex.
+bool TimeSeriesStore::appendInOrder(Series& s, const StoredRecord* records, size_t count) {
+  std::vector<SegmentIndexEntry> idx;
+  bool rollupsOk = true;
+  size_t i = 0;
+  while (i < count) {
+    if (s.segFd < 0 || s.segments.back().records >= _segmentRecords) {
+      if (!startSegment(s, records[i].timestampUs)) return false;
+    }
+    Segment& seg = s.segments.back();
+    size_t n = std::min((size_t)(_segmentRecords - seg.records), count - i);
+
+    idx.clear();
+    for (size_t k = 0; k < n; k++) {
+      uint64_t recno = seg.records + k;
+      if (recno % INDEX_STRIDE == 0) idx.push_back(SegmentIndexEntry{records[i + k].timestampUs, recno});
+    }
+
+    if (!writeAll(s.segFd, records + i, n * sizeof(StoredRecord)) ||
+        !writeAll(s.idxFd, idx.data(), idx.size() * sizeof(SegmentIndexEntry))) {
+      // Keep the segment at a whole number of indexed records
+      if (ftruncate(s.segFd, (off_t)(HEADER_SIZE + seg.records * sizeof(StoredRecord))) != 0) {
+        perror("timeseries: truncate after failed write");
+      }
+      return false;
+    }
+    seg.records += n;
+    seg.index.insert(seg.index.end(), idx.begin(), idx.end());
+    s.lastUs = records[i + n - 1].timestampUs;
+    for (size_t k = 0; k < n; k++) {
+      for (auto& tier : s.rollups) rollupsOk = tier.add(records[i + k]) && rollupsOk;
+    }
+    i += n;
+  }
+  return rollupsOk;
+}
+
+// Merge records, some older than s.lastUs, into place: cut the series just
+// after the oldest one and append the stored records from there merged
+// with the new ones (stored first among equal timestamps). Caller holds
+// s.mutex.
+bool TimeSeriesStore::merge(Series& s, const StoredRecord* records, size_t count) {
+  std::vector<StoredRecord> added(records, records + count);
+  std::stable_sort(added.begin(), added.end(), recordsInOrder);
+  int64_t cutUs = added.front().timestampUs;
+  uint64_t older = (uint64_t)std::count_if(added.begin(), added.end(), [&](const StoredRecord& r) {
+    return r.timestampUs < s.lastUs;
+  });
+
+  std::vector<StoredRecord> stored;
+  readRanges(s, scanRanges(s, cutUs + 1, INT64_MAX), cutUs + 1, INT64_MAX,
+             [&](const StoredRecord* r, size_t n) { stored.insert(stored.end(), r, r + n); });
+  std::vector<StoredRecord> tail(stored.size() + added.size());
+  std::merge(stored.begin(), stored.end(), added.begin(), added.end(), tail.begin(), recordsInOrder);
+
+  if (!writeJournal(s, cutUs, tail) || !truncateAfter(s, cutUs) ||
+      !appendInOrder(s, tail.data(), tail.size())) {
+    return false;
+  }
+  _merged += older;
+  unlink((s.dir + "/merge.jnl").c_str());
+  return true;
+}
+
+// Written to a temporary name and renamed, so merge.jnl is always whole
+bool TimeSeriesStore::writeJournal(Series& s, int64_t cutUs, const std::vector<StoredRecord>& tail) {
+  std::string tmpPath = s.dir + "/merge.tmp";
+  int fd = ::open(tmpPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+  if (fd < 0) return false;
+  JournalHeader header{};
+  memcpy(header.magic, JOURNAL_MAGIC, sizeof(JOURNAL_MAGIC));
+  header.cutUs = cutUs;
+  bool ok = writeAll(fd, &header, sizeof(header)) &&
+            writeAll(fd, tail.data(), tail.size() * sizeof(StoredRecord));
+  close(fd);
+  if (!ok || rename(tmpPath.c_str(), (s.dir + "/merge.jnl").c_str()) != 0) {
+    unlink(tmpPath.c_str());
+    return false;
+  }
+  return true;
+}
+
+// Finish a merge a crash interrupted: cut the series where it was to be
+// cut and append the journalled tail again. Caller holds s.mutex.
+bool TimeSeriesStore::replayJournal(Series& s, std::string& error) {
+  std::string path = s.dir + "/merge.jnl";
+  unlink((s.dir + "/merge.tmp").c_str());
+  int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0) return true;
+  JournalHeader header;
+  struct stat st;
+  std::vector<StoredRecord> tail;
+  bool ok = fstat(fd, &st) == 0 && (size_t)st.st_size >= sizeof(header) &&
+            ((size_t)st.st_size - sizeof(header)) % sizeof(StoredRecord) == 0 &&
+            pread(fd, &header, sizeof(header), 0) == (ssize_t)sizeof(header) &&
+            memcmp(header.magic, JOURNAL_MAGIC, sizeof(JOURNAL_MAGIC)) == 0;
+  if (ok) {
+    tail.resize(((size_t)st.st_size - sizeof(header)) / sizeof(StoredRecord));
+    ssize_t want = (ssize_t)(tail.size() * sizeof(StoredRecord));
+    ok = pread(fd, tail.data(), (size_t)want, sizeof(header)) == want;
+  }
+  close(fd);
+  if (!ok) {
+    error = "bad merge journal " + path;
+    return false;
+  }
+  if (!truncateAfter(s, header.cutUs) || !appendInOrder(s, tail.data(), tail.size())) {
+    error = "cannot replay " + path;
+    return false;
+  }
+  unlink(path.c_str());
+  return true;
+}
+
+// Drop the records after cutUs and rewind the rollups to match. Caller
+// holds s.mutex.
+bool TimeSeriesStore::truncateAfter(Series& s, int64_t cutUs) {
+  if (s.segments.empty()) return true;
+  size_t i = 0;
+  while (i + 1 < s.segments.size() && s.segments[i + 1].firstUs <= cutUs) i++;
+  Segment& seg = s.segments[i];
+  if (!loadIndex(s, seg)) return false;
+
+  // The first record after cutUs, searched within its index block
+  std::string segPath = segmentPath(s, seg.seq, "seg");
+  auto block = std::upper_bound(seg.index.begin(), seg.index.end(), cutUs,
+                                [](int64_t us, const SegmentIndexEntry& e) { return us < e.timestampUs; });
+  uint64_t lo = block == seg.index.begin() ? 0 : (block - 1)->record;
+  uint64_t hi = block == seg.index.end() ? seg.records : block->record;
+  uint64_t keep = 0;
+  int64_t keptLastUs = INT64_MIN;
+  {
+    MappedFile file(segPath, HEADER_SIZE + hi * sizeof(StoredRecord));
+    if (hi > 0 && !file.data()) return false;
+    if (hi > 0) {
+      const StoredRecord* records = reinterpret_cast<const StoredRecord*>(file.data() + HEADER_SIZE);
+      keep = (uint64_t)(std::upper_bound(records + lo, records + hi, cutUs,
+                                         [](int64_t us, const StoredRecord& r) {
+                                           return us < r.timestampUs;
+                                         }) -
+                        records);
+      if (keep > 0) keptLastUs = records[keep - 1].timestampUs;
+    }
+  }
+
+  {
+    std::unique_lock<std::shared_mutex> files(s.files);
+    if (s.segFd >= 0) close(s.segFd);
+    if (s.idxFd >= 0) close(s.idxFd);
+    s.segFd = s.idxFd = -1;
+    // An emptied segment goes too; the next append starts a new one
+    size_t first = keep > 0 ? i + 1 : i;
+    while (s.segments.size() > first) {
+      unlink(segmentPath(s, s.segments.back().seq, "seg").c_str());
+      unlink(segmentPath(s, s.segments.back().seq, "idx").c_str());
+      s.segments.pop_back();
+    }
+    if (keep > 0) {
+      std::string idxPath = segmentPath(s, seg.seq, "idx");
+      seg.index.resize((keep + INDEX_STRIDE - 1) / INDEX_STRIDE);
+      seg.records = keep;
+      s.segFd = ::open(segPath.c_str(), O_RDWR | O_APPEND | O_CLOEXEC);
+      s.idxFd = ::open(idxPath.c_str(), O_WRONLY | O_APPEND | O_CLOEXEC);
+      if (s.segFd < 0 || s.idxFd < 0 ||
+          ftruncate(s.segFd, (off_t)(HEADER_SIZE + keep * sizeof(StoredRecord))) != 0 ||
+          ftruncate(s.idxFd, (off_t)(seg.index.size() * sizeof(SegmentIndexEntry))) != 0) {
+        return false;
+      }
+    }
+    s.lastUs = keptLastUs;
+    for (auto& tier : s.rollups) {
+      if (!tier.rewind(cutUs)) return false;
+    }
+  }
+  replayRollups(s);
+  return true;
+}
+
+size_t TimeSeriesStore::scan(const std::string& device, int64_t fromUs, int64_t toUs, const ScanFn& fn) {
+  Series* s = series(device, false);
+  if (!s || fromUs >= toUs) return 0;
+
+  // Narrow each overlapping segment to whole index blocks under the lock,
+  // then read the records without holding it
+  std::vector<ScanRange> ranges;
+  {
+    std::lock_guard<std::mutex> lock(s->mutex);
+    ranges = scanRanges(*s, fromUs, toUs);
+  }
+  return readRanges(*s, ranges, fromUs, toUs, fn);
+}
+
+// Caller holds s.mutex
+std::vector<TimeSeriesStore::ScanRange> TimeSeriesStore::scanRanges(Series& s, int64_t fromUs,
+                                                                     int64_t toUs) {
+  std::vector<ScanRange> ranges;
+  for (size_t i = 0; i < s.segments.size(); i++) {
+    Segment& seg = s.segments[i];
+    int64_t nextFirst = i + 1 < s.segments.size() ? s.segments[i + 1].firstUs : INT64_MAX;
+    if (seg.records == 0 || nextFirst < fromUs) continue;
+    if (seg.firstUs >= toUs) break;
+    if (!loadIndex(s, seg)) continue;
+
+    auto first = std::lower_bound(seg.index.begin(), seg.index.end(), fromUs, indexByTimestamp);
+    auto last = std::lower_bound(first, seg.index.end(), toUs, indexByTimestamp);
+    uint64_t lo = first == seg.index.begin() ? 0 : (first - 1)->record;
+    uint64_t hi = last == seg.index.end() ? seg.records : last->record;
+    if (hi > lo) ranges.push_back(ScanRange{segmentPath(s, seg.seq, "seg"), lo, hi});
+  }
+  return ranges;
+}
+
+size_t TimeSeriesStore::readRanges(Series& s, const std::vector<ScanRange>& ranges, int64_t fromUs,
+                                   int64_t toUs, const ScanFn& fn) {
+  std::shared_lock<std::shared_mutex> files(s.files);
+  size_t total = 0;
+  for (const ScanRange& r : ranges) {
+    MappedFile file(r.path, HEADER_SIZE + r.hi * sizeof(StoredRecord));
+    if (!file.data() || file.length() < HEADER_SIZE) continue;
+    const StoredRecord* records = reinterpret_cast<const StoredRecord*>(file.data() + HEADER_SIZE);
+    uint64_t hi = std::min<uint64_t>(r.hi, (file.length() - HEADER_SIZE) / sizeof(StoredRecord));
+    if (hi <= r.lo) continue;
+    const StoredRecord* begin = std::lower_bound(records + r.lo, records + hi, fromUs, byTimestamp);
+    const StoredRecord* end = std::lower_bound(begin, records + hi, toUs, byTimestamp);
+    if (end > begin) {
+      fn(begin, (size_t)(end - begin));
+      total += (size_t)(end - begin);
+    }
+  }
+  return total;
+}
+
+size_t TimeSeriesStore::scanRollups(const std::string& device, int tier, int64_t fromUs,
+                                    int64_t toUs, const RollupFn& fn) {
+  Series* s = series(device, false);
+  if (!s || tier < 0 || tier >= ROLLUP_TIERS || fromUs >= toUs) return 0;
+
+  std::string path;
+  uint64_t written;
+  RollupBucket open;
+  bool haveOpen;
+  {
+    std::lock_guard<std::mutex> lock(s->mutex);
+    const RollupTier& t = s->rollups[tier];
+    path = t.path();
+    written = t.writtenBuckets();
+    haveOpen = t.openBucket(open);
+  }
+
+  int64_t firstStart = fromUs < INT64_MIN + ROLLUP_WIDTH_US[tier] ? INT64_MIN
+                                                                  : rollupBucketStart(tier, fromUs);
+  size_t total = 0;
+  std::shared_lock<std::shared_mutex> files(s->files);
+  if (written > 0) {
+    MappedFile file(path, RollupTier::HEADER_SIZE + written * sizeof(RollupBucket));
+    if (file.data() && file.length() >= RollupTier::HEADER_SIZE) {
+      written = std::min<uint64_t>(
+          written, (file.length() - RollupTier::HEADER_SIZE) / sizeof(RollupBucket));
+      const RollupBucket* buckets =
+          reinterpret_cast<const RollupBucket*>(file.data() + RollupTier::HEADER_SIZE);
+      const RollupBucket* begin = std::lower_bound(buckets, buckets + written, firstStart, bucketByStart);
+      const RollupBucket* end = std::lower_bound(begin, buckets + written, toUs, bucketByStart);
+      if (end > begin) {
+        fn(begin, (size_t)(end - begin));
+        total += (size_t)(end - begin);
+      }
+    }
+  }
+  if (haveOpen && open.startUs >= firstStart && open.startUs < toUs) {
+    fn(&open, 1);
+    total++;
+  }
+  return total;
+}
+
+std::vector<std::string> TimeSeriesStore::devices() {
+  std::lock_guard<std::mutex> lock(_seriesMutex);
+  std::vector<std::string> names;
+  for (const auto& entry : _series) names.push_back(entry.first);
+  return names;
+}
+
+int64_t TimeSeriesStore::lastTimestampUs(const std::string& device) {
+  Series* s = series(device, false);
+  if (!s) return INT64_MIN;
+  std::lock_guard<std::mutex> lock(s->mutex);
+  return s->lastUs;
+}
+
+uint64_t TimeSeriesStore::recordCount(const std::string& device) {
+  Series* s = series(device, false);
+  if (!s) return 0;
+  std::lock_guard<std::mutex> lock(s->mutex);
+  uint64_t total = 0;
+  for (const auto& seg : s->segments) total += seg.records;
+  return total;
+}
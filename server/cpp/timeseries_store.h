@@ -0,0 +1,157 @@
+#ifndef SENSOR_SERVER_TIMESERIES_STORE_H
+#define SENSOR_SERVER_TIMESERIES_STORE_H
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <string>
+#include <vector>
+
+#include "rollups.h"
+
+// Append-only binary time-series store, one series per device.
+//
+// Layout on disk:
+//
+//   <root>/<device>/00000001.seg   64-byte header, then fixed-width records
+//   <root>/<device>/00000001.idx   sparse index: one (timestamp, record)
+//                                  entry per INDEX_STRIDE records
+//
+// A record is 24 bytes (vs ~150 for a JSON log line) and records are kept
+// in timestamp order, so a range query is a binary search of the in-memory
+// sparse index, a binary search inside one INDEX_STRIDE block of the
+// mmap()ed segment, and then a sequential read. Segments roll over after
+// segmentRecords records (~60 days at one reading per 5 s by default).
+//
+// Opening the store reads one header per segment plus the active
+// segment's index, so startup cost and RAM do not grow with history.
+// Indexes of older segments are loaded on first query.
+//
+// Records at or after the newest stored timestamp are appended. An older
+// one (a log import into a live series, or two senders sharing one device
+// name) is merged into place and counted in mergedRecords(): the records
+// after it are read back, the series is cut at its timestamp and the
+// merged tail is appended again, with the rollups rewound to the cut. The
+// tail is first written to <root>/<device>/merge.jnl, which open() replays
+// if a crash interrupts the rewrite. A merge costs a read and a write of
+// everything after the cut, so it is cheap near the end of a series and
+// slow far back in a long one. Equal timestamps are kept, in arrival order.
+//
+// open() takes an exclusive lock on <root>/.lock, so a second process
+// (another server, or lora_ingest) cannot open the same store.
+//
+// Every append also updates the device's minute/hour/day rollups (see
+// RollupTier), which scanRollups() reads back.
+
+#pragma pack(push, 1)
+struct StoredRecord {
+  int64_t timestampUs;  // Unix microseconds
+  float voltage;        // V
+  float pressureKpa;
+  float depthM;
+  float volumeL;
+};
+#pragma pack(pop)
+static_assert(sizeof(StoredRecord) == 24, "on-disk record layout");
+
+struct SegmentIndexEntry {
+  int64_t timestampUs;
+  uint64_t record;
+};
+
+class TimeSeriesStore {
+public:
+  static const uint32_t DEFAULT_SEGMENT_RECORDS = 1u << 20;
+  static const uint32_t INDEX_STRIDE = 256;
+  static const size_t HEADER_SIZE = 64;
+
+  // Called with consecutive matching records, one run per segment
+  using ScanFn = std::function<void(const StoredRecord* records, size_t count)>;
+  using RollupFn = std::function<void(const RollupBucket* buckets, size_t count)>;
+
+  explicit TimeSeriesStore(std::string root, uint32_t segmentRecords = DEFAULT_SEGMENT_RECORDS);
+  ~TimeSeriesStore();
+
+  TimeSeriesStore(const TimeSeriesStore&) = delete;
+  TimeSeriesStore& operator=(const TimeSeriesStore&) = delete;
+
+  // Create the root directory if needed and open every existing series
+  bool open(std::string& error);
+
+  // Letters, digits, '-' and '_', 1-64 characters (used as a directory name)
+  static bool validDeviceName(const std::string& device);
+
+  bool append(const std::string& device, const StoredRecord* records, size_t count);
+
+  // Records with fromUs <= timestamp < toUs, oldest first. Returns the count.
+  size_t scan(const std::string& device, int64_t fromUs, int64_t toUs, const ScanFn& fn);
+
+  // Buckets of one tier (0 = minute, see ROLLUP_NAMES) from the one that
+  // contains fromUs up to those starting before toUs, oldest first. The
+  // last may still be accumulating. Returns the count.
+  size_t scanRollups(const std::string& device, int tier, int64_t fromUs, int64_t toUs,
+                     const RollupFn& fn);
+
+  std::vector<std::string> devices();
+  uint64_t recordCount(const std::string& device);
+  // Newest stored timestamp, INT64_MIN for an empty or unknown series
+  int64_t lastTimestampUs(const std::string& device);
+  uint64_t mergedRecords() const { return _merged; }
+
+private:
+  struct Segment {
+    uint32_t seq = 0;
+    int64_t firstUs = 0;
+    uint64_t records = 0;
+    bool indexLoaded = false;
+    std::vector<SegmentIndexEntry> index;
+  };
+
+  struct Series {
+    std::mutex mutex;
+    std::string dir;
+    std::vector<Segment> segments;
+    int segFd = -1;  // Active (last) segment, open for append
+    int idxFd = -1;
+    int64_t lastUs = INT64_MIN;
+    RollupTier rollups[ROLLUP_TIERS];
+    // Held shared while reading mapped files, exclusive while a merge
+    // truncates them
+    std::shared_mutex files;
+  };
+
+  // Part of one segment a scan reads, found under the series mutex
+  struct ScanRange {
+    std::string path;
+    uint64_t lo, hi;
+  };
+
+  Series* series(const std::string& device, bool create);
+  bool openSeries(Series& s, std::string& error);
+  bool openRollups(Series& s, std::string& error);
+  void replayRollups(Series& s);
+  bool startSegment(Series& s, int64_t firstUs);
+  bool appendInOrder(Series& s, const StoredRecord* records, size_t count);
+  bool merge(Series& s, const StoredRecord* records, size_t count);
+  bool writeJournal(Series& s, int64_t cutUs, const std::vector<StoredRecord>& tail);
+  bool replayJournal(Series& s, std::string& error);
+  bool truncateAfter(Series& s, int64_t cutUs);
+  std::vector<ScanRange> scanRanges(Series& s, int64_t fromUs, int64_t toUs);
+  size_t readRanges(Series& s, const std::vector<ScanRange>& ranges, int64_t fromUs, int64_t toUs,
+                    const ScanFn& fn);
+  bool loadIndex(Series& s, Segment& seg);
+  std::string segmentPath(const Series& s, uint32_t seq, const char* ext) const;
+
+  std::string _root;
+  uint32_t _segmentRecords;
+  std::mutex _seriesMutex;
+  std::map<std::string, std::unique_ptr<Series>> _series;
+  std::atomic<uint64_t> _merged{0};
+  int _lockFd = -1;  // flock()ed <root>/.lock, held while open
+};
+
+#endif
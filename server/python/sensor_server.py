@@ -4,21 +4,70 @@ HTTP server with web dashboard for Arduino water tank monitor
 Run on your server: python3 sensor_server.py
 """
 
-from http.server import BaseHTTPRequestHandler, HTTPServer
+from http.server import BaseHTTPRequestHandler, ThreadingHTTPServer
 from urllib.parse import urlparse, parse_qs
 import json
-from datetime import datetime
+from datetime import datetime, timedelta
 from collections import deque
 import os
+import threading
 
 PORT = 8080
 LOG_FILE = "/tmp/water-tank-sensor.log"
 MAX_READINGS = 100  # Keep last 100 readings in memory
 
+# Dashboard page, shared with the C++ server (server/cpp)
+DASHBOARD_FILE = os.path.join(os.path.dirname(os.path.abspath(__file__)),
+                              '..', 'web', 'dashboard.html')
+with open(DASHBOARD_FILE, 'rb') as f:
+    DASHBOARD_HTML = f.read()
+
+# Short parameter names sent by the firmware's /update requests
+FIRMWARE_PARAM_ALIASES = {
+    'depth': 'water_depth_m',
+    'pressure': 'pressure_kpa',
+    'volume': 'volume_liters',
+}
+
+# /api/stream: events kept for clients that fall behind, and the quiet
+# time after which a comment line keeps proxies from closing the stream
+STREAM_EVENTS = 64
+STREAM_HEARTBEAT_S = 15
+
 # Store recent readings in memory
 recent_readings = deque(maxlen=MAX_READINGS)
 
+# One server-sent event per upload, (sequence, encoded event), and the
+# condition /api/stream handlers wait on. Guards recent_readings too.
+stream_events = deque(maxlen=STREAM_EVENTS)
+stream_sequence = 0
+readings_changed = threading.Condition()
+
+
+def add_readings(readings):
+    """Store readings and wake /api/stream clients with just these"""
+    global stream_sequence
+    if not readings:
+        return
+    event = b'event: readings\ndata: ' + json.dumps(readings).encode() + b'\n\n'
+    with readings_changed:
+        recent_readings.extend(readings)
+        stream_sequence += 1
+        stream_events.append((stream_sequence, event))
+        readings_changed.notify_all()
+
+
+def snapshot_event():
+    """The snapshot event for a new stream client and the sequence it covers"""
+    with readings_changed:
+        readings, sequence = list(recent_readings), stream_sequence
+    return b'event: snapshot\ndata: ' + json.dumps(readings).encode() + b'\n\n', sequence
+
+
 class SensorHandler(BaseHTTPRequestHandler):
+    # Keep-alive: the firmware reuses one connection across uploads.
+    # Every response must therefore carry a Content-Length.
+    protocol_version = 'HTTP/1.1'
 
     def do_GET(self):
         parsed_path = urlparse(self.path)
@@ -31,6 +80,10 @@ class SensorHandler(BaseHTTPRequestHandler):
         elif parsed_path.path == '/api/sensor-data':
             self.handle_sensor_data(parsed_path.query)
 
+        # Firmware upload endpoint (HttpUploader, keep-alive GET)
+        elif parsed_path.path == '/update':
+            self.handle_sensor_data(parsed_path.query)
+
         # API endpoint to get recent readings (for dashboard)
         elif parsed_path.path == '/api/readings':
             self.serve_readings()
@@ -39,345 +92,32 @@ class SensorHandler(BaseHTTPRequestHandler):
         elif parsed_path.path == '/api/latest':
             self.serve_latest()
 
+        # Server-sent events: a snapshot, then new readings as they arrive
+        elif parsed_path.path == '/api/stream':
+            self.serve_stream()
+
         else:
             self.send_error(404, "Endpoint not found")
 
-    def serve_dashboard(self):
-        """Serve the HTML dashboard"""
-        html = """<!DOCTYPE html>
-<html lang="en">
-<head>
-    <meta charset="UTF-8">
-    <meta name="viewport" content="width=device-width, initial-scale=1.0">
-    <title>Water Tank Monitor Dashboard</title>
-    <script src="https://cdn.jsdelivr.net/npm/chart.js"></script>
-    <style>
-        * {
-            margin: 0;
-            padding: 0;
-            box-sizing: border-box;
-        }
-        body {
-            font-family: -apple-system, BlinkMacSystemFont, 'Segoe UI', Roboto, Oxygen, Ubuntu, sans-serif;
-            background: linear-gradient(135deg, #667eea 0%, #764ba2 100%);
-            min-height: 100vh;
-            padding: 20px;
-        }
-        .container {
-            max-width: 1400px;
-            margin: 0 auto;
-        }
-        h1 {
-            color: white;
-            text-align: center;
-            margin-bottom: 30px;
-            font-size: 2.5em;
-            text-shadow: 2px 2px 4px rgba(0,0,0,0.3);
-        }
-        .stats-grid {
-            display: grid;
-            grid-template-columns: repeat(auto-fit, minmax(250px, 1fr));
-            gap: 20px;
-            margin-bottom: 30px;
-        }
-        .stat-card {
-            background: white;
-            border-radius: 15px;
-            padding: 25px;
-            box-shadow: 0 10px 30px rgba(0,0,0,0.2);
-            transition: transform 0.3s ease;
-        }
-        .stat-card:hover {
-            transform: translateY(-5px);
-        }
-        .stat-label {
-            color: #666;
-            font-size: 0.9em;
-            margin-bottom: 10px;
-            text-transform: uppercase;
-            letter-spacing: 1px;
-        }
-        .stat-value {
-            font-size: 2.5em;
-            font-weight: bold;
-            color: #667eea;
-        }
-        .stat-unit {
-            font-size: 0.6em;
-            color: #999;
-            font-weight: normal;
-        }
-        .chart-container {
-            background: white;
-            border-radius: 15px;
-            padding: 25px;
-            box-shadow: 0 10px 30px rgba(0,0,0,0.2);
-            margin-bottom: 20px;
-        }
-        .chart-wrapper {
-            position: relative;
-            height: 400px;
-        }
-        .status {
-            background: white;
-            border-radius: 15px;
-            padding: 20px;
-            box-shadow: 0 10px 30px rgba(0,0,0,0.2);
-            display: flex;
-            justify-content: space-between;
-            align-items: center;
-        }
-        .status-indicator {
-            display: flex;
-            align-items: center;
-            gap: 10px;
-        }
-        .status-dot {
-            width: 12px;
-            height: 12px;
-            border-radius: 50%;
-            background: #4ade80;
-            animation: pulse 2s infinite;
-        }
-        @keyframes pulse {
-            0%, 100% { opacity: 1; }
-            50% { opacity: 0.5; }
-        }
-        .last-update {
-            color: #666;
-            font-size: 0.9em;
-        }
-        .loading {
-            text-align: center;
-            color: white;
-            font-size: 1.2em;
-            margin-top: 50px;
-        }
-    </style>
-</head>
-<body>
-    <div class="container">
-        <h1>💧 Water Tank Monitor</h1>
-
-        <div class="stats-grid">
-            <div class="stat-card">
-                <div class="stat-label">Water Volume</div>
-                <div class="stat-value" id="volume">--<span class="stat-unit">L</span></div>
-            </div>
-            <div class="stat-card">
-                <div class="stat-label">Water Depth</div>
-                <div class="stat-value" id="depth">--<span class="stat-unit">m</span></div>
-            </div>
-            <div class="stat-card">
-                <div class="stat-label">Pressure</div>
-                <div class="stat-value" id="pressure">--<span class="stat-unit">kPa</span></div>
-            </div>
-            <div class="stat-card">
-                <div class="stat-label">Sensor Voltage</div>
-                <div class="stat-value" id="voltage">--<span class="stat-unit">V</span></div>
-            </div>
-        </div>
-
-        <div class="chart-container">
-            <h2 style="margin-bottom: 20px; color: #333;">Water Volume Over Time</h2>
-            <div class="chart-wrapper">
-                <canvas id="volumeChart"></canvas>
-            </div>
-        </div>
-
-        <div class="chart-container">
-            <h2 style="margin-bottom: 20px; color: #333;">Pressure & Depth</h2>
-            <div class="chart-wrapper">
-                <canvas id="pressureChart"></canvas>
-            </div>
-        </div>
-
-        <div class="status">
-            <div class="status-indicator">
-                <div class="status-dot"></div>
-                <span>Live Monitoring Active</span>
-            </div>
-            <div class="last-update" id="lastUpdate">Last update: --</div>
-        </div>
-    </div>
-
-    <script>
-        // Chart.js configuration
-        const commonOptions = {
-            responsive: true,
-            maintainAspectRatio: false,
-            plugins: {
-                legend: {
-                    display: true,
-                    position: 'top'
-                }
-            },
-            scales: {
-                x: {
-                    display: true,
-                    title: {
-                        display: true,
-                        text: 'Time'
-                    }
-                },
-                y: {
-                    display: true,
-                    beginAtZero: false
-                }
-            }
-        };
-
-        // Initialize volume chart
-        const volumeCtx = document.getElementById('volumeChart').getContext('2d');
-        const volumeChart = new Chart(volumeCtx, {
-            type: 'line',
-            data: {
-                labels: [],
-                datasets: [{
-                    label: 'Water Volume (L)',
-                    data: [],
-                    borderColor: '#667eea',
-                    backgroundColor: 'rgba(102, 126, 234, 0.1)',
-                    borderWidth: 2,
-                    tension: 0.4,
-                    fill: true
-                }]
-            },
-            options: {
-                ...commonOptions,
-                scales: {
-                    ...commonOptions.scales,
-                    y: {
-                        ...commonOptions.scales.y,
-                        title: {
-                            display: true,
-                            text: 'Volume (Liters)'
-                        }
-                    }
-                }
-            }
-        });
-
-        // Initialize pressure chart
-        const pressureCtx = document.getElementById('pressureChart').getContext('2d');
-        const pressureChart = new Chart(pressureCtx, {
-            type: 'line',
-            data: {
-                labels: [],
-                datasets: [
-                    {
-                        label: 'Pressure (kPa)',
-                        data: [],
-                        borderColor: '#f59e0b',
-                        backgroundColor: 'rgba(245, 158, 11, 0.1)',
-                        borderWidth: 2,
-                        tension: 0.4,
-                        yAxisID: 'y'
-                    },
-                    {
-                        label: 'Depth (m)',
-                        data: [],
-                        borderColor: '#10b981',
-                        backgroundColor: 'rgba(16, 185, 129, 0.1)',
-                        borderWidth: 2,
-                        tension: 0.4,
-                        yAxisID: 'y1'
-                    }
-                ]
-            },
-            options: {
-                ...commonOptions,
-                scales: {
-                    x: commonOptions.scales.x,
-                    y: {
-                        type: 'linear',
-                        display: true,
-                        position: 'left',
-                        title: {
-                            display: true,
-                            text: 'Pressure (kPa)'
-                        }
-                    },
-                    y1: {
-                        type: 'linear',
-                        display: true,
-                        position: 'right',
-                        title: {
-                            display: true,
-                            text: 'Depth (m)'
-                        },
-                        grid: {
-                            drawOnChartArea: false
-                        }
-                    }
-                }
-            }
-        });
-
-        function formatTime(timestamp) {
-            const date = new Date(timestamp);
-            return date.toLocaleTimeString();
-        }
-
-        function updateDashboard(data) {
-            if (!data || data.length === 0) return;
-
-            // Update stat cards with latest reading
-            const latest = data[data.length - 1];
-            document.getElementById('volume').innerHTML =
-                `${latest.volume_liters.toFixed(2)}<span class="stat-unit">L</span>`;
-            document.getElementById('depth').innerHTML =
-                `${latest.water_depth_m.toFixed(3)}<span class="stat-unit">m</span>`;
-            document.getElementById('pressure').innerHTML =
-                `${latest.pressure_kpa.toFixed(3)}<span class="stat-unit">kPa</span>`;
-            document.getElementById('voltage').innerHTML =
-                `${latest.voltage.toFixed(3)}<span class="stat-unit">V</span>`;
-            document.getElementById('lastUpdate').textContent =
-                `Last update: ${formatTime(latest.timestamp)}`;
-
-            // Prepare chart data (show last 50 points)
-            const recentData = data.slice(-50);
-            const labels = recentData.map(r => formatTime(r.timestamp));
-
-            // Update volume chart
-            volumeChart.data.labels = labels;
-            volumeChart.data.datasets[0].data = recentData.map(r => r.volume_liters);
-            volumeChart.update('none');
-
-            // Update pressure chart
-            pressureChart.data.labels = labels;
-            pressureChart.data.datasets[0].data = recentData.map(r => r.pressure_kpa);
-            pressureChart.data.datasets[1].data = recentData.map(r => r.water_depth_m);
-            pressureChart.update('none');
-        }
-
-        async function fetchData() {
-            try {
-                const response = await fetch('/api/readings');
-                const data = await response.json();
-                updateDashboard(data);
-            } catch (error) {
-                console.error('Error fetching data:', error);
-            }
-        }
-
-        // Initial load
-        fetchData();
+    def do_POST(self):
+        parsed_path = urlparse(self.path)
 
-        // Update every 5 seconds
-        setInterval(fetchData, 5000);
-    </script>
-</body>
-</html>"""
+        # Batched readings buffered by the firmware (HttpUploader::uploadBatch)
+        if parsed_path.path == '/update/batch':
+            self.handle_sensor_batch()
+        else:
+            self.send_error(404, "Endpoint not found")
 
-        self.send_response(200)
-        self.send_header('Content-type', 'text/html')
-        self.end_headers()
-        self.wfile.write(html.encode())
+    def serve_dashboard(self):
+        """Serve the HTML dashboard"""
+        self.send_body(DASHBOARD_HTML, 'text/html')
 
     def handle_sensor_data(self, query):
         """Handle sensor data from Arduino"""
         params = parse_qs(query)
+        for short, full in FIRMWARE_PARAM_ALIASES.items():
+            if short in params and full not in params:
+                params[full] = params[short]
 
         try:
             # Extract sensor data
@@ -390,22 +130,18 @@ class SensorHandler(BaseHTTPRequestHandler):
             }
 
             # Store in memory
-            recent_readings.append(data)
+            add_readings([data])
 
             # Log to file
             self.log_sensor_data(data)
 
             # Send success response
-            self.send_response(200)
-            self.send_header('Content-type', 'application/json')
-            self.end_headers()
-
             response = {
                 'status': 'success',
                 'message': 'Sensor data received',
                 'data': data
             }
-            self.wfile.write(json.dumps(response).encode())
+            self.send_body(json.dumps(response).encode(), 'application/json')
 
             # Print to console
             print(f"[{data['timestamp']}] Received: "
@@ -417,32 +153,122 @@ class SensorHandler(BaseHTTPRequestHandler):
         except (ValueError, IndexError) as e:
             self.send_error(400, f"Invalid parameters: {e}")
 
+    def handle_sensor_batch(self):
+        """Handle a CSV batch of buffered readings from Arduino.
+
+        One reading per line: age_ms,voltage_mv,pressure_ckpa,depth_mm,volume_cl[,tank]
+        age_ms is how long before the request the reading was taken. Multi-tank
+        devices add the tank index to rows for tanks other than 0.
+        """
+        try:
+            length = int(self.headers.get('Content-Length', 0))
+            body = self.rfile.read(length).decode('ascii')
+            received_at = datetime.now()
+
+            readings = []
+            for line in body.splitlines():
+                if not line.strip():
+                    continue
+                fields = line.split(',')
+                tank = fields.pop() if len(fields) == 6 else None
+                age_ms, voltage, pressure, depth, volume = (int(f) for f in fields)
+                reading = {
+                    'voltage': voltage / 1000.0,
+                    'pressure_kpa': pressure / 100.0,
+                    'water_depth_m': depth / 1000.0,
+                    'volume_liters': volume / 100.0,
+                    'timestamp': (received_at - timedelta(milliseconds=age_ms)).isoformat()
+                }
+                if tank is not None:
+                    reading['tank'] = int(tank)
+                readings.append(reading)
+        except (ValueError, UnicodeDecodeError) as e:
+            self.send_error(400, f"Invalid batch: {e}")
+            return
+
+        # Rows arrive oldest first
+        add_readings(readings)
+        self.log_sensor_batch(readings)
+
+        response = {
+            'status': 'success',
+            'message': 'Sensor batch received',
+            'accepted': len(readings)
+        }
+        self.send_body(json.dumps(response).encode(), 'application/json')
+
+        if readings:
+            latest = readings[-1]
+            print(f"[{latest['timestamp']}] Received batch of {len(readings)}: "
+                  f"D={latest['water_depth_m']:.3f}m, "
+                  f"Vol={latest['volume_liters']:.2f}L")
+
     def serve_readings(self):
         """Return all recent readings as JSON"""
-        self.send_response(200)
-        self.send_header('Content-type', 'application/json')
-        self.send_header('Access-Control-Allow-Origin', '*')
-        self.end_headers()
-        self.wfile.write(json.dumps(list(recent_readings)).encode())
+        with readings_changed:
+            readings = list(recent_readings)
+        self.send_body(json.dumps(readings).encode(), 'application/json', cors=True)
 
     def serve_latest(self):
         """Return the latest reading as JSON"""
-        if recent_readings:
-            latest = recent_readings[-1]
-        else:
-            latest = {}
+        with readings_changed:
+            latest = recent_readings[-1] if recent_readings else {}
+
+        self.send_body(json.dumps(latest).encode(), 'application/json', cors=True)
 
+    def serve_stream(self):
+        """Stream readings as server-sent events until the client goes away.
+
+        No Content-Length: the response runs until the connection closes.
+        A client that misses more than STREAM_EVENTS uploads gets a new
+        snapshot.
+        """
         self.send_response(200)
-        self.send_header('Content-type', 'application/json')
+        self.send_header('Content-type', 'text/event-stream')
+        self.send_header('Cache-Control', 'no-cache')
         self.send_header('Access-Control-Allow-Origin', '*')
         self.end_headers()
-        self.wfile.write(json.dumps(latest).encode())
+        self.close_connection = True
+
+        event, sent = snapshot_event()
+        try:
+            self.wfile.write(b'retry: 5000\n\n' + event)
+            while True:
+                with readings_changed:
+                    readings_changed.wait_for(lambda: stream_sequence != sent, STREAM_HEARTBEAT_S)
+                    pending = [(seq, e) for seq, e in stream_events if seq > sent]
+                    missed = stream_events and stream_events[0][0] > sent + 1
+                if missed:
+                    event, sent = snapshot_event()
+                    self.wfile.write(event)
+                    pending = [(seq, e) for seq, e in pending if seq > sent]
+                if pending:
+                    self.wfile.write(b''.join(e for _, e in pending))
+                    sent = pending[-1][0]
+                elif not missed:
+                    self.wfile.write(b':\n\n')
+        except (BrokenPipeError, ConnectionResetError):
+            pass
+
+    def send_body(self, body, content_type, cors=False):
+        """Send a 200 response with an explicit Content-Length (keep-alive)"""
+        self.send_response(200)
+        self.send_header('Content-type', content_type)
+        self.send_header('Content-Length', str(len(body)))
+        if cors:
+            self.send_header('Access-Control-Allow-Origin', '*')
+        self.end_headers()
+        self.wfile.write(body)
 
     def log_sensor_data(self, data):
         """Log sensor data to file"""
+        self.log_sensor_batch([data])
+
+    def log_sensor_batch(self, readings):
+        """Log several readings to file with a single open/write"""
         try:
             with open(LOG_FILE, 'a') as f:
-                f.write(json.dumps(data) + '\n')
+                f.write(''.join(json.dumps(r) + '\n' for r in readings))
         except Exception as e:
             print(f"Warning: Could not write to log file: {e}")
 
@@ -455,7 +281,8 @@ class SensorHandler(BaseHTTPRequestHandler):
 def run_server():
     """Start the HTTP server"""
     server_address = ('', PORT)
-    httpd = HTTPServer(server_address, SensorHandler)
+    # A thread per connection: /api/stream clients stay connected
+    httpd = ThreadingHTTPServer(server_address, SensorHandler)
 
     print(f"=== Water Tank Sensor Server ===")
     print(f"Starting server on port {PORT}...")
@@ -0,0 +1,287 @@
+#ifndef SIM_SCENARIO_H
+#define SIM_SCENARIO_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+// Scripted timelines for the firmware simulator (see sim_main.cpp).
+//
+// A scenario is a text file, one directive per line, '#' starts a comment.
+// Times are relative to the start of the run and take ms/s/m/h/d units,
+// which may be combined ("2h30m"); a bare number is milliseconds.
+//
+//   duration 7d                  length of the run
+//   step 10ms                    loop() period (default: the ADC sample interval)
+//   start-millis 4294000000      millis() at t = 0 (wraps at 2^32 on the target)
+//   seed 42                      noise seed
+//
+//   level 0 200                  ADC code at a time; linear in between, held
+//   level 6h 900                 after the last point (fill/drain curves)
+//   noise 4                      uniform +/- codes on every sample
+//   spike 3h 1023 50ms           code forced for a while (sensor glitch)
+//
+//   wifi-down 2h 2h30m           access point unreachable
+//   wifi-associate 3s            WiFi.begin() to WL_CONNECTED when reachable
+//   server-down 10h 10h5m        TCP connect refused
+//   server-silent 11h 11h1m      connects, never answers
+//   server-error 12h 12h10m      answers 500
+//   server-latency 80ms          response time otherwise
+//
+//   lora-join 8s                 network answers join requests sent from
+//                                then on (or "never"; default at once)
+//   lora-dwell on                400 ms uplink dwell time limit
+//   lora-duty-cycle 100          band busy 99x each airtime (1%), or "off"
+//   lora-busy 3h 3h10m           LMIC refuses uplinks (LMIC_ERROR_TX_BUSY)
+//
+// Windows are half-open: [from, to).
+
+struct SimWindow {
+  uint64_t from;
+  uint64_t to;
+};
+
+struct SimSpike {
+  uint64_t at;
+  uint64_t length;
+  int code;
+};
+
+struct SimLevelPoint {
+  uint64_t at;
+  double code;
+};
+
+struct Scenario {
+  uint64_t durationMs = 24ULL * 3600 * 1000;
+  uint64_t stepMs = 10;
+  uint64_t startMillis = 0;
+  uint32_t seed = 1;
+
+  std::vector<SimLevelPoint> level;
+  double noise = 0;
+  std::vector<SimSpike> spikes;
+
+  std::vector<SimWindow> wifiDown;
+  uint64_t wifiAssociateMs = 3000;
+  std::vector<SimWindow> serverDown;
+  std::vector<SimWindow> serverSilent;
+  std::vector<SimWindow> serverError;
+  uint64_t serverLatencyMs = 50;
+
+  uint64_t loraJoinMs = 0;  // UINT64_MAX = never
+  bool loraDwell = false;
+  unsigned long loraDutyCycle = 0;  // Divisor, 0 = none
+  std::vector<SimWindow> loraBusy;
+
+  // Noise-free ADC code at t
+  double levelAt(uint64_t t) const {
+    if (level.empty()) return 512;
+    if (t <= level.front().at) return level.front().code;
+    for (size_t i = 1; i < level.size(); i++) {
+      if (t < level[i].at) {
+        const SimLevelPoint& a = level[i - 1];
+        const SimLevelPoint& b = level[i];
+        return a.code + (b.code - a.code) * (double)(t - a.at) / (double)(b.at - a.at);
+      }
+    }
+    return level.back().code;
+  }
+
+  // Spike code at t, or -1
+  int spikeAt(uint64_t t) const {
+    for (const SimSpike& s : spikes) {
+      if (t >= s.at && t < s.at + s.length) return s.code;
+    }
+    return -1;
+  }
+
+  static bool inWindow(const std::vector<SimWindow>& windows, uint64_t t) {
+    for (const SimWindow& w : windows) {
+      if (t >= w.from && t < w.to) return true;
+    }
+    return false;
+  }
+
+  // Earliest scripted change after t (so the simulator can land on it)
+  uint64_t nextChangeAfter(uint64_t t) const {
+    uint64_t next = UINT64_MAX;
+    auto consider = [&](uint64_t at) {
+      if (at > t && at < next) next = at;
+    };
+    for (const SimSpike& s : spikes) {
+      consider(s.at);
+      consider(s.at + s.length);
+    }
+    for (const auto* windows : {&wifiDown, &serverDown, &serverSilent, &serverError, &loraBusy}) {
+      for (const SimWindow& w : *windows) {
+        consider(w.from);
+        consider(w.to);
+      }
+    }
+    return next;
+  }
+};
+
+// "2h30m", "150ms", "4294000000" -> milliseconds
+inline bool parseSimTime(const std::string& text, uint64_t& ms) {
+  if (text.empty()) return false;
+  const char* p = text.c_str();
+  uint64_t total = 0;
+  while (*p) {
+    char* end;
+    unsigned long long n = strtoull(p, &end, 10);
+    if (end == p) return false;
+    p = end;
+    uint64_t unit = 1;
+    if (strncmp(p, "ms", 2) == 0) {
+      p += 2;
+    } else if (*p == 's') {
+      unit = 1000;
+      p++;
+    } else if (*p == 'm') {
+      unit = 60 * 1000;
+      p++;
+    } else if (*p == 'h') {
+      unit = 3600 * 1000;
+      p++;
+    } else if (*p == 'd') {
+      unit = 24ULL * 3600 * 1000;
+      p++;
+    } else if (*p != '\0') {
+      return false;
+    }
+    total += n * unit;
+  }
+  ms = total;
+  return true;
+}
+
+// Human-readable duration for reports: "2d 3h", "4m 10s", "850 ms"
+inline std::string formatSimTime(uint64_t ms) {
+  char buf[48];
+  uint64_t s = ms / 1000;
+  if (ms < 10000) {
+    snprintf(buf, sizeof(buf), "%llu ms", (unsigned long long)ms);
+  } else if (s < 3600) {
+    snprintf(buf, sizeof(buf), "%llum %llus", (unsigned long long)(s / 60), (unsigned long long)(s % 60));
+  } else if (s < 86400) {
+    snprintf(buf, sizeof(buf), "%lluh %llum", (unsigned long long)(s / 3600),
+             (unsigned long long)(s % 3600 / 60));
+  } else {
+    snprintf(buf, sizeof(buf), "%llud %lluh", (unsigned long long)(s / 86400),
+             (unsigned long long)(s % 86400 / 3600));
+  }
+  return buf;
+}
+
+// Returns false and sets error ("file:line: message") on a bad directive
+inline bool loadScenario(const std::string& path, Scenario& sc, std::string& error) {
+  std::ifstream in(path);
+  if (!in) {
+    error = path + ": cannot open";
+    return false;
+  }
+  std::string line;
+  int lineNo = 0;
+  while (std::getline(in, line)) {
+    lineNo++;
+    size_t hash = line.find('#');
+    if (hash != std::string::npos) line.erase(hash);
+    std::istringstream words(line);
+    std::string key;
+    if (!(words >> key)) continue;
+    std::vector<std::string> args;
+    for (std::string w; words >> w;) args.push_back(w);
+
+    auto fail = [&](const char* message) {
+      error = path + ":" + std::to_string(lineNo) + ": " + key + ": " + message;
+      return false;
+    };
+    auto time = [&](size_t i, uint64_t& ms) {
+      return i < args.size() && parseSimTime(args[i], ms);
+    };
+    auto window = [&](std::vector<SimWindow>& windows) {
+      SimWindow w;
+      if (args.size() != 2 || !time(0, w.from) || !time(1, w.to) || w.to <= w.from) {
+        return fail("expected <from> <to>");
+      }
+      windows.push_back(w);
+      return true;
+    };
+    auto single = [&](uint64_t& ms) {
+      if (args.size() != 1 || !time(0, ms)) return fail("expected a time");
+      return true;
+    };
+
+    bool ok;
+    if (key == "duration") {
+      ok = single(sc.durationMs);
+    } else if (key == "step") {
+      ok = single(sc.stepMs) && (sc.stepMs > 0 || fail("must be > 0"));
+    } else if (key == "start-millis") {
+      ok = single(sc.startMillis);
+    } else if (key == "seed") {
+      ok = args.size() == 1 || fail("expected a number");
+      if (ok) sc.seed = (uint32_t)strtoul(args[0].c_str(), nullptr, 10);
+    } else if (key == "level") {
+      SimLevelPoint pt;
+      ok = (args.size() == 2 && time(0, pt.at)) || fail("expected <time> <code>");
+      if (ok) {
+        pt.code = atof(args[1].c_str());
+        ok = sc.level.empty() || pt.at > sc.level.back().at || fail("times must increase");
+        if (ok) sc.level.push_back(pt);
+      }
+    } else if (key == "noise") {
+      ok = args.size() == 1 || fail("expected an amplitude in codes");
+      if (ok) sc.noise = atof(args[0].c_str());
+    } else if (key == "spike") {
+      SimSpike s;
+      ok = (args.size() == 3 && time(0, s.at) && time(2, s.length)) ||
+           fail("expected <time> <code> <length>");
+      if (ok) {
+        s.code = atoi(args[1].c_str());
+        sc.spikes.push_back(s);
+      }
+    } else if (key == "wifi-down") {
+      ok = window(sc.wifiDown);
+    } else if (key == "wifi-associate") {
+      ok = single(sc.wifiAssociateMs);
+    } else if (key == "server-down") {
+      ok = window(sc.serverDown);
+    } else if (key == "server-silent") {
+      ok = window(sc.serverSilent);
+    } else if (key == "server-error") {
+      ok = window(sc.serverError);
+    } else if (key == "server-latency") {
+      ok = single(sc.serverLatencyMs);
+    } else if (key == "lora-join") {
+      if (args.size() == 1 && args[0] == "never") {
+        sc.loraJoinMs = UINT64_MAX;
+        ok = true;
+      } else {
+        ok = single(sc.loraJoinMs);
+      }
+    } else if (key == "lora-dwell") {
+      ok = (args.size() == 1 && (args[0] == "on" || args[0] == "off")) || fail("expected on or off");
+      if (ok) sc.loraDwell = args[0] == "on";
+    } else if (key == "lora-duty-cycle") {
+      ok = args.size() == 1 || fail("expected a divisor or off");
+      if (ok) sc.loraDutyCycle = args[0] == "off" ? 0 : strtoul(args[0].c_str(), nullptr, 10);
+    } else if (key == "lora-busy") {
+      ok = window(sc.loraBusy);
+    } else {
+      ok = fail("unknown directive");
+    }
+    if (!ok) return false;
+  }
+  return true;
+}
+
+#endif
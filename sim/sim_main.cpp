@@ -0,0 +1,394 @@
+// Discrete-event simulator: runs setup()/loop() from src/main.cpp against
+// the host mocks on a virtual clock, driven by a scripted scenario (see
+// Scenario.h), and reports what the firmware did.
+//
+// Build and run from the project root:
+//   pio run -e sim -t exec
+// or directly:
+//   g++ -std=c++17 -O2 -I include -I test/mocks src/main.cpp
+//       sim/sim_main.cpp test/mocks/mocks.cpp test/mocks/lmic_mock.cpp
+//       test/mocks/adc_backend_mock.cpp -o firmware_sim
+//   ./firmware_sim sim/scenarios/outages.sim
+// Add -D WIFI_TRANSPORT_MQTT to both to simulate the MQTT transport against
+// the mock broker.
+//
+// The clock advances by the scenario step (default 10 ms) after every
+// loop() pass, and lands exactly on each scripted change. The ADC backend
+// mock samples every 100 ms as the clock passes, seeing the tank level as of
+// the end of the step. Nothing in the firmware blocks (a pass that moves
+// the mock clock fails the run), so a pass costs tens of host nanoseconds
+// and a simulated week takes a few wall-clock seconds; a coarser step
+// (--step 100ms) trades event timing for speed.
+//
+// Everything but the loop latency section is deterministic: same scenario,
+// same report.
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <chrono>
+#include <string>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+static inline uint64_t simTicks() { return __rdtsc(); }
+#else
+static inline uint64_t simTicks() {
+  return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+      std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+#endif
+
+#include "Arduino.h"
+#include "WiFiS3.h"
+#include "lmic.h"
+#include "HttpUploader.h"
+#include "MqttUploader.h"
+#include "ReadingBuffer.h"
+#include "WiFiConnection.h"
+#include "BlockAdc.h"
+#include "ChangeReporter.h"
+#include "Scenario.h"
+
+// The sketch
+void setup();
+void loop();
+#ifdef WIFI_TRANSPORT_MQTT
+typedef MqttUploader WiFiUploader;
+#else
+typedef HttpUploader WiFiUploader;
+#endif
+extern WiFiUploader uploader;
+extern WiFiConnectionManager wifiManager;
+extern ReadingBuffer<360> wifiBacklog;
+extern bool loraJoined;
+extern BlockAdc<50> blockAdc;
+extern ChangeReporterArray<1> loraReporter;
+
+extern "C" {
+void mock_set_millis(unsigned long value);
+void mock_set_wifi_status(int status);
+unsigned long mock_wifi_begin_count();
+void mock_set_analog_value(int value);
+void mock_set_client_connected(bool connected);
+void mock_set_client_response(const char* response);
+void mock_set_response_delay(unsigned long ms);
+void mock_set_empty_poll_cost(unsigned long ms);
+void mock_drop_connection();
+void mock_set_mqtt_broker(bool enabled);
+void mock_set_mqtt_connack(int code);
+void mock_set_mqtt_silent(bool silent);
+void mock_reset();
+}
+
+namespace {
+
+const char* const RESPONSE_OK =
+    "HTTP/1.1 200 OK\r\nContent-Type: application/json\r\nContent-Length: 2\r\n\r\n{}";
+const char* const RESPONSE_ERROR =
+    "HTTP/1.1 500 Internal Server Error\r\nContent-Length: 0\r\n\r\n";
+
+struct Stats {
+  uint64_t count = 0;
+  uint64_t min = UINT64_MAX;
+  uint64_t max = 0;
+  uint64_t maxAt = 0;
+  double sum = 0;
+
+  void add(uint64_t v, uint64_t at) {
+    count++;
+    sum += (double)v;
+    if (v < min) min = v;
+    if (v > max) {
+      max = v;
+      maxAt = at;
+    }
+  }
+  double mean() const { return count ? sum / (double)count : 0; }
+};
+
+// The outside world at time t: access point, association, server, sensor
+class World {
+public:
+  explicit World(const Scenario& sc) : _sc(sc), _rng(sc.seed) {}
+
+  void apply(uint64_t t) {
+    bool apUp = !Scenario::inWindow(_sc.wifiDown, t);
+    unsigned long begins = mock_wifi_begin_count();
+    if (!apUp) {
+      _associating = false;
+      if (_associated) {
+        _associated = false;
+        mock_drop_connection();
+      }
+    } else if (begins != _begins) {
+      _associating = true;
+      _associatedAt = t + _sc.wifiAssociateMs;
+    }
+    _begins = begins;
+    if (_associating && t >= _associatedAt) {
+      _associating = false;
+      _associated = true;
+    }
+    mock_set_wifi_status(_associated ? WL_CONNECTED : WL_DISCONNECTED);
+
+    bool reachable = _associated && !Scenario::inWindow(_sc.serverDown, t);
+    if (_reachable && !reachable) mock_drop_connection();
+    _reachable = reachable;
+    mock_set_client_connected(reachable);
+#ifdef WIFI_TRANSPORT_MQTT
+    // The broker: silent, or refusing connections (it has no error reply
+    // to a PUBLISH, so an error window also drops the connection)
+    bool error = Scenario::inWindow(_sc.serverError, t);
+    if (error && !_error) mock_drop_connection();
+    _error = error;
+    mock_set_mqtt_silent(Scenario::inWindow(_sc.serverSilent, t));
+    mock_set_mqtt_connack(error ? 3 : 0);
+#else
+    if (Scenario::inWindow(_sc.serverSilent, t)) {
+      mock_set_client_response(nullptr);
+    } else if (Scenario::inWindow(_sc.serverError, t)) {
+      mock_set_client_response(RESPONSE_ERROR);
+    } else {
+      mock_set_client_response(RESPONSE_OK);
+    }
+#endif
+    mock_set_response_delay((unsigned long)_sc.serverLatencyMs);
+    mock_lmic_set_busy(Scenario::inWindow(_sc.loraBusy, t));
+
+    double code = _sc.levelAt(t);
+    if (_sc.noise > 0) code += _sc.noise * (2.0 * uniform() - 1.0);
+    int spike = _sc.spikeAt(t);
+    if (spike >= 0) code = spike;
+    int raw = (int)(code + 0.5);
+    mock_set_analog_value(raw < 0 ? 0 : (raw > ADC_MAX ? ADC_MAX : raw));
+  }
+
+private:
+  double uniform() {
+    _rng = _rng * 1664525u + 1013904223u;
+    return (double)(_rng >> 8) / (double)(1u << 24);
+  }
+
+  const Scenario& _sc;
+  uint32_t _rng;
+  unsigned long _begins = 0;
+  bool _associating = false;
+  bool _associated = false;
+  bool _reachable = false;
+  bool _error = false;
+  uint64_t _associatedAt = 0;
+};
+
+void usage(const char* argv0) {
+  fprintf(stderr, "Usage: %s [scenario.sim] [--duration T] [--step T]\n", argv0);
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  Scenario sc;
+  std::string name = "(default)";
+  uint64_t durationOverride = 0;
+  uint64_t stepOverride = 0;
+  for (int i = 1; i < argc; i++) {
+    std::string arg = argv[i];
+    if ((arg == "--duration" || arg == "--step") && i + 1 < argc) {
+      uint64_t& target = arg == "--duration" ? durationOverride : stepOverride;
+      if (!parseSimTime(argv[++i], target) || target == 0) {
+        usage(argv[0]);
+        return 2;
+      }
+    } else if (arg[0] != '-') {
+      std::string error;
+      if (!loadScenario(arg, sc, error)) {
+        fprintf(stderr, "%s\n", error.c_str());
+        return 2;
+      }
+      name = arg;
+    } else {
+      usage(argv[0]);
+      return arg == "-h" || arg == "--help" ? 0 : 2;
+    }
+  }
+  if (durationOverride) sc.durationMs = durationOverride;
+  if (stepOverride) sc.stepMs = stepOverride;
+
+  mock_reset();
+  mock_lmic_reset();
+  mock_set_empty_poll_cost(0);  // The simulator owns the clock
+#ifdef WIFI_TRANSPORT_MQTT
+  mock_set_mqtt_broker(true);
+#endif
+  mock_lmic_set_join_accept_after(sc.loraJoinMs == UINT64_MAX ? MOCK_LMIC_NEVER
+                                                               : (unsigned long)sc.loraJoinMs);
+  mock_lmic_set_dwell_time(sc.loraDwell);
+  mock_lmic_set_duty_cycle(sc.loraDutyCycle);
+
+  World world(sc);
+  uint64_t t = 0;
+  mock_set_millis((unsigned long)(sc.startMillis + t));
+  world.apply(t);
+  setup();
+
+  // Observed behaviour
+  uint64_t loops = 0;
+  uint64_t lastReadings = 0, lastReadingAt = 0;
+  Stats readingInterval;
+  uint32_t lastCompleted = 0, lastFailures = 0;
+  uint64_t lastOkAt = 0;
+  Stats okGap;
+  uint64_t httpOk = 0, httpError = 0;
+  uint16_t peakBacklog = 0;
+  uint64_t wifiConnectedMs = 0;
+  int64_t joinedAt = -1;
+
+  uint64_t loopHist[64] = {0};
+  uint64_t loopTicks = 0, loopMax = 0, loopMaxAt = 0;
+  unsigned long waitMax = 0;
+  uint64_t waitMaxAt = 0;
+
+  uint64_t nextChange = sc.nextChangeAfter(0);
+  auto wall0 = std::chrono::steady_clock::now();
+  uint64_t ticks0 = simTicks();
+
+  while (t < sc.durationMs) {
+    unsigned long clock0 = millis();
+    uint64_t c0 = simTicks();
+    loop();
+    uint64_t c = simTicks() - c0;
+    // Only something waiting inside loop() moves the mock clock
+    if (millis() - clock0 > waitMax) {
+      waitMax = millis() - clock0;
+      waitMaxAt = t;
+    }
+    loops++;
+    loopTicks += c;
+    loopHist[c ? 63 - __builtin_clzll(c) : 0]++;
+    if (c > loopMax) {
+      loopMax = c;
+      loopMaxAt = t;
+    }
+
+    uint64_t readings = wifiBacklog.firstSeq() + wifiBacklog.size();
+    if (readings != lastReadings) {
+      if (lastReadings) readingInterval.add(t - lastReadingAt, t);
+      lastReadings = readings;
+      lastReadingAt = t;
+    }
+    if (wifiBacklog.size() > peakBacklog) peakBacklog = wifiBacklog.size();
+    if (uploader.completed() != lastCompleted) {
+      lastCompleted = uploader.completed();
+      if (uploader.lastSucceeded()) {
+        httpOk++;
+        okGap.add(t - lastOkAt, t);
+        lastOkAt = t;
+      } else {
+        httpError++;
+      }
+    }
+    lastFailures = uploader.failures();
+    if (joinedAt < 0 && loraJoined) joinedAt = (int64_t)t;
+
+    uint64_t dt = sc.stepMs;
+    if (t >= nextChange) nextChange = sc.nextChangeAfter(t);
+    if (nextChange - t < dt) dt = nextChange - t;
+    if (wifiManager.connected()) wifiConnectedMs += dt;
+    t += dt;
+    world.apply(t);
+    mock_set_millis((unsigned long)(sc.startMillis + t));
+  }
+
+  double wallSec = std::chrono::duration<double>(std::chrono::steady_clock::now() - wall0).count();
+  uint64_t runTicks = simTicks() - ticks0;
+  double nsPerTick = runTicks ? wallSec * 1e9 / (double)runTicks : 0;
+
+  uint64_t dropped = wifiBacklog.dropped();
+  uint64_t delivered = wifiBacklog.firstSeq() - dropped;
+
+  printf("=== Firmware simulation: %s ===\n", name.c_str());
+  printf("Simulated %s in %.2f s wall (%.0f simulated hours/s), %llu loop() passes, step %llu ms\n",
+         formatSimTime(sc.durationMs).c_str(), wallSec,
+         wallSec > 0 ? (double)sc.durationMs / 3.6e6 / wallSec : 0.0,
+         (unsigned long long)loops, (unsigned long long)sc.stepMs);
+  if (sc.startMillis + sc.durationMs > 0xFFFFFFFFULL) {
+    if (sizeof(unsigned long) == 4) {
+      printf("millis() wrapped past 2^32 during the run\n");
+    } else {
+      printf("Note: unsigned long is 64-bit on this host, so millis() did not wrap at 2^32;\n"
+             "      build with -m32 to reproduce the target's 49.7-day wrap\n");
+    }
+  }
+
+  printf("\nReadings\n");
+  printf("  queued for WiFi %llu, delivered %llu, dropped %llu, still buffered %u (peak %u)\n",
+         (unsigned long long)lastReadings, (unsigned long long)delivered,
+         (unsigned long long)dropped, wifiBacklog.size(), peakBacklog);
+  if (readingInterval.count) {
+    printf("  interval min %llu ms, mean %.1f ms, max %llu ms (at %s)\n",
+           (unsigned long long)readingInterval.min, readingInterval.mean(),
+           (unsigned long long)readingInterval.max, formatSimTime(readingInterval.maxAt).c_str());
+  }
+  printf("  ADC blocks %lu (%u samples each), overruns %lu\n", (unsigned long)blockAdc.sequence(),
+         blockAdc.blockSize(), (unsigned long)blockAdc.overruns());
+
+  printf("\nWiFi uploads\n");
+  printf("  requests ok %llu, HTTP errors %llu, failed (connect/timeout/closed) %u, connects %u\n",
+         (unsigned long long)httpOk, (unsigned long long)httpError, lastFailures,
+         uploader.connects());
+  if (okGap.count) {
+    printf("  gap between successful uploads: mean %.1f s, max %s (ending at %s)\n",
+           okGap.mean() / 1000.0, formatSimTime(okGap.max).c_str(), formatSimTime(okGap.maxAt).c_str());
+  }
+  printf("  WiFi attempts %u, connected %.2f%% of the time\n", wifiManager.attempts(),
+         100.0 * (double)wifiConnectedMs / (double)sc.durationMs);
+
+  mock_lmic_stats_t lora;
+  mock_lmic_get_stats(&lora);
+  double days = (double)sc.durationMs / 86400000.0;
+  printf("\nLoRaWAN\n");
+  if (joinedAt >= 0) {
+    printf("  joined at %s after %lu join requests\n", formatSimTime((uint64_t)joinedAt).c_str(),
+           lora.joinRequests);
+  } else {
+    printf("  never joined (%lu join requests)\n", lora.joinRequests);
+  }
+  printf("  uplinks %lu (%.1f per hour), rejected busy %lu, cancelled %lu\n", lora.uplinks,
+         (double)lora.uplinks * 3.6e6 / (double)sc.durationMs, lora.busyRejects, lora.cancelled);
+  printf("  held back by duty cycle %lu (%s total)\n", lora.deferred,
+         formatSimTime(lora.deferredMs).c_str());
+  printf("  airtime %.1f s (%.1f s per day), longest %.1f ms\n", (double)lora.airtimeUs / 1e6,
+         days > 0 ? (double)lora.airtimeUs / 1e6 / days : 0.0, lora.maxAirtimeUs / 1000.0);
+  // Every report the firmware records as sent must be an uplink LMIC took;
+  // one that wasn't would re-centre the deadband on a level never sent
+  unsigned long loraReports = 0;
+  for (int r = 0; r < ChangeReporter::REASON_COUNT; r++) {
+    loraReports += loraReporter.tank(0).count((ChangeReporter::Reason)r);
+  }
+  printf("  reports recorded %lu\n", loraReports);
+  bool reportsLost = loraReports != lora.uplinks;
+  if (reportsLost) {
+    printf("  FAIL: %lu reports recorded without an accepted uplink\n", loraReports - lora.uplinks);
+  }
+
+  printf("\nloop() waits\n");
+  bool waited = waitMax > 0;
+  if (waited) {
+    printf("  FAIL: a pass held the clock for %lu ms (at %s)\n", waitMax,
+           formatSimTime(waitMaxAt).c_str());
+  } else {
+    printf("  none: no pass moved the simulated clock\n");
+  }
+
+  printf("\nloop() latency (host, %.2f ns per tick)\n", nsPerTick);
+  printf("  mean %.0f ns, max %.0f ns (at %s)\n", (double)loopTicks / (double)loops * nsPerTick,
+         (double)loopMax * nsPerTick, formatSimTime(loopMaxAt).c_str());
+  for (int b = 0; b < 64; b++) {
+    if (!loopHist[b]) continue;
+    printf("  %10.0f - %-10.0f ns %12llu\n", (double)(1ULL << b) * nsPerTick,
+           (double)(2ULL << b) * nsPerTick, (unsigned long long)loopHist[b]);
+  }
+  return reportsLost || waited ? 1 : 0;
+}
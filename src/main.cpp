@@ -2,6 +2,18 @@
 #include <lmic.h>
 #include <hal/hal.h>
 #include <SPI.h>
+#include "BlockAdc.h"
+#include "SensorConversion.h"
+#include "TankArray.h"
+#include "LevelFilter.h"
+#include "ReadingBuffer.h"
+#include "HttpUploader.h"
+#include "MqttUploader.h"
+#include "LoRaFrame.h"
+#include "WiFiConnection.h"
+#include "LoopProfiler.h"
+#include "ChangeReporter.h"
+#include "DeadlineScheduler.h"
 
 // LoRaWAN Configuration (OTAA)
 // IMPORTANT: Replace these with your actual credentials from The Things Network/ChirpStack
@@ -42,22 +54,69 @@ const char* password = "GU23enY5!";
 const char* serverHost = "192.168.55.192";
 const int serverPort = 8080;
 
-// Sensor configuration
-const float ADC_REF_V = 5.00f;
-const int   ADC_MAX   = 1023;
-const float V_MIN  = 0.50f;
-const float V_MAX  = 4.50f;
-const float FS_KPA = 10.0f;
+// WiFi uploads go to the web server as HTTP batches, or with
+// -D WIFI_TRANSPORT_MQTT to an MQTT broker on the same host (see
+// MqttUploader.h): topic wt/<client id>, QoS 1, binary rows
+#ifdef WIFI_TRANSPORT_MQTT
+const MqttSettings mqttSettings = {serverHost, 1883, "tank-1", 0, 0, 1, MQTT_PAYLOAD_BINARY};
+#endif
 
-// Tank configuration
-const float TANK_DIAMETER_MM = 100.0f;
-const float TANK_RADIUS_M = (TANK_DIAMETER_MM / 2.0f) / 1000.0f;
+// Sensor and tank configuration: see include/SensorConfig.h
 
 // Timing
 unsigned long lastLoRaUploadTime = 0;
 unsigned long lastWiFiUploadTime = 0;
 const unsigned long loraUploadInterval = 60000;  // LoRa upload every 60 seconds (respect duty cycle)
-const unsigned long wifiUploadInterval = 5000;   // WiFi upload every 5 seconds
+const unsigned long wifiUploadInterval = 5000;   // WiFi flush every 5 seconds (raise to batch more readings per request)
+const unsigned long readingInterval = 5000;      // Record a reading every 5 seconds
+
+// Change-driven reporting (see ChangeReporter.h): a reading goes out when
+// depth has moved 10 mm since the last one sent, depth is changing faster
+// than 60 mm/min, or the heartbeat is due. WiFi still flushes at most every
+// wifiUploadInterval and LoRa at most every loraUploadInterval. For the old
+// fixed-interval behaviour use {0, 0, 0, 0}.
+const ReportThresholds wifiReportThresholds = {10, 0, 60, 600000};   // 10 min heartbeat
+const ReportThresholds loraReportThresholds = {10, 0, 60, 900000};   // 15 min heartbeat
+
+// Tank shapes (see TankGeometry.h), precomputed at startup, e.g.
+//   TankGeometry::horizontalCylinder(1200.0f, 2400.0f)   // diameter, length mm
+//   TankGeometry::coneBottom(1500.0f, 400.0f, 2000.0f)   // diameter, cone, height mm
+//   TankGeometry::strapping(points, count)               // manufacturer table
+const TankGeometry tankGeometries[] = {
+  TankGeometry::verticalCylinder(TANK_DIAMETER_MM),
+};
+
+// Tanks, one sensor channel each (see TankArray.h). The first row is the
+// SensorConfig.h tank, read through the lookup table; add a row per extra
+// sensor, e.g.
+//   {A1, 0.5f, 4.5f, 10.0f, &tankGeometries[1]},
+// Up to 8 tanks are sampled together and sent in one payload per upload.
+const TankChannel tankChannels[] = {
+  TankChannel::sensorConfig(A0, &tankGeometries[0]),
+};
+const uint8_t TANK_COUNT = sizeof(tankChannels) / sizeof(tankChannels[0]);
+TankArray<TANK_COUNT> tanks(tankChannels);
+
+ChangeReporterArray<TANK_COUNT> wifiReporter(wifiReportThresholds);
+ChangeReporterArray<TANK_COUNT> loraReporter(loraReportThresholds);
+
+// Sensor sampling (see BlockAdc.h): a timer takes a 14-bit sample of 4
+// summed conversions of every tank channel every 100 ms in the background;
+// each block of 50 (one reading interval) is averaged into one reading per
+// tank
+const uint16_t ADC_BLOCK_SAMPLES = 50;
+BlockAdc<ADC_BLOCK_SAMPLES, TANK_COUNT> blockAdc;
+
+// Every ADC sample goes through a per-tank filter (see LevelFilter.h) and
+// each reading is the filter's estimate at the end of the block. In sensor
+// volts (about 3.9 mV per mm at the default span): Kalman with 20 mV sample
+// noise and 1 mV drift per sample (time constant about 2 s), samples more
+// than 0.2 V (about 50 mm) off dropped unless 3 arrive in a row.
+const LevelFilterSettings levelFilterSettings = {FILTER_KALMAN, 0.05f, 1e-6f, 4e-4f, 0.2f, 3};
+LevelFilter levelFilters[TANK_COUNT];
+
+// Most recent reading of each tank
+PackedReading latestReadings[TANK_COUNT];
 
 // LoRaWAN state
 static osjob_t sendjob;
@@ -65,147 +124,98 @@ bool loraJoined = false;
 bool loraSending = false;
 
 // Data buffer for LoRaWAN
-static uint8_t loraPayload[12];
+static uint8_t loraPayload[LORA_FRAME_MAX_PAYLOAD];
 
-WiFiClient client;
-
-// Utility functions
-static float clampf(float x, float a, float b) {
-  if (x < a) return a;
-  if (x > b) return b;
-  return x;
-}
+// Readings for the next LoRaWAN frame (one uplink interval of history,
+// every tank)
+ReadingBuffer<(loraUploadInterval / readingInterval) * TANK_COUNT> loraHistory;
 
-static float voltageToKpa(float v) {
-  float span = V_MAX - V_MIN;
-  if (span < 0.001f) return 0.0f;
-
-  float ratio = (v - V_MIN) / span;
-  ratio = clampf(ratio, 0.0f, 1.0f);
-  return ratio * FS_KPA;
-}
-
-float readA0VoltageAveraged() {
-  const int samples = 10;
-  float sum = 0.0f;
-
-  for (int i = 0; i < samples; i++) {
-    int raw = analogRead(A0);
-    sum += (float)raw;
-    delay(10);
-  }
-
-  float avgRaw = sum / (float)samples;
-  return (avgRaw * ADC_REF_V) / (float)ADC_MAX;
-}
-
-void connectWiFi() {
-  if (WiFi.status() == WL_CONNECTED) {
-    return;
-  }
-
-  Serial.print("Connecting to WiFi: ");
-  Serial.println(ssid);
-
-  WiFi.begin(ssid, password);
-
-  unsigned long startTime = millis();
-  while (WiFi.status() != WL_CONNECTED && (millis() - startTime) < 15000) {
-    delay(500);
-    Serial.print(".");
-  }
-
-  if (WiFi.status() == WL_CONNECTED) {
-    Serial.println("\nWiFi connected!");
-    Serial.print("IP address: ");
-    Serial.println(WiFi.localIP());
-  } else {
-    Serial.println("\nWiFi connection failed!");
-  }
+WiFiConnectionManager wifiManager(ssid, password);
+WiFiClient client;
+#ifdef WIFI_TRANSPORT_MQTT
+typedef MqttUploader WiFiUploader;
+WiFiUploader uploader(client, mqttSettings);
+#else
+typedef HttpUploader WiFiUploader;
+WiFiUploader uploader(client, serverHost, serverPort);
+#endif
+
+// Readings waiting for WiFi upload (30 minutes at 5 s for one tank, kept
+// through outages; shared by all tanks)
+ReadingBuffer<360> wifiBacklog;
+
+// loop() profile: send 'p' on the serial console for a report, 'r' to
+// reset it. Build with -D LOOP_STATS_IN_UPLOADS to also send the summary
+// with every WiFi upload (X-Device-Stats header, or wt/<client id>/stats over
+// MQTT).
+enum LoopSection {
+  SECTION_LMIC, SECTION_ADC, SECTION_HTTP_POLL, SECTION_WIFI,
+  SECTION_READING, SECTION_WIFI_UPLOAD, SECTION_LORA_SEND, SECTION_CONSOLE,
+  SECTION_IDLE, SECTION_COUNT
+};
+static const char* const LOOP_SECTION_NAMES[SECTION_COUNT] = {
+  "lmic", "adc", "http_poll", "wifi", "reading", "wifi_upload", "lora_send", "console",
+  "idle"
+};
+LoopProfiler loopProfiler(LOOP_SECTION_NAMES, SECTION_COUNT);
+#ifdef LOOP_STATS_IN_UPLOADS
+static char loopSummary[LoopProfiler::SUMMARY_SIZE];
+#endif
+
+// Everything in loop() that runs on a timer (see DeadlineScheduler.h)
+enum TaskId { TASK_READING, TASK_WIFI_UPLOAD, TASK_LORA_SEND, TASK_CONSOLE, TASK_COUNT };
+DeadlineScheduler<TASK_COUNT> scheduler;
+const unsigned long uploadBusyRetry = 50;      // Recheck an in-flight upload
+const unsigned long loraRetryInterval = 1000;  // Not joined yet, previous uplink pending or refused
+const unsigned long consoleInterval = 100;
+
+// Whether the network has set the 400 ms uplink dwell limit
+// (TxParamSetupReq), which shrinks the payload each data rate carries
+bool loraUplinkDwell() {
+  return (LMIC.txParam & MCMD_TxParam_UL_DWELL_MASK) != 0;
 }
 
-void uploadToServer(float depth_m, float pressure_kpa, float volume_liters) {
-  if (WiFi.status() != WL_CONNECTED) {
-    Serial.println("WiFi not connected. Skipping WiFi upload.");
-    return;
+// Pack the last minute of readings into a multi-sample frame (see
+// LoRaFrame.h), as many as fit the current data rate, every tank in each
+// sample. Returns the length.
+uint8_t packLoRaPayload() {
+  LoRaFrameEncoder frame(loraPayload, au915MaxPayload(LMIC.datarate, loraUplinkDwell()),
+                         readingInterval / 1000, TANK_COUNT);
+  PackedReading sample[TANK_COUNT];
+  for (uint16_t i = loraHistory.size(); i >= TANK_COUNT; i -= TANK_COUNT) {
+    uint16_t first = i - TANK_COUNT;
+    if (loraHistory.at(first).tank != 0) break;
+    for (uint8_t t = 0; t < TANK_COUNT; t++) sample[t] = loraHistory.at(first + t).reading;
+    if (!frame.addSample(sample)) break;
   }
-
-  Serial.print("Connecting to server: ");
-  Serial.println(serverHost);
-
-  if (!client.connect(serverHost, serverPort)) {
-    Serial.println("Connection to server failed!");
-    return;
-  }
-
-  String url = "/update?";
-  url += "depth=" + String(depth_m, 3);
-  url += "&pressure=" + String(pressure_kpa, 2);
-  url += "&volume=" + String(volume_liters, 2);
-
-  client.print("GET " + url + " HTTP/1.1\r\n");
-  client.print("Host: " + String(serverHost) + "\r\n");
-  client.print("Connection: close\r\n\r\n");
-
-  unsigned long timeout = millis();
-  while (client.available() == 0) {
-    if (millis() - timeout > 5000) {
-      Serial.println("Server timeout!");
-      client.stop();
-      return;
-    }
-  }
-
-  Serial.println("Server response:");
-  while (client.available()) {
-    String line = client.readStringUntil('\r');
-    Serial.print(line);
-  }
-
-  client.stop();
-  Serial.println("\nData uploaded via WiFi!");
+  return frame.length();
 }
 
-// Pack sensor data into compact binary format for LoRaWAN
-void packLoRaPayload(float voltage, float pressure_kpa, float depth_m, float volume_liters) {
-  // Pack data efficiently to minimize payload size (air time)
-  // voltage: 2 bytes (uint16, resolution 0.001V)
-  // pressure: 2 bytes (uint16, resolution 0.01 kPa)
-  // depth: 2 bytes (uint16, resolution 0.001m)
-  // volume: 2 bytes (uint16, resolution 0.01 liters)
-
-  uint16_t volt_packed = (uint16_t)(voltage * 1000.0f);
-  uint16_t press_packed = (uint16_t)(pressure_kpa * 100.0f);
-  uint16_t depth_packed = (uint16_t)(depth_m * 1000.0f);
-  uint16_t vol_packed = (uint16_t)(volume_liters * 100.0f);
-
-  loraPayload[0] = (volt_packed >> 8) & 0xFF;
-  loraPayload[1] = volt_packed & 0xFF;
-  loraPayload[2] = (press_packed >> 8) & 0xFF;
-  loraPayload[3] = press_packed & 0xFF;
-  loraPayload[4] = (depth_packed >> 8) & 0xFF;
-  loraPayload[5] = depth_packed & 0xFF;
-  loraPayload[6] = (vol_packed >> 8) & 0xFF;
-  loraPayload[7] = vol_packed & 0xFF;
-}
-
-void do_send(osjob_t* j) {
+// Queue the LoRaWAN frame. Returns true once LMIC has accepted it.
+bool do_send(osjob_t* j) {
   if (LMIC.opmode & OP_TXRXPEND) {
     Serial.println(F("OP_TXRXPEND, not sending"));
-  } else {
-    // Read sensor data
-    float voltage = readA0VoltageAveraged();
-    float pressure_kpa = voltageToKpa(voltage);
-    float depth_m = pressure_kpa * 0.10197162f;
-    float volume_m3 = PI * TANK_RADIUS_M * TANK_RADIUS_M * depth_m;
-    float volume_liters = volume_m3 * 1000.0f;
-
-    // Pack and send
-    packLoRaPayload(voltage, pressure_kpa, depth_m, volume_liters);
-    LMIC_setTxData2(1, loraPayload, sizeof(loraPayload), 0);
-    Serial.println(F("Packet queued for LoRaWAN transmission"));
-    loraSending = true;
+    return false;
   }
+  uint8_t length = packLoRaPayload();
+  if (length == 0) {
+    // One sample of every tank is more than this data rate carries
+    Serial.print(F("LoRa: "));
+    Serial.print(TANK_COUNT);
+    Serial.print(F(" tanks don't fit a "));
+    Serial.print(au915MaxPayload(LMIC.datarate, loraUplinkDwell()));
+    Serial.println(F("-byte frame, not sending"));
+    return false;
+  }
+  int result = LMIC_setTxData2(LORA_FRAME_PORT, loraPayload, length, 0);
+  if (result != LMIC_ERROR_SUCCESS) {
+    Serial.print(F("LMIC_setTxData2 failed: "));
+    Serial.println(result);
+    return false;
+  }
+  Serial.println(F("Packet queued for LoRaWAN transmission"));
+  loraSending = true;
+  return true;
 }
 
 // LMIC event handler
@@ -312,6 +322,141 @@ void onEvent (ev_t ev) {
   }
 }
 
+void printReading(const PackedReading& reading, float uncertaintyMm) {
+  float voltage = reading.voltage / 1000.0f;
+  float pressure_kpa = reading.pressure / 100.0f;
+  float depth_m = reading.depth / 1000.0f;
+  float volume_liters = reading.volume / 100.0f;
+
+  Serial.print(F("Voltage: "));
+  Serial.print(voltage, 3);
+  Serial.println(F(" V"));
+
+  Serial.print(F("Pressure: "));
+  Serial.print(pressure_kpa, 2);
+  Serial.println(F(" kPa"));
+
+  Serial.print(F("Water Depth: "));
+  Serial.print(depth_m, 3);
+  Serial.print(F(" m (+/- "));
+  Serial.print(uncertaintyMm, 1);
+  Serial.println(F(" mm)"));
+
+  Serial.print(F("Tank Capacity: "));
+  Serial.print(volume_liters, 2);
+  Serial.println(F(" liters"));
+}
+
+// One reading per tank per completed ADC block, shared by the display and
+// both transports
+void readingTask() {
+  if (!blockAdc.ready()) return;
+  unsigned long now = millis();
+  const volatile uint16_t* block = blockAdc.block();
+  float voltsPerCount = ADC_REF_V / (float)adcSampleFullScale(blockAdc.settings());
+  for (uint16_t i = 0; i < ADC_BLOCK_SAMPLES; i++) {
+    for (uint8_t t = 0; t < TANK_COUNT; t++) {
+      levelFilters[t].update(block[i * TANK_COUNT + t] * voltsPerCount);
+    }
+  }
+  blockAdc.release();
+  float volts[TANK_COUNT];
+  for (uint8_t t = 0; t < TANK_COUNT; t++) volts[t] = levelFilters[t].value();
+  tanks.convertVolts(volts, latestReadings);
+
+  Serial.println(F("--- Measurement ---"));
+  for (uint8_t t = 0; t < TANK_COUNT; t++) {
+    if (TANK_COUNT > 1) {
+      Serial.print(F("Tank "));
+      Serial.println(t);
+    }
+    printReading(latestReadings[t],
+                 levelFilters[t].stddev() * tanks.depthPerVolt(t) * 1000.0f);
+  }
+
+  Serial.print(F("LoRa Status: "));
+  if (loraJoined) {
+    Serial.println(F("JOINED"));
+  } else {
+    Serial.println(F("NOT JOINED"));
+  }
+  Serial.println();
+
+  // Buffer reportable readings for WiFi upload whether or not WiFi is up
+  // right now; LoRa frames carry the whole last minute when one is due
+  if (wifiReporter.offer(now, latestReadings)) {
+    for (uint8_t t = 0; t < TANK_COUNT; t++) wifiBacklog.push(now, latestReadings[t], t);
+    wifiReporter.reported(now, latestReadings);
+    if (!scheduler.scheduled(TASK_WIFI_UPLOAD)) scheduler.at(TASK_WIFI_UPLOAD, now);
+  }
+  for (uint8_t t = 0; t < TANK_COUNT; t++) loraHistory.push(now, latestReadings[t], t);
+  if (loraReporter.offer(now, latestReadings) && !scheduler.scheduled(TASK_LORA_SEND)) {
+    // At most once per upload interval (duty cycle)
+    unsigned long allowed = lastLoRaUploadTime + loraUploadInterval;
+    scheduler.at(TASK_LORA_SEND, DeadlineScheduler<TASK_COUNT>::before(allowed, now) ? now : allowed);
+  }
+  loopProfiler.lap(SECTION_READING);
+}
+
+// Flush buffered readings via WiFi: at most every wifiUploadInterval, or
+// straight away while a backlog from an outage still fills whole batches
+// and the server is accepting them. Runs until the backlog is empty.
+void wifiUploadTask() {
+  unsigned long now = millis();
+  if (!wifiBacklog.empty()) {
+    bool backfilling = uploader.lastSucceeded() &&
+                       wifiBacklog.size() >= WiFiUploader::MAX_BATCH_ROWS;
+    if (uploader.busy()) {
+      scheduler.at(TASK_WIFI_UPLOAD, now + uploadBusyRetry);
+    } else if (!wifiManager.connected()) {
+      scheduler.at(TASK_WIFI_UPLOAD, now + wifiUploadInterval);
+    } else if (!backfilling && now - lastWiFiUploadTime < wifiUploadInterval) {
+      scheduler.at(TASK_WIFI_UPLOAD, lastWiFiUploadTime + wifiUploadInterval);
+    } else {
+#ifdef LOOP_STATS_IN_UPLOADS
+      loopProfiler.formatSummary(loopSummary, sizeof(loopSummary));
+#endif
+      uploader.uploadBatch(wifiBacklog);
+      lastWiFiUploadTime = now;
+      // Rows stay in the backlog until acknowledged
+      scheduler.at(TASK_WIFI_UPLOAD, now + uploadBusyRetry);
+    }
+  }
+  loopProfiler.lap(SECTION_WIFI_UPLOAD);
+}
+
+// Send the pending LoRaWAN report once joined and idle
+void loraSendTask() {
+  unsigned long now = millis();
+  if (!loraJoined || loraSending) {
+    scheduler.at(TASK_LORA_SEND, now + loraRetryInterval);
+  } else if (loraReporter.due() && !loraHistory.empty()) {
+    // A report LMIC didn't take stays due and is retried, so a fill or
+    // drain is not dropped until the next threshold crossing
+    if (do_send(&sendjob)) {
+      loraReporter.reported(now, latestReadings);
+      lastLoRaUploadTime = now;
+    } else {
+      scheduler.at(TASK_LORA_SEND, now + loraRetryInterval);
+    }
+  }
+  loopProfiler.lap(SECTION_LORA_SEND);
+}
+
+// Loop profile on demand
+void consoleTask() {
+  if (Serial.available() > 0) {
+    int c = Serial.read();
+    if (c == 'p') {
+      loopProfiler.printTo(Serial);
+    } else if (c == 'r') {
+      loopProfiler.reset();
+      Serial.println(F("Loop profile reset"));
+    }
+  }
+  loopProfiler.lap(SECTION_CONSOLE);
+}
+
 void setup() {
   Serial.begin(115200);
   while (!Serial) {
@@ -320,6 +465,15 @@ void setup() {
 
   Serial.println(F("\n=== Water Tank Sensor with LoRaWAN + WiFi ==="));
   Serial.println("Tank diameter: " + String(TANK_DIAMETER_MM) + "mm");
+  for (uint8_t t = 0; t < TANK_COUNT; t++) {
+    if (!tankChannels[t].geometry->valid()) {
+      Serial.print(F("Invalid geometry for tank "));
+      Serial.println(t);
+    }
+  }
+  if (!tanks.valid()) {
+    Serial.println(F("A table channel does not match SensorConfig.h; using the float pipeline"));
+  }
 
   // Initialize LoRaWAN
   Serial.println(F("Initializing LoRaWAN..."));
@@ -348,73 +502,69 @@ void setup() {
   Serial.println(F("Starting OTAA join..."));
   LMIC_startJoining();
 
-  // Connect to WiFi as backup
+  // Connect to WiFi as backup (completes in the background from loop())
   Serial.println(F("Connecting to WiFi backup..."));
-  connectWiFi();
+  wifiManager.begin();
+
+  for (uint8_t t = 0; t < TANK_COUNT; t++) levelFilters[t] = LevelFilter(levelFilterSettings);
+  const AdcSettings adcSettings = {tanks.pins(), TANK_COUNT, 14, 4,
+                                   readingInterval * 1000 / ADC_BLOCK_SAMPLES};
+  if (!blockAdc.begin(adcSettings)) {
+    Serial.println(F("ADC sampling timer unavailable!"));
+  }
+
+  unsigned long now = millis();
+  scheduler.add(TASK_READING, readingTask);
+  scheduler.add(TASK_WIFI_UPLOAD, wifiUploadTask);
+  scheduler.add(TASK_LORA_SEND, loraSendTask);
+  scheduler.every(TASK_CONSOLE, consoleTask, consoleInterval, now);
+
+  loopProfiler.begin();
+#if defined(LOOP_STATS_IN_UPLOADS) && defined(WIFI_TRANSPORT_MQTT)
+  uploader.setStats(loopSummary);
+#elif defined(LOOP_STATS_IN_UPLOADS)
+  uploader.setExtraHeader(loopSummary);
+#endif
 
   Serial.println(F("Setup complete. Starting measurements...\n"));
 }
 
+// Wait for the next interrupt (at the latest the 1 ms SysTick) when no
+// task is due, no upload reply is in flight and LMIC has neither a radio
+// operation pending nor a job due before the next task
+void idleUntilNextTask() {
+  uint32_t wait = scheduler.msUntilNext(millis());
+  if (wait == 0 || uploader.busy() || (LMIC.opmode & OP_TXRXPEND)) return;
+  if (os_queryTimeCriticalJobs(ms2osticks(wait))) return;
+#if defined(ARDUINO_ARCH_RENESAS)
+  __WFI();
+#endif
+}
+
 void loop() {
+  loopProfiler.loopStart();
+
   // Process LoRaWAN events (CRITICAL - must be called frequently)
+  loopProfiler.noteRunloop();
   os_runloop_once();
+  loopProfiler.lap(SECTION_LMIC);
 
-  // Ensure WiFi is connected (backup)
-  static unsigned long lastWiFiCheck = 0;
-  if (millis() - lastWiFiCheck > 30000) {  // Check every 30 seconds
-    if (WiFi.status() != WL_CONNECTED) {
-      Serial.println(F("WiFi disconnected. Reconnecting..."));
-      connectWiFi();
-    }
-    lastWiFiCheck = millis();
-  }
+  // Drain any pending HTTP response or MQTT ack, keep the MQTT connection
+  // alive (never blocks)
+  uploader.poll();
+  loopProfiler.lap(SECTION_HTTP_POLL);
 
-  // Read and display sensor data
-  static unsigned long lastDisplay = 0;
-  if (millis() - lastDisplay > 5000) {  // Display every 5 seconds
-    float voltage = readA0VoltageAveraged();
-    float pressure_kpa = voltageToKpa(voltage);
-    float depth_m = pressure_kpa * 0.10197162f;
-    float volume_m3 = PI * TANK_RADIUS_M * TANK_RADIUS_M * depth_m;
-    float volume_liters = volume_m3 * 1000.0f;
-
-    Serial.println(F("--- Measurement ---"));
-    Serial.print(F("Voltage: "));
-    Serial.print(voltage, 3);
-    Serial.println(F(" V"));
-
-    Serial.print(F("Pressure: "));
-    Serial.print(pressure_kpa, 2);
-    Serial.println(F(" kPa"));
-
-    Serial.print(F("Water Depth: "));
-    Serial.print(depth_m, 3);
-    Serial.println(F(" m"));
-
-    Serial.print(F("Tank Capacity: "));
-    Serial.print(volume_liters, 2);
-    Serial.println(F(" liters"));
-
-    Serial.print(F("LoRa Status: "));
-    if (loraJoined) {
-      Serial.println(F("JOINED"));
-    } else {
-      Serial.println(F("NOT JOINED"));
-    }
-    Serial.println();
+  // Keep WiFi connected (backup): reconnects with backoff, never blocks
+  wifiManager.tick();
+  loopProfiler.lap(SECTION_WIFI);
 
-    lastDisplay = millis();
+  // A completed ADC block is due as a reading now
+  if (blockAdc.ready()) scheduler.atOrBefore(TASK_READING, millis());
+  loopProfiler.lap(SECTION_ADC);
 
-    // Upload via WiFi (more frequent updates)
-    if (millis() - lastWiFiUploadTime >= wifiUploadInterval) {
-      uploadToServer(depth_m, pressure_kpa, volume_liters);
-      lastWiFiUploadTime = millis();
-    }
-  }
+  // Readings, uploads and the console, each when due
+  scheduler.runDue(millis());
 
-  // Send via LoRaWAN (less frequent due to duty cycle restrictions)
-  if (loraJoined && !loraSending && (millis() - lastLoRaUploadTime >= loraUploadInterval)) {
-    do_send(&sendjob);
-    lastLoRaUploadTime = millis();
-  }
+  idleUntilNextTask();
+  loopProfiler.lap(SECTION_IDLE);
 }
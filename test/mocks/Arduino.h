@@ -2,10 +2,23 @@
 #define ARDUINO_MOCK_H
 
 #include <stdint.h>
+#include <string.h>
 
 // Mock Arduino constants
 #define PI 3.1415926535897932384626433832795
 #define A0 0
+#define A1 1
+#define A2 2
+#define A3 3
+#define A4 4
+#define A5 5
+#define DEC 10
+#define HEX 16
+
+// Flash strings are plain strings on the host
+#define PROGMEM
+#define F(s) (s)
+#define memcpy_P memcpy
 
 // Mock Serial
 class MockSerial {
@@ -18,6 +31,12 @@ public:
     void print(int) {}
     void println(int) {}
     void println() {}
+    int available() { return 0; }
+    int read() { return -1; }
+    template <typename T> void print(const T&) {}
+    template <typename T> void println(const T&) {}
+    template <typename T> void print(const T&, int) {}
+    template <typename T> void println(const T&, int) {}
     operator bool() { return true; }
 };
 
@@ -25,7 +44,9 @@ extern MockSerial Serial;
 
 // Mock functions
 unsigned long millis();
+unsigned long micros();
 void delay(unsigned long);
 int analogRead(uint8_t);
+void analogReadResolution(int bits);
 
 #endif
@@ -0,0 +1,6 @@
+#ifndef SPI_MOCK_H
+#define SPI_MOCK_H
+
+// The LMIC mock never touches the radio, so SPI is empty on the host
+
+#endif
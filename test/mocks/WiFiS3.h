@@ -1,6 +1,8 @@
 #ifndef WIFIS3_MOCK_H
 #define WIFIS3_MOCK_H
 
+#include <stdio.h>
+#include <stdint.h>
 #include <string.h>
 
 // WiFi status codes
@@ -11,6 +13,63 @@
 #define WL_CONNECTION_LOST 5
 #define WL_DISCONNECTED 6
 
+// String class mock
+class String {
+public:
+    String() : _str(nullptr) {}
+    String(const char* str) : _str(nullptr) { assign(str); }
+    String(const String& other) : _str(nullptr) { assign(other._str); }
+    String(float val, int decimals = 2) : _str(nullptr) {
+        char buf[32];
+        snprintf(buf, sizeof(buf), "%.*f", decimals, val);
+        assign(buf);
+    }
+    ~String() { delete[] _str; }
+
+    String& operator=(const String& other) {
+        if (this != &other) {
+            delete[] _str;
+            _str = nullptr;
+            assign(other._str);
+        }
+        return *this;
+    }
+
+    String& operator+=(const String& other) {
+        *this = *this + other;
+        return *this;
+    }
+
+    String operator+(const String& other) const {
+        if (!_str && !other._str) return String();
+        if (!_str) return String(other._str);
+        if (!other._str) return String(_str);
+
+        char* newStr = new char[strlen(_str) + strlen(other._str) + 1];
+        strcpy(newStr, _str);
+        strcat(newStr, other._str);
+        String result(newStr);
+        delete[] newStr;
+        return result;
+    }
+
+    friend String operator+(const char* lhs, const String& rhs) {
+        return String(lhs) + rhs;
+    }
+
+    const char* c_str() const { return _str ? _str : ""; }
+
+private:
+    void assign(const char* str) {
+        if (str) {
+            _str = new char[strlen(str) + 1];
+            strcpy(_str, str);
+        }
+    }
+
+    char* _str;
+};
+
 class IPAddress {
 public:
     IPAddress() {}
@@ -20,60 +79,30 @@ public:
 class MockWiFiClient {
 public:
     bool connect(const char* host, int port);
+    uint8_t connected();
     void stop();
     size_t print(const char* str);
     size_t print(const String& str);
+    size_t write(const uint8_t* buf, size_t size);
     int available();
+    int read();
     String readStringUntil(char terminator);
 };
 
 class MockWiFiClass {
 public:
-    void begin(const char* ssid, const char* pass);
+    // Like WiFiS3, begin() waits for the link until it is up (after the
+    // mock connect delay) or the timeout (10 s by default) passes
+    int begin(const char* ssid, const char* pass);
+    void setTimeout(unsigned long timeout) { _timeout = timeout; }
     int status();
     IPAddress localIP();
+
+private:
+    unsigned long _timeout = 10000;
 };
 
 extern MockWiFiClass WiFi;
 typedef MockWiFiClient WiFiClient;
 
-// String class mock
-class String {
-public:
-    String() : _str(nullptr) {}
-    String(const char* str) {
-        if (str) {
-            _str = new char[strlen(str) + 1];
-            strcpy(_str, str);
-        } else {
-            _str = nullptr;
-        }
-    }
-    String(float val, int decimals) {
-        char buf[32];
-        snprintf(buf, sizeof(buf), "%.*f", decimals, val);
-        _str = new char[strlen(buf) + 1];
-        strcpy(_str, buf);
-    }
-    ~String() { delete[] _str; }
-    
-    String operator+(const String& other) const {
-        if (!_str && !other._str) return String();
-        if (!_str) return String(other._str);
-        if (!other._str) return String(_str);
-        
-        char* newStr = new char[strlen(_str) + strlen(other._str) + 1];
-        strcpy(newStr, _str);
-        strcat(newStr, other._str);
-        String result(newStr);
-        delete[] newStr;
-        return result;
-    }
-    
-    const char* c_str() const { return _str ? _str : ""; }
-    
-private:
-    char* _str;
-};
-
 #endif
@@ -0,0 +1,62 @@
+#include "AdcBackend.h"
+
+// Host stand-in for the ADC sampling timer: mocks.cpp calls
+// mock_adc_backend_clock() whenever the mock clock moves, and every sample
+// period that has elapsed since the last one fires the handler, as the
+// timer interrupt would. Conversions go through the mock analogRead().
+
+static bool mock_adc_running = false;
+static AdcSettings mock_adc_settings;
+static AdcSampleHandler mock_adc_handler = nullptr;
+static void* mock_adc_context = nullptr;
+static unsigned long mock_adc_next_us = 0;
+static unsigned long mock_adc_samples = 0;
+
+bool adcBackendBegin(const AdcSettings& settings, AdcSampleHandler handler, void* context) {
+    if (!adcSettingsValid(settings) || !handler) return false;
+    mock_adc_settings = settings;
+    mock_adc_handler = handler;
+    mock_adc_context = context;
+    analogReadResolution(settings.resolutionBits);
+    mock_adc_next_us = micros() + settings.sampleIntervalUs;
+    mock_adc_running = true;
+    return true;
+}
+
+void adcBackendStop() {
+    mock_adc_running = false;
+}
+
+void mock_adc_backend_clock() {
+    if (!mock_adc_running) return;
+    unsigned long now = micros();
+    unsigned long interval = mock_adc_settings.sampleIntervalUs;
+    if ((long)(mock_adc_next_us - now) > (long)interval) {
+        // Clock set backwards: restart the period from here
+        mock_adc_next_us = now + interval;
+    }
+    while (mock_adc_running && (long)(now - mock_adc_next_us) >= 0) {
+        mock_adc_next_us += interval;
+        mock_adc_samples++;
+        uint16_t samples[ADC_MAX_CHANNELS];
+        adcConvert(mock_adc_settings, samples);
+        mock_adc_handler(mock_adc_context, samples);
+    }
+}
+
+void mock_adc_backend_reset() {
+    mock_adc_running = false;
+    mock_adc_handler = nullptr;
+    mock_adc_context = nullptr;
+    mock_adc_samples = 0;
+}
+
+extern "C" {
+    bool mock_adc_backend_running() {
+        return mock_adc_running;
+    }
+
+    unsigned long mock_adc_backend_samples() {
+        return mock_adc_samples;
+    }
+}
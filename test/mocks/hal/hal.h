@@ -0,0 +1,6 @@
+#ifndef LMIC_HAL_MOCK_H
+#define LMIC_HAL_MOCK_H
+
+#include "../lmic.h"
+
+#endif
@@ -0,0 +1,152 @@
+#ifndef LMIC_MOCK_H
+#define LMIC_MOCK_H
+
+#include <stdint.h>
+
+// Host stand-in for the MCCI LMIC API used by src/main.cpp.
+//
+// No radio, but AU915 timing: every join request and uplink is charged its
+// time on air (Semtech SX1276 formula, 13 bytes of LoRaWAN framing on top
+// of the application payload) on one of the enabled channels for its data
+// rate. Optionally the 400 ms uplink dwell time limit (TxParamSetupReq)
+// and a duty-cycle budget apply: an uplink that can never fit is cancelled
+// (EV_TXCANCELED), one sent before the band is free again is held back
+// until it is, like the real LMIC scheduler.
+//
+// Joins: a join request goes out at DR2 every MOCK_LMIC_JOIN_RETRY_MS
+// until the network accepts one (see mock_lmic_set_join_accept_after());
+// EV_JOINED follows in the 5 s JoinAccept window, unanswered requests end
+// with EV_JOIN_TXCOMPLETE. Uplinks end with EV_TXCOMPLETE once the RX2
+// window has passed.
+//
+// Events are delivered to the sketch's onEvent() from os_runloop_once(),
+// one per call, like the real run loop. Times follow the mock millis().
+
+typedef uint8_t u1_t;
+typedef int8_t s1_t;
+typedef uint16_t u2_t;
+typedef int16_t s2_t;
+typedef uint32_t u4_t;
+typedef int32_t s4_t;
+typedef uint8_t bit_t;
+typedef s4_t ostime_t;
+typedef u4_t devaddr_t;
+typedef u1_t dr_t;
+typedef u1_t* xref2u1_t;
+
+#define OSTICKS_PER_SEC 62500
+#define ms2osticks(ms) ((ostime_t)(((int64_t)(ms) * OSTICKS_PER_SEC) / 1000))
+#define LMIC_UNUSED_PIN 0xff
+
+enum _ev_t {
+  EV_SCAN_TIMEOUT = 1, EV_BEACON_FOUND, EV_BEACON_MISSED, EV_BEACON_TRACKED,
+  EV_JOINING, EV_JOINED, EV_RFU1, EV_JOIN_FAILED, EV_REJOIN_FAILED,
+  EV_TXCOMPLETE, EV_LOST_TSYNC, EV_RESET, EV_RXCOMPLETE, EV_LINK_DEAD,
+  EV_LINK_ALIVE, EV_SCAN_FOUND, EV_TXSTART, EV_TXCANCELED, EV_RXSTART,
+  EV_JOIN_TXCOMPLETE
+};
+typedef enum _ev_t ev_t;
+
+// AU915 data rates
+enum { DR_SF12 = 0, DR_SF11, DR_SF10, DR_SF9, DR_SF8, DR_SF7, DR_SF8C };
+
+enum { OP_TXRXPEND = 0x0080, OP_JOINING = 0x0004 };
+enum { TXRX_ACK = 0x80, TXRX_NACK = 0x40 };
+// LMIC.txParam: TxParamSetupReq from the network
+enum { MCMD_TxParam_UL_DWELL_MASK = 0x10 };
+
+// LMIC_setTxData2() results
+enum {
+  LMIC_ERROR_SUCCESS = 0,
+  LMIC_ERROR_TX_BUSY = -1,
+  LMIC_ERROR_TX_TOO_LARGE = -2,
+  LMIC_ERROR_TX_NOT_FEASIBLE = -3,
+  LMIC_ERROR_TX_FAILED = -4
+};
+
+struct osjob_t;
+typedef void (*osjobcb_t)(osjob_t*);
+struct osjob_t {
+  osjob_t* next;
+  ostime_t deadline;
+  osjobcb_t func;
+};
+
+struct lmic_pinmap {
+  u1_t nss;
+  u1_t rxtx;
+  u1_t rst;
+  u1_t dio[3];
+};
+
+struct lmic_t {
+  dr_t datarate;
+  s1_t txpow;
+  u2_t opmode;
+  u1_t txrxFlags;
+  u1_t txParam;  // MCMD_TxParam_UL_DWELL_MASK while the uplink dwell limit applies
+  u1_t dataLen;
+  u1_t frame[255];
+};
+
+extern lmic_t LMIC;
+
+void os_init();
+void os_runloop_once();
+ostime_t os_getTime();
+// True if a job is due within `time` ticks from now
+bit_t os_queryTimeCriticalJobs(ostime_t time);
+void LMIC_reset();
+void LMIC_disableChannel(u1_t channel);
+void LMIC_enableChannel(u1_t channel);
+void LMIC_setDrTxpow(dr_t dr, s1_t txpow);
+void LMIC_setLinkCheckMode(bit_t enabled);
+bit_t LMIC_startJoining();
+int LMIC_setTxData2(u1_t port, xref2u1_t data, u1_t dlen, u1_t confirmed);
+void LMIC_getSessionKeys(u4_t* netid, devaddr_t* devaddr, xref2u1_t nwkKey, xref2u1_t artKey);
+
+// Mock timing
+const unsigned long MOCK_LMIC_NEVER = 0xFFFFFFFFUL;
+const unsigned long MOCK_LMIC_JOIN_ACCEPT_DELAY_MS = 5000;  // RX1 for JoinAccept
+const unsigned long MOCK_LMIC_RX2_DELAY_MS = 2000;          // Uplink end to RX2
+const unsigned long MOCK_LMIC_JOIN_RETRY_MS = 10000;        // Unanswered join to next try
+const u1_t MOCK_LMIC_JOIN_DR = DR_SF10;
+const u1_t MOCK_LMIC_FRAME_OVERHEAD = 13;  // MHDR, FHDR, FPort, MIC
+
+struct mock_lmic_stats_t {
+  unsigned long joinRequests;
+  unsigned long joinLatencyMs;  // LMIC_startJoining() to EV_JOINED, or MOCK_LMIC_NEVER
+  unsigned long uplinks;        // Accepted by LMIC_setTxData2()
+  unsigned long busyRejects;    // LMIC_ERROR_TX_BUSY
+  unsigned long cancelled;      // Not feasible at the data rate (EV_TXCANCELED)
+  unsigned long deferred;       // Held back for the duty-cycle budget
+  unsigned long deferredMs;     // Total hold-back time
+  uint64_t airtimeUs;           // Joins and uplinks
+  uint32_t maxAirtimeUs;
+};
+
+// Mock control
+extern "C" {
+  // Time on air of a PHY payload (application payload + frame overhead)
+  uint32_t mock_lmic_airtime_us(u1_t dr, u1_t phyLength);
+  // Network answers join requests sent this long after
+  // LMIC_startJoining() (default 0); MOCK_LMIC_NEVER for never
+  void mock_lmic_set_join_accept_after(unsigned long ms);
+  // Enforce the AU915 400 ms uplink dwell time (default off)
+  void mock_lmic_set_dwell_time(bool limited);
+  // Band stays busy for airtime * (divisor - 1) after each transmission,
+  // e.g. 100 for a 1% duty cycle; 0 (default) for none
+  void mock_lmic_set_duty_cycle(unsigned long divisor);
+  // LMIC_setTxData2() refuses every uplink with LMIC_ERROR_TX_BUSY while
+  // set, as the real stack does with a frame or MAC command still queued
+  void mock_lmic_set_busy(bool busy);
+  unsigned long mock_lmic_uplinks();
+  void mock_lmic_get_stats(mock_lmic_stats_t* stats);
+  bool mock_lmic_channel_enabled(u1_t channel);
+  // Channel of the last transmission, -1 before the first
+  int mock_lmic_last_channel();
+  const uint8_t* mock_lmic_last_payload(uint8_t* length, uint8_t* port);
+  void mock_lmic_reset();
+}
+
+#endif
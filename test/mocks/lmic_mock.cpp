@@ -0,0 +1,285 @@
+#include "lmic.h"
+#include "Arduino.h"
+#include <string.h>
+
+// The sketch's event handler; absent from the unit test binary
+void onEvent(ev_t ev) __attribute__((weak));
+
+lmic_t LMIC;
+
+static const int CHANNELS = 72;         // 0-63 125 kHz, 64-71 500 kHz
+static const int FIRST_500K_CHANNEL = 64;
+static const uint32_t DWELL_LIMIT_US = 400000;
+
+static unsigned long mock_join_accept_after = 0;
+static bool mock_dwell_limited = false;
+static unsigned long mock_duty_divisor = 0;
+static bool mock_busy = false;
+
+static bool mock_channels[CHANNELS];
+static int mock_last_channel = -1;
+static bool mock_band_busy = false;
+static unsigned long mock_band_free_at = 0;
+static unsigned long mock_join_started_at = 0;
+static mock_lmic_stats_t mock_stats;
+static uint8_t mock_last_port = 0;
+static uint8_t mock_last_length = 0;
+
+// Pending work, run in due order by os_runloop_once(): an event for the
+// sketch, or the next join attempt
+static const int JOIN_ATTEMPT = -1;
+struct PendingEvent {
+    int ev;
+    unsigned long due;
+};
+static PendingEvent mock_events[16];
+static int mock_event_count = 0;
+
+static void schedule(int ev, unsigned long due) {
+    if (mock_event_count < (int)(sizeof(mock_events) / sizeof(mock_events[0]))) {
+        mock_events[mock_event_count++] = PendingEvent{ev, due};
+    }
+}
+
+// Largest application payload per AU915 data rate, dwell time off / on
+// (LoRaWAN Regional Parameters; DR0-1 cannot carry an uplink under dwell)
+static u1_t maxPayload(dr_t dr) {
+    static const u1_t OFF[] = {51, 51, 51, 115, 242, 242, 242};
+    static const u1_t ON[] = {0, 0, 11, 53, 125, 242, 242};
+    if (dr > DR_SF8C) return 0;
+    return mock_dwell_limited ? ON[dr] : OFF[dr];
+}
+
+// Next enabled channel for the data rate's bandwidth, round robin
+static int pickChannel(dr_t dr) {
+    int first = dr == DR_SF8C ? FIRST_500K_CHANNEL : 0;
+    int count = dr == DR_SF8C ? CHANNELS - FIRST_500K_CHANNEL : FIRST_500K_CHANNEL;
+    int last = mock_last_channel >= first && mock_last_channel < first + count
+                   ? mock_last_channel - first : count - 1;
+    for (int i = 1; i <= count; i++) {
+        int ch = first + (last + i) % count;
+        if (mock_channels[ch]) return ch;
+    }
+    return -1;
+}
+
+// Reserve the band for a transmission of the given airtime, starting now
+// or once the duty-cycle budget allows; returns when it ends
+static unsigned long transmit(int channel, uint32_t airtimeUs) {
+    unsigned long now = millis();
+    unsigned long start = now;
+    if (mock_band_busy && (long)(mock_band_free_at - now) > 0) {
+        start = mock_band_free_at;
+        mock_stats.deferred++;
+        mock_stats.deferredMs += start - now;
+    }
+    unsigned long airtimeMs = (airtimeUs + 999) / 1000;
+    if (mock_duty_divisor > 0) {
+        mock_band_busy = true;
+        mock_band_free_at = start + airtimeMs * mock_duty_divisor;
+    }
+    mock_last_channel = channel;
+    mock_stats.airtimeUs += airtimeUs;
+    if (airtimeUs > mock_stats.maxAirtimeUs) mock_stats.maxAirtimeUs = airtimeUs;
+    schedule(EV_TXSTART, start);
+    return start + airtimeMs;
+}
+
+static void joinAttempt() {
+    int channel = pickChannel(MOCK_LMIC_JOIN_DR);
+    if (channel < 0) {
+        schedule(JOIN_ATTEMPT, millis() + MOCK_LMIC_JOIN_RETRY_MS);
+        return;
+    }
+    // 23-byte JoinRequest: MHDR, JoinEUI, DevEUI, DevNonce, MIC
+    uint32_t airtimeUs = mock_lmic_airtime_us(MOCK_LMIC_JOIN_DR, 23);
+    mock_stats.joinRequests++;
+    unsigned long end = transmit(channel, airtimeUs);
+    unsigned long start = end - (airtimeUs + 999) / 1000;
+    if (mock_join_accept_after != MOCK_LMIC_NEVER &&
+        start - mock_join_started_at >= mock_join_accept_after) {
+        schedule(EV_JOINED, end + MOCK_LMIC_JOIN_ACCEPT_DELAY_MS);
+    } else {
+        unsigned long noAccept = end + MOCK_LMIC_JOIN_ACCEPT_DELAY_MS + 1000;
+        schedule(EV_JOIN_TXCOMPLETE, noAccept);
+        schedule(JOIN_ATTEMPT, noAccept + MOCK_LMIC_JOIN_RETRY_MS);
+    }
+}
+
+void os_init() {
+    mock_event_count = 0;
+}
+
+void os_runloop_once() {
+    unsigned long now = millis();
+    int next = -1;
+    for (int i = 0; i < mock_event_count; i++) {
+        if ((long)(now - mock_events[i].due) < 0) continue;
+        if (next < 0 || (long)(mock_events[i].due - mock_events[next].due) < 0) next = i;
+    }
+    if (next < 0) return;
+
+    int ev = mock_events[next].ev;
+    mock_events[next] = mock_events[--mock_event_count];
+    if (ev == JOIN_ATTEMPT) {
+        joinAttempt();
+        return;
+    }
+    if (ev == EV_JOINED) {
+        LMIC.opmode &= ~OP_JOINING;
+        mock_stats.joinLatencyMs = now - mock_join_started_at;
+    }
+    if (ev == EV_TXCOMPLETE) LMIC.opmode &= ~OP_TXRXPEND;
+    if (onEvent) onEvent((ev_t)ev);
+}
+
+bit_t os_queryTimeCriticalJobs(ostime_t time) {
+    unsigned long horizon = millis() + (unsigned long)((int64_t)time * 1000 / OSTICKS_PER_SEC);
+    for (int i = 0; i < mock_event_count; i++) {
+        if ((long)(mock_events[i].due - horizon) <= 0) return 1;
+    }
+    return 0;
+}
+
+ostime_t os_getTime() {
+    return (ostime_t)((uint64_t)millis() * OSTICKS_PER_SEC / 1000);
+}
+
+void LMIC_reset() {
+    memset(&LMIC, 0, sizeof(LMIC));
+    // The network's TxParamSetupReq outlives the reset
+    if (mock_dwell_limited) LMIC.txParam = MCMD_TxParam_UL_DWELL_MASK;
+    mock_event_count = 0;
+    for (int c = 0; c < CHANNELS; c++) mock_channels[c] = true;
+    mock_last_channel = -1;
+    mock_band_busy = false;
+}
+
+void LMIC_disableChannel(u1_t channel) {
+    if (channel < CHANNELS) mock_channels[channel] = false;
+}
+
+void LMIC_enableChannel(u1_t channel) {
+    if (channel < CHANNELS) mock_channels[channel] = true;
+}
+
+void LMIC_setLinkCheckMode(bit_t) {}
+
+void LMIC_setDrTxpow(dr_t dr, s1_t txpow) {
+    LMIC.datarate = dr;
+    LMIC.txpow = txpow;
+}
+
+bit_t LMIC_startJoining() {
+    if (LMIC.opmode & OP_JOINING) return 0;
+    LMIC.opmode |= OP_JOINING;
+    mock_join_started_at = millis();
+    schedule(EV_JOINING, mock_join_started_at);
+    schedule(JOIN_ATTEMPT, mock_join_started_at);
+    return 1;
+}
+
+int LMIC_setTxData2(u1_t port, xref2u1_t data, u1_t dlen, u1_t) {
+    if (mock_busy || (LMIC.opmode & (OP_TXRXPEND | OP_JOINING))) {
+        mock_stats.busyRejects++;
+        return LMIC_ERROR_TX_BUSY;
+    }
+    if (dlen > sizeof(LMIC.frame) - MOCK_LMIC_FRAME_OVERHEAD) return LMIC_ERROR_TX_TOO_LARGE;
+
+    uint32_t airtimeUs = mock_lmic_airtime_us(LMIC.datarate, dlen + MOCK_LMIC_FRAME_OVERHEAD);
+    int channel = pickChannel(LMIC.datarate);
+    if (dlen > maxPayload(LMIC.datarate) || channel < 0 ||
+        (mock_dwell_limited && airtimeUs > DWELL_LIMIT_US)) {
+        mock_stats.cancelled++;
+        schedule(EV_TXCANCELED, millis());
+        return LMIC_ERROR_TX_NOT_FEASIBLE;
+    }
+
+    memcpy(LMIC.frame, data, dlen);
+    LMIC.dataLen = 0;  // No downlink
+    LMIC.txrxFlags = 0;
+    mock_last_port = port;
+    mock_last_length = dlen;
+    LMIC.opmode |= OP_TXRXPEND;
+    mock_stats.uplinks++;
+    unsigned long end = transmit(channel, airtimeUs);
+    schedule(EV_TXCOMPLETE, end + MOCK_LMIC_RX2_DELAY_MS);
+    return LMIC_ERROR_SUCCESS;
+}
+
+void LMIC_getSessionKeys(u4_t* netid, devaddr_t* devaddr, xref2u1_t nwkKey, xref2u1_t artKey) {
+    *netid = 0;
+    *devaddr = 0;
+    memset(nwkKey, 0, 16);
+    memset(artKey, 0, 16);
+}
+
+extern "C" {
+    // Semtech SX1276 time on air: explicit header, CRC on, coding rate 4/5,
+    // 8-symbol preamble, low data rate optimisation at SF11/12 on 125 kHz.
+    // AU915 DR0-5 are SF12-SF7 at 125 kHz, DR6 is SF8 at 500 kHz.
+    uint32_t mock_lmic_airtime_us(u1_t dr, u1_t phyLength) {
+        int sf = dr == DR_SF8C ? 8 : 12 - dr;
+        uint32_t bandwidth = dr == DR_SF8C ? 500000 : 125000;
+        int lowDataRate = bandwidth == 125000 && sf >= 11 ? 1 : 0;
+        uint32_t symbolUs = (1000000u << sf) / bandwidth;
+
+        int bits = 8 * phyLength - 4 * sf + 28 + 16;
+        int perBlock = 4 * (sf - 2 * lowDataRate);
+        int blocks = bits > 0 ? (bits + perBlock - 1) / perBlock : 0;
+        uint32_t payloadSymbols = 8 + (uint32_t)blocks * 5;
+        // Preamble: 8 programmed symbols + 4.25
+        return (1225 * symbolUs) / 100 + payloadSymbols * symbolUs;
+    }
+
+    void mock_lmic_set_join_accept_after(unsigned long ms) {
+        mock_join_accept_after = ms;
+    }
+
+    void mock_lmic_set_dwell_time(bool limited) {
+        mock_dwell_limited = limited;
+        LMIC.txParam = limited ? MCMD_TxParam_UL_DWELL_MASK : 0;
+    }
+
+    void mock_lmic_set_duty_cycle(unsigned long divisor) {
+        mock_duty_divisor = divisor;
+    }
+
+    void mock_lmic_set_busy(bool busy) {
+        mock_busy = busy;
+    }
+
+    unsigned long mock_lmic_uplinks() {
+        return mock_stats.uplinks;
+    }
+
+    void mock_lmic_get_stats(mock_lmic_stats_t* stats) {
+        *stats = mock_stats;
+    }
+
+    bool mock_lmic_channel_enabled(u1_t channel) {
+        return channel < CHANNELS && mock_channels[channel];
+    }
+
+    int mock_lmic_last_channel() {
+        return mock_last_channel;
+    }
+
+    const uint8_t* mock_lmic_last_payload(uint8_t* length, uint8_t* port) {
+        if (length) *length = mock_last_length;
+        if (port) *port = mock_last_port;
+        return LMIC.frame;
+    }
+
+    void mock_lmic_reset() {
+        mock_dwell_limited = false;
+        LMIC_reset();
+        mock_join_accept_after = 0;
+        mock_duty_divisor = 0;
+        mock_busy = false;
+        memset(&mock_stats, 0, sizeof(mock_stats));
+        mock_stats.joinLatencyMs = MOCK_LMIC_NEVER;
+        mock_last_port = 0;
+        mock_last_length = 0;
+    }
+}
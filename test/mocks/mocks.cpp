@@ -1,32 +1,141 @@
 #include "Arduino.h"
 #include "WiFiS3.h"
 #include <time.h>
+#include <new>
+#include <stdlib.h>
 
 // Global state
 MockSerial Serial;
 MockWiFiClass WiFi;
 
 static unsigned long mock_millis_value = 0;
+static unsigned long mock_micros_extra = 0;  // micros() beyond millis() * 1000
 static int mock_wifi_status = WL_DISCONNECTED;
-static int mock_analog_value = 512;
+static unsigned long mock_wifi_begins = 0;
+static unsigned long mock_wifi_connect_delay = 0;  // ms for begin() to see the link
+static int mock_analog_value = 512;        // 10-bit code
+static const int MOCK_ANALOG_PINS = 32;
+static int mock_analog_pin_value[MOCK_ANALOG_PINS];  // -1: mock_analog_value
+static bool mock_analog_pins_set = false;
+static int mock_analog_bits = 10;          // analogReadResolution()
+static int mock_analog_noise = 0;          // +/- codes per conversion
+static uint32_t mock_analog_rng = 1;
 static bool mock_client_connected = false;
 
+// Client socket state
+static bool mock_client_open = false;
+static bool mock_server_closes = false;
+static unsigned long mock_connect_attempts = 0;
+static unsigned long mock_connects = 0;
+static unsigned long mock_bytes_written = 0;
+
+// Scripted server: mock_response is queued each time a request ends and
+// becomes readable mock_response_delay ms later
+static const char* mock_response = nullptr;
+static unsigned long mock_response_delay = 0;
+static unsigned long mock_rx_ready_at = 0;
+static unsigned long mock_requests = 0;
+static unsigned long mock_empty_poll_cost = 1;
+static char mock_rx[1024];
+static size_t mock_rx_len = 0;
+static size_t mock_rx_pos = 0;
+static char mock_last_request[512];
+static size_t mock_last_request_len = 0;
+static unsigned long mock_bytes_read = 0;
+
+// MQTT 3.1.1 broker stand-in: while enabled, written bytes are parsed as
+// MQTT packets and answered with CONNACK, PUBACK (QoS 1) and PINGRESP,
+// queued like a scripted response. One session is remembered across
+// connections for a client that connects with CleanSession 0.
+static bool mock_mqtt_enabled = false;
+static int mock_mqtt_connack_code = 0;
+static bool mock_mqtt_silent = false;
+static bool mock_mqtt_closing = false;  // Refused: close once the reply is read
+static uint8_t mock_mqtt_in[2048];
+static size_t mock_mqtt_in_len = 0;
+static char mock_mqtt_session[32];
+static unsigned long mock_mqtt_counts[16];
+static char mock_mqtt_topic[64];
+static uint8_t mock_mqtt_payload[1024];
+static size_t mock_mqtt_payload_len = 0;
+static int mock_mqtt_qos = -1;
+static bool mock_mqtt_dup = false;
+static int mock_mqtt_packet_id = -1;  // Of the last QoS 1 PUBLISH
+static int mock_mqtt_present = -1;  // Session present in the last CONNACK
+
+// Mock ADC timer (adc_backend_mock.cpp): fires as the clock advances
+void mock_adc_backend_clock() __attribute__((weak));
+void mock_adc_backend_reset() __attribute__((weak));
+
+static void clockAdvanced() {
+    if (mock_adc_backend_clock) mock_adc_backend_clock();
+}
+
+// Heap allocation counter (all operator new calls in the test binary)
+static unsigned long mock_allocations = 0;
+
+void* operator new(size_t size) {
+    mock_allocations++;
+    void* p = malloc(size ? size : 1);
+    if (!p) throw std::bad_alloc();
+    return p;
+}
+
+void* operator new[](size_t size) {
+    mock_allocations++;
+    void* p = malloc(size ? size : 1);
+    if (!p) throw std::bad_alloc();
+    return p;
+}
+
+void operator delete(void* p) noexcept { free(p); }
+void operator delete[](void* p) noexcept { free(p); }
+void operator delete(void* p, size_t) noexcept { free(p); }
+void operator delete[](void* p, size_t) noexcept { free(p); }
+
 // Arduino mock implementations
 unsigned long millis() {
     return mock_millis_value;
 }
 
+unsigned long micros() {
+    return mock_millis_value * 1000 + mock_micros_extra;
+}
+
 void delay(unsigned long ms) {
     mock_millis_value += ms;
+    clockAdvanced();
 }
 
+// The 10-bit mock value rescaled to the current resolution, plus noise
 int analogRead(uint8_t pin) {
-    return mock_analog_value;
+    long max = (1L << mock_analog_bits) - 1;
+    int value = mock_analog_value;
+    if (mock_analog_pins_set && pin < MOCK_ANALOG_PINS && mock_analog_pin_value[pin] >= 0) {
+        value = mock_analog_pin_value[pin];
+    }
+    long code = (value * max + 511) / 1023;
+    if (mock_analog_noise > 0) {
+        mock_analog_rng = mock_analog_rng * 1664525u + 1013904223u;
+        code += (long)((mock_analog_rng >> 8) % (uint32_t)(2 * mock_analog_noise + 1)) -
+                mock_analog_noise;
+    }
+    return (int)(code < 0 ? 0 : (code > max ? max : code));
+}
+
+void analogReadResolution(int bits) {
+    mock_analog_bits = bits;
 }
 
 // WiFi mock implementations
-void MockWiFiClass::begin(const char* ssid, const char* pass) {
-    // Simulate connection attempt
+int MockWiFiClass::begin(const char* ssid, const char* pass) {
+    mock_wifi_begins++;
+    unsigned long wait = mock_wifi_connect_delay < _timeout ? mock_wifi_connect_delay : _timeout;
+    if (wait > 0) {
+        mock_millis_value += wait;
+        clockAdvanced();
+    }
+    return mock_wifi_status;
 }
 
 int MockWiFiClass::status() {
@@ -38,24 +147,175 @@ IPAddress MockWiFiClass::localIP() {
 }
 
 bool MockWiFiClient::connect(const char* host, int port) {
+    mock_connect_attempts++;
+    if (mock_client_connected) {
+        mock_connects++;
+        mock_client_open = true;
+        mock_rx_len = mock_rx_pos = 0;
+        mock_mqtt_in_len = 0;
+        mock_mqtt_closing = false;
+    }
     return mock_client_connected;
 }
 
+uint8_t MockWiFiClient::connected() {
+    if (mock_client_open && (mock_server_closes || mock_mqtt_closing) && mock_rx_len > 0 &&
+        mock_rx_pos >= mock_rx_len) {
+        // Server closed after its response was drained
+        mock_client_open = false;
+    }
+    return mock_client_open ? 1 : 0;
+}
+
 void MockWiFiClient::stop() {
+    mock_client_open = false;
+    mock_rx_len = mock_rx_pos = 0;
 }
 
 size_t MockWiFiClient::print(const char* str) {
-    return strlen(str);
+    return write((const uint8_t*)str, strlen(str));
 }
 
 size_t MockWiFiClient::print(const String& str) {
-    return strlen(str.c_str());
+    return print(str.c_str());
+}
+
+// Queue bytes from the server, readable after the response delay
+static void queueReply(const uint8_t* data, size_t len) {
+    if (mock_rx_pos >= mock_rx_len) mock_rx_len = mock_rx_pos = 0;
+    mock_rx_ready_at = mock_millis_value + mock_response_delay;
+    if (mock_rx_len + len <= sizeof(mock_rx)) {
+        memcpy(mock_rx + mock_rx_len, data, len);
+        mock_rx_len += len;
+    }
+}
+
+static uint16_t mqttU16(const uint8_t* p) {
+    return (uint16_t)((p[0] << 8) | p[1]);
+}
+
+static void mqttPacket(uint8_t type, const uint8_t* body, size_t len) {
+    mock_mqtt_counts[type >> 4]++;
+    switch (type >> 4) {
+        case 1: {  // CONNECT: protocol name, level, flags, keep alive, client id
+            if (len < 12) return;
+            bool clean = (body[7] & 0x02) != 0;
+            uint16_t idLen = mqttU16(body + 10);
+            char id[sizeof(mock_mqtt_session)];
+            size_t n = idLen < sizeof(id) - 1 ? idLen : sizeof(id) - 1;
+            memcpy(id, body + 12, n);
+            id[n] = '\0';
+            bool present = !clean && mock_mqtt_session[0] && strcmp(id, mock_mqtt_session) == 0;
+            if (mock_mqtt_connack_code != 0) present = false;
+            if (mock_mqtt_connack_code == 0) {
+                if (clean) {
+                    mock_mqtt_session[0] = '\0';
+                } else {
+                    strcpy(mock_mqtt_session, id);
+                }
+            }
+            mock_mqtt_present = present ? 1 : 0;
+            if (mock_mqtt_silent) return;
+            uint8_t connack[4] = {0x20, 0x02, (uint8_t)(present ? 1 : 0),
+                                  (uint8_t)mock_mqtt_connack_code};
+            queueReply(connack, 4);
+            if (mock_mqtt_connack_code != 0) mock_mqtt_closing = true;
+            return;
+        }
+        case 3: {  // PUBLISH: topic, packet id if QoS > 0, payload
+            if (len < 2) return;
+            int qos = (type >> 1) & 3;
+            uint16_t topicLen = mqttU16(body);
+            size_t n = topicLen < sizeof(mock_mqtt_topic) - 1 ? topicLen : sizeof(mock_mqtt_topic) - 1;
+            memcpy(mock_mqtt_topic, body + 2, n);
+            mock_mqtt_topic[n] = '\0';
+            size_t pos = 2 + topicLen + (qos ? 2 : 0);
+            if (pos > len) return;
+            mock_mqtt_payload_len = len - pos < sizeof(mock_mqtt_payload) ? len - pos : sizeof(mock_mqtt_payload);
+            memcpy(mock_mqtt_payload, body + pos, mock_mqtt_payload_len);
+            mock_mqtt_qos = qos;
+            mock_mqtt_dup = (type & 0x08) != 0;
+            if (qos) mock_mqtt_packet_id = mqttU16(body + 2 + topicLen);
+            if (qos == 1 && !mock_mqtt_silent) {
+                uint8_t puback[4] = {0x40, 0x02, body[2 + topicLen], body[3 + topicLen]};
+                queueReply(puback, 4);
+            }
+            return;
+        }
+        case 12: {  // PINGREQ
+            if (mock_mqtt_silent) return;
+            uint8_t pingresp[2] = {0xD0, 0x00};
+            queueReply(pingresp, 2);
+            return;
+        }
+        default:
+            return;
+    }
+}
+
+// Append written bytes and handle every complete packet
+static void mqttReceive(const uint8_t* buf, size_t size) {
+    if (mock_mqtt_in_len + size > sizeof(mock_mqtt_in)) mock_mqtt_in_len = 0;
+    memcpy(mock_mqtt_in + mock_mqtt_in_len, buf, size);
+    mock_mqtt_in_len += size;
+    size_t pos = 0;
+    while (pos + 2 <= mock_mqtt_in_len) {
+        size_t remaining = 0, header = 1;
+        int shift = 0;
+        bool more = true;
+        while (more && pos + header < mock_mqtt_in_len && header <= 4) {
+            uint8_t b = mock_mqtt_in[pos + header++];
+            remaining |= (size_t)(b & 0x7F) << shift;
+            shift += 7;
+            more = (b & 0x80) != 0;
+        }
+        if (more || pos + header + remaining > mock_mqtt_in_len) break;
+        mqttPacket(mock_mqtt_in[pos], mock_mqtt_in + pos + header, remaining);
+        pos += header + remaining;
+    }
+    memmove(mock_mqtt_in, mock_mqtt_in + pos, mock_mqtt_in_len - pos);
+    mock_mqtt_in_len -= pos;
+}
+
+size_t MockWiFiClient::write(const uint8_t* buf, size_t size) {
+    mock_bytes_written += size;
+    size_t n = size < sizeof(mock_last_request) - 1 ? size : sizeof(mock_last_request) - 1;
+    memcpy(mock_last_request, buf, n);
+    mock_last_request[n] = '\0';
+    mock_last_request_len = n;
+
+    if (mock_mqtt_enabled) {
+        mqttReceive(buf, size);
+        return size;
+    }
+
+    // A blank line ends the request headers: queue the scripted response
+    bool requestEnd = size >= 4 && memcmp(buf + size - 4, "\r\n\r\n", 4) == 0;
+    if (requestEnd) mock_requests++;
+    if (mock_response && requestEnd) {
+        queueReply((const uint8_t*)mock_response, strlen(mock_response));
+    }
+    return size;
 }
 
 int MockWiFiClient::available() {
+    if (mock_rx_pos < mock_rx_len && (long)(mock_millis_value - mock_rx_ready_at) >= 0) {
+        return (int)(mock_rx_len - mock_rx_pos);
+    }
+    // Each empty poll costs 1 ms so busy-wait timeouts terminate
+    mock_millis_value += mock_empty_poll_cost;
+    if (mock_empty_poll_cost) clockAdvanced();
     return 0;
 }
 
+int MockWiFiClient::read() {
+    if (mock_rx_pos < mock_rx_len && (long)(mock_millis_value - mock_rx_ready_at) >= 0) {
+        mock_bytes_read++;
+        return (unsigned char)mock_rx[mock_rx_pos++];
+    }
+    return -1;
+}
+
 String MockWiFiClient::readStringUntil(char terminator) {
     return String("HTTP/1.1 200 OK");
 }
@@ -64,24 +324,182 @@ String MockWiFiClient::readStringUntil(char terminator) {
 extern "C" {
     void mock_set_millis(unsigned long value) {
         mock_millis_value = value;
+        mock_micros_extra = 0;
+        clockAdvanced();
+    }
+
+    void mock_set_micros(unsigned long value) {
+        mock_millis_value = value / 1000;
+        mock_micros_extra = value % 1000;
+        clockAdvanced();
     }
     
     void mock_set_wifi_status(int status) {
         mock_wifi_status = status;
     }
     
+    unsigned long mock_wifi_begin_count() {
+        return mock_wifi_begins;
+    }
+
+    void mock_set_wifi_connect_delay(unsigned long ms) {
+        mock_wifi_connect_delay = ms;
+    }
+
     void mock_set_analog_value(int value) {
         mock_analog_value = value;
     }
+
+    void mock_set_analog_pin_value(uint8_t pin, int value) {
+        if (!mock_analog_pins_set) {
+            for (int i = 0; i < MOCK_ANALOG_PINS; i++) mock_analog_pin_value[i] = -1;
+            mock_analog_pins_set = true;
+        }
+        if (pin < MOCK_ANALOG_PINS) mock_analog_pin_value[pin] = value;
+    }
+
+    void mock_set_analog_noise(int codes) {
+        mock_analog_noise = codes;
+    }
     
     void mock_set_client_connected(bool connected) {
         mock_client_connected = connected;
     }
+
+    void mock_set_client_response(const char* response) {
+        mock_response = response;
+    }
+
+    void mock_set_server_closes(bool closes) {
+        mock_server_closes = closes;
+    }
+
+    void mock_set_response_delay(unsigned long ms) {
+        mock_response_delay = ms;
+    }
+
+    void mock_set_empty_poll_cost(unsigned long ms) {
+        mock_empty_poll_cost = ms;
+    }
+
+    void mock_drop_connection() {
+        mock_client_open = false;
+        mock_rx_len = mock_rx_pos = 0;
+        mock_mqtt_in_len = 0;
+    }
+
+    unsigned long mock_client_requests() {
+        return mock_requests;
+    }
+
+    unsigned long mock_client_connect_attempts() {
+        return mock_connect_attempts;
+    }
+
+    unsigned long mock_client_connects() {
+        return mock_connects;
+    }
+
+    unsigned long mock_client_bytes_written() {
+        return mock_bytes_written;
+    }
+
+    const char* mock_client_last_request() {
+        return mock_last_request;
+    }
+
+    unsigned long mock_client_bytes_read() {
+        return mock_bytes_read;
+    }
+
+    void mock_set_mqtt_broker(bool enabled) {
+        mock_mqtt_enabled = enabled;
+    }
+
+    void mock_set_mqtt_connack(int code) {
+        mock_mqtt_connack_code = code;
+    }
+
+    void mock_set_mqtt_silent(bool silent) {
+        mock_mqtt_silent = silent;
+    }
+
+    unsigned long mock_mqtt_packets(int type) {
+        return type >= 0 && type < 16 ? mock_mqtt_counts[type] : 0;
+    }
+
+    const char* mock_mqtt_last_topic() {
+        return mock_mqtt_topic;
+    }
+
+    const uint8_t* mock_mqtt_last_payload() {
+        return mock_mqtt_payload;
+    }
+
+    unsigned long mock_mqtt_last_payload_length() {
+        return mock_mqtt_payload_len;
+    }
+
+    int mock_mqtt_last_qos() {
+        return mock_mqtt_qos;
+    }
+
+    bool mock_mqtt_last_dup() {
+        return mock_mqtt_dup;
+    }
+
+    int mock_mqtt_last_packet_id() {
+        return mock_mqtt_packet_id;
+    }
+
+    int mock_mqtt_session_present() {
+        return mock_mqtt_present;
+    }
+
+    unsigned long mock_allocation_count() {
+        return mock_allocations;
+    }
     
     void mock_reset() {
         mock_millis_value = 0;
+        mock_micros_extra = 0;
         mock_wifi_status = WL_DISCONNECTED;
+        mock_wifi_begins = 0;
+        mock_wifi_connect_delay = 0;
+        WiFi.setTimeout(10000);
         mock_analog_value = 512;
+        mock_analog_pins_set = false;
+        mock_analog_bits = 10;
+        mock_analog_noise = 0;
+        mock_analog_rng = 1;
+        if (mock_adc_backend_reset) mock_adc_backend_reset();
         mock_client_connected = false;
+        mock_client_open = false;
+        mock_server_closes = false;
+        mock_connect_attempts = 0;
+        mock_connects = 0;
+        mock_bytes_written = 0;
+        mock_response = nullptr;
+        mock_response_delay = 0;
+        mock_rx_ready_at = 0;
+        mock_requests = 0;
+        mock_empty_poll_cost = 1;
+        mock_rx_len = mock_rx_pos = 0;
+        mock_last_request[0] = '\0';
+        mock_last_request_len = 0;
+        mock_bytes_read = 0;
+        mock_mqtt_enabled = false;
+        mock_mqtt_connack_code = 0;
+        mock_mqtt_silent = false;
+        mock_mqtt_closing = false;
+        mock_mqtt_in_len = 0;
+        mock_mqtt_session[0] = '\0';
+        memset(mock_mqtt_counts, 0, sizeof(mock_mqtt_counts));
+        mock_mqtt_topic[0] = '\0';
+        mock_mqtt_payload_len = 0;
+        mock_mqtt_qos = -1;
+        mock_mqtt_dup = false;
+        mock_mqtt_packet_id = -1;
+        mock_mqtt_present = -1;
     }
 }
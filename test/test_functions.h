@@ -8,12 +8,13 @@
 #include <WiFiS3.h>
 #endif
 
-// Sensor configuration (from main file)
-extern const float ADC_REF_V;
-extern const int ADC_MAX;
-extern const float V_MIN;
-extern const float V_MAX;
-extern const float FS_KPA;
+// Sensor configuration and conversions (shared with src/main.cpp):
+// ADC_REF_V, ADC_MAX, V_MIN, V_MAX, FS_KPA, clampf(), voltageToKpa(),
+// adcToVoltage() and the readingForCode() lookup table
+#include "SensorConversion.h"
+#include "HttpUploader.h"
+#include "MqttUploader.h"
+#include "WiFiConnection.h"
 
 // WiFi credentials
 extern const char* ssid;
@@ -24,20 +25,43 @@ extern const int serverPort;
 // WiFi client
 extern WiFiClient client;
 
-// Function declarations
-float clampf(float x, float a, float b);
-float voltageToKpa(float v);
-float readA0VoltageAveraged();
-void connectWiFi();
-void uploadToServer(float depth_m, float pressure_kpa, float volume_liters);
-
 // Mock control functions (only available in tests)
 #ifdef UNIT_TEST
 extern "C" {
     void mock_set_millis(unsigned long value);
+    void mock_set_micros(unsigned long value);
     void mock_set_wifi_status(int status);
+    unsigned long mock_wifi_begin_count();
+    void mock_set_wifi_connect_delay(unsigned long ms);
     void mock_set_analog_value(int value);
+    void mock_set_analog_pin_value(uint8_t pin, int value);
+    void mock_set_analog_noise(int codes);
+    bool mock_adc_backend_running();
+    unsigned long mock_adc_backend_samples();
     void mock_set_client_connected(bool connected);
+    void mock_set_client_response(const char* response);
+    void mock_set_server_closes(bool closes);
+    void mock_set_response_delay(unsigned long ms);
+    void mock_set_empty_poll_cost(unsigned long ms);
+    void mock_drop_connection();
+    unsigned long mock_client_requests();
+    unsigned long mock_client_connect_attempts();
+    unsigned long mock_client_connects();
+    unsigned long mock_client_bytes_written();
+    const char* mock_client_last_request();
+    unsigned long mock_client_bytes_read();
+    void mock_set_mqtt_broker(bool enabled);
+    void mock_set_mqtt_connack(int code);
+    void mock_set_mqtt_silent(bool silent);
+    unsigned long mock_mqtt_packets(int type);
+    const char* mock_mqtt_last_topic();
+    const uint8_t* mock_mqtt_last_payload();
+    unsigned long mock_mqtt_last_payload_length();
+    int mock_mqtt_last_qos();
+    bool mock_mqtt_last_dup();
+    int mock_mqtt_last_packet_id();
+    int mock_mqtt_session_present();
+    unsigned long mock_allocation_count();
     void mock_reset();
 }
 #endif
@@ -1,6 +1,16 @@
 #include <unity.h>
 #define UNIT_TEST
 #include "test_functions.h"
+#include "MedianFilter.h"
+#include "LoRaFrame.h"
+#include "lmic.h"
+#include "LoopProfiler.h"
+#include "ChangeReporter.h"
+#include "DeadlineScheduler.h"
+#include "BlockAdc.h"
+#include "TankArray.h"
+#include "TankGeometry.h"
+#include "LevelFilter.h"
 #include <math.h>
 
 // Test setup and teardown
@@ -110,257 +120,2562 @@ void test_voltageToKpa_negative_voltage(void) {
 }
 
 // ============================================================================
-// Test Case 3: readA0VoltageAveraged() returns an average voltage value
-//              within expected range
+// Test Case 3: adcToVoltage() converts codes and block averages
 // ============================================================================
 
-void test_readA0VoltageAveraged_zero_reading(void) {
-    mock_set_analog_value(0);
-    float result = readA0VoltageAveraged();
-    TEST_ASSERT_EQUAL_FLOAT(0.0f, result);
+void test_adcToVoltage_zero_code(void) {
+    TEST_ASSERT_EQUAL_FLOAT(0.0f, adcToVoltage(0.0f));
 }
 
-void test_readA0VoltageAveraged_max_reading(void) {
+void test_adcToVoltage_max_code(void) {
     // ADC_MAX = 1023, ADC_REF_V = 5.00V
-    mock_set_analog_value(1023);
-    float result = readA0VoltageAveraged();
-    TEST_ASSERT_EQUAL_FLOAT(5.0f, result);
+    TEST_ASSERT_EQUAL_FLOAT(5.0f, adcToVoltage(1023.0f));
 }
 
-void test_readA0VoltageAveraged_mid_reading(void) {
+void test_adcToVoltage_mid_code(void) {
     // Half of ADC_MAX should give half of ADC_REF_V
-    mock_set_analog_value(512);
-    float result = readA0VoltageAveraged();
-    TEST_ASSERT_FLOAT_WITHIN(0.01f, 2.505f, result);  // 512/1023 * 5.0 ≈ 2.505
+    TEST_ASSERT_FLOAT_WITHIN(0.01f, 2.505f, adcToVoltage(512.0f));  // 512/1023 * 5.0 ≈ 2.505
 }
 
-void test_readA0VoltageAveraged_quarter_reading(void) {
-    // Quarter of ADC_MAX
-    mock_set_analog_value(256);
-    float result = readA0VoltageAveraged();
-    TEST_ASSERT_FLOAT_WITHIN(0.01f, 1.252f, result);  // 256/1023 * 5.0 ≈ 1.252
+void test_adcToVoltage_quarter_code(void) {
+    TEST_ASSERT_FLOAT_WITHIN(0.01f, 1.252f, adcToVoltage(256.0f));  // 256/1023 * 5.0 ≈ 1.252
 }
 
-void test_readA0VoltageAveraged_within_expected_range(void) {
-    // Test with a typical sensor value
-    mock_set_analog_value(700);
-    float result = readA0VoltageAveraged();
-    
-    // Result should be within 0V to 5V range
+void test_adcToVoltage_within_expected_range(void) {
+    // A typical sensor value, around 3.42V (700/1023 * 5.0)
+    float result = adcToVoltage(700.0f);
     TEST_ASSERT_TRUE(result >= 0.0f);
     TEST_ASSERT_TRUE(result <= 5.0f);
-    
-    // More specifically, should be around 3.42V (700/1023 * 5.0)
     TEST_ASSERT_FLOAT_WITHIN(0.01f, 3.421f, result);
 }
 
-void test_readA0VoltageAveraged_samples_multiple_times(void) {
-    // The function samples 10 times, each with 10ms delay
-    // This should advance millis by 100ms total
-    mock_set_millis(0);
-    mock_set_analog_value(500);
-    
-    readA0VoltageAveraged();
-    
-    // Verify that time has advanced (10 samples * 10ms each = 100ms)
-    TEST_ASSERT_EQUAL_UINT32(100, millis());
+void test_adcToVoltage_fractional_code(void) {
+    // Block averages land between codes
+    TEST_ASSERT_FLOAT_WITHIN(0.0001f, 3.4238f, adcToVoltage(700.5f));  // 700.5/1023 * 5.0
 }
 
 // ============================================================================
-// Test Case 4: connectWiFi() handles WiFi connection attempts and
-//              timeouts properly
+// Test Case 4: WiFiConnectionManager connects in the background with
+//              exponential backoff and never blocks loop()
 // ============================================================================
 
-void test_connectWiFi_already_connected(void) {
+// Run a loop() stand-in for durationMs of mock time in 1 ms steps: poll
+// "LMIC", then tick the manager. Returns the longest gap between polls.
+static unsigned long runWiFiLoop(WiFiConnectionManager& wifi, unsigned long durationMs,
+                                 unsigned long* lmicPolls) {
+    unsigned long worstGap = 0;
+    unsigned long lastPoll = millis();
+    unsigned long end = millis() + durationMs;
+    while (millis() < end) {
+        unsigned long now = millis();
+        if (now - lastPoll > worstGap) worstGap = now - lastPoll;
+        lastPoll = now;
+        if (lmicPolls) (*lmicPolls)++;
+
+        wifi.tick();
+        mock_set_millis(millis() + 1);
+    }
+    return worstGap;
+}
+
+void test_wifiManager_already_connected(void) {
+    WiFiConnectionManager wifi(ssid, password);
     mock_set_wifi_status(WL_CONNECTED);
     mock_set_millis(0);
-    
-    connectWiFi();
-    
-    // Should return immediately without waiting
-    TEST_ASSERT_EQUAL_UINT32(0, millis());
+
+    wifi.begin();
+    runWiFiLoop(wifi, 300, nullptr);
+
+    TEST_ASSERT_TRUE(wifi.connected());
+    TEST_ASSERT_EQUAL_UINT32(1, mock_wifi_begin_count());
 }
 
-void test_connectWiFi_successful_connection(void) {
+void test_wifiManager_begin_does_not_block(void) {
+    WiFiConnectionManager wifi(ssid, password);
     mock_set_wifi_status(WL_DISCONNECTED);
+    mock_set_wifi_connect_delay(10000);  // Access point out of reach
     mock_set_millis(0);
-    
-    // Simulate connection after some delay
-    // Note: In real implementation, WiFi.status() would change during the loop
-    // For this mock, we'll test the timeout behavior
-    connectWiFi();
-    
-    // The function should have attempted connection
-    // With our mock always returning WL_DISCONNECTED, it will timeout
+
+    wifi.begin();
+    wifi.tick();
+
+    // The old connectWiFi() spent up to 15 s here, and WiFiS3's own
+    // begin() 10 s
+    TEST_ASSERT_LESS_OR_EQUAL_UINT32(WiFiConnectionManager::BEGIN_WAIT_MS, millis());
+    TEST_ASSERT_EQUAL_INT(WiFiConnectionManager::CONNECTING, wifi.state());
 }
 
-void test_connectWiFi_timeout_behavior(void) {
+void test_wifiManager_connects_when_link_comes_up(void) {
+    WiFiConnectionManager wifi(ssid, password);
     mock_set_wifi_status(WL_DISCONNECTED);
     mock_set_millis(0);
-    
-    connectWiFi();
-    
-    // Should timeout after 15000ms (15 seconds)
-    // The loop delays 500ms each iteration
-    // 15000 / 500 = 30 iterations maximum
-    unsigned long elapsed = millis();
-    TEST_ASSERT_TRUE(elapsed >= 15000);
+
+    wifi.begin();
+    runWiFiLoop(wifi, 3000, nullptr);
+    TEST_ASSERT_FALSE(wifi.connected());
+
+    mock_set_wifi_status(WL_CONNECTED);
+    runWiFiLoop(wifi, 300, nullptr);
+    TEST_ASSERT_TRUE(wifi.connected());
+    TEST_ASSERT_EQUAL_UINT32(1, wifi.attempts());
 }
 
-void test_connectWiFi_respects_15_second_timeout(void) {
+void test_wifiManager_times_out_into_backoff(void) {
+    WiFiConnectionManager wifi(ssid, password);
     mock_set_wifi_status(WL_DISCONNECTED);
     mock_set_millis(0);
-    
-    connectWiFi();
-    
-    // Elapsed time should not exceed 15 seconds by much
-    // Allowing some overhead for the final iteration
-    unsigned long elapsed = millis();
-    TEST_ASSERT_TRUE(elapsed <= 16000);
+
+    wifi.begin();
+    runWiFiLoop(wifi, 15500, nullptr);
+
+    TEST_ASSERT_EQUAL_INT(WiFiConnectionManager::BACKOFF, wifi.state());
+    TEST_ASSERT_EQUAL_UINT32(5000, wifi.backoffMs());
+    TEST_ASSERT_EQUAL_UINT16(1, wifi.consecutiveFailures());
 }
 
-void test_connectWiFi_calls_wifi_begin(void) {
+void test_wifiManager_backoff_grows_and_caps(void) {
+    WiFiConnectionManager wifi(ssid, password);
     mock_set_wifi_status(WL_DISCONNECTED);
-    
-    // This test verifies the function doesn't crash
-    // and completes (WiFi.begin is called internally)
-    connectWiFi();
-    
-    TEST_ASSERT_TRUE(true);  // If we get here, function executed
+    mock_set_millis(0);
+
+    wifi.begin();
+    // Attempt (15 s) + backoff 5, 10, 20, 40 s...
+    runWiFiLoop(wifi, 15000 + 5000 + 15000 + 10000 + 15000 + 500, nullptr);
+    TEST_ASSERT_EQUAL_UINT32(20000, wifi.backoffMs());
+
+    runWiFiLoop(wifi, 2 * 3600000UL, nullptr);
+    TEST_ASSERT_EQUAL_UINT32(300000, wifi.backoffMs());
+}
+
+void test_wifiManager_outage_keeps_lmic_cadence(void) {
+    // Connected, then a 10 minute outage, then recovery
+    // begin() runs into WiFiS3's full wait unless the manager bounds it
+    WiFiConnectionManager wifi(ssid, password);
+    unsigned long lmicPolls = 0;
+    mock_set_wifi_status(WL_CONNECTED);
+    mock_set_wifi_connect_delay(10000);
+    mock_set_millis(0);
+    wifi.begin();
+    unsigned long worstGap = runWiFiLoop(wifi, 60000, &lmicPolls);
+    TEST_ASSERT_TRUE(wifi.connected());
+
+    mock_set_wifi_status(WL_CONNECTION_LOST);
+    uint32_t beginsBefore = mock_wifi_begin_count();
+    unsigned long gap = runWiFiLoop(wifi, 600000, &lmicPolls);
+    if (gap > worstGap) worstGap = gap;
+    uint32_t outageAttempts = mock_wifi_begin_count() - beginsBefore;
+    TEST_ASSERT_FALSE(wifi.connected());
+
+    mock_set_wifi_status(WL_CONNECTED);
+    gap = runWiFiLoop(wifi, 200000, &lmicPolls);
+    if (gap > worstGap) worstGap = gap;
+
+    // os_runloop_once() would have been called every 1 ms, except for one
+    // bounded begin() per reconnect attempt
+    const unsigned long beginWait = WiFiConnectionManager::BEGIN_WAIT_MS;
+    uint32_t loopBegins = mock_wifi_begin_count() - 1;
+    TEST_ASSERT_LESS_OR_EQUAL_UINT32(beginWait + 1, worstGap);
+    TEST_ASSERT_EQUAL_UINT32(860000 - beginWait * loopBegins, lmicPolls);
+    TEST_ASSERT_TRUE(wifi.connected());
+
+    // Backoff keeps reconnect attempts rare: 7 tries in a 10 minute outage
+    // (immediate, then after 5, 10, 20, 40, 80, 160 s) rather than 40
+    TEST_ASSERT_EQUAL_UINT32(7, outageAttempts);
 }
 
 // ============================================================================
-// Test Case 5: uploadToServer() attempts connection and sends correct
-//              HTTP GET request with parameters
+// Test Case 5: HttpUploader sends keep-alive GET requests without blocking
+//              or allocating
 // ============================================================================
 
-void test_uploadToServer_wifi_not_connected(void) {
+static const char* HTTP_OK_RESPONSE =
+    "HTTP/1.1 200 OK\r\n"
+    "Content-Type: application/json\r\n"
+    "Content-Length: 16\r\n"
+    "\r\n"
+    "{\"status\": \"ok\"}";
+
+static PackedReading testReading(uint16_t depth, uint16_t pressure, uint32_t volume) {
+    PackedReading r;
+    r.voltage = 0;
+    r.pressure = pressure;
+    r.depth = depth;
+    r.volume = volume;
+    return r;
+}
+
+// Poll until the uploader goes idle (bounded so a bug cannot hang the suite)
+static void drainResponse(HttpUploader& uploader) {
+    for (int i = 0; i < 100 && uploader.busy(); i++) {
+        uploader.poll();
+    }
+}
+
+void test_uploader_wifi_not_connected(void) {
+    HttpUploader uploader(client, serverHost, serverPort);
     mock_set_wifi_status(WL_DISCONNECTED);
-    mock_set_millis(0);
-    
-    uploadToServer(1.5f, 5.25f, 47.12f);
-    
+    mock_set_client_connected(true);
+
+    TEST_ASSERT_FALSE(uploader.upload(testReading(1500, 525, 4712)));
+
     // Should return early without attempting server connection
-    // No time should have passed
-    TEST_ASSERT_EQUAL_UINT32(0, millis());
+    TEST_ASSERT_EQUAL_UINT32(0, mock_client_connect_attempts());
+    TEST_ASSERT_FALSE(uploader.busy());
 }
 
-void test_uploadToServer_server_connection_fails(void) {
+void test_uploader_server_connection_fails(void) {
+    HttpUploader uploader(client, serverHost, serverPort);
     mock_set_wifi_status(WL_CONNECTED);
     mock_set_client_connected(false);
     mock_set_millis(0);
-    
-    uploadToServer(1.5f, 5.25f, 47.12f);
-    
-    // Should attempt connection but fail early
+
+    TEST_ASSERT_FALSE(uploader.upload(testReading(1500, 525, 4712)));
+
+    TEST_ASSERT_EQUAL_UINT32(1, mock_client_connect_attempts());
+    TEST_ASSERT_EQUAL_UINT32(1, uploader.failures());
+    TEST_ASSERT_FALSE(uploader.busy());
     TEST_ASSERT_EQUAL_UINT32(0, millis());
 }
 
-void test_uploadToServer_successful_connection_sends_request(void) {
+void test_uploader_formats_request(void) {
+    HttpUploader uploader(client, serverHost, serverPort);
+    mock_set_wifi_status(WL_CONNECTED);
+    mock_set_client_connected(true);
+
+    TEST_ASSERT_TRUE(uploader.upload(testReading(1500, 525, 4712)));
+
+    TEST_ASSERT_EQUAL_STRING(
+        "GET /update?depth=1.500&pressure=5.25&volume=47.12 HTTP/1.1\r\n"
+        "Host: 192.168.55.192\r\n"
+        "Connection: keep-alive\r\n\r\n",
+        mock_client_last_request());
+}
+
+void test_uploader_formats_small_values_with_leading_zeros(void) {
+    HttpUploader uploader(client, serverHost, serverPort);
+    mock_set_wifi_status(WL_CONNECTED);
+    mock_set_client_connected(true);
+
+    uploader.upload(testReading(7, 0, 5));
+
+    TEST_ASSERT_TRUE(strncmp(mock_client_last_request(),
+                             "GET /update?depth=0.007&pressure=0.00&volume=0.05 ", 50) == 0);
+}
+
+void test_uploader_upload_does_not_block(void) {
+    // The old uploadToServer() busy-waited up to 5 s for the response
+    HttpUploader uploader(client, serverHost, serverPort);
     mock_set_wifi_status(WL_CONNECTED);
     mock_set_client_connected(true);
     mock_set_millis(0);
-    
-    // This will attempt to send the request
-    // The mock client.available() returns 0, so it will timeout
-    uploadToServer(1.5f, 5.25f, 47.12f);
-    
-    // Should timeout after 5000ms waiting for response
-    unsigned long elapsed = millis();
-    TEST_ASSERT_TRUE(elapsed >= 5000);
+
+    TEST_ASSERT_TRUE(uploader.upload(testReading(1000, 200, 300)));
+
+    TEST_ASSERT_EQUAL_UINT32(0, millis());
+    TEST_ASSERT_TRUE(uploader.busy());
 }
 
-void test_uploadToServer_formats_parameters_correctly(void) {
+void test_uploader_poll_completes_response(void) {
+    HttpUploader uploader(client, serverHost, serverPort);
     mock_set_wifi_status(WL_CONNECTED);
     mock_set_client_connected(true);
-    
-    // Test that the function doesn't crash with various parameter values
-    uploadToServer(0.0f, 0.0f, 0.0f);
-    mock_reset();
+    mock_set_client_response(HTTP_OK_RESPONSE);
+
+    uploader.upload(testReading(1000, 200, 300));
+    drainResponse(uploader);
+
+    TEST_ASSERT_FALSE(uploader.busy());
+    TEST_ASSERT_EQUAL_INT(200, uploader.lastStatus());
+    TEST_ASSERT_EQUAL_UINT32(1, uploader.completed());
+    TEST_ASSERT_TRUE(client.connected());  // kept alive
+}
+
+void test_uploader_reuses_connection_without_allocating(void) {
+    HttpUploader uploader(client, serverHost, serverPort);
     mock_set_wifi_status(WL_CONNECTED);
     mock_set_client_connected(true);
-    
-    uploadToServer(1.234f, 5.67f, 89.12f);
-    mock_reset();
+    mock_set_client_response(HTTP_OK_RESPONSE);
+
+    unsigned long allocationsBefore = mock_allocation_count();
+    for (int i = 0; i < 1000; i++) {
+        TEST_ASSERT_TRUE(uploader.upload(testReading((uint16_t)i, 200, 300)));
+        drainResponse(uploader);
+    }
+
+    TEST_ASSERT_EQUAL_UINT32(1, mock_client_connects());
+    TEST_ASSERT_EQUAL_UINT32(0, mock_allocation_count() - allocationsBefore);
+    TEST_ASSERT_EQUAL_UINT32(1000, uploader.completed());
+    TEST_ASSERT_EQUAL_UINT32(0, uploader.failures());
+}
+
+void test_uploader_reconnects_after_server_close(void) {
+    HttpUploader uploader(client, serverHost, serverPort);
     mock_set_wifi_status(WL_CONNECTED);
     mock_set_client_connected(true);
-    
-    uploadToServer(10.999f, 99.99f, 999.99f);
-    
-    TEST_ASSERT_TRUE(true);  // If we get here, all calls succeeded
+    mock_set_client_response("HTTP/1.0 200 OK\r\nConnection: close\r\n\r\ndone");
+    mock_set_server_closes(true);
+
+    for (int i = 0; i < 3; i++) {
+        TEST_ASSERT_TRUE(uploader.upload(testReading(1000, 200, 300)));
+        drainResponse(uploader);
+    }
+
+    // Body delimited by close still completes; each upload reopens lazily
+    TEST_ASSERT_EQUAL_UINT32(3, uploader.completed());
+    TEST_ASSERT_EQUAL_UINT32(3, mock_client_connects());
 }
 
-void test_uploadToServer_respects_5_second_timeout(void) {
+void test_uploader_respects_5_second_timeout(void) {
+    HttpUploader uploader(client, serverHost, serverPort);
     mock_set_wifi_status(WL_CONNECTED);
     mock_set_client_connected(true);
     mock_set_millis(0);
-    
-    uploadToServer(1.0f, 2.0f, 3.0f);
-    
-    // Should timeout after approximately 5000ms
-    unsigned long elapsed = millis();
-    TEST_ASSERT_TRUE(elapsed >= 5000);
-    TEST_ASSERT_TRUE(elapsed <= 6000);
+
+    uploader.upload(testReading(1000, 200, 300));
+
+    mock_set_millis(4000);
+    uploader.poll();
+    TEST_ASSERT_TRUE(uploader.busy());
+
+    mock_set_millis(5100);
+    uploader.poll();
+    TEST_ASSERT_FALSE(uploader.busy());
+    TEST_ASSERT_EQUAL_UINT32(1, uploader.failures());
+    TEST_ASSERT_FALSE(client.connected());
 }
 
-void test_uploadToServer_handles_negative_values(void) {
+void test_uploader_waits_for_slow_response(void) {
+    HttpUploader uploader(client, serverHost, serverPort);
     mock_set_wifi_status(WL_CONNECTED);
     mock_set_client_connected(true);
-    
-    // Test with negative values (edge case)
-    uploadToServer(-1.0f, -2.0f, -3.0f);
-    
-    TEST_ASSERT_TRUE(true);  // Should not crash
+    mock_set_client_response(HTTP_OK_RESPONSE);
+    mock_set_response_delay(300);
+    mock_set_empty_poll_cost(0);
+    mock_set_millis(0);
+
+    uploader.upload(testReading(1000, 200, 300));
+    mock_set_millis(299);
+    drainResponse(uploader);
+    TEST_ASSERT_TRUE(uploader.busy());
+
+    mock_set_millis(300);
+    drainResponse(uploader);
+    TEST_ASSERT_FALSE(uploader.busy());
+    TEST_ASSERT_EQUAL_INT(200, uploader.lastStatus());
+
+    // A drop mid-response fails the request instead of waiting out the timeout
+    uploader.upload(testReading(1000, 200, 300));
+    mock_drop_connection();
+    drainResponse(uploader);
+    TEST_ASSERT_FALSE(uploader.busy());
+    TEST_ASSERT_EQUAL_UINT32(1, uploader.failures());
+}
+
+void test_uploader_skips_while_response_pending(void) {
+    HttpUploader uploader(client, serverHost, serverPort);
+    mock_set_wifi_status(WL_CONNECTED);
+    mock_set_client_connected(true);
+
+    TEST_ASSERT_TRUE(uploader.upload(testReading(1000, 200, 300)));
+    TEST_ASSERT_FALSE(uploader.upload(testReading(1001, 200, 300)));
+    TEST_ASSERT_EQUAL_UINT32(1, mock_client_connects());
+}
+
+// ============================================================================
+// Test Case 6: Median filters match a sorted reference
+// ============================================================================
+
+// Reference median: insertion sort, as in readA0VoltageMedian()
+static int sortedMedian(const int* src, int n) {
+    int vals[128];
+    for (int i = 0; i < n; i++) vals[i] = src[i];
+    for (int i = 1; i < n; i++) {
+        int key = vals[i];
+        int j = i - 1;
+        while (j >= 0 && vals[j] > key) {
+            vals[j + 1] = vals[j];
+            j--;
+        }
+        vals[j + 1] = key;
+    }
+    if (n & 1) return vals[n / 2];
+    return (vals[n / 2 - 1] + vals[n / 2]) / 2;
+}
+
+static uint32_t testRandState = 1;
+static int testRand(int range) {
+    testRandState = testRandState * 1103515245u + 12345u;
+    return (int)((testRandState >> 16) % (uint32_t)range);
+}
+
+void test_medianSelect_odd_counts_match_sort(void) {
+    int vals[101];
+    for (int n = 5; n <= 101; n += 2) {
+        for (int i = 0; i < n; i++) vals[i] = testRand(1024);
+        int expected = sortedMedian(vals, n);
+        TEST_ASSERT_EQUAL_INT(expected, medianSelect(vals, n));
+    }
+}
+
+void test_medianSelect_even_count_averages_middle_pair(void) {
+    int vals[] = { 40, 10, 30, 20 };
+    TEST_ASSERT_EQUAL_INT(25, medianSelect(vals, 4));
+}
+
+void test_medianSelect_handles_duplicates(void) {
+    int vals[51];
+    for (int i = 0; i < 51; i++) vals[i] = testRand(3);  // heavy ties
+    int expected = sortedMedian(vals, 51);
+    TEST_ASSERT_EQUAL_INT(expected, medianSelect(vals, 51));
+}
+
+void test_medianSelect_rejects_spike(void) {
+    int vals[] = { 512, 511, 1023, 513, 512 };
+    TEST_ASSERT_EQUAL_INT(512, medianSelect(vals, 5));
+}
+
+void test_runningMedian_matches_sliding_reference(void) {
+    RunningMedian<51> running;
+    int history[600];
+    for (int i = 0; i < 600; i++) {
+        history[i] = testRand(1024);
+        running.add(history[i]);
+
+        int n = (i + 1 < 51) ? i + 1 : 51;
+        int expected = sortedMedian(&history[i + 1 - n], n);
+        TEST_ASSERT_EQUAL_INT(expected, running.median());
+    }
+    TEST_ASSERT_TRUE(running.full());
+}
+
+void test_blockMedian_matches_sliding_reference(void) {
+    BlockMedian<11> block;
+    int history[200];
+    for (int i = 0; i < 200; i++) {
+        history[i] = testRand(64);
+        block.add(history[i]);
+
+        int n = (i + 1 < 11) ? i + 1 : 11;
+        TEST_ASSERT_EQUAL_INT(sortedMedian(&history[i + 1 - n], n), block.median());
+    }
+}
+
+void test_medianFilter_alias_defaults_to_block(void) {
+    MedianFilter<5> filter;
+    int samples[] = { 500, 900, 510, 505, 100 };
+    for (int i = 0; i < 5; i++) filter.add(samples[i]);
+    TEST_ASSERT_EQUAL_INT(505, filter.median());
+    TEST_ASSERT_EQUAL_UINT8(5, filter.count());
+}
+
+// ============================================================================
+// Test Case 7: Compile-time ADC lookup table matches the float pipeline
+// ============================================================================
+
+// Built at compile time; fails the build rather than the test run
+static_assert(makeSensorTable().entries[ADC_MAX].voltage == 5000,
+              "full-scale code must pack to 5.000 V");
+
+// Float pipeline as previously computed per reading in loop()/do_send()
+static PackedReading floatPipeline(int code) {
+    float voltage = ((float)code * ADC_REF_V) / (float)ADC_MAX;
+    float pressure_kpa = voltageToKpa(voltage);
+    float depth_m = pressure_kpa * 0.10197162f;
+    float volume_m3 = PI * TANK_RADIUS_M * TANK_RADIUS_M * depth_m;
+    float volume_liters = volume_m3 * 1000.0f;
+
+    PackedReading packed;
+    packed.voltage = (uint16_t)(voltage * 1000.0f);
+    packed.pressure = (uint16_t)(pressure_kpa * 100.0f);
+    packed.depth = (uint16_t)(depth_m * 1000.0f);
+    packed.volume = (uint16_t)(volume_liters * 100.0f);
+    return packed;
+}
+
+void test_sensorTable_matches_float_pipeline_for_every_code(void) {
+    for (int code = 0; code <= ADC_MAX; code++) {
+        PackedReading expected = floatPipeline(code);
+        const PackedReading& actual = readingForCode((uint16_t)code);
+        TEST_ASSERT_EQUAL_UINT16(expected.voltage, actual.voltage);
+        TEST_ASSERT_EQUAL_UINT16(expected.pressure, actual.pressure);
+        TEST_ASSERT_EQUAL_UINT16(expected.depth, actual.depth);
+        TEST_ASSERT_EQUAL_UINT16(expected.volume, actual.volume);
+    }
+}
+
+void test_sensorTable_below_vmin_reads_empty(void) {
+    // 0.40 V is below V_MIN = 0.50 V
+    const PackedReading& r = readingForCode(82);
+    TEST_ASSERT_EQUAL_UINT16(400, r.voltage);
+    TEST_ASSERT_EQUAL_UINT16(0, r.pressure);
+    TEST_ASSERT_EQUAL_UINT16(0, r.depth);
+    TEST_ASSERT_EQUAL_UINT16(0, r.volume);
+}
+
+void test_sensorTable_full_scale(void) {
+    // 4.50 V and above clamp to FS_KPA = 10 kPa
+    const PackedReading& r = readingForCode(ADC_MAX);
+    TEST_ASSERT_EQUAL_UINT16(1000, r.pressure);
+    TEST_ASSERT_EQUAL_UINT16(1019, r.depth);  // 10 kPa * 0.10197 m/kPa
+}
+
+void test_sensorTable_clamps_out_of_range_codes(void) {
+    const PackedReading& top = readingForCode(ADC_MAX);
+    const PackedReading& beyond = readingForCode(4095);
+    TEST_ASSERT_EQUAL_PTR(&top, &beyond);
+}
+
+// ============================================================================
+// Test Case 8: Reading buffer keeps readings through outages and uploads
+//              them in batches
+// ============================================================================
+
+static void pushReadings(ReadingRing& ring, int count, uint32_t startMs) {
+    for (int i = 0; i < count; i++) {
+        ring.push(startMs + (uint32_t)i * 5000, testReading((uint16_t)(100 + i), 50, 25));
+    }
+}
+
+void test_readingBuffer_keeps_fifo_order(void) {
+    ReadingBuffer<8> ring;
+    pushReadings(ring, 3, 0);
+
+    TEST_ASSERT_EQUAL_UINT16(3, ring.size());
+    TEST_ASSERT_EQUAL_UINT16(100, ring.at(0).reading.depth);
+    TEST_ASSERT_EQUAL_UINT16(102, ring.at(2).reading.depth);
+    TEST_ASSERT_EQUAL_UINT32(10000, ring.at(2).timestamp);
+}
+
+void test_readingBuffer_drops_oldest_when_full(void) {
+    ReadingBuffer<4> ring;
+    pushReadings(ring, 6, 0);
+
+    TEST_ASSERT_EQUAL_UINT16(4, ring.size());
+    TEST_ASSERT_EQUAL_UINT32(2, ring.dropped());
+    TEST_ASSERT_EQUAL_UINT32(2, ring.firstSeq());
+    TEST_ASSERT_EQUAL_UINT16(102, ring.at(0).reading.depth);
+}
+
+void test_readingBuffer_discard_survives_overwrite(void) {
+    ReadingBuffer<4> ring;
+    pushReadings(ring, 4, 0);
+    uint32_t sentThrough = ring.firstSeq() + 1;  // rows 0 and 1 in flight
+
+    // Two more readings overwrite the in-flight rows before the ack
+    pushReadings(ring, 2, 20000);
+    ring.discardThrough(sentThrough);
+
+    TEST_ASSERT_EQUAL_UINT16(4, ring.size());
+    TEST_ASSERT_EQUAL_UINT16(102, ring.at(0).reading.depth);
+}
+
+void test_uploader_batch_body_format(void) {
+    HttpUploader uploader(client, serverHost, serverPort);
+    ReadingBuffer<8> ring;
+    mock_set_wifi_status(WL_CONNECTED);
+    mock_set_client_connected(true);
+
+    ring.push(1000, testReading(1234, 1210, 952));
+    ring.push(6000, testReading(1240, 1216, 957));
+    mock_set_millis(7000);
+
+    TEST_ASSERT_TRUE(uploader.uploadBatch(ring));
+    TEST_ASSERT_EQUAL_STRING("6000,0,1210,1234,952\n1000,0,1216,1240,957\n",
+                             uploader.lastBody());
+    TEST_ASSERT_EQUAL_STRING(
+        "POST /update/batch HTTP/1.1\r\n"
+        "Host: 192.168.55.192\r\n"
+        "Content-Type: text/csv\r\n"
+        "Content-Length: 42\r\n"
+        "Connection: keep-alive\r\n\r\n",
+        uploader.lastRequest());
+}
+
+void test_uploader_batch_discarded_only_after_ack(void) {
+    HttpUploader uploader(client, serverHost, serverPort);
+    ReadingBuffer<8> ring;
+    mock_set_wifi_status(WL_CONNECTED);
+    mock_set_client_connected(true);
+    mock_set_client_response(HTTP_OK_RESPONSE);
+    pushReadings(ring, 5, 0);
+
+    uploader.uploadBatch(ring);
+    TEST_ASSERT_EQUAL_UINT16(5, ring.size());  // still in flight
+
+    drainResponse(uploader);
+    TEST_ASSERT_TRUE(ring.empty());
+    TEST_ASSERT_TRUE(uploader.lastSucceeded());
+}
+
+void test_uploader_batch_kept_on_server_error(void) {
+    HttpUploader uploader(client, serverHost, serverPort);
+    ReadingBuffer<8> ring;
+    mock_set_wifi_status(WL_CONNECTED);
+    mock_set_client_connected(true);
+    mock_set_client_response("HTTP/1.1 500 Error\r\nContent-Length: 0\r\n\r\n");
+    pushReadings(ring, 5, 0);
+
+    uploader.uploadBatch(ring);
+    drainResponse(uploader);
+
+    TEST_ASSERT_EQUAL_UINT16(5, ring.size());
+    TEST_ASSERT_FALSE(uploader.lastSucceeded());
+}
+
+void test_uploader_skips_request_too_long_for_buffer(void) {
+    HttpUploader uploader(client, serverHost, serverPort);
+    ReadingBuffer<8> ring;
+    mock_set_wifi_status(WL_CONNECTED);
+    mock_set_client_connected(true);
+    mock_set_client_response(HTTP_OK_RESPONSE);
+    PackedReading reading = testReading(1500, 525, 4712);
+
+    TEST_ASSERT_TRUE(uploader.upload(reading));
+    drainResponse(uploader);
+    size_t plain = uploader.lastRequestLength();
+    unsigned long written = mock_client_bytes_written();
+
+    // An extra header that fills the buffer to the last byte still fits
+    static char header[HttpUploader::REQUEST_BUFFER_SIZE + 1];
+    size_t fits = HttpUploader::REQUEST_BUFFER_SIZE - 1 - plain - strlen("\r\nX-Device-Stats: ");
+    memset(header, 'x', fits);
+    header[fits] = '\0';
+    uploader.setExtraHeader(header);
+    TEST_ASSERT_TRUE(uploader.upload(reading));
+    drainResponse(uploader);
+    TEST_ASSERT_EQUAL_UINT32(HttpUploader::REQUEST_BUFFER_SIZE - 1, uploader.lastRequestLength());
+    TEST_ASSERT_EQUAL_UINT32(0, uploader.oversized());
+    written = mock_client_bytes_written();
+
+    // One byte more: nothing is sent rather than a request cut short
+    header[fits] = 'x';
+    header[fits + 1] = '\0';
+    TEST_ASSERT_FALSE(uploader.upload(reading));
+    TEST_ASSERT_FALSE(uploader.busy());
+    TEST_ASSERT_EQUAL_UINT32(1, uploader.oversized());
+    TEST_ASSERT_EQUAL_UINT32(written, mock_client_bytes_written());
+
+    // Same for a batch, whose rows stay buffered
+    pushReadings(ring, 5, 0);
+    TEST_ASSERT_FALSE(uploader.uploadBatch(ring));
+    TEST_ASSERT_FALSE(uploader.busy());
+    TEST_ASSERT_EQUAL_UINT32(2, uploader.oversized());
+    TEST_ASSERT_EQUAL_UINT32(written, mock_client_bytes_written());
+    TEST_ASSERT_EQUAL_UINT16(5, ring.size());
+
+    // Sent once the header is short again
+    uploader.setExtraHeader(0);
+    TEST_ASSERT_TRUE(uploader.uploadBatch(ring));
+    drainResponse(uploader);
+    TEST_ASSERT_EQUAL_UINT16(0, ring.size());
+    TEST_ASSERT_EQUAL_UINT32(2, uploader.oversized());
+}
+
+void test_uploader_backfills_outage_in_few_requests(void) {
+    // 10 minutes of 5 s readings while WiFi is down
+    HttpUploader uploader(client, serverHost, serverPort);
+    ReadingBuffer<360> ring;
+    mock_set_wifi_status(WL_DISCONNECTED);
+    pushReadings(ring, 120, 0);
+    TEST_ASSERT_FALSE(uploader.uploadBatch(ring));
+    TEST_ASSERT_EQUAL_UINT16(120, ring.size());
+
+    // WiFi back: drain everything
+    mock_set_wifi_status(WL_CONNECTED);
+    mock_set_client_connected(true);
+    mock_set_client_response(HTTP_OK_RESPONSE);
+    int requests = 0;
+    while (!ring.empty() && requests < 100) {
+        TEST_ASSERT_TRUE(uploader.uploadBatch(ring));
+        drainResponse(uploader);
+        requests++;
+    }
+
+    TEST_ASSERT_TRUE(ring.empty());
+    TEST_ASSERT_EQUAL_INT(5, requests);  // 120 readings / 24 per request
+    TEST_ASSERT_EQUAL_UINT32(1, mock_client_connects());
+    TEST_ASSERT_EQUAL_UINT32(0, ring.dropped());
 }
 
 // ============================================================================
 // Test runner
 // ============================================================================
 
-int main(int argc, char **argv) {
-    UNITY_BEGIN();
-    
-    // Test Case 1: clampf()
-    RUN_TEST(test_clampf_value_below_min);
-    RUN_TEST(test_clampf_value_above_max);
-    RUN_TEST(test_clampf_value_within_range);
-    RUN_TEST(test_clampf_value_at_min_boundary);
-    RUN_TEST(test_clampf_value_at_max_boundary);
-    RUN_TEST(test_clampf_negative_range);
-    RUN_TEST(test_clampf_very_small_numbers);
-    
-    // Test Case 2: voltageToKpa()
-    RUN_TEST(test_voltageToKpa_min_voltage);
-    RUN_TEST(test_voltageToKpa_max_voltage);
-    RUN_TEST(test_voltageToKpa_mid_voltage);
-    RUN_TEST(test_voltageToKpa_below_min);
-    RUN_TEST(test_voltageToKpa_above_max);
-    RUN_TEST(test_voltageToKpa_quarter_range);
-    RUN_TEST(test_voltageToKpa_three_quarter_range);
-    RUN_TEST(test_voltageToKpa_negative_voltage);
-    
-    // Test Case 3: readA0VoltageAveraged()
-    RUN_TEST(test_readA0VoltageAveraged_zero_reading);
-    RUN_TEST(test_readA0VoltageAveraged_max_reading);
-    RUN_TEST(test_readA0VoltageAveraged_mid_reading);
-    RUN_TEST(test_readA0VoltageAveraged_quarter_reading);
-    RUN_TEST(test_readA0VoltageAveraged_within_expected_range);
-    RUN_TEST(test_readA0VoltageAveraged_samples_multiple_times);
-    
-    // Test Case 4: connectWiFi()
-    RUN_TEST(test_connectWiFi_already_connected);
-    RUN_TEST(test_connectWiFi_successful_connection);
-    RUN_TEST(test_connectWiFi_timeout_behavior);
-    RUN_TEST(test_connectWiFi_respects_15_second_timeout);
-    RUN_TEST(test_connectWiFi_calls_wifi_begin);
-    
-    // Test Case 5: uploadToServer()
-    RUN_TEST(test_uploadToServer_wifi_not_connected);
-    RUN_TEST(test_uploadToServer_server_connection_fails);
-    RUN_TEST(test_uploadToServer_successful_connection_sends_request);
-    RUN_TEST(test_uploadToServer_formats_parameters_correctly);
-    RUN_TEST(test_uploadToServer_respects_5_second_timeout);
-    RUN_TEST(test_uploadToServer_handles_negative_values);
+// ============================================================================
+// Test Case 9: Multi-sample LoRaWAN frame round-trips and fits the data rate
+// ============================================================================
+
+// A minute of 5 s readings from a slowly filling tank, newest first
+static void fillingTrace(PackedReading* out, int count) {
+    for (int i = 0; i < count; i++) {
+        out[i] = readingForCode((uint16_t)(600 - i * 3));
+    }
+}
+
+static int decodeAll(const uint8_t* frame, uint8_t length, PackedReading* out, int max) {
+    LoRaFrameReader reader(frame, length);
+    int n = 0;
+    while (n < max && reader.next(out[n])) n++;
+    return reader.malformed() ? -1 : n;
+}
+
+static void assertReadingEqual(const PackedReading& expected, const PackedReading& actual) {
+    TEST_ASSERT_EQUAL_UINT16(expected.voltage, actual.voltage);
+    TEST_ASSERT_EQUAL_UINT16(expected.pressure, actual.pressure);
+    TEST_ASSERT_EQUAL_UINT16(expected.depth, actual.depth);
+    TEST_ASSERT_EQUAL_UINT16(expected.volume, actual.volume);
+}
+
+void test_loraFrame_zigzag_varint_sizes(void) {
+    TEST_ASSERT_EQUAL_UINT32(0, zigZagEncode(0));
+    TEST_ASSERT_EQUAL_UINT32(1, zigZagEncode(-1));
+    TEST_ASSERT_EQUAL_UINT32(2, zigZagEncode(1));
+    TEST_ASSERT_EQUAL_INT32(-65535, zigZagDecode(zigZagEncode(-65535)));
+    TEST_ASSERT_EQUAL_INT32(65535, zigZagDecode(zigZagEncode(65535)));
+
+    // +/-63 fits one byte, the full uint16 range three
+    TEST_ASSERT_EQUAL_UINT8(1, varintSize(zigZagEncode(-63)));
+    TEST_ASSERT_EQUAL_UINT8(2, varintSize(zigZagEncode(64)));
+    TEST_ASSERT_EQUAL_UINT8(3, varintSize(zigZagEncode(-65535)));
+}
+
+void test_loraFrame_single_reading_keeps_legacy_layout(void) {
+    uint8_t frame[LORA_FRAME_MAX_PAYLOAD];
+    LoRaFrameEncoder encoder(frame, sizeof(frame), 5);
+    TEST_ASSERT_TRUE(encoder.add(testReading(0x1234, 0x5678, 0x9ABC)));
+
+    TEST_ASSERT_EQUAL_UINT8(LORA_FRAME_BASE_SIZE, encoder.length());
+    TEST_ASSERT_EQUAL_UINT8(LORA_FRAME_VERSION, frame[0]);
+    TEST_ASSERT_EQUAL_UINT8(1, frame[1]);
+    TEST_ASSERT_EQUAL_UINT8(5, frame[2]);
+    // Bytes after the header are the old 8-byte payload
+    TEST_ASSERT_EQUAL_UINT8(0x56, frame[5]);
+    TEST_ASSERT_EQUAL_UINT8(0x78, frame[6]);
+    TEST_ASSERT_EQUAL_UINT8(0x12, frame[7]);
+    TEST_ASSERT_EQUAL_UINT8(0x34, frame[8]);
+}
+
+void test_loraFrame_minute_of_history_round_trips(void) {
+    PackedReading trace[12];
+    fillingTrace(trace, 12);
+
+    uint8_t frame[LORA_FRAME_MAX_PAYLOAD];
+    LoRaFrameEncoder encoder(frame, au915MaxPayload(5, false), 5);  // DR5 = SF7, as configured
+    for (int i = 0; i < 12; i++) {
+        TEST_ASSERT_TRUE(encoder.add(trace[i]));
+    }
+
+    // Small deltas cost one byte per field: 11 + 11 * 4 bytes for 12 readings,
+    // against 12 uplinks of the old 12-byte payload
+    TEST_ASSERT_EQUAL_UINT8(55, encoder.length());
+
+    PackedReading decoded[16];
+    TEST_ASSERT_EQUAL_INT(12, decodeAll(frame, encoder.length(), decoded, 16));
+    for (int i = 0; i < 12; i++) {
+        assertReadingEqual(trace[i], decoded[i]);
+    }
+}
+
+void test_loraFrame_extreme_deltas_round_trip(void) {
+    PackedReading trace[6];
+    for (int i = 0; i < 6; i++) {
+        uint16_t v = (i % 2) ? 0xFFFF : 0;
+        trace[i] = testReading(v, (uint16_t)~v, v);
+        trace[i].voltage = (uint16_t)(i * 13000);
+    }
+
+    uint8_t frame[LORA_FRAME_MAX_PAYLOAD];
+    LoRaFrameEncoder encoder(frame, sizeof(frame), 5);
+    for (int i = 0; i < 6; i++) {
+        TEST_ASSERT_TRUE(encoder.add(trace[i]));
+    }
+
+    PackedReading decoded[6];
+    TEST_ASSERT_EQUAL_INT(6, decodeAll(frame, encoder.length(), decoded, 6));
+    for (int i = 0; i < 6; i++) {
+        assertReadingEqual(trace[i], decoded[i]);
+    }
+}
+
+void test_loraFrame_drops_oldest_to_fit_data_rate(void) {
+    TEST_ASSERT_EQUAL_UINT8(51, au915MaxPayload(0, false));
+    TEST_ASSERT_EQUAL_UINT8(51, au915MaxPayload(2, false));
+    TEST_ASSERT_EQUAL_UINT8(115, au915MaxPayload(3, false));
+    TEST_ASSERT_EQUAL_UINT8(242, au915MaxPayload(6, false));
+
+    PackedReading trace[12];
+    fillingTrace(trace, 12);
+
+    // DR0-2 allow 51 bytes: newest reading plus 10 deltas
+    uint8_t frame[LORA_FRAME_MAX_PAYLOAD];
+    LoRaFrameEncoder encoder(frame, au915MaxPayload(0, false), 5);
+    int added = 0;
+    while (added < 12 && encoder.add(trace[added])) added++;
+
+    TEST_ASSERT_EQUAL_INT(11, added);
+    TEST_ASSERT_EQUAL_UINT8(11, encoder.count());
+    TEST_ASSERT_LESS_OR_EQUAL_UINT32(51, encoder.length());
+
+    PackedReading decoded[12];
+    TEST_ASSERT_EQUAL_INT(11, decodeAll(frame, encoder.length(), decoded, 12));
+    assertReadingEqual(trace[10], decoded[10]);
+
+    // A budget below the base frame holds nothing
+    LoRaFrameEncoder tiny(frame, LORA_FRAME_BASE_SIZE - 1, 5);
+    TEST_ASSERT_FALSE(tiny.add(trace[0]));
+    TEST_ASSERT_EQUAL_UINT8(0, tiny.length());
+}
+
+void test_loraFrame_fits_dwell_limited_data_rate(void) {
+    TEST_ASSERT_EQUAL_UINT8(0, au915MaxPayload(0, true));
+    TEST_ASSERT_EQUAL_UINT8(0, au915MaxPayload(1, true));
+    TEST_ASSERT_EQUAL_UINT8(11, au915MaxPayload(2, true));
+    TEST_ASSERT_EQUAL_UINT8(53, au915MaxPayload(3, true));
+    TEST_ASSERT_EQUAL_UINT8(125, au915MaxPayload(4, true));
+    TEST_ASSERT_EQUAL_UINT8(242, au915MaxPayload(6, true));
+    TEST_ASSERT_EQUAL_UINT8(0, au915MaxPayload(7, true));
+
+    PackedReading trace[12];
+    fillingTrace(trace, 12);
+    uint8_t frame[LORA_FRAME_MAX_PAYLOAD];
+
+    // DR2 under dwell: the base frame exactly, newest reading only
+    LoRaFrameEncoder dr2(frame, au915MaxPayload(2, true), 5);
+    TEST_ASSERT_TRUE(dr2.add(trace[0]));
+    TEST_ASSERT_FALSE(dr2.add(trace[1]));
+    TEST_ASSERT_EQUAL_UINT8(LORA_FRAME_BASE_SIZE, dr2.length());
+
+    // DR3 under dwell: fewer readings than the 115 bytes without it
+    LoRaFrameEncoder dr3(frame, au915MaxPayload(3, true), 5);
+    int added = 0;
+    while (added < 12 && dr3.add(trace[added])) added++;
+    TEST_ASSERT_TRUE(added > 1);
+    TEST_ASSERT_LESS_OR_EQUAL_UINT32(53, dr3.length());
+    PackedReading decoded[12];
+    TEST_ASSERT_EQUAL_INT(added, decodeAll(frame, dr3.length(), decoded, 12));
+
+    // DR0 under dwell: nothing fits
+    LoRaFrameEncoder dr0(frame, au915MaxPayload(0, true), 5);
+    TEST_ASSERT_FALSE(dr0.add(trace[0]));
+    TEST_ASSERT_EQUAL_UINT8(0, dr0.length());
+}
+
+void test_loraFrame_reader_rejects_malformed_frames(void) {
+    PackedReading trace[4];
+    fillingTrace(trace, 4);
+    uint8_t frame[LORA_FRAME_MAX_PAYLOAD];
+    LoRaFrameEncoder encoder(frame, sizeof(frame), 5);
+    for (int i = 0; i < 4; i++) encoder.add(trace[i]);
+    uint8_t length = encoder.length();
+    PackedReading decoded[4];
+
+    // Legacy 8-byte payload and unknown versions
+    TEST_ASSERT_FALSE(LoRaFrameReader(frame, 8).valid());
+    frame[0] = 2;
+    TEST_ASSERT_FALSE(LoRaFrameReader(frame, length).valid());
+    frame[0] = LORA_FRAME_VERSION;
+
+    // Truncated deltas and trailing garbage
+    TEST_ASSERT_EQUAL_INT(-1, decodeAll(frame, length - 1, decoded, 4));
+    frame[length] = 0;
+    TEST_ASSERT_EQUAL_INT(-1, decodeAll(frame, length + 1, decoded, 4));
+
+    // A delta that would take a field below zero
+    frame[LORA_FRAME_BASE_SIZE] = (uint8_t)zigZagEncode(63);
+    frame[3] = 0;
+    frame[4] = 0;
+    TEST_ASSERT_EQUAL_INT(-1, decodeAll(frame, length, decoded, 4));
+}
+
+// ============================================================================
+// Test Case 10: LMIC mock airtime, dwell time and duty cycle
+// ============================================================================
+
+// Events the mock delivered (src/main.cpp's onEvent() is not linked here)
+static ev_t lmicEvents[32];
+static int lmicEventCount = 0;
+
+void onEvent(ev_t ev) {
+    if (lmicEventCount < 32) lmicEvents[lmicEventCount++] = ev;
+}
+
+static void resetLmic() {
+    mock_lmic_reset();
+    lmicEventCount = 0;
+    mock_set_millis(0);
+}
+
+// Step the clock 1 ms at a time, running the LMIC loop like loop() does
+static void runLmicUntil(unsigned long end) {
+    for (unsigned long t = millis(); t <= end; t++) {
+        mock_set_millis(t);
+        for (int i = 0; i < 4; i++) os_runloop_once();
+    }
+}
+
+static bool lmicEventSeen(ev_t ev) {
+    for (int i = 0; i < lmicEventCount; i++) {
+        if (lmicEvents[i] == ev) return true;
+    }
+    return false;
+}
+
+void test_lmic_airtime_matches_reference(void) {
+    // 12-byte application payload (25-byte PHY): 1482.8 ms at SF12, 61.7 ms at SF7
+    TEST_ASSERT_EQUAL_UINT32(1482752, mock_lmic_airtime_us(DR_SF12, 25));
+    TEST_ASSERT_EQUAL_UINT32(61696, mock_lmic_airtime_us(DR_SF7, 25));
+    // 500 kHz SF8 is faster than 125 kHz SF7
+    TEST_ASSERT_EQUAL_UINT32(28288, mock_lmic_airtime_us(DR_SF8C, 25));
+    // A JoinRequest at DR2 fits the 400 ms dwell limit
+    TEST_ASSERT_EQUAL_UINT32(370688, mock_lmic_airtime_us(DR_SF10, 23));
+}
+
+void test_lmic_join_retries_until_accepted(void) {
+    resetLmic();
+    mock_lmic_set_join_accept_after(15000);
+
+    TEST_ASSERT_EQUAL_UINT8(1, LMIC_startJoining());
+    runLmicUntil(30000);
+
+    // First request at 0 is ignored, the retry after the RX windows and
+    // backoff (16.4 s) is answered in RX1
+    mock_lmic_stats_t stats;
+    mock_lmic_get_stats(&stats);
+    TEST_ASSERT_EQUAL_UINT32(2, stats.joinRequests);
+    TEST_ASSERT_EQUAL_UINT32(16371 + 371 + MOCK_LMIC_JOIN_ACCEPT_DELAY_MS, stats.joinLatencyMs);
+    TEST_ASSERT_TRUE(lmicEventSeen(EV_JOIN_TXCOMPLETE));
+    TEST_ASSERT_EQUAL(EV_JOINED, lmicEvents[lmicEventCount - 1]);
+    TEST_ASSERT_FALSE(LMIC.opmode & OP_JOINING);
+}
+
+void test_lmic_uplink_completes_after_rx_windows(void) {
+    resetLmic();
+    LMIC_setDrTxpow(DR_SF7, 14);
+    uint8_t payload[55] = {0};
+
+    TEST_ASSERT_EQUAL_INT(LMIC_ERROR_SUCCESS, LMIC_setTxData2(2, payload, sizeof(payload), 0));
+    TEST_ASSERT_EQUAL_INT(LMIC_ERROR_TX_BUSY, LMIC_setTxData2(2, payload, sizeof(payload), 0));
+
+    // 68-byte PHY at SF7: 123.1 ms on air, then RX1 and RX2
+    runLmicUntil(124 + MOCK_LMIC_RX2_DELAY_MS - 1);
+    TEST_ASSERT_TRUE(LMIC.opmode & OP_TXRXPEND);
+    runLmicUntil(124 + MOCK_LMIC_RX2_DELAY_MS);
+    TEST_ASSERT_FALSE(LMIC.opmode & OP_TXRXPEND);
+    TEST_ASSERT_EQUAL(EV_TXSTART, lmicEvents[0]);
+    TEST_ASSERT_EQUAL(EV_TXCOMPLETE, lmicEvents[1]);
+
+    mock_lmic_stats_t stats;
+    mock_lmic_get_stats(&stats);
+    TEST_ASSERT_EQUAL_UINT32(1, stats.uplinks);
+    TEST_ASSERT_EQUAL_UINT32(1, stats.busyRejects);
+    TEST_ASSERT_EQUAL_UINT32(123136, stats.maxAirtimeUs);
+}
+
+void test_lmic_dwell_time_cancels_long_uplinks(void) {
+    resetLmic();
+    mock_lmic_set_dwell_time(true);
+    uint8_t payload[51] = {0};
+
+    // DR2 carries 11 bytes under dwell, DR0 nothing: both cancelled
+    LMIC_setDrTxpow(DR_SF10, 14);
+    TEST_ASSERT_EQUAL_INT(LMIC_ERROR_TX_NOT_FEASIBLE, LMIC_setTxData2(2, payload, 51, 0));
+    LMIC_setDrTxpow(DR_SF12, 14);
+    TEST_ASSERT_EQUAL_INT(LMIC_ERROR_TX_NOT_FEASIBLE, LMIC_setTxData2(2, payload, 1, 0));
+    TEST_ASSERT_FALSE(LMIC.opmode & OP_TXRXPEND);
+    runLmicUntil(0);
+    TEST_ASSERT_EQUAL_INT(2, lmicEventCount);
+    TEST_ASSERT_EQUAL(EV_TXCANCELED, lmicEvents[0]);
+
+    // The same frame is fine at SF7
+    LMIC_setDrTxpow(DR_SF7, 14);
+    TEST_ASSERT_EQUAL_INT(LMIC_ERROR_SUCCESS, LMIC_setTxData2(2, payload, 51, 0));
+
+    mock_lmic_stats_t stats;
+    mock_lmic_get_stats(&stats);
+    TEST_ASSERT_EQUAL_UINT32(2, stats.cancelled);
+    TEST_ASSERT_EQUAL_UINT32(1, stats.uplinks);
+}
+
+void test_lmic_dwell_state_matches_payload_limits(void) {
+    uint8_t payload[LORA_FRAME_MAX_PAYLOAD] = {0};
+    for (int dwell = 0; dwell < 2; dwell++) {
+        for (u1_t dr = DR_SF12; dr <= DR_SF8C; dr++) {
+            resetLmic();
+            mock_lmic_set_dwell_time(dwell);
+            LMIC_reset();  // setup() resets after the network set dwell
+            TEST_ASSERT_EQUAL(dwell != 0, (LMIC.txParam & MCMD_TxParam_UL_DWELL_MASK) != 0);
+
+            // The stack takes exactly what au915MaxPayload() allows
+            bool on = LMIC.txParam & MCMD_TxParam_UL_DWELL_MASK;
+            uint8_t limit = au915MaxPayload(dr, on);
+            LMIC_setDrTxpow(dr, 14);
+            if (limit < LORA_FRAME_MAX_PAYLOAD) {
+                TEST_ASSERT_EQUAL_INT(LMIC_ERROR_TX_NOT_FEASIBLE,
+                                      LMIC_setTxData2(2, payload, limit + 1, 0));
+            }
+            if (limit > 0) {
+                TEST_ASSERT_EQUAL_INT(LMIC_ERROR_SUCCESS, LMIC_setTxData2(2, payload, limit, 0));
+            }
+        }
+    }
+}
+
+void test_lmic_duty_cycle_holds_back_uplink(void) {
+    resetLmic();
+    mock_lmic_set_duty_cycle(100);  // 1%
+    LMIC_setDrTxpow(DR_SF7, 14);
+    uint8_t payload[55] = {0};
+
+    LMIC_setTxData2(2, payload, sizeof(payload), 0);
+    runLmicUntil(3000);
+    TEST_ASSERT_FALSE(LMIC.opmode & OP_TXRXPEND);
+
+    // 124 ms on air at 1% keeps the band busy until 12.4 s
+    lmicEventCount = 0;
+    TEST_ASSERT_EQUAL_INT(LMIC_ERROR_SUCCESS, LMIC_setTxData2(2, payload, sizeof(payload), 0));
+    runLmicUntil(12399);
+    TEST_ASSERT_EQUAL_INT(0, lmicEventCount);
+    runLmicUntil(12400);
+    TEST_ASSERT_EQUAL(EV_TXSTART, lmicEvents[0]);
+
+    mock_lmic_stats_t stats;
+    mock_lmic_get_stats(&stats);
+    TEST_ASSERT_EQUAL_UINT32(1, stats.deferred);
+    TEST_ASSERT_EQUAL_UINT32(12400 - 3000, stats.deferredMs);
+}
+
+void test_lmic_fsb2_channel_plan(void) {
+    resetLmic();
+    // As setup() configures AU915 sub-band 2
+    for (int c = 0; c < 72; c++) LMIC_disableChannel(c);
+    for (int c = 8; c < 16; c++) LMIC_enableChannel(c);
+    LMIC_enableChannel(65);
+    TEST_ASSERT_FALSE(mock_lmic_channel_enabled(0));
+    TEST_ASSERT_TRUE(mock_lmic_channel_enabled(8));
+    TEST_ASSERT_TRUE(mock_lmic_channel_enabled(65));
+    TEST_ASSERT_FALSE(mock_lmic_channel_enabled(64));
+
+    // 125 kHz uplinks rotate through channels 8-15
+    LMIC_setDrTxpow(DR_SF7, 14);
+    uint8_t payload[11] = {0};
+    bool used[72] = {false};
+    for (int i = 0; i < 16; i++) {
+        LMIC_setTxData2(2, payload, sizeof(payload), 0);
+        used[mock_lmic_last_channel()] = true;
+        runLmicUntil(millis() + 3000);
+    }
+    for (int c = 0; c < 72; c++) {
+        TEST_ASSERT_EQUAL(c >= 8 && c < 16, used[c]);
+    }
+
+    // DR6 goes out on the sub-band's 500 kHz channel
+    LMIC_setDrTxpow(DR_SF8C, 14);
+    LMIC_setTxData2(2, payload, sizeof(payload), 0);
+    TEST_ASSERT_EQUAL_INT(65, mock_lmic_last_channel());
+}
+
+// ============================================================================
+// Test Case 11: Loop profiler sections, histogram and LMIC gap
+// ============================================================================
+
+static const char* const PROFILE_SECTIONS[] = {"lmic", "adc", "wifi_upload"};
+
+// One loop() pass with the given section lengths in us
+static void profiledPass(LoopProfiler& profiler, unsigned long& now, unsigned long lmicUs,
+                         unsigned long adcUs, unsigned long uploadUs) {
+    mock_set_micros(now);
+    profiler.loopStart();
+    profiler.noteRunloop();
+    mock_set_micros(now += lmicUs);
+    profiler.lap(0);
+    mock_set_micros(now += adcUs);
+    profiler.lap(1);
+    mock_set_micros(now += uploadUs);
+    profiler.lap(2);
+}
+
+void test_loopProfiler_charges_time_to_sections(void) {
+    LoopProfiler profiler(PROFILE_SECTIONS, 3);
+    unsigned long now = 1000;
+    profiledPass(profiler, now, 20, 5, 0);
+    profiledPass(profiler, now, 30, 5, 4000);  // A blocking upload
+    profiledPass(profiler, now, 10, 5, 0);
+    mock_set_micros(now);
+    profiler.loopStart();
+
+    TEST_ASSERT_EQUAL_UINT32(3, profiler.loops());
+    TEST_ASSERT_EQUAL_UINT32(3, profiler.section(0).passes);
+    TEST_ASSERT_EQUAL_UINT32(60, profiler.ticksToUs(profiler.section(0).totalTicks));
+    TEST_ASSERT_EQUAL_UINT32(30, profiler.section(0).maxTicks);
+    TEST_ASSERT_EQUAL_UINT32(15, profiler.ticksToUs(profiler.section(1).totalTicks));
+    TEST_ASSERT_EQUAL_UINT32(4000, profiler.section(2).maxTicks);
+    TEST_ASSERT_EQUAL_UINT32(4035, profiler.maxLoopUs());
+    // The upload delayed the next os_runloop_once() by its full length
+    TEST_ASSERT_EQUAL_UINT32(4035, profiler.maxRunloopGapUs());
+}
+
+void test_loopProfiler_log2_histogram(void) {
+    TEST_ASSERT_EQUAL_UINT8(0, LoopProfiler::bucket(0));
+    TEST_ASSERT_EQUAL_UINT8(0, LoopProfiler::bucket(1));
+    TEST_ASSERT_EQUAL_UINT8(1, LoopProfiler::bucket(3));
+    TEST_ASSERT_EQUAL_UINT8(9, LoopProfiler::bucket(1000));
+    TEST_ASSERT_EQUAL_UINT8(10, LoopProfiler::bucket(1024));
+    TEST_ASSERT_EQUAL_UINT8(LoopProfiler::HISTOGRAM_BUCKETS - 1, LoopProfiler::bucket(0xFFFFFFFFUL));
+
+    LoopProfiler profiler(PROFILE_SECTIONS, 3);
+    unsigned long now = 0;
+    for (int i = 0; i < 10; i++) profiledPass(profiler, now, 20, 5, 0);
+    profiledPass(profiler, now, 20, 5, 5000);
+    mock_set_micros(now);
+    profiler.loopStart();
+
+    TEST_ASSERT_EQUAL_UINT32(10, profiler.histogram(4));  // 25 us
+    TEST_ASSERT_EQUAL_UINT32(1, profiler.histogram(12));  // 5025 us
+
+    profiler.reset();
+    TEST_ASSERT_EQUAL_UINT32(0, profiler.loops());
+    TEST_ASSERT_EQUAL_UINT32(0, profiler.histogram(4));
+    TEST_ASSERT_EQUAL_UINT32(0, profiler.maxRunloopGapUs());
+}
+
+void test_loopProfiler_summary_in_upload_header(void) {
+    LoopProfiler profiler(PROFILE_SECTIONS, 3);
+    unsigned long now = 0;
+    profiledPass(profiler, now, 20, 5, 0);
+    profiledPass(profiler, now, 20, 5, 4000);
+    mock_set_micros(now);
+    profiler.loopStart();
+
+    char summary[LoopProfiler::SUMMARY_SIZE];
+    profiler.formatSummary(summary, sizeof(summary));
+    TEST_ASSERT_EQUAL_STRING("loops=2;max_us=4025;lmic_gap_us=25;worst=wifi_upload:4000", summary);
+
+    // Truncated, still terminated
+    char small[8];
+    TEST_ASSERT_EQUAL_UINT32(7, profiler.formatSummary(small, sizeof(small)));
+    TEST_ASSERT_EQUAL_STRING("loops=2", small);
+
+    HttpUploader uploader(client, serverHost, serverPort);
+    mock_set_wifi_status(WL_CONNECTED);
+    mock_set_client_connected(true);
+    uploader.setExtraHeader(summary);
+    uploader.upload(testReading(1500, 525, 4712));
+    TEST_ASSERT_EQUAL_STRING(
+        "GET /update?depth=1.500&pressure=5.25&volume=47.12 HTTP/1.1\r\n"
+        "Host: 192.168.55.192\r\n"
+        "X-Device-Stats: loops=2;max_us=4025;lmic_gap_us=25;worst=wifi_upload:4000\r\n"
+        "Connection: keep-alive\r\n\r\n",
+        mock_client_last_request());
+}
+
+// ============================================================================
+// Test Case 12: Change-driven reporting on a simulated fill/drain day
+// ============================================================================
+
+static const ReportThresholds DEVICE_REPORTING = {10, 0, 60, 600000};
+
+// Noise-free ADC code of a day: full tank overnight, pumped up from 400
+// to 800 at 06:00-06:30, drained back down 18:00-22:00
+static int fillDrainCode(uint32_t t) {
+    const uint32_t H = 3600000UL;
+    if (t < 6 * H) return 400;
+    if (t < 6 * H + H / 2) return 400 + (int)((uint64_t)(t - 6 * H) * 400 / (H / 2));
+    if (t < 18 * H) return 800;
+    if (t < 22 * H) return 800 - (int)((uint64_t)(t - 18 * H) * 400 / (4 * H));
+    return 400;
+}
+
+void test_changeReporter_fill_drain_day_cuts_reports_tenfold(void) {
+    ChangeReporter reporter(DEVICE_REPORTING);
+    uint32_t lcg = 1;
+    uint32_t readings = 0, reports = 0;
+    uint32_t firstFillReport = 0, firstDrainReport = 0;
+    uint16_t worstLag = 0;
+    PackedReading last = {0, 0, 0, 0};
+
+    for (uint32_t t = 0; t < 24 * 3600000UL; t += 5000) {
+        lcg = lcg * 1664525u + 1013904223u;
+        int code = fillDrainCode(t) + (int)(lcg >> 30) % 3 - 1;  // +/- 1 code of noise
+        const PackedReading& r = readingForCode((uint16_t)code);
+        readings++;
+        if (reporter.offer(t, r)) {
+            bool change = reporter.reason() != ChangeReporter::HEARTBEAT;
+            reporter.reported(t, r);
+            last = r;
+            reports++;
+            if (change && !firstFillReport && t >= 6 * 3600000UL) firstFillReport = t;
+            if (change && !firstDrainReport && t >= 18 * 3600000UL) firstDrainReport = t;
+        }
+        // What the server shows vs the noise-free level
+        uint16_t truth = readingForCode((uint16_t)fillDrainCode(t)).depth;
+        uint16_t lag = truth > last.depth ? truth - last.depth : last.depth - truth;
+        if (lag > worstLag) worstLag = lag;
+    }
+
+    TEST_ASSERT_EQUAL_UINT32(17280, readings);
+    TEST_ASSERT_TRUE_MESSAGE(reports * 10 <= readings, "less than a tenfold reduction");
+    // Heartbeat alone is 144 a day; the fill and drain add the rest
+    TEST_ASSERT_TRUE(reports > 144 + 2 * 30);
+    TEST_ASSERT_TRUE(reporter.count(ChangeReporter::DEPTH) > 60);
+    // The fill (~16 mm/min) is reported within a minute of starting, the
+    // slow drain (~2 mm/min) once it has moved the 10 mm deadband
+    TEST_ASSERT_TRUE(firstFillReport - 6 * 3600000UL <= 60000);
+    TEST_ASSERT_TRUE(firstDrainReport - 18 * 3600000UL <= 6 * 60000);
+    // The reported level never trails the true one by more than the
+    // deadband plus one code of noise (~1.3 mm)
+    TEST_ASSERT_TRUE(worstLag <= DEVICE_REPORTING.depthMm + 3);
+}
+
+void test_changeReporter_rate_trips_inside_deadband(void) {
+    ReportThresholds thresholds = {100, 0, 60, 3600000};
+    ChangeReporter reporter(thresholds);
+    PackedReading r = testReading(500, 0, 0);
+    TEST_ASSERT_TRUE(reporter.offer(0, r));
+    TEST_ASSERT_EQUAL(ChangeReporter::FIRST, reporter.reason());
+    reporter.reported(0, r);
+
+    // 4 mm in 5 s is 48 mm/min: below the threshold
+    r.depth = 504;
+    TEST_ASSERT_FALSE(reporter.offer(5000, r));
+    // 6 mm in the next 5 s is 72 mm/min: a pump has started
+    r.depth = 510;
+    TEST_ASSERT_TRUE(reporter.offer(10000, r));
+    TEST_ASSERT_EQUAL(ChangeReporter::RATE, reporter.reason());
+
+    // Stays due until the transport reports it
+    r.depth = 511;
+    TEST_ASSERT_TRUE(reporter.offer(15000, r));
+    reporter.reported(15000, r);
+    TEST_ASSERT_EQUAL_UINT32(1, reporter.count(ChangeReporter::RATE));
+    TEST_ASSERT_FALSE(reporter.offer(20000, r));
+}
+
+void test_changeReporter_volume_deadband_and_heartbeat(void) {
+    ReportThresholds thresholds = {0, 50, 0, 60000};
+    ChangeReporter reporter(thresholds);
+    PackedReading r = testReading(500, 0, 1000);
+    reporter.offer(0, r);
+    reporter.reported(0, r);
+
+    r.volume = 1049;
+    TEST_ASSERT_FALSE(reporter.offer(5000, r));
+    r.volume = 950;
+    TEST_ASSERT_TRUE(reporter.offer(10000, r));
+    TEST_ASSERT_EQUAL(ChangeReporter::VOLUME, reporter.reason());
+    reporter.reported(10000, r);
+
+    TEST_ASSERT_FALSE(reporter.offer(69999, r));
+    TEST_ASSERT_TRUE(reporter.offer(70000, r));
+    TEST_ASSERT_EQUAL(ChangeReporter::HEARTBEAT, reporter.reason());
+}
+
+void test_changeReporter_zero_thresholds_report_every_reading(void) {
+    ReportThresholds everyReading = {0, 0, 0, 0};
+    ChangeReporter reporter(everyReading);
+    PackedReading r = testReading(500, 0, 0);
+    for (uint32_t t = 0; t < 60000; t += 5000) {
+        TEST_ASSERT_TRUE(reporter.offer(t, r));
+        reporter.reported(t, r);
+    }
+}
+
+// ============================================================================
+// Test Case 13: Deadline scheduler
+// ============================================================================
+
+static const int SCHED_LOG_SIZE = 64;
+static uint8_t schedLog[SCHED_LOG_SIZE];
+static uint32_t schedLogAt[SCHED_LOG_SIZE];
+static int schedLogCount = 0;
+static uint32_t schedNow = 0;
+static DeadlineScheduler<4>* schedUnderTest = 0;
+
+static void schedRecord(uint8_t id) {
+    if (schedLogCount < SCHED_LOG_SIZE) {
+        schedLog[schedLogCount] = id;
+        schedLogAt[schedLogCount] = schedNow;
+        schedLogCount++;
+    }
+}
+static void schedTask0() { schedRecord(0); }
+static void schedTask1() { schedRecord(1); }
+static void schedTask2() { schedRecord(2); }
+static void schedTaskAgain() {
+    // Keeps asking to run again straight away
+    schedRecord(3);
+    schedUnderTest->at(3, schedNow);
+}
+
+static void resetSchedLog() {
+    schedLogCount = 0;
+    schedNow = 0;
+}
+
+// Advance the clock 1 ms at a time, running whatever is due
+static void runSchedulerUntil(DeadlineScheduler<4>& scheduler, uint32_t end) {
+    for (; schedNow != end; schedNow++) scheduler.runDue(schedNow);
+    scheduler.runDue(schedNow);
+}
+
+void test_scheduler_runs_tasks_in_deadline_order(void) {
+    resetSchedLog();
+    DeadlineScheduler<4> scheduler;
+    scheduler.add(0, schedTask0);
+    scheduler.add(1, schedTask1);
+    scheduler.add(2, schedTask2);
+    scheduler.at(2, 30);
+    scheduler.at(0, 20);
+    scheduler.at(1, 10);
+    TEST_ASSERT_EQUAL(3, scheduler.pending());
+    TEST_ASSERT_EQUAL_UINT32(10, scheduler.msUntilNext(0));
+
+    TEST_ASSERT_EQUAL(3, scheduler.runDue(30));
+    TEST_ASSERT_EQUAL(3, schedLogCount);
+    TEST_ASSERT_EQUAL(1, schedLog[0]);
+    TEST_ASSERT_EQUAL(0, schedLog[1]);
+    TEST_ASSERT_EQUAL(2, schedLog[2]);
+
+    // One-shots are gone once run
+    TEST_ASSERT_EQUAL(0, scheduler.pending());
+    TEST_ASSERT_EQUAL_UINT32(DeadlineScheduler<4>::NO_DEADLINE, scheduler.msUntilNext(30));
+    TEST_ASSERT_EQUAL(0, scheduler.runDue(1000));
+}
+
+void test_scheduler_periodic_task_does_not_drift(void) {
+    resetSchedLog();
+    DeadlineScheduler<4> scheduler;
+    scheduler.every(0, schedTask0, 100, 0);
+
+    // Run late each time: deadlines stay on the 100 ms grid
+    for (uint32_t t = 7; t < 1000; t += 100) {
+        schedNow = t;
+        scheduler.runDue(t);
+        TEST_ASSERT_EQUAL_UINT32(t - 7 + 100, scheduler.deadline(0));
+    }
+    TEST_ASSERT_EQUAL(10, schedLogCount);
+}
+
+void test_scheduler_overrun_skips_ahead(void) {
+    resetSchedLog();
+    DeadlineScheduler<4> scheduler;
+    scheduler.every(0, schedTask0, 100, 0);
+    scheduler.runDue(0);
+
+    // Stalled for 1 s: one run, not ten back to back
+    schedNow = 1050;
+    TEST_ASSERT_EQUAL(1, scheduler.runDue(1050));
+    TEST_ASSERT_EQUAL_UINT32(1150, scheduler.deadline(0));
+    TEST_ASSERT_EQUAL(0, scheduler.runDue(1100));
+}
+
+void test_scheduler_cancel_and_at_or_before(void) {
+    resetSchedLog();
+    DeadlineScheduler<4> scheduler;
+    scheduler.add(0, schedTask0);
+    scheduler.add(1, schedTask1);
+    scheduler.add(2, schedTask2);
+    scheduler.at(0, 100);
+    scheduler.at(1, 200);
+    scheduler.at(2, 300);
+
+    scheduler.cancel(0);
+    TEST_ASSERT_FALSE(scheduler.scheduled(0));
+    TEST_ASSERT_EQUAL_UINT32(200, scheduler.msUntilNext(0));
+
+    // Only ever brings a deadline forward
+    scheduler.atOrBefore(2, 400);
+    TEST_ASSERT_EQUAL_UINT32(300, scheduler.deadline(2));
+    scheduler.atOrBefore(2, 150);
+    TEST_ASSERT_EQUAL_UINT32(150, scheduler.deadline(2));
+    scheduler.atOrBefore(0, 500);
+    TEST_ASSERT_TRUE(scheduler.scheduled(0));
+
+    // Rescheduling later moves a task back
+    scheduler.at(2, 250);
+    runSchedulerUntil(scheduler, 600);
+    TEST_ASSERT_EQUAL(3, schedLogCount);
+    TEST_ASSERT_EQUAL(1, schedLog[0]);
+    TEST_ASSERT_EQUAL_UINT32(200, schedLogAt[0]);
+    TEST_ASSERT_EQUAL(2, schedLog[1]);
+    TEST_ASSERT_EQUAL_UINT32(250, schedLogAt[1]);
+    TEST_ASSERT_EQUAL(0, schedLog[2]);
+    TEST_ASSERT_EQUAL_UINT32(500, schedLogAt[2]);
+
+    // Unregistered ids are ignored
+    scheduler.at(3, 0);
+    TEST_ASSERT_FALSE(scheduler.scheduled(3));
+}
+
+void test_scheduler_survives_millis_wrap(void) {
+    resetSchedLog();
+    DeadlineScheduler<4> scheduler;
+    schedNow = 0xFFFFFF00UL;
+    scheduler.every(0, schedTask0, 100, schedNow);
+    scheduler.add(1, schedTask1);
+    scheduler.at(1, schedNow + 0x180);  // 0x80 after the wrap
+
+    TEST_ASSERT_EQUAL_UINT32(0, scheduler.msUntilNext(schedNow));
+    runSchedulerUntil(scheduler, 0x200);
+
+    // Periodic runs every 100 ms straight through the wrap
+    int periodic = 0;
+    uint32_t last = 0;
+    for (int i = 0; i < schedLogCount; i++) {
+        if (schedLog[i] != 0) continue;
+        if (periodic > 0) TEST_ASSERT_EQUAL_UINT32(100, schedLogAt[i] - last);
+        last = schedLogAt[i];
+        periodic++;
+    }
+    TEST_ASSERT_EQUAL(8, periodic);  // 0xFFFFFF00 .. 0x1BC
+
+    // The one-shot ran 0x180 after scheduling, not 49 days early
+    bool found = false;
+    for (int i = 0; i < schedLogCount; i++) {
+        if (schedLog[i] == 1) {
+            TEST_ASSERT_EQUAL_UINT32(0x80, schedLogAt[i]);
+            found = true;
+        }
+    }
+    TEST_ASSERT_TRUE(found);
+    TEST_ASSERT_EQUAL_UINT32(0x220 - 0x200, scheduler.msUntilNext(0x200));
+}
+
+void test_scheduler_run_budget_bounds_one_pass(void) {
+    resetSchedLog();
+    DeadlineScheduler<4> scheduler;
+    schedUnderTest = &scheduler;
+    scheduler.add(3, schedTaskAgain);
+    scheduler.every(0, schedTask0, 10, 0);
+    scheduler.at(3, 0);
+
+    // A task rescheduling itself for now cannot hold loop() forever
+    TEST_ASSERT_EQUAL(4, scheduler.runDue(0));
+    TEST_ASSERT_EQUAL(4, schedLogCount);
+    TEST_ASSERT_EQUAL_UINT32(0, scheduler.msUntilNext(0));
+    schedUnderTest = 0;
+}
+
+void test_lmic_reports_time_critical_jobs(void) {
+    resetLmic();
+    TEST_ASSERT_FALSE(os_queryTimeCriticalJobs(ms2osticks(60000)));
+
+    // Join attempt and EV_JOINING are due now
+    LMIC_startJoining();
+    TEST_ASSERT_TRUE(os_queryTimeCriticalJobs(ms2osticks(0)));
+    runLmicUntil(10);
+
+    // Next job is the join accept after the RX delay
+    TEST_ASSERT_FALSE(os_queryTimeCriticalJobs(ms2osticks(100)));
+    TEST_ASSERT_TRUE(os_queryTimeCriticalJobs(ms2osticks(MOCK_LMIC_JOIN_ACCEPT_DELAY_MS + 1000)));
+}
+
+// ============================================================================
+// Test Case 14: Block ADC acquisition
+// ============================================================================
+
+static const uint8_t ADC_PIN_A0[] = {A0};
+
+static void advanceMicros(unsigned long us) {
+    mock_set_micros(micros() + us);
+}
+
+void test_adcSettings_validation(void) {
+    AdcSettings ok = {ADC_PIN_A0, 1, 14, 4, 1000};
+    TEST_ASSERT_TRUE(adcSettingsValid(ok));
+    TEST_ASSERT_EQUAL_UINT32(4UL * 16383, adcSampleFullScale(ok));
+
+    AdcSettings tooWide = {ADC_PIN_A0, 1, 14, 8, 1000};   // 17-bit sums
+    AdcSettings oddBits = {ADC_PIN_A0, 1, 11, 1, 1000};
+    AdcSettings oddRatio = {ADC_PIN_A0, 1, 12, 3, 1000};
+    AdcSettings noInterval = {ADC_PIN_A0, 1, 10, 1, 0};
+    TEST_ASSERT_FALSE(adcSettingsValid(tooWide));
+    TEST_ASSERT_FALSE(adcSettingsValid(oddBits));
+    TEST_ASSERT_FALSE(adcSettingsValid(oddRatio));
+    TEST_ASSERT_FALSE(adcSettingsValid(noInterval));
+
+    BlockAdc<8> adc;
+    TEST_ASSERT_FALSE(adc.begin(tooWide));
+    TEST_ASSERT_FALSE(mock_adc_backend_running());
+}
+
+void test_blockAdc_fills_blocks_on_the_timer(void) {
+    mock_set_analog_value(1023);
+    BlockAdc<8> adc;
+    AdcSettings settings = {ADC_PIN_A0, 1, 12, 4, 1000};
+    TEST_ASSERT_TRUE(adc.begin(settings));
+
+    // One sample per elapsed period, however the clock moves
+    advanceMicros(7999);
+    TEST_ASSERT_EQUAL_UINT32(7, mock_adc_backend_samples());
+    TEST_ASSERT_FALSE(adc.ready());
+    advanceMicros(1);
+    TEST_ASSERT_TRUE(adc.ready());
+    TEST_ASSERT_EQUAL_UINT32(1, adc.sequence());
+
+    // Each sample sums 4 conversions at 12 bits
+    for (uint16_t i = 0; i < 8; i++) TEST_ASSERT_EQUAL_UINT16(4 * 4095, adc.block()[i]);
+    TEST_ASSERT_EQUAL_UINT32(adc.blockFullScale(), adc.blockSum());
+    adc.end();
+}
+
+void test_blockAdc_double_buffers_and_counts_overruns(void) {
+    BlockAdc<4> adc;
+    AdcSettings settings = {ADC_PIN_A0, 1, 10, 1, 1000};
+    adc.begin(settings);
+
+    mock_set_analog_value(100);
+    advanceMicros(4000);
+    TEST_ASSERT_TRUE(adc.ready());
+    const volatile uint16_t* held = adc.block();
+
+    // The next block fills the other buffer while this one is held
+    mock_set_analog_value(200);
+    advanceMicros(3000);
+    TEST_ASSERT_EQUAL_UINT32(400, adc.blockSum());
+    TEST_ASSERT_TRUE(held == adc.block());
+
+    // Completing it while still held discards it rather than overwrite
+    advanceMicros(1000);
+    TEST_ASSERT_EQUAL_UINT32(1, adc.overruns());
+    TEST_ASSERT_EQUAL_UINT32(1, adc.sequence());
+    TEST_ASSERT_EQUAL_UINT32(400, adc.blockSum());
+
+    adc.release();
+    TEST_ASSERT_FALSE(adc.ready());
+    advanceMicros(4000);
+    TEST_ASSERT_TRUE(adc.ready());
+    TEST_ASSERT_FALSE(held == adc.block());
+    TEST_ASSERT_EQUAL_UINT32(800, adc.blockSum());
+    adc.end();
+}
+
+void test_readingForLevel_interpolates_table(void) {
+    // Whole codes match the table exactly
+    for (uint32_t code = 0; code <= (uint32_t)ADC_MAX; code += 31) {
+        PackedReading r = readingForLevel(code, ADC_MAX);
+        const PackedReading& expected = readingForCode((uint16_t)code);
+        TEST_ASSERT_EQUAL_UINT16(expected.voltage, r.voltage);
+        TEST_ASSERT_EQUAL_UINT16(expected.depth, r.depth);
+        TEST_ASSERT_EQUAL_UINT16(expected.volume, r.volume);
+    }
+    TEST_ASSERT_EQUAL_UINT16(readingForCode(ADC_MAX).depth, readingForLevel(5, 5).depth);
+    TEST_ASSERT_EQUAL_UINT16(0, readingForLevel(0, 0).depth);
+
+    // 14-bit steps in between stay monotonic and inside the neighbours
+    uint32_t fullScale = 16383;
+    uint16_t lastDepth = 0;
+    for (uint32_t code = 8000; code < 8400; code++) {
+        PackedReading r = readingForLevel(code, fullScale);
+        TEST_ASSERT_TRUE(r.depth >= lastDepth);
+        lastDepth = r.depth;
+    }
+    PackedReading mid = readingForLevel(2 * 512 + 1, 2 * ADC_MAX);  // Code 512.5
+    TEST_ASSERT_TRUE(mid.voltage > readingForCode(512).voltage);
+    TEST_ASSERT_TRUE(mid.voltage < readingForCode(513).voltage);
+}
+
+void test_blockAdc_oversampling_averages_out_noise(void) {
+    // Same tank level, +/-12 codes of conversion noise at 14 bits
+    mock_set_analog_value(600);
+    mock_set_analog_noise(12);
+    BlockAdc<50> adc;
+    AdcSettings settings = {ADC_PIN_A0, 1, 14, 4, 100000};
+    adc.begin(settings);
+
+    const PackedReading& truth = readingForCode(600);
+    for (int block = 0; block < 10; block++) {
+        advanceMicros(5000000);
+        TEST_ASSERT_TRUE(adc.ready());
+        PackedReading r = readingForLevel(adc.blockSum(), adc.blockFullScale());
+        adc.release();
+        TEST_ASSERT_INT_WITHIN(1, truth.depth, r.depth);
+    }
+    TEST_ASSERT_EQUAL_UINT32(0, adc.overruns());
+    adc.end();
+}
+
+// ============================================================================
+// Test Case 15: Multi-tank acquisition
+// ============================================================================
+
+void test_tankArray_default_channel_matches_table(void) {
+    const TankGeometry geometry = TankGeometry::verticalCylinder(TANK_DIAMETER_MM);
+    const TankChannel channels[] = {TankChannel::sensorConfig(A0, &geometry)};
+    TankArray<1> tanks(channels);
+    for (uint32_t code = 0; code <= (uint32_t)ADC_MAX; code++) {
+        PackedReading r;
+        tanks.convert(&code, ADC_MAX, &r);
+        const PackedReading& expected = readingForCode((uint16_t)code);
+        TEST_ASSERT_EQUAL_UINT16(expected.voltage, r.voltage);
+        TEST_ASSERT_EQUAL_UINT16(expected.pressure, r.pressure);
+        TEST_ASSERT_EQUAL_UINT16(expected.depth, r.depth);
+        TEST_ASSERT_EQUAL_UINT16(expected.volume, r.volume);
+    }
+}
+
+void test_tankArray_filter_volts_go_through_table(void) {
+    const TankGeometry geometry = TankGeometry::verticalCylinder(TANK_DIAMETER_MM);
+    const TankGeometry other = TankGeometry::verticalCylinder(200.0f);
+    const TankChannel channels[] = {
+        TankChannel::sensorConfig(A0, &geometry),
+        {A1, V_MIN, V_MAX, FS_KPA, &other},
+    };
+    TankArray<2> tanks(channels);
+    TEST_ASSERT_TRUE(tanks.usesTable(0));
+    TEST_ASSERT_FALSE(tanks.usesTable(1));
+
+    // Whole codes in volts match the table; estimates in between stay
+    // within a unit of the float pipeline
+    for (uint16_t code = 0; code <= ADC_MAX; code += 7) {
+        float volts[2] = {adcToVoltage((float)code), adcToVoltage((float)code)};
+        PackedReading r[2];
+        tanks.convertVolts(volts, r);
+        const PackedReading& expected = readingForCode(code);
+        TEST_ASSERT_EQUAL_UINT16(expected.voltage, r[0].voltage);
+        TEST_ASSERT_EQUAL_UINT16(expected.depth, r[0].depth);
+        TEST_ASSERT_EQUAL_UINT32(expected.volume, r[0].volume);
+        TEST_ASSERT_EQUAL_UINT16(expected.depth, r[1].depth);
+
+        volts[0] = adcToVoltage(code + 0.37f);
+        tanks.convertVolts(volts, r);
+        PackedReading exact = packReading(volts[0]);
+        TEST_ASSERT_INT_WITHIN(1, exact.voltage, r[0].voltage);
+        TEST_ASSERT_INT_WITHIN(1, exact.depth, r[0].depth);
+        TEST_ASSERT_INT_WITHIN(1, exact.volume, r[0].volume);
+    }
+
+    // A filter estimate can leave the ADC range
+    float outside[2] = {-0.02f, 5.3f};
+    PackedReading r[2];
+    tanks.convertVolts(outside, r);
+    TEST_ASSERT_EQUAL_UINT16(0, r[0].depth);
+    const TankChannel high[] = {TankChannel::sensorConfig(A0, &geometry)};
+    TankArray<1> single(high);
+    single.convertVolts(&outside[1], r);
+    TEST_ASSERT_EQUAL_UINT16(readingForCode(ADC_MAX).depth, r[0].depth);
+}
+
+void test_tankArray_table_is_explicit_and_checked(void) {
+    const TankGeometry geometry = TankGeometry::verticalCylinder(TANK_DIAMETER_MM);
+    const TankGeometry other = TankGeometry::verticalCylinder(200.0f);
+    const TankChannel channels[] = {
+        TankChannel::sensorConfig(A0, &geometry),
+        {A1, V_MIN, V_MAX, FS_KPA, &geometry},     // Same values, not asked for
+        TankChannel::sensorConfig(A2, &other),    // Asked for, wrong tank
+    };
+    TankArray<3> tanks(channels);
+    TEST_ASSERT_TRUE(tanks.usesTable(0));
+    TEST_ASSERT_FALSE(tanks.usesTable(1));
+    TEST_ASSERT_FALSE(tanks.usesTable(2));
+    TEST_ASSERT_FALSE(tanks.valid());
+
+    // The mismatched channel still converts, through the float pipeline
+    const TankChannel plain[] = {{A2, V_MIN, V_MAX, FS_KPA, &other}};
+    TankArray<1> expected(plain);
+    TEST_ASSERT_TRUE(expected.valid());
+    uint32_t sums[3] = {614, 614, 614};
+    PackedReading r[3], e;
+    tanks.convert(sums, ADC_MAX, r);
+    expected.convert(&sums[2], ADC_MAX, &e);
+    TEST_ASSERT_EQUAL_UINT16(e.depth, r[2].depth);
+    TEST_ASSERT_EQUAL_UINT32(e.volume, r[2].volume);
+
+    const TankChannel good[] = {TankChannel::sensorConfig(A0, &geometry)};
+    TEST_ASSERT_TRUE(TankArray<1>(good).valid());
+}
+
+void test_tankArray_converts_each_channel_with_its_config(void) {
+    const TankGeometry small = TankGeometry::verticalCylinder(100.0f);
+    const TankGeometry wide = TankGeometry::verticalCylinder(200.0f);
+    const TankChannel channels[] = {
+        {A0, 0.5f, 4.5f, 10.0f, &small},
+        {A1, 0.5f, 4.5f, 20.0f, &small},   // Twice the pressure span
+        {A2, 0.5f, 4.5f, 10.0f, &wide},    // Four times the area
+    };
+    TankArray<3> tanks(channels);
+    TEST_ASSERT_EQUAL_UINT8(A1, tanks.pins()[1]);
+
+    uint32_t sums[3] = {614, 614, 614};  // 3.0 V each
+    PackedReading r[3];
+    tanks.convert(sums, ADC_MAX, r);
+    TEST_ASSERT_EQUAL_UINT16(r[0].voltage, r[1].voltage);
+    TEST_ASSERT_INT_WITHIN(1, 2 * r[0].pressure, r[1].pressure);
+    TEST_ASSERT_INT_WITHIN(1, 2 * r[0].depth, r[1].depth);
+    TEST_ASSERT_EQUAL_UINT16(r[0].depth, r[2].depth);
+    TEST_ASSERT_INT_WITHIN(2, 4 * r[0].volume, r[2].volume);
+}
+
+void test_blockAdc_samples_all_channels_in_one_pass(void) {
+    static const uint8_t pins[] = {A0, A1, A2};
+    mock_set_analog_pin_value(A0, 100);
+    mock_set_analog_pin_value(A1, 200);
+    mock_set_analog_pin_value(A2, 300);
+    BlockAdc<4, 3> adc;
+
+    // Settings must name as many channels as the template
+    AdcSettings wrong = {pins, 2, 10, 2, 1000};
+    TEST_ASSERT_FALSE(adc.begin(wrong));
+
+    AdcSettings settings = {pins, 3, 10, 2, 1000};
+    TEST_ASSERT_TRUE(adc.begin(settings));
+    advanceMicros(4000);
+    TEST_ASSERT_TRUE(adc.ready());
+    TEST_ASSERT_EQUAL_UINT32(4, mock_adc_backend_samples());
+
+    // Passes are interleaved: A0, A1, A2, A0, ...
+    TEST_ASSERT_EQUAL_UINT16(200, adc.block()[0]);
+    TEST_ASSERT_EQUAL_UINT16(400, adc.block()[1]);
+    TEST_ASSERT_EQUAL_UINT16(600, adc.block()[5]);
+    uint32_t sums[3];
+    adc.blockSums(sums);
+    TEST_ASSERT_EQUAL_UINT32(800, sums[0]);
+    TEST_ASSERT_EQUAL_UINT32(1600, sums[1]);
+    TEST_ASSERT_EQUAL_UINT32(2400, sums[2]);
+    TEST_ASSERT_EQUAL_UINT32(sums[1], adc.blockSum(1));
+    adc.end();
+}
+
+void test_loraFrame_multi_tank_round_trip(void) {
+    PackedReading samples[3][2] = {
+        {{3000, 500, 510, 400}, {2000, 200, 204, 1600}},
+        {{2990, 498, 508, 399}, {2000, 200, 204, 1600}},
+        {{2980, 496, 506, 397}, {2010, 202, 206, 1615}},
+    };
+    uint8_t buf[LORA_FRAME_MAX_PAYLOAD];
+    LoRaFrameEncoder enc(buf, sizeof(buf), 5, 2);
+    for (int i = 0; i < 3; i++) TEST_ASSERT_TRUE(enc.addSample(samples[i]));
+    TEST_ASSERT_EQUAL_UINT8(LORA_FRAME_VERSION_MULTI, buf[0]);
+    TEST_ASSERT_EQUAL_UINT8(2, buf[3]);
+
+    LoRaFrameReader reader(buf, enc.length());
+    TEST_ASSERT_EQUAL_UINT8(2, reader.tanks());
+    PackedReading single;
+    TEST_ASSERT_FALSE(reader.next(single));  // Needs nextSample()
+    PackedReading out[2];
+    for (int i = 0; i < 3; i++) {
+        TEST_ASSERT_TRUE(reader.nextSample(out));
+        for (int t = 0; t < 2; t++) {
+            TEST_ASSERT_EQUAL_UINT16(samples[i][t].voltage, out[t].voltage);
+            TEST_ASSERT_EQUAL_UINT16(samples[i][t].depth, out[t].depth);
+            TEST_ASSERT_EQUAL_UINT16(samples[i][t].volume, out[t].volume);
+        }
+    }
+    TEST_ASSERT_FALSE(reader.nextSample(out));
+    TEST_ASSERT_FALSE(reader.malformed());
+
+    // One tank stays a byte-identical version 1 frame
+    uint8_t v1[LORA_FRAME_MAX_PAYLOAD];
+    uint8_t v1ByAdd[LORA_FRAME_MAX_PAYLOAD];
+    LoRaFrameEncoder one(v1, sizeof(v1), 5, 1);
+    LoRaFrameEncoder legacy(v1ByAdd, sizeof(v1ByAdd), 5);
+    for (int i = 0; i < 3; i++) {
+        one.addSample(&samples[i][0]);
+        legacy.add(samples[i][0]);
+    }
+    TEST_ASSERT_EQUAL_UINT8(LORA_FRAME_VERSION, v1[0]);
+    TEST_ASSERT_EQUAL_UINT8(legacy.length(), one.length());
+    TEST_ASSERT_EQUAL_MEMORY(v1ByAdd, v1, one.length());
+}
+
+void test_uploader_batch_tank_column(void) {
+    HttpUploader uploader(client, serverHost, serverPort);
+    ReadingBuffer<8> ring;
+    mock_set_wifi_status(WL_CONNECTED);
+    mock_set_client_connected(true);
+
+    ring.push(1000, testReading(1234, 1210, 952), 0);
+    ring.push(1000, testReading(800, 790, 2512), 1);
+    mock_set_millis(2000);
+
+    TEST_ASSERT_TRUE(uploader.uploadBatch(ring));
+    TEST_ASSERT_EQUAL_STRING("1000,0,1210,1234,952\n1000,0,790,800,2512,1\n",
+                             uploader.lastBody());
+}
+
+void test_changeReporterArray_reports_all_tanks_together(void) {
+    ReportThresholds thresholds = {10, 0, 0, 600000};
+    ChangeReporterArray<2> reporter(thresholds);
+    PackedReading r[2] = {testReading(1000, 0, 0), testReading(500, 0, 0)};
+    TEST_ASSERT_TRUE(reporter.offer(0, r));  // First reading
+    reporter.reported(0, r);
+
+    // Tank 1 alone moving past the deadband makes a report due
+    r[1].depth = 505;
+    TEST_ASSERT_FALSE(reporter.offer(5000, r));
+    r[1].depth = 511;
+    TEST_ASSERT_TRUE(reporter.offer(10000, r));
+    TEST_ASSERT_TRUE(reporter.due());
+    reporter.reported(10000, r);
+    TEST_ASSERT_FALSE(reporter.due());
+
+    // Both re-centred on what was sent
+    r[0].depth = 1009;
+    r[1].depth = 520;
+    TEST_ASSERT_FALSE(reporter.offer(15000, r));
+}
+
+// ============================================================================
+// Test Case 16: Tank geometry
+// ============================================================================
+
+void test_geometry_vertical_cylinder_and_rectangular(void) {
+    TankGeometry cylinder = TankGeometry::verticalCylinder(TANK_DIAMETER_MM);
+    TEST_ASSERT_TRUE(cylinder.valid());
+    TEST_ASSERT_EQUAL_FLOAT(depthToLiters(0.5f), cylinder.liters(0.5f));
+    TEST_ASSERT_EQUAL_FLOAT(0.0f, cylinder.heightM());
+
+    TankGeometry box = TankGeometry::rectangular(1000.0f, 500.0f);
+    TEST_ASSERT_FLOAT_WITHIN(0.01f, 400.0f, box.liters(0.8f));
+
+    TEST_ASSERT_FALSE(TankGeometry::verticalCylinder(0.0f).valid());
+    TEST_ASSERT_FALSE(TankGeometry::rectangular(100.0f, -1.0f).valid());
+    TEST_ASSERT_EQUAL_FLOAT(0.0f, TankGeometry().liters(1.0f));
+}
+
+void test_geometry_horizontal_cylinder_table_tracks_formula(void) {
+    // 1.2 m diameter, 2.4 m long: about 2714 L full
+    TankGeometry g = TankGeometry::horizontalCylinder(1200.0f, 2400.0f);
+    TEST_ASSERT_TRUE(g.valid());
+    TEST_ASSERT_EQUAL(TankGeometry::UNIFORM_TABLE, g.kind());
+    double r = 0.6, full = PI * r * r * 2.4 * 1000.0;
+    float last = -1.0f;
+    for (int mm = 0; mm <= 1200; mm += 7) {
+        double h = mm / 1000.0, c = r - h;
+        double expected = (r * r * acos(c / r) - c * sqrt(2.0 * r * h - h * h)) * 2.4 * 1000.0;
+        float liters = g.liters(mm / 1000.0f);
+        TEST_ASSERT_FLOAT_WITHIN(0.002 * full, expected, liters);
+        TEST_ASSERT_TRUE(liters >= last);
+        last = liters;
+    }
+    TEST_ASSERT_FLOAT_WITHIN(0.5f, full / 2, g.liters(0.6f));
+    TEST_ASSERT_FLOAT_WITHIN(0.5f, full, g.liters(1.2f));
+    TEST_ASSERT_EQUAL_FLOAT(g.liters(1.2f), g.liters(5.0f));  // Full above the top
+    TEST_ASSERT_EQUAL_FLOAT(0.0f, g.liters(-0.1f));
+}
+
+void test_geometry_cone_bottom(void) {
+    // 1 m diameter, 300 mm cone, 1.3 m overall
+    TankGeometry g = TankGeometry::coneBottom(1000.0f, 300.0f, 1300.0f);
+    TEST_ASSERT_TRUE(g.valid());
+    double area = PI * 0.5 * 0.5;
+    double cone = area * 0.3 / 3.0 * 1000.0;
+    TEST_ASSERT_FLOAT_WITHIN(0.5f, cone, g.liters(0.3f));
+    TEST_ASSERT_FLOAT_WITHIN(0.5f, cone + area * 1000.0, g.liters(1.3f));
+    TEST_ASSERT_FLOAT_WITHIN(1.0f, cone * 0.125, g.liters(0.15f));  // Half the cone's height
+    // Straight wall above the cone: volume linear in depth
+    TEST_ASSERT_FLOAT_WITHIN(0.5f, cone + area * 500.0, g.liters(0.8f));
+
+    TEST_ASSERT_FALSE(TankGeometry::coneBottom(1000.0f, 1400.0f, 1300.0f).valid());
+    TEST_ASSERT_TRUE(TankGeometry::coneBottom(1000.0f, 0.0f, 1300.0f).valid());
+}
+
+void test_geometry_strapping_table(void) {
+    // 200 -> 400 mm dips (a typo in the table) and is held level
+    const StrappingPoint points[] = {
+        {0, 0}, {100, 50}, {200, 120}, {400, 110}, {700, 500},
+    };
+    TankGeometry g = TankGeometry::strapping(points, 5);
+    TEST_ASSERT_TRUE(g.valid());
+    TEST_ASSERT_EQUAL_FLOAT(0.7f, g.heightM());
+    TEST_ASSERT_EQUAL_FLOAT(50.0f, g.liters(0.1f));
+    TEST_ASSERT_FLOAT_WITHIN(0.01f, 85.0f, g.liters(0.15f));
+    TEST_ASSERT_FLOAT_WITHIN(0.01f, 120.0f, g.liters(0.3f));
+    TEST_ASSERT_FLOAT_WITHIN(0.01f, 120.0f + 380.0f / 3.0f, g.liters(0.5f));
+    TEST_ASSERT_EQUAL_FLOAT(500.0f, g.liters(2.0f));
+    TEST_ASSERT_EQUAL_FLOAT(0.0f, g.liters(0.0f));
+
+    const StrappingPoint unsorted[] = {{0, 0}, {200, 10}, {200, 20}};
+    TEST_ASSERT_FALSE(TankGeometry::strapping(unsorted, 3).valid());
+    TEST_ASSERT_FALSE(TankGeometry::strapping(points, 1).valid());
+    TEST_ASSERT_FALSE(TankGeometry::strapping(points, TankGeometry::MAX_STRAPPING_POINTS + 1).valid());
+}
+
+void test_tankArray_uses_each_tank_geometry(void) {
+    const StrappingPoint points[] = {{0, 0}, {500, 100}, {1000, 400}};
+    const TankGeometry geometries[] = {
+        TankGeometry::horizontalCylinder(400.0f, 1000.0f),
+        TankGeometry::strapping(points, 3),
+        TankGeometry::rectangular(1000.0f, 1000.0f),
+    };
+    const TankChannel channels[] = {
+        {A0, 0.5f, 4.5f, 10.0f, &geometries[0]},
+        {A1, 0.5f, 4.5f, 10.0f, &geometries[1]},
+        {A2, 0.5f, 4.5f, 10.0f, &geometries[2]},
+    };
+    TankArray<3> tanks(channels);
+    uint32_t sums[3] = {614, 614, 614};
+    PackedReading r[3];
+    tanks.convert(sums, ADC_MAX, r);
+    for (int c = 0; c < 2; c++) {
+        float liters = geometries[c].liters(r[c].depth / 1000.0f);
+        TEST_ASSERT_FLOAT_WITHIN(0.5f, liters, r[c].volume / 100.0f);
+    }
+    // 1 m2 at ~0.64 m is about 637 L
+    TEST_ASSERT_TRUE(r[2].volume > 63000);
+
+    // A full 1 m2 tank, about 1020 L, is carried past 655.35 L
+    sums[2] = ADC_MAX;
+    tanks.convert(sums, ADC_MAX, r);
+    TEST_ASSERT_UINT32_WITHIN(50, 101971, r[2].volume);
+
+    // A 2.7 kL horizontal cylinder at the top of the sensor span
+    const TankGeometry large = TankGeometry::horizontalCylinder(1200.0f, 2400.0f);
+    const TankChannel deep[] = {{A0, 0.5f, 4.5f, 20.0f, &large}};
+    TankArray<1> one(deep);
+    uint32_t full = ADC_MAX;
+    one.convert(&full, ADC_MAX, r);
+    TEST_ASSERT_FLOAT_WITHIN(1.0f, large.liters(r[0].depth / 1000.0f), r[0].volume / 100.0f);
+    TEST_ASSERT_TRUE(r[0].volume > 250000);
+}
+
+void test_large_volumes_reach_every_transport(void) {
+    // Newest first: a 2.7 kL tank draining, then a full-range swing
+    PackedReading samples[4] = {
+        testReading(900, 880, 270000), testReading(901, 881, 270150),
+        testReading(910, 890, PACKED_VOLUME_MAX), testReading(0, 0, 0),
+    };
+    uint8_t buf[LORA_FRAME_MAX_PAYLOAD];
+    LoRaFrameEncoder enc(buf, sizeof(buf), 5);
+    for (int i = 0; i < 4; i++) TEST_ASSERT_TRUE(enc.add(samples[i]));
+    TEST_ASSERT_EQUAL_UINT8(LORA_FRAME_VERSION_WIDE, buf[0]);
+    TEST_ASSERT_EQUAL_UINT8(1, buf[3]);
+    static const uint8_t NEWEST[] = {0, 0, 0x03, 0x70, 0x03, 0x84, 0x00, 0x04, 0x1E, 0xB0};
+    TEST_ASSERT_EQUAL_MEMORY(NEWEST, buf + LORA_FRAME_MULTI_HEADER_SIZE, sizeof(NEWEST));
+
+    LoRaFrameReader reader(buf, enc.length());
+    PackedReading out;
+    for (int i = 0; i < 4; i++) {
+        TEST_ASSERT_TRUE(reader.next(out));
+        TEST_ASSERT_EQUAL_UINT32(samples[i].volume, out.volume);
+        TEST_ASSERT_EQUAL_UINT16(samples[i].depth, out.depth);
+    }
+    TEST_ASSERT_FALSE(reader.next(out));
+    TEST_ASSERT_FALSE(reader.malformed());
+
+    // A volume delta past 32 bits is malformed
+    uint8_t bad[] = {LORA_FRAME_VERSION_WIDE, 2, 5, 1, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+                     0, 0, 0, 0x80, 0x80, 0x80, 0x80, 0x10};
+    LoRaFrameReader badReader(bad, sizeof(bad));
+    TEST_ASSERT_TRUE(badReader.next(out));
+    TEST_ASSERT_FALSE(badReader.next(out));
+    TEST_ASSERT_TRUE(badReader.malformed());
+
+    // A 16-bit frame ends at the first older volume it cannot carry
+    PackedReading filling[2] = {testReading(500, 490, 65000), testReading(510, 500, 66000)};
+    LoRaFrameEncoder narrow(buf, sizeof(buf), 5);
+    TEST_ASSERT_TRUE(narrow.add(filling[0]));
+    TEST_ASSERT_FALSE(narrow.add(filling[1]));
+    TEST_ASSERT_EQUAL_UINT8(LORA_FRAME_VERSION, buf[0]);
+    TEST_ASSERT_EQUAL_UINT8(1, narrow.count());
+
+    // Batch rows carry the volume in full
+    HttpUploader uploader(client, serverHost, serverPort);
+    ReadingBuffer<8> ring;
+    mock_set_wifi_status(WL_CONNECTED);
+    mock_set_client_connected(true);
+    ring.push(1000, samples[0], 1);
+    mock_set_millis(1000);
+    TEST_ASSERT_TRUE(uploader.uploadBatch(ring));
+    TEST_ASSERT_EQUAL_STRING("0,0,880,900,270000,1\n", uploader.lastBody());
+}
+
+// ============================================================================
+// Test Case 17: Streaming level filter
+// ============================================================================
+
+static const LevelFilterSettings FIRMWARE_FILTER = {FILTER_KALMAN, 0.05f, 1e-6f, 4e-4f, 0.2f, 3};
+static const LevelFilterSettings EMA_FILTER = {FILTER_EMA, 0.05f, 0.0f, 4e-4f, 0.2f, 3};
+
+// A tank trace as the ADC sees it, in sensor volts at 10 samples/s: slosh
+// (0.01 V at 1.7 s), pump noise (+/-0.015 V), a 0.5 V spike every 97
+// samples, and the level stepping from 2.0 V to 2.4 V (about 100 mm) at
+// stepAt. Deterministic, so runs compare.
+static float traceSample(uint32_t i, uint32_t stepAt, float* truth) {
+    static uint32_t seed = 0;
+    if (i == 0) seed = 12345;
+    float level = i < stepAt ? 2.0f : 2.4f;
+    *truth = level;
+    float noise = 0.0f;
+    for (int k = 0; k < 3; k++) {
+        seed = seed * 1103515245u + 12345u;
+        noise += ((seed >> 16) & 0x7FFF) / 32767.0f - 0.5f;
+    }
+    float x = level + 0.01f * sinf(i * 2.0f * (float)PI / 17.0f) + noise * 0.01f;
+    if (i % 97 == 96) x += 0.5f;
+    return x;
+}
+
+struct TraceResult {
+    uint32_t latencySamples;  // Step to the first reading within 0.02 V of the new level
+    float jitter;             // RMS error of the readings before the step
+};
+
+// Readings every 50 samples (one 5 s block), either the block mean (the
+// previous behaviour) or the filter's estimate at the end of the block
+static TraceResult replayTrace(const LevelFilterSettings* settings) {
+    const uint32_t block = 50, stepAt = 2030, length = 4000;
+    LevelFilter filter(settings ? *settings : EMA_FILTER);
+    TraceResult result = {0, 0.0f};
+    float sum = 0.0f, errors = 0.0f;
+    int readings = 0;
+    for (uint32_t i = 0; i < length; i++) {
+        float truth;
+        float x = traceSample(i, stepAt, &truth);
+        sum += x;
+        filter.update(x);
+        if (i % block != block - 1) continue;
+        float reading = settings ? filter.value() : sum / block;
+        sum = 0.0f;
+        if (i < stepAt && i >= 5 * block) {
+            errors += (reading - truth) * (reading - truth);
+            readings++;
+        }
+        if (i >= stepAt && result.latencySamples == 0 && fabsf(reading - 2.4f) < 0.02f) {
+            result.latencySamples = i - stepAt + 1;
+        }
+    }
+    result.jitter = sqrtf(errors / readings);
+    return result;
+}
+
+void test_levelFilter_ema_converges_with_uncertainty(void) {
+    LevelFilter f(EMA_FILTER);
+    TEST_ASSERT_FALSE(f.primed());
+    f.update(1.0f);
+    TEST_ASSERT_TRUE(f.primed());
+    TEST_ASSERT_EQUAL_FLOAT(1.0f, f.value());
+
+    // +/-0.02 V square noise around 1.5 V
+    for (int i = 0; i < 400; i++) f.update(1.5f + (i & 1 ? 0.02f : -0.02f));
+    TEST_ASSERT_FLOAT_WITHIN(0.002f, 1.5f, f.value());
+    // Sample sd 0.02 scaled by sqrt(alpha / (2 - alpha)): about 0.0032
+    TEST_ASSERT_FLOAT_WITHIN(0.0005f, 0.02f * sqrtf(0.05f / 1.95f), f.stddev());
+
+    f.reset();
+    TEST_ASSERT_FALSE(f.primed());
+}
+
+void test_levelFilter_kalman_settles_to_steady_state(void) {
+    LevelFilter f(FIRMWARE_FILTER);
+    f.update(2.0f);
+    TEST_ASSERT_FLOAT_WITHIN(1e-5f, 0.02f, f.stddev());  // sqrt(R) to start
+    for (int i = 0; i < 500; i++) f.update(2.0f);
+    // Steady-state P solves P^2 + QP - QR = 0 (P after the update)
+    float q = 1e-6f, r = 4e-4f;
+    float prior = (q + sqrtf(q * q + 4.0f * q * r)) / 2.0f;
+    float steady = prior * r / (prior + r);
+    TEST_ASSERT_FLOAT_WITHIN(0.0001f, sqrtf(steady), f.stddev());
+
+    // Tracks a small step at the steady-state gain (about 5% per sample)
+    f.update(2.1f);
+    TEST_ASSERT_FLOAT_WITHIN(0.002f, 2.0f + 0.1f * prior / (prior + r), f.value());
+}
+
+void test_levelFilter_rejects_spikes_but_follows_real_steps(void) {
+    LevelFilter f(FIRMWARE_FILTER);
+    for (int i = 0; i < 50; i++) f.update(2.0f);
+
+    // One and two samples out are dropped
+    TEST_ASSERT_FALSE(f.update(2.5f));
+    TEST_ASSERT_TRUE(f.update(2.0f));
+    TEST_ASSERT_FALSE(f.update(1.5f));
+    TEST_ASSERT_FALSE(f.update(1.5f));
+    TEST_ASSERT_EQUAL_FLOAT(2.0f, f.value());
+    TEST_ASSERT_EQUAL_UINT32(3, f.rejected());
+
+    // The third in a row is a real change: restart there
+    TEST_ASSERT_TRUE(f.update(1.5f));
+    TEST_ASSERT_EQUAL_FLOAT(1.5f, f.value());
+
+    // Off: everything goes into the estimate
+    LevelFilterSettings open = FIRMWARE_FILTER;
+    open.spikeLimit = 0.0f;
+    LevelFilter g(open);
+    g.update(2.0f);
+    TEST_ASSERT_TRUE(g.update(3.0f));
+    TEST_ASSERT_TRUE(g.value() > 2.0f);
+}
+
+void test_levelFilter_trace_beats_block_average(void) {
+    TraceResult blockMean = replayTrace(nullptr);
+    TraceResult kalman = replayTrace(&FIRMWARE_FILTER);
+    TraceResult ema = replayTrace(&EMA_FILTER);
+
+    // The block mean shows the step one to two blocks late...
+    TEST_ASSERT_TRUE(blockMean.latencySamples >= 50);
+    // ...the filters at the first reading after it
+    TEST_ASSERT_TRUE(kalman.latencySamples > 0 && kalman.latencySamples <= 50);
+    TEST_ASSERT_TRUE(ema.latencySamples > 0 && ema.latencySamples <= 50);
+    TEST_ASSERT_TRUE(kalman.latencySamples < blockMean.latencySamples);
+
+    // Spikes and slosh move the block mean; the filters hold steadier
+    TEST_ASSERT_TRUE(kalman.jitter < blockMean.jitter / 2);
+    TEST_ASSERT_TRUE(ema.jitter < blockMean.jitter / 2);
+    TEST_ASSERT_TRUE(kalman.jitter < 0.004f);  // About 1 mm
+}
+
+// The reading path of loop() as src/main.cpp wires it: a finished block
+// is picked up as a due reading, then filtered sample by sample and
+// converted. AdcSampler took loop()'s worst pass from ~100 ms of
+// analogRead() to a few µs; nothing on this path may wait on the clock
+// either, whichever pass a block completes on.
+static const uint8_t PASS_TASK_READING = 0;
+static const uint16_t PASS_BLOCK_SAMPLES = 50;
+static BlockAdc<PASS_BLOCK_SAMPLES, 2>* passAdc = 0;
+static TankArray<2>* passTanks = 0;
+static LevelFilter passFilters[2];
+static PackedReading passReadings[2];
+static uint32_t passReadingCount = 0;
+
+static void passReadingTask() {
+    if (!passAdc->ready()) return;
+    const volatile uint16_t* block = passAdc->block();
+    float voltsPerCount = ADC_REF_V / (float)adcSampleFullScale(passAdc->settings());
+    for (uint16_t i = 0; i < PASS_BLOCK_SAMPLES; i++) {
+        for (uint8_t t = 0; t < 2; t++) passFilters[t].update(block[i * 2 + t] * voltsPerCount);
+    }
+    passAdc->release();
+    float volts[2] = {passFilters[0].value(), passFilters[1].value()};
+    passTanks->convertVolts(volts, passReadings);
+    passReadingCount++;
+}
+
+void test_reading_pass_never_waits(void) {
+    static const uint8_t pins[] = {A0, A1};
+    mock_set_analog_pin_value(A0, 600);
+    mock_set_analog_pin_value(A1, 300);
+    mock_set_analog_noise(12);
+    const TankGeometry geometry = TankGeometry::verticalCylinder(TANK_DIAMETER_MM);
+    const TankChannel channels[] = {
+        TankChannel::sensorConfig(A0, &geometry),
+        TankChannel::sensorConfig(A1, &geometry),
+    };
+    TankArray<2> tanks(channels);
+    BlockAdc<PASS_BLOCK_SAMPLES, 2> adc;
+    passAdc = &adc;
+    passTanks = &tanks;
+    passReadingCount = 0;
+    for (uint8_t t = 0; t < 2; t++) passFilters[t] = LevelFilter(FIRMWARE_FILTER);
+    DeadlineScheduler<1> scheduler;
+    scheduler.add(PASS_TASK_READING, passReadingTask);
+
+    // A block every 5 s, as main.cpp samples
+    mock_set_millis(0);
+    AdcSettings settings = {pins, 2, 14, 4, 5000000UL / PASS_BLOCK_SAMPLES};
+    TEST_ASSERT_TRUE(adc.begin(settings));
+
+    // 1 ms passes for 10 minutes; time each on the mock clock
+    unsigned long worstPassUs = 0;
+    for (unsigned long ms = 1; ms <= 600000; ms++) {
+        mock_set_millis(ms);
+        unsigned long start = micros();
+        if (adc.ready()) scheduler.atOrBefore(PASS_TASK_READING, millis());
+        scheduler.runDue(millis());
+        unsigned long pass = micros() - start;
+        if (pass > worstPassUs) worstPassUs = pass;
+    }
+    adc.end();
+
+    TEST_ASSERT_EQUAL_UINT32(0, worstPassUs);
+    TEST_ASSERT_EQUAL_UINT32(120, passReadingCount);
+    TEST_ASSERT_EQUAL_UINT32(0, adc.overruns());
+    TEST_ASSERT_INT_WITHIN(2, readingForCode(600).depth, passReadings[0].depth);
+    TEST_ASSERT_INT_WITHIN(2, readingForCode(300).depth, passReadings[1].depth);
+}
+
+// ============================================================================
+// Test Case 18: MQTT transport against the mock broker
+// ============================================================================
+
+static const MqttSettings MQTT_QOS1_BINARY = {
+    "192.168.55.192", 1883, "tank-1", 0, 0, 1, MQTT_PAYLOAD_BINARY};
+static const MqttSettings MQTT_QOS0_TEXT = {
+    "192.168.55.192", 1883, "tank-1", 0, 0, 0, MQTT_PAYLOAD_TEXT};
+
+static void drainMqtt(MqttUploader& uploader) {
+    for (int i = 0; i < 100 && uploader.busy(); i++) {
+        uploader.poll();
+    }
+}
+
+static void brokerUp(void) {
+    mock_set_wifi_status(WL_CONNECTED);
+    mock_set_client_connected(true);
+    mock_set_mqtt_broker(true);
+}
+
+void test_mqtt_connect_rides_with_first_publish(void) {
+    MqttUploader uploader(client, MQTT_QOS0_TEXT);
+    ReadingBuffer<8> ring;
+    brokerUp();
+    ring.push(1000, testReading(1234, 1210, 952));
+    mock_set_millis(7000);
+
+    TEST_ASSERT_TRUE(uploader.uploadBatch(ring));
+
+    // CONNECT (MQTT 3.1.1, CleanSession 0, keep alive 120 s) and PUBLISH
+    // in one write, no round trip in between
+    const uint8_t* p = uploader.lastPacket();
+    static const uint8_t CONNECT[] = {0x10, 18, 0, 4, 'M', 'Q', 'T', 'T', 4, 0x00, 0, 120,
+                                      0, 6, 't', 'a', 'n', 'k', '-', '1'};
+    TEST_ASSERT_EQUAL_MEMORY(CONNECT, p, sizeof(CONNECT));
+    TEST_ASSERT_EQUAL_HEX8(0x30, p[sizeof(CONNECT)]);  // PUBLISH, QoS 0
+    TEST_ASSERT_EQUAL_UINT32(sizeof(CONNECT) + 2 + 11 + 21, uploader.lastPacketLength());
+    TEST_ASSERT_EQUAL_UINT32(1, mock_mqtt_packets(1));
+    TEST_ASSERT_EQUAL_UINT32(1, mock_mqtt_packets(3));
+    TEST_ASSERT_EQUAL_STRING("wt/tank-1", mock_mqtt_last_topic());
+    TEST_ASSERT_EQUAL_INT(0, mock_mqtt_last_qos());
+
+    // Text payload: the /update/batch rows
+    TEST_ASSERT_EQUAL_UINT32(21, mock_mqtt_last_payload_length());
+    TEST_ASSERT_EQUAL_MEMORY("6000,0,1210,1234,952\n", mock_mqtt_last_payload(), 21);
+
+    // QoS 0: released on write; the CONNACK still comes back
+    TEST_ASSERT_TRUE(ring.empty());
+    TEST_ASSERT_TRUE(uploader.busy());
+    drainMqtt(uploader);
+    TEST_ASSERT_FALSE(uploader.busy());
+    TEST_ASSERT_EQUAL_UINT8(0, uploader.lastReturnCode());
+    TEST_ASSERT_FALSE(uploader.sessionPresent());
+}
+
+void test_mqtt_qos1_binary_released_on_puback(void) {
+    MqttUploader uploader(client, MQTT_QOS1_BINARY);
+    ReadingBuffer<8> ring;
+    brokerUp();
+    ring.push(1000, testReading(1234, 1210, 952));
+    ring.push(6000, testReading(1240, 1216, 957), 2);
+    mock_set_millis(7000);
+
+    TEST_ASSERT_TRUE(uploader.uploadBatch(ring));
+    TEST_ASSERT_EQUAL_INT(1, mock_mqtt_last_qos());
+    static const uint8_t PAYLOAD[] = {
+        MQTT_BINARY_VERSION,
+        0, 0, 0x17, 0x70, 0, 0, 0x04, 0xBA, 0x04, 0xD2, 0, 0, 0x03, 0xB8, 0,  // 6000 ms old
+        0, 0, 0x03, 0xE8, 0, 0, 0x04, 0xC0, 0x04, 0xD8, 0, 0, 0x03, 0xBD, 2,  // tank 2
+    };
+    TEST_ASSERT_EQUAL_UINT32(sizeof(PAYLOAD), mock_mqtt_last_payload_length());
+    TEST_ASSERT_EQUAL_MEMORY(PAYLOAD, mock_mqtt_last_payload(), sizeof(PAYLOAD));
+
+    TEST_ASSERT_EQUAL_UINT16(2, ring.size());  // Until the PUBACK
+    drainMqtt(uploader);
+    TEST_ASSERT_TRUE(ring.empty());
+    TEST_ASSERT_TRUE(uploader.lastSucceeded());
+
+    // The next batch reuses the connection and session, without allocating
+    ring.push(11000, testReading(1250, 1220, 960));
+    unsigned long allocations = mock_allocation_count();
+    TEST_ASSERT_TRUE(uploader.uploadBatch(ring));
+    drainMqtt(uploader);
+    TEST_ASSERT_EQUAL_UINT32(allocations, mock_allocation_count());
+    TEST_ASSERT_TRUE(ring.empty());
+    TEST_ASSERT_EQUAL_UINT32(1, mock_mqtt_packets(1));
+    TEST_ASSERT_EQUAL_UINT32(2, mock_mqtt_packets(3));
+    TEST_ASSERT_EQUAL_UINT32(2, uploader.completed());
+    TEST_ASSERT_EQUAL_UINT32(1, uploader.connects());
+}
+
+void test_mqtt_lost_puback_keeps_rows_and_session(void) {
+    MqttUploader uploader(client, MQTT_QOS1_BINARY);
+    ReadingBuffer<8> ring;
+    brokerUp();
+    pushReadings(ring, 3, 0);
+    TEST_ASSERT_TRUE(uploader.uploadBatch(ring));
+    drainMqtt(uploader);
+    pushReadings(ring, 3, 15000);
+
+    // The broker stops answering: after the timeout the rows are still there
+    mock_set_mqtt_silent(true);
+    mock_set_millis(20000);
+    TEST_ASSERT_TRUE(uploader.uploadBatch(ring));
+    drainMqtt(uploader);
+    mock_set_millis(20000 + MqttUploader::RESPONSE_TIMEOUT_MS + 1);
+    drainMqtt(uploader);
+    TEST_ASSERT_FALSE(uploader.busy());
+    TEST_ASSERT_FALSE(uploader.lastSucceeded());
+    TEST_ASSERT_EQUAL_UINT32(1, uploader.failures());
+    TEST_ASSERT_EQUAL_UINT16(3, ring.size());
+
+    // Reconnected, the broker still has the session
+    mock_set_mqtt_silent(false);
+    TEST_ASSERT_TRUE(uploader.uploadBatch(ring));
+    drainMqtt(uploader);
+    TEST_ASSERT_EQUAL_UINT32(2, uploader.connects());
+    TEST_ASSERT_TRUE(uploader.sessionPresent());
+    TEST_ASSERT_EQUAL_INT(1, mock_mqtt_session_present());
+    TEST_ASSERT_TRUE(ring.empty());
+}
+
+void test_mqtt_unacked_batch_resent_with_same_packet_id(void) {
+    MqttUploader uploader(client, MQTT_QOS1_BINARY);
+    ReadingBuffer<8> ring;
+    brokerUp();
+    pushReadings(ring, 3, 0);
+
+    // The broker takes the PUBLISH but the PUBACK never arrives
+    mock_set_mqtt_silent(true);
+    mock_set_millis(15000);
+    TEST_ASSERT_TRUE(uploader.uploadBatch(ring));
+    TEST_ASSERT_FALSE(mock_mqtt_last_dup());
+    int packetId = mock_mqtt_last_packet_id();
+    mock_set_millis(15000 + MqttUploader::RESPONSE_TIMEOUT_MS + 1);
+    drainMqtt(uploader);
+    TEST_ASSERT_FALSE(uploader.busy());
+    TEST_ASSERT_EQUAL_UINT16(3, ring.size());
+
+    // Newer rows arrive meanwhile; the resend is the original PUBLISH:
+    // same packet id, DUP set, only the three unacknowledged rows
+    pushReadings(ring, 2, 20000);
+    mock_set_mqtt_silent(false);
+    TEST_ASSERT_TRUE(uploader.uploadBatch(ring));
+    TEST_ASSERT_TRUE(mock_mqtt_last_dup());
+    TEST_ASSERT_EQUAL_INT(packetId, mock_mqtt_last_packet_id());
+    TEST_ASSERT_EQUAL_UINT32(1 + 3 * MQTT_BINARY_ROW_SIZE, mock_mqtt_last_payload_length());
+    drainMqtt(uploader);
+    TEST_ASSERT_TRUE(uploader.lastSucceeded());
+    TEST_ASSERT_EQUAL_UINT16(2, ring.size());
+
+    // The newer rows go out as a new PUBLISH
+    TEST_ASSERT_TRUE(uploader.uploadBatch(ring));
+    TEST_ASSERT_FALSE(mock_mqtt_last_dup());
+    TEST_ASSERT_EQUAL_INT(packetId + 1, mock_mqtt_last_packet_id());
+    TEST_ASSERT_EQUAL_UINT32(1 + 2 * MQTT_BINARY_ROW_SIZE, mock_mqtt_last_payload_length());
+    drainMqtt(uploader);
+    TEST_ASSERT_TRUE(ring.empty());
+}
+
+void test_mqtt_refused_connection_keeps_rows(void) {
+    MqttSettings settings = MQTT_QOS1_BINARY;
+    settings.username = "tank";
+    settings.password = "secret";
+    MqttUploader uploader(client, settings);
+    ReadingBuffer<8> ring;
+    brokerUp();
+    mock_set_mqtt_connack(5);  // Not authorized
+    pushReadings(ring, 2, 0);
+
+    TEST_ASSERT_TRUE(uploader.uploadBatch(ring));
+    // Username and password flags, then both strings after the client id
+    TEST_ASSERT_EQUAL_HEX8(0xC0, uploader.lastPacket()[9]);
+    TEST_ASSERT_EQUAL_MEMORY("\0\4tank\0\6secret", uploader.lastPacket() + 20, 14);
+    drainMqtt(uploader);
+
+    TEST_ASSERT_EQUAL_UINT8(5, uploader.lastReturnCode());
+    TEST_ASSERT_FALSE(uploader.lastSucceeded());
+    TEST_ASSERT_EQUAL_UINT16(2, ring.size());
+    TEST_ASSERT_FALSE(client.connected());
+}
+
+void test_mqtt_pings_when_idle(void) {
+    MqttUploader uploader(client, MQTT_QOS1_BINARY);
+    ReadingBuffer<8> ring;
+    brokerUp();
+    pushReadings(ring, 1, 0);
+    TEST_ASSERT_TRUE(uploader.uploadBatch(ring));
+    drainMqtt(uploader);
+
+    mock_set_millis(MqttUploader::KEEP_ALIVE_S * 1000UL - 1);
+    uploader.poll();
+    TEST_ASSERT_EQUAL_UINT32(0, mock_mqtt_packets(12));
+
+    mock_set_millis(MqttUploader::KEEP_ALIVE_S * 1000UL);
+    uploader.poll();
+    TEST_ASSERT_EQUAL_UINT32(1, mock_mqtt_packets(12));
+    TEST_ASSERT_TRUE(uploader.busy());
+    drainMqtt(uploader);
+    TEST_ASSERT_FALSE(uploader.busy());
+    TEST_ASSERT_EQUAL_UINT32(0, uploader.failures());
+    TEST_ASSERT_EQUAL_UINT32(1, uploader.connects());
+}
+
+void test_mqtt_uses_fewer_bytes_than_http(void) {
+    // One reading per upload, as at the 5 s WiFi interval: bytes both ways
+    // after the connection is up
+    ReadingBuffer<8> ring;
+    brokerUp();
+    MqttUploader mqtt(client, MQTT_QOS1_BINARY);
+    pushReadings(ring, 1, 0);
+    mqtt.uploadBatch(ring);
+    drainMqtt(mqtt);
+    unsigned long written = mock_client_bytes_written();
+    unsigned long read = mock_client_bytes_read();
+    pushReadings(ring, 1, 5000);
+    mqtt.uploadBatch(ring);
+    drainMqtt(mqtt);
+    unsigned long mqttBytes = mock_client_bytes_written() - written + mock_client_bytes_read() - read;
+    TEST_ASSERT_EQUAL_UINT32(2 + 11 + 2 + 16 + 4, mqttBytes);  // PUBLISH, PUBACK
+
+    mock_reset();
+    mock_set_wifi_status(WL_CONNECTED);
+    mock_set_client_connected(true);
+    mock_set_client_response(HTTP_OK_RESPONSE);
+    HttpUploader http(client, serverHost, serverPort);
+    pushReadings(ring, 1, 0);
+    http.uploadBatch(ring);
+    drainResponse(http);
+    written = mock_client_bytes_written();
+    read = mock_client_bytes_read();
+    pushReadings(ring, 1, 5000);
+    http.uploadBatch(ring);
+    drainResponse(http);
+    unsigned long httpBytes = mock_client_bytes_written() - written + mock_client_bytes_read() - read;
+    TEST_ASSERT_TRUE(httpBytes > 5 * mqttBytes);
+}
+
+int main(int argc, char **argv) {
+    UNITY_BEGIN();
+    
+    // Test Case 1: clampf()
+    RUN_TEST(test_clampf_value_below_min);
+    RUN_TEST(test_clampf_value_above_max);
+    RUN_TEST(test_clampf_value_within_range);
+    RUN_TEST(test_clampf_value_at_min_boundary);
+    RUN_TEST(test_clampf_value_at_max_boundary);
+    RUN_TEST(test_clampf_negative_range);
+    RUN_TEST(test_clampf_very_small_numbers);
+    
+    // Test Case 2: voltageToKpa()
+    RUN_TEST(test_voltageToKpa_min_voltage);
+    RUN_TEST(test_voltageToKpa_max_voltage);
+    RUN_TEST(test_voltageToKpa_mid_voltage);
+    RUN_TEST(test_voltageToKpa_below_min);
+    RUN_TEST(test_voltageToKpa_above_max);
+    RUN_TEST(test_voltageToKpa_quarter_range);
+    RUN_TEST(test_voltageToKpa_three_quarter_range);
+    RUN_TEST(test_voltageToKpa_negative_voltage);
+    
+    // Test Case 3: adcToVoltage()
+    RUN_TEST(test_adcToVoltage_zero_code);
+    RUN_TEST(test_adcToVoltage_max_code);
+    RUN_TEST(test_adcToVoltage_mid_code);
+    RUN_TEST(test_adcToVoltage_quarter_code);
+    RUN_TEST(test_adcToVoltage_within_expected_range);
+    RUN_TEST(test_adcToVoltage_fractional_code);
+    
+    // Test Case 4: WiFiConnectionManager
+    RUN_TEST(test_wifiManager_already_connected);
+    RUN_TEST(test_wifiManager_begin_does_not_block);
+    RUN_TEST(test_wifiManager_connects_when_link_comes_up);
+    RUN_TEST(test_wifiManager_times_out_into_backoff);
+    RUN_TEST(test_wifiManager_backoff_grows_and_caps);
+    RUN_TEST(test_wifiManager_outage_keeps_lmic_cadence);
+
+    // Test Case 5: HttpUploader
+    RUN_TEST(test_uploader_wifi_not_connected);
+    RUN_TEST(test_uploader_server_connection_fails);
+    RUN_TEST(test_uploader_formats_request);
+    RUN_TEST(test_uploader_formats_small_values_with_leading_zeros);
+    RUN_TEST(test_uploader_upload_does_not_block);
+    RUN_TEST(test_uploader_poll_completes_response);
+    RUN_TEST(test_uploader_reuses_connection_without_allocating);
+    RUN_TEST(test_uploader_reconnects_after_server_close);
+    RUN_TEST(test_uploader_respects_5_second_timeout);
+    RUN_TEST(test_uploader_waits_for_slow_response);
+    RUN_TEST(test_uploader_skips_while_response_pending);
+
+    // Test Case 6: Median filters
+    RUN_TEST(test_medianSelect_odd_counts_match_sort);
+    RUN_TEST(test_medianSelect_even_count_averages_middle_pair);
+    RUN_TEST(test_medianSelect_handles_duplicates);
+    RUN_TEST(test_medianSelect_rejects_spike);
+    RUN_TEST(test_runningMedian_matches_sliding_reference);
+    RUN_TEST(test_blockMedian_matches_sliding_reference);
+    RUN_TEST(test_medianFilter_alias_defaults_to_block);
+
+    // Test Case 7: ADC lookup table
+    RUN_TEST(test_sensorTable_matches_float_pipeline_for_every_code);
+    RUN_TEST(test_sensorTable_below_vmin_reads_empty);
+    RUN_TEST(test_sensorTable_full_scale);
+    RUN_TEST(test_sensorTable_clamps_out_of_range_codes);
+
+    // Test Case 8: Reading buffer and batched uploads
+    RUN_TEST(test_readingBuffer_keeps_fifo_order);
+    RUN_TEST(test_readingBuffer_drops_oldest_when_full);
+    RUN_TEST(test_readingBuffer_discard_survives_overwrite);
+    RUN_TEST(test_uploader_batch_body_format);
+    RUN_TEST(test_uploader_batch_discarded_only_after_ack);
+    RUN_TEST(test_uploader_batch_kept_on_server_error);
+    RUN_TEST(test_uploader_skips_request_too_long_for_buffer);
+    RUN_TEST(test_uploader_backfills_outage_in_few_requests);
+
+    // Test Case 9: Multi-sample LoRaWAN frame
+    RUN_TEST(test_loraFrame_zigzag_varint_sizes);
+    RUN_TEST(test_loraFrame_single_reading_keeps_legacy_layout);
+    RUN_TEST(test_loraFrame_minute_of_history_round_trips);
+    RUN_TEST(test_loraFrame_extreme_deltas_round_trip);
+    RUN_TEST(test_loraFrame_drops_oldest_to_fit_data_rate);
+    RUN_TEST(test_loraFrame_fits_dwell_limited_data_rate);
+    RUN_TEST(test_loraFrame_reader_rejects_malformed_frames);
+
+    // Test Case 10: LMIC mock
+    RUN_TEST(test_lmic_airtime_matches_reference);
+    RUN_TEST(test_lmic_join_retries_until_accepted);
+    RUN_TEST(test_lmic_uplink_completes_after_rx_windows);
+    RUN_TEST(test_lmic_dwell_time_cancels_long_uplinks);
+    RUN_TEST(test_lmic_dwell_state_matches_payload_limits);
+    RUN_TEST(test_lmic_duty_cycle_holds_back_uplink);
+    RUN_TEST(test_lmic_fsb2_channel_plan);
+
+    // Test Case 11: Loop profiler
+    RUN_TEST(test_loopProfiler_charges_time_to_sections);
+    RUN_TEST(test_loopProfiler_log2_histogram);
+    RUN_TEST(test_loopProfiler_summary_in_upload_header);
+
+    // Test Case 12: Change-driven reporting
+    RUN_TEST(test_changeReporter_fill_drain_day_cuts_reports_tenfold);
+    RUN_TEST(test_changeReporter_rate_trips_inside_deadband);
+    RUN_TEST(test_changeReporter_volume_deadband_and_heartbeat);
+    RUN_TEST(test_changeReporter_zero_thresholds_report_every_reading);
+
+    // Test Case 13: Deadline scheduler
+    RUN_TEST(test_scheduler_runs_tasks_in_deadline_order);
+    RUN_TEST(test_scheduler_periodic_task_does_not_drift);
+    RUN_TEST(test_scheduler_overrun_skips_ahead);
+    RUN_TEST(test_scheduler_cancel_and_at_or_before);
+    RUN_TEST(test_scheduler_survives_millis_wrap);
+    RUN_TEST(test_scheduler_run_budget_bounds_one_pass);
+    RUN_TEST(test_lmic_reports_time_critical_jobs);
+
+    // Test Case 14: Block ADC acquisition
+    RUN_TEST(test_adcSettings_validation);
+    RUN_TEST(test_blockAdc_fills_blocks_on_the_timer);
+    RUN_TEST(test_blockAdc_double_buffers_and_counts_overruns);
+    RUN_TEST(test_readingForLevel_interpolates_table);
+    RUN_TEST(test_blockAdc_oversampling_averages_out_noise);
+
+    // Test Case 15: Multi-tank acquisition
+    RUN_TEST(test_tankArray_default_channel_matches_table);
+    RUN_TEST(test_tankArray_filter_volts_go_through_table);
+    RUN_TEST(test_tankArray_table_is_explicit_and_checked);
+    RUN_TEST(test_tankArray_converts_each_channel_with_its_config);
+    RUN_TEST(test_blockAdc_samples_all_channels_in_one_pass);
+    RUN_TEST(test_loraFrame_multi_tank_round_trip);
+    RUN_TEST(test_uploader_batch_tank_column);
+    RUN_TEST(test_changeReporterArray_reports_all_tanks_together);
+
+    // Test Case 16: Tank geometry
+    RUN_TEST(test_geometry_vertical_cylinder_and_rectangular);
+    RUN_TEST(test_geometry_horizontal_cylinder_table_tracks_formula);
+    RUN_TEST(test_geometry_cone_bottom);
+    RUN_TEST(test_geometry_strapping_table);
+    RUN_TEST(test_tankArray_uses_each_tank_geometry);
+    RUN_TEST(test_large_volumes_reach_every_transport);
+
+    // Test Case 17: Streaming level filter
+    RUN_TEST(test_levelFilter_ema_converges_with_uncertainty);
+    RUN_TEST(test_levelFilter_kalman_settles_to_steady_state);
+    RUN_TEST(test_levelFilter_rejects_spikes_but_follows_real_steps);
+    RUN_TEST(test_levelFilter_trace_beats_block_average);
+    RUN_TEST(test_reading_pass_never_waits);
+
+    // Test Case 18: MQTT transport
+    RUN_TEST(test_mqtt_connect_rides_with_first_publish);
+    RUN_TEST(test_mqtt_qos1_binary_released_on_puback);
+    RUN_TEST(test_mqtt_lost_puback_keeps_rows_and_session);
+    RUN_TEST(test_mqtt_unacked_batch_resent_with_same_packet_id);
+    RUN_TEST(test_mqtt_refused_connection_keeps_rows);
+    RUN_TEST(test_mqtt_pings_when_idle);
+    RUN_TEST(test_mqtt_uses_fewer_bytes_than_http);
     
     return UNITY_END();
 }